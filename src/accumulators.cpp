@@ -13,10 +13,18 @@
 #include "accumulatorcheckpoints.h"
 #include "zsmncchain.h"
 
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
 using namespace libzerocoin;
 
+//! fewer checksums than this are read on the calling thread
+static const size_t ACCUMULATOR_LOAD_PARALLEL_MIN = 64;
+
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
+CAccumulatorWitnessCache witnessCache;
 
 uint32_t ParseChecksum(uint256 nChecksum, CoinDenomination denomination)
 {
@@ -146,6 +154,67 @@ bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint)
 	return true;
 }
 
+//Load many checkpoints at once, as LoadAccumulatorValuesFromDB() would one after the other
+bool LoadAccumulatorValuesFromDB(const std::vector<uint256>& vCheckpoints)
+{
+	//consecutive checkpoints mostly share checksums, read each of them once
+	std::vector<uint32_t> vChecksums;
+	for (const uint256& nCheckpoint : vCheckpoints) {
+		for (auto& denomination : zerocoinDenomList)
+			vChecksums.push_back(ParseChecksum(nCheckpoint, denomination));
+	}
+	std::sort(vChecksums.begin(), vChecksums.end());
+	vChecksums.erase(std::unique(vChecksums.begin(), vChecksums.end()), vChecksums.end());
+
+	std::vector<CBigNum> vValues(vChecksums.size());
+	std::vector<char> vFound(vChecksums.size(), 0);
+	boost::mutex csError;
+	std::string strError;
+	auto readRange = [&](size_t nBegin, size_t nEnd) {
+		try {
+			for (size_t i = nBegin; i < nEnd; i++)
+				vFound[i] = zerocoinDB->ReadAccumulatorValue(vChecksums[i], vValues[i]);
+		} catch (const std::exception& e) {
+			boost::lock_guard<boost::mutex> lock(csError);
+			strError = e.what();
+		}
+	};
+	size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+	if (vChecksums.size() < ACCUMULATOR_LOAD_PARALLEL_MIN || nThreads == 1) {
+		readRange(0, vChecksums.size());
+	} else {
+		size_t nChunk = (vChecksums.size() + nThreads - 1) / nThreads;
+		boost::thread_group threadGroup;
+		for (size_t nBegin = nChunk; nBegin < vChecksums.size(); nBegin += nChunk) {
+			size_t nEnd = std::min(nBegin + nChunk, vChecksums.size());
+			threadGroup.create_thread([&readRange, nBegin, nEnd]() { readRange(nBegin, nEnd); });
+		}
+		readRange(0, std::min(nChunk, vChecksums.size()));
+		threadGroup.join_all();
+	}
+	if (!strError.empty())
+		throw std::runtime_error(strError);
+
+	bool fAllFound = true;
+	for (const uint256& nCheckpoint : vCheckpoints) {
+		for (auto& denomination : zerocoinDenomList) {
+			uint32_t nChecksum = ParseChecksum(nCheckpoint, denomination);
+			size_t i = std::lower_bound(vChecksums.begin(), vChecksums.end(), nChecksum) - vChecksums.begin();
+
+			//if read is not successful then we are not in a state to verify zerocoin transactions
+			if (!vFound[i]) {
+				if (!count(listAccCheckpointsNoDB.begin(), listAccCheckpointsNoDB.end(), nCheckpoint))
+					listAccCheckpointsNoDB.push_back(nCheckpoint);
+				LogPrint("zero", "%s : Missing databased value for checksum %d", __func__, nChecksum);
+				fAllFound = false;
+				break;
+			}
+			mapAccumulatorValues.insert(make_pair(nChecksum, vValues[i]));
+		}
+	}
+	return fAllFound;
+}
+
 //Erase accumulator checkpoints for a certain block range
 bool EraseCheckpoints(int nStartHeight, int nEndHeight)
 {
@@ -271,12 +340,8 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
 		}
 
 		//grab mints from this block
-		CBlock block;
-		if (!ReadBlockFromDisk(block, pindex))
-			return error("%s: failed to read block from disk", __func__);
-
 		std::list<PublicCoin> listPubcoins;
-		if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
+		if (!GetBlockPubcoinList(pindex, listPubcoins, fFilterInvalid))
 			return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
 
 		nTotalMintsFound += listPubcoins.size();
@@ -353,7 +418,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 	CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
 	int n = 0;
 	while (pindex->nHeight < nHeightEnd) {
-		n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+		n += pindex->mintDenominations.count(denom);
 		pindex = chainActive.Next(pindex);
 	}
 
@@ -367,12 +432,8 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
 	int nMintsAdded = 0;
 	if (pindex->MintedDenomination(coin.getDenomination())) {
 		//grab mints from this block
-		CBlock block;
-		if (!ReadBlockFromDisk(block, pindex))
-			return error("%s: failed to read block from disk while adding pubcoins to witness", __func__);
-
 		list<PublicCoin> listPubcoins;
-		if (!BlockToPubcoinList(block, listPubcoins, true))
+		if (!GetBlockPubcoinList(pindex, listPubcoins, true))
 			return error("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
 
 		//add the mints to the witness
@@ -417,8 +478,9 @@ bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom
 	return true;
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CBlockIndex* pindexCheckpoint)
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CBlockIndex* pindexCheckpoint, const uint256& hashSerial)
 {
+	int64_t nTimeStart = GetTimeMicros();
 	LogPrint("zero", "%s: generating\n", __func__);
 	int nLockAttempts = 0;
 	while (nLockAttempts < 100) {
@@ -480,8 +542,31 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
 	RandomizeSecurityLevel(nSecurityLevel); //make security level not always the same and predictable
 	libzerocoin::Accumulator witnessAccumulator = accumulator;
 
+	//Resume from the cached witness unless it was folded past the point where this walk stops
+	uint256 hashPubcoin = GetPubCoinHash(coin.getValue());
+	CAccumulatorWitnessState stateCached;
+	bool fCached = witnessCache.Get(hashPubcoin, stateCached);
+	if (fCached && (!chainActive[stateCached.nHeight] || chainActive[stateCached.nHeight - 1]->GetBlockHash() != stateCached.hashBlockPrev))
+		fCached = false;
+	bool fCacheHit = fCached && stateCached.nHeight > pindex->nHeight && stateCached.nHeight <= nHeightStop &&
+		(nSecurityLevel == 100 || stateCached.nCheckpointsAdded < nSecurityLevel);
+	if (fCacheHit) {
+		pindex = chainActive[stateCached.nHeight];
+		nCheckpointsAdded = stateCached.nCheckpointsAdded;
+		nMintsAdded = stateCached.nMintsAdded;
+		witnessAccumulator.setValue(stateCached.bnWitness);
+	}
+
+	CAccumulatorWitnessState state;
+	state.bnPubcoin = coin.getValue();
+	state.nDenomination = coin.getDenomination();
+	state.nHeightMintAdded = nHeightMintAdded;
+	state.nAccStartHeight = nAccStartHeight;
+	state.hashSerial = hashSerial;
+
 	bool fDoubleCounted = false;
 	while (pindex) {
+		int nCheckpointsBefore = nCheckpointsAdded;
 		if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
 			++nCheckpointsAdded;
 
@@ -498,6 +583,12 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
 				return error("%s : failed to find checksum in database for accumulator", __func__);
 
 			accumulator.setValue(bnAccValue);
+
+			state.nHeight = pindex->nHeight;
+			state.hashBlockPrev = pindex->pprev->GetBlockHash();
+			state.nCheckpointsAdded = nCheckpointsBefore;
+			state.nMintsAdded = nMintsAdded;
+			state.bnWitness = witnessAccumulator.getValue();
 			break;
 		}
 
@@ -517,6 +608,11 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
 	if (!witness.VerifyWitness(accumulator, coin))
 		return error("%s: failed to verify witness", __func__);
 
+	//Only replace a cached witness that is further along if it is no longer on the active chain
+	if (state.nHeight > 0 && (!fCached || state.nHeight > stateCached.nHeight))
+		witnessCache.Put(hashPubcoin, state);
+	witnessCache.RecordGeneration(fCacheHit, GetTimeMicros() - nTimeStart);
+
 	// A certain amount of accumulated coins are required
 	if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
 		strError = _(strprintf("Less than %d mints added, unable to create spend", Params().Zerocoin_RequiredAccumulation()).c_str());
@@ -547,8 +643,7 @@ map<CoinDenomination, int> GetMintMaturityHeight()
 		for (auto denom : libzerocoin::zerocoinDenomList) {
 			//If the denom has not already had a mint added to it, then see if it has a mint added on this block
 			if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-				mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-					pindex->vMintDenominationsInBlock.end(), denom);
+				mapDenomMaturity.at(denom).first += pindex->mintDenominations.count(denom);
 
 				//if mint was found then record this block as the first block that maturity occurs.
 				if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
@@ -571,3 +666,211 @@ map<CoinDenomination, int> GetMintMaturityHeight()
 
 	return mapRet;
 }
+
+bool CAccumulatorWitnessCache::Load()
+{
+	std::map<uint256, CAccumulatorWitnessState> mapLoaded;
+	if (!zerocoinDB->ReadWitnessStates(mapLoaded))
+		return false;
+
+	LOCK(cs);
+	mapStates.swap(mapLoaded);
+	LogPrint("zero", "%s : loaded %d cached witnesses\n", __func__, mapStates.size());
+	return true;
+}
+
+bool CAccumulatorWitnessCache::Get(const uint256& hashPubcoin, CAccumulatorWitnessState& state) const
+{
+	LOCK(cs);
+	auto it = mapStates.find(hashPubcoin);
+	if (it == mapStates.end() || it->second.nHeightSpent)
+		return false;
+
+	state = it->second;
+	return true;
+}
+
+void CAccumulatorWitnessCache::Put(const uint256& hashPubcoin, const CAccumulatorWitnessState& state)
+{
+	LOCK(cs);
+	if (!mapStates.count(hashPubcoin) && mapStates.size() >= MAX_CACHED_WITNESSES) {
+		LogPrint("zero", "%s : cache full, not keeping witness of %s\n", __func__, hashPubcoin.GetHex());
+		return;
+	}
+	mapStates[hashPubcoin] = state;
+	if (!zerocoinDB->WriteWitnessState(hashPubcoin, state))
+		LogPrintf("%s : failed to write witness of %s\n", __func__, hashPubcoin.GetHex());
+}
+
+void CAccumulatorWitnessCache::Erase(const uint256& hashPubcoin)
+{
+	LOCK(cs);
+	if (!mapStates.erase(hashPubcoin))
+		return;
+	zerocoinDB->EraseWitnessState(hashPubcoin);
+}
+
+void CAccumulatorWitnessCache::MarkSpent(const uint256& hashSerial, int nHeight)
+{
+	LOCK(cs);
+	for (auto& it : mapStates) {
+		if (it.second.hashSerial != hashSerial)
+			continue;
+		LogPrint("zero", "%s : mint %s spent at height %d\n", __func__, it.first.GetHex(), nHeight);
+		it.second.nHeightSpent = nHeight;
+		zerocoinDB->WriteWitnessState(it.first, it.second);
+	}
+}
+
+void CAccumulatorWitnessCache::UnmarkSpent(const uint256& hashSerial)
+{
+	LOCK(cs);
+	for (auto& it : mapStates) {
+		if (it.second.hashSerial != hashSerial || !it.second.nHeightSpent)
+			continue;
+		LogPrint("zero", "%s : spend of mint %s disconnected\n", __func__, it.first.GetHex());
+		it.second.nHeightSpent = 0;
+		zerocoinDB->WriteWitnessState(it.first, it.second);
+	}
+}
+
+void CAccumulatorWitnessCache::PruneSpent(int nHeight)
+{
+	LOCK(cs);
+	for (auto it = mapStates.begin(); it != mapStates.end();) {
+		if (it->second.nHeightSpent && it->second.nHeightSpent <= nHeight) {
+			zerocoinDB->EraseWitnessState(it->first);
+			it = mapStates.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void CAccumulatorWitnessCache::RecordGeneration(bool fHit, int64_t nMicros)
+{
+	LOCK(cs);
+	if (fHit)
+		++nHits;
+	else
+		++nMisses;
+	nLastMicros = nMicros;
+	nTotalMicros += nMicros;
+}
+
+UniValue CAccumulatorWitnessCache::GetStats() const
+{
+	LOCK(cs);
+	UniValue obj(UniValue::VOBJ);
+	uint64_t nGenerated = nHits + nMisses;
+	uint64_t nSpent = 0;
+	for (const auto& it : mapStates) {
+		if (it.second.nHeightSpent)
+			++nSpent;
+	}
+	obj.push_back(Pair("mints", (uint64_t)mapStates.size()));
+	obj.push_back(Pair("spent", nSpent));
+	obj.push_back(Pair("hits", nHits));
+	obj.push_back(Pair("misses", nMisses));
+	obj.push_back(Pair("hitrate", nGenerated ? (double)nHits / nGenerated : 0.0));
+	obj.push_back(Pair("last_ms", nLastMicros / 1000.0));
+	obj.push_back(Pair("average_ms", nGenerated ? nTotalMicros / 1000.0 / nGenerated : 0.0));
+	return obj;
+}
+
+void CAccumulatorWitnessCache::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+	if (!tx.IsZerocoinSpend())
+		return;
+	{
+		LOCK(cs);
+		if (mapStates.empty())
+			return;
+	}
+
+	//Spends are synced with their block by ConnectTip() and without one by DisconnectTip()
+	int nHeight = 0;
+	if (pblock) {
+		LOCK(cs_main);
+		BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+		if (mi == mapBlockIndex.end())
+			return;
+		nHeight = mi->second->nHeight;
+	}
+
+	for (const CTxIn& txin : tx.vin) {
+		if (!txin.scriptSig.IsZerocoinSpend())
+			continue;
+		CoinSpend spend = TxInToZerocoinSpend(txin);
+		uint256 hashSerial = GetSerialHash(spend.getCoinSerialNumber());
+		if (pblock)
+			MarkSpent(hashSerial, nHeight);
+		else
+			UnmarkSpent(hashSerial);
+	}
+}
+
+void CAccumulatorWitnessCache::Fold()
+{
+	int nHeightTip;
+	{
+		LOCK(cs_main);
+		nHeightTip = chainActive.Height();
+	}
+
+	//A reorg cannot go back to spends this deep any more
+	PruneSpent(nHeightTip - Params().MaxReorganizationDepth());
+
+	//Fold the cached witnesses up to where a spend at full security level stops, two checkpoints deep
+	int nHeightStop = nHeightTip - (nHeightTip % 10) - 20;
+
+	//Only the unspent witnesses behind the stop height, a bounded number of them per run
+	std::vector<uint256> vUpdate;
+	{
+		LOCK(cs);
+		for (const auto& it : mapStates) {
+			if (it.second.nHeightSpent || it.second.nHeight >= nHeightStop)
+				continue;
+			vUpdate.push_back(it.first);
+			if (vUpdate.size() >= MAX_WITNESS_FOLDS_PER_RUN)
+				break;
+		}
+	}
+
+	for (const uint256& hashPubcoin : vUpdate) {
+		if (ShutdownRequested())
+			return;
+
+		//The state is read again under cs_main, which spends are marked under too
+		LOCK(cs_main);
+		CAccumulatorWitnessState state;
+		if (!Get(hashPubcoin, state))
+			continue;
+
+		CBlockIndex* pindexPrev = chainActive[state.nHeight - 1];
+		if (!pindexPrev || pindexPrev->GetBlockHash() != state.hashBlockPrev) {
+			//the blocks folded into this witness were disconnected, it is rebuilt on next use
+			LogPrint("zero", "%s : dropping witness of %s after reorg\n", __func__, hashPubcoin.GetHex());
+			Erase(hashPubcoin);
+			continue;
+		}
+
+		CoinDenomination denom = static_cast<CoinDenomination>(state.nDenomination);
+		PublicCoin coin(Params().Zerocoin_Params(false), state.bnPubcoin, denom);
+		Accumulator witnessAccumulator(Params().Zerocoin_Params(false), denom, state.bnWitness);
+		CBlockIndex* pindex = chainActive.Next(pindexPrev);
+		while (pindex && pindex->nHeight < nHeightStop) {
+			if (pindex->nHeight != state.nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
+				++state.nCheckpointsAdded;
+			state.nMintsAdded += AddBlockMintsToAccumulator(coin, state.nHeightMintAdded, pindex, &witnessAccumulator, true);
+			pindex = chainActive.Next(pindex);
+		}
+		if (!pindex)
+			continue;
+
+		state.nHeight = pindex->nHeight;
+		state.hashBlockPrev = pindex->pprev->GetBlockHash();
+		state.bnWitness = witnessAccumulator.getValue();
+		Put(hashPubcoin, state);
+	}
+}
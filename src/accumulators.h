@@ -12,18 +12,23 @@
 #include "primitives/zerocoin.h"
 #include "accumulatormap.h"
 #include "chain.h"
+#include "sync.h"
 #include "uint256.h"
+#include "validationinterface.h"
+
+#include <univalue.h>
 
 class CBlockIndex;
 
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr);
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr, const uint256& hashSerial = uint256());
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, AccumulatorMap& mapAccumulators);
 void DatabaseChecksums(AccumulatorMap& mapAccumulators);
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint);
+bool LoadAccumulatorValuesFromDB(const std::vector<uint256>& vCheckpoints);
 bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nCheckpointPrevious);
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination);
 uint32_t GetChecksum(const CBigNum &bnValue);
@@ -31,4 +36,105 @@ int GetChecksumHeight(uint32_t nChecksum, libzerocoin::CoinDenomination denomina
 bool InvalidCheckpointRange(int nHeight);
 bool ValidateAccumulatorCheckpoint(const CBlock& block, CBlockIndex* pindex, AccumulatorMap& mapAccumulators);
 
+/** Mints whose witnesses CAccumulatorWitnessCache keeps, witnesses of further mints are not cached */
+static const unsigned int MAX_CACHED_WITNESSES = 1000;
+/** Cached witnesses folded per CAccumulatorWitnessCache::Fold(), the others follow on later runs or when they are used */
+static const unsigned int MAX_WITNESS_FOLDS_PER_RUN = 20;
+/** How often the scheduler runs CAccumulatorWitnessCache::Fold(), in seconds */
+static const int64_t WITNESS_FOLD_INTERVAL = 60;
+
+/** The witness of a mint as far as GenerateAccumulatorWitness has walked the chain for it */
+class CAccumulatorWitnessState
+{
+public:
+    CBigNum bnPubcoin;
+    int nDenomination;
+    int nHeightMintAdded;
+    int nAccStartHeight;
+
+    //! next block to fold into the witness, and the hash of the block before it
+    int nHeight;
+    uint256 hashBlockPrev;
+
+    //! walk counters and witness value before folding nHeight
+    int nCheckpointsAdded;
+    int nMintsAdded;
+    CBigNum bnWitness;
+
+    //! hash of the mint's serial if known, and the height of the block spending the mint or 0
+    uint256 hashSerial;
+    int nHeightSpent;
+
+    CAccumulatorWitnessState() : nDenomination(0), nHeightMintAdded(0), nAccStartHeight(0), nHeight(0), nCheckpointsAdded(0), nMintsAdded(0), nHeightSpent(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(bnPubcoin);
+        READWRITE(nDenomination);
+        READWRITE(nHeightMintAdded);
+        READWRITE(nAccStartHeight);
+        READWRITE(nHeight);
+        READWRITE(hashBlockPrev);
+        READWRITE(nCheckpointsAdded);
+        READWRITE(nMintsAdded);
+        READWRITE(bnWitness);
+        READWRITE(hashSerial);
+        READWRITE(nHeightSpent);
+    }
+};
+
+/**
+ * Persistent cache of mint witnesses. Once a witness has been generated for a
+ * mint it is kept folded up to two checkpoints below the tip by Fold(), so the
+ * next spend of that mint only walks the last few blocks. States that a reorg
+ * has invalidated are dropped and rebuilt on next use. When the spend of a mint
+ * connects its witness is set aside, it is used again if the spend is
+ * disconnected and dropped once the spend is deeper than a reorg can go.
+ */
+class CAccumulatorWitnessCache : public CValidationInterface
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<uint256, CAccumulatorWitnessState> mapStates;
+
+    uint64_t nHits;
+    uint64_t nMisses;
+    int64_t nLastMicros;
+    int64_t nTotalMicros;
+
+public:
+    CAccumulatorWitnessCache() : nHits(0), nMisses(0), nLastMicros(0), nTotalMicros(0) {}
+
+    bool Load();
+    /** The witness of a mint that is not spent */
+    bool Get(const uint256& hashPubcoin, CAccumulatorWitnessState& state) const;
+    /** Keep a witness, unless MAX_CACHED_WITNESSES other mints are cached already */
+    void Put(const uint256& hashPubcoin, const CAccumulatorWitnessState& state);
+    void Erase(const uint256& hashPubcoin);
+    /** The spend of the mint with this serial hash connected at nHeight */
+    void MarkSpent(const uint256& hashSerial, int nHeight);
+    /** The spend of the mint with this serial hash was disconnected */
+    void UnmarkSpent(const uint256& hashSerial);
+    /** Drop the witnesses of mints spent at or below nHeight */
+    void PruneSpent(int nHeight);
+    /**
+     * Fold up to MAX_WITNESS_FOLDS_PER_RUN witnesses that are behind the stop height
+     * towards the active tip, run from the scheduler thread. Each witness is folded
+     * under its own cs_main lock, which is held while the witness walks the blocks
+     * since it was last folded: about WITNESS_FOLD_INTERVAL worth of blocks normally,
+     * but all blocks since the last start for witnesses loaded after a long downtime.
+     */
+    void Fold();
+    void RecordGeneration(bool fHit, int64_t nMicros);
+    UniValue GetStats() const;
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override;
+};
+
+extern CAccumulatorWitnessCache witnessCache;
+
 #endif //SupportMasterNodeCommunity_ACCUMULATORS_H
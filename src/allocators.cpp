@@ -4,6 +4,10 @@
 
 #include "allocators.h"
 
+#include <atomic>
+
+#include <boost/thread/mutex.hpp>
+
 #ifdef WIN32
 #ifdef _WIN32_WINNT
 #undef _WIN32_WINNT
@@ -64,3 +68,111 @@ bool MemoryPageLocker::Unlock(const void* addr, size_t len)
 LockedPageManager::LockedPageManager() : LockedPageManagerBase<MemoryPageLocker>(GetSystemPageSize())
 {
 }
+
+namespace
+{
+/** Smallest size class, smaller buffers are rounded up to it */
+const int POOL_MIN_CLASS_BITS = 8;
+/** Largest size class; bigger buffers always come from and go back to the heap */
+const int POOL_MAX_CLASS_BITS = 22;
+const int POOL_CLASSES = POOL_MAX_CLASS_BITS - POOL_MIN_CLASS_BITS + 1;
+/** Buffers kept per size class */
+const size_t POOL_MAX_BUFFERS_PER_CLASS = 64;
+/** Bytes kept over all size classes */
+const size_t POOL_MAX_CACHED_BYTES = 32 << 20;
+
+/**
+ * One pool for all threads: network messages are allocated on the message handler
+ * thread and mostly released on the network thread after sending, so per-thread
+ * pools would never get their buffers back. Each size class has its own lock.
+ */
+class CBufferPool
+{
+public:
+    boost::mutex mutexClass[POOL_CLASSES];
+    std::vector<void*> vFree[POOL_CLASSES];
+
+    std::atomic<uint64_t> nAllocations;
+    std::atomic<uint64_t> nHeapAllocations;
+    std::atomic<uint64_t> nReleases;
+    std::atomic<uint64_t> nHeapReleases;
+    std::atomic<size_t> nCachedBytes;
+
+    CBufferPool() : nAllocations(0), nHeapAllocations(0), nReleases(0), nHeapReleases(0), nCachedBytes(0)
+    {
+        for (int i = 0; i < POOL_CLASSES; i++)
+            vFree[i].reserve(POOL_MAX_BUFFERS_PER_CLASS);
+    }
+};
+
+/** Size class index of a buffer of nSize bytes, -1 if it is too large to be pooled */
+int GetPoolClass(size_t nSize)
+{
+    if (nSize > ((size_t)1 << POOL_MAX_CLASS_BITS))
+        return -1;
+    int nClass = 0;
+    while (((size_t)1 << (POOL_MIN_CLASS_BITS + nClass)) < nSize)
+        nClass++;
+    return nClass;
+}
+
+CBufferPool& GetBufferPool()
+{
+    // Never destroyed: buffers may still be released during static destruction
+    static CBufferPool* ppool = new CBufferPool();
+    return *ppool;
+}
+} // namespace
+
+void* PoolAllocate(size_t nSize)
+{
+    CBufferPool& pool = GetBufferPool();
+    pool.nAllocations++;
+
+    int nClass = GetPoolClass(nSize);
+    if (nClass >= 0) {
+        boost::mutex::scoped_lock lock(pool.mutexClass[nClass]);
+        std::vector<void*>& vFree = pool.vFree[nClass];
+        if (!vFree.empty()) {
+            void* p = vFree.back();
+            vFree.pop_back();
+            pool.nCachedBytes -= (size_t)1 << (POOL_MIN_CLASS_BITS + nClass);
+            return p;
+        }
+    }
+    pool.nHeapAllocations++;
+    return ::operator new(nClass < 0 ? nSize : (size_t)1 << (POOL_MIN_CLASS_BITS + nClass));
+}
+
+void PoolRelease(void* p, size_t nSize)
+{
+    CBufferPool& pool = GetBufferPool();
+    pool.nReleases++;
+
+    int nClass = GetPoolClass(nSize);
+    if (nClass >= 0) {
+        size_t nClassSize = (size_t)1 << (POOL_MIN_CLASS_BITS + nClass);
+        boost::mutex::scoped_lock lock(pool.mutexClass[nClass]);
+        std::vector<void*>& vFree = pool.vFree[nClass];
+        // the byte limit is shared by all classes, other threads may overshoot it by a buffer each
+        if (vFree.size() < POOL_MAX_BUFFERS_PER_CLASS && pool.nCachedBytes + nClassSize <= POOL_MAX_CACHED_BYTES) {
+            vFree.push_back(p);
+            pool.nCachedBytes += nClassSize;
+            return;
+        }
+    }
+    pool.nHeapReleases++;
+    ::operator delete(p);
+}
+
+BufferPoolStats GetBufferPoolStats()
+{
+    CBufferPool& pool = GetBufferPool();
+    BufferPoolStats stats;
+    stats.nAllocations = pool.nAllocations;
+    stats.nHeapAllocations = pool.nHeapAllocations;
+    stats.nReleases = pool.nReleases;
+    stats.nHeapReleases = pool.nHeapReleases;
+    stats.nCachedBytes = pool.nCachedBytes;
+    return stats;
+}
@@ -7,6 +7,8 @@
 #define BITCOIN_ALLOCATORS_H
 
 #include <map>
+#include <new>
+#include <stdint.h>
 #include <string.h>
 #include <string>
 #include <vector>
@@ -258,10 +260,73 @@ struct zero_after_free_allocator : public std::allocator<T> {
     }
 };
 
+//
+// Pool of buffers for data that is not secret, like network messages, shared by
+// all threads. Buffers are rounded up to a power of two size class and kept for
+// reuse when released, without being cleared. A buffer may be released on another
+// thread than the one that allocated it.
+//
+struct BufferPoolStats {
+    uint64_t nAllocations;     // buffers handed out
+    uint64_t nHeapAllocations; // of which had to come from the heap
+    uint64_t nReleases;        // buffers given back
+    uint64_t nHeapReleases;    // of which went back to the heap because the pool was full
+    size_t nCachedBytes;       // currently kept for reuse
+};
+
+void* PoolAllocate(size_t nSize);
+void PoolRelease(void* p, size_t nSize);
+/** Statistics of the pool, counted over all threads */
+BufferPoolStats GetBufferPoolStats();
+
+//
+// Allocator that takes its buffers from the shared buffer pool and does not clear them.
+// Never use it for keys or other secrets.
+//
+template <typename T>
+struct pooled_allocator : public std::allocator<T> {
+    // MSVC8 default copy constructor is broken
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    pooled_allocator() throw() {}
+    pooled_allocator(const pooled_allocator& a) throw() : base(a) {}
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>& a) throw() : base(a)
+    {
+    }
+    ~pooled_allocator() throw() {}
+    template <typename _Other>
+    struct rebind {
+        typedef pooled_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        if (n > std::size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T*>(PoolAllocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (p != NULL)
+            PoolRelease(p, sizeof(T) * n);
+    }
+};
+
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
 // Byte-vector that clears its contents before deletion.
 typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
 
+// Byte-vector for network messages, recycled through the shared buffer pool.
+typedef std::vector<char, pooled_allocator<char> > CNetSerializeData;
+
 #endif // BITCOIN_ALLOCATORS_H
@@ -0,0 +1,136 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilecache.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/locks.hpp>
+
+CBlockFileCache blockFileCache;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+bool CMappedBlockFile::GetRecord(unsigned int nPos, unsigned int nTrailer, const char*& pbegin, const char*& pend) const
+{
+    const size_t nHeader = MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (nPos < nHeader || nPos > nSize)
+        return false;
+    const char* pheader = pdata + nPos - nHeader;
+    if (memcmp(pheader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return false;
+    uint64_t nLen = ReadLE32((const unsigned char*)pheader + MESSAGE_START_SIZE);
+    if (nLen + nTrailer > nSize - nPos)
+        return false;
+    pbegin = pdata + nPos;
+    pend = pbegin + nLen + nTrailer;
+    return true;
+}
+
+void CBlockFileCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (lru.size() > nMaxFiles) {
+        mapFiles.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+void CBlockFileCache::EraseFrom(int nFile)
+{
+    for (LruList::iterator it = lru.begin(); it != lru.end();) {
+        if (it->first.second >= nFile) {
+            mapFiles.erase(it->first);
+            it = lru.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CBlockFileCache::SetFinishedFiles(int nFile)
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    // Files are only truncated while being written, which those are again
+    if (nFile < nFinishedFiles)
+        EraseFrom(nFile);
+    nFinishedFiles = nFile;
+}
+
+CBlockFileCache::MappedFilePtr CBlockFileCache::Get(int nFile, const char* prefix, size_t nMinSize)
+{
+    FileKey key(prefix[0], nFile);
+    boost::lock_guard<boost::mutex> lock(cs);
+    if (nFile >= nFinishedFiles || nMaxFiles == 0)
+        return MappedFilePtr();
+    std::map<FileKey, LruList::iterator>::iterator mi = mapFiles.find(key);
+    if (mi != mapFiles.end()) {
+        LruList::iterator it = mi->second;
+        if (it->second->nSize >= nMinSize) {
+            lru.splice(lru.begin(), lru, it);
+            nHits++;
+            return it->second;
+        }
+        // An undo file that grew since
+        lru.erase(it);
+        mapFiles.erase(mi);
+    }
+
+#ifndef WIN32
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), prefix);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return MappedFilePtr();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (size_t)st.st_size < nMinSize) {
+        close(fd);
+        return MappedFilePtr();
+    }
+    // Shared, so undo data written to the file later shows through
+    void* pmap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pmap == MAP_FAILED) {
+        LogPrintf("%s: failed to map %s\n", __func__, path.string());
+        return MappedFilePtr();
+    }
+    MappedFilePtr pfile = std::make_shared<const CMappedBlockFile>((const char*)pmap, (size_t)st.st_size);
+    nMaps++;
+
+    lru.push_front(std::make_pair(key, pfile));
+    mapFiles[key] = lru.begin();
+    if (lru.size() > nMaxFiles) {
+        mapFiles.erase(lru.back().first);
+        lru.pop_back();
+    }
+    return pfile;
+#else
+    return MappedFilePtr();
+#endif
+}
+
+void CBlockFileCache::Clear()
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    nFinishedFiles = 0;
+    EraseFrom(0);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILECACHE_H
+#define BITCOIN_BLOCKFILECACHE_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+#include <boost/thread/mutex.hpp>
+
+/** Default for -mmapblockfiles: mapped files cost address space only, which 32-bit hosts lack */
+static const unsigned int DEFAULT_MMAP_BLOCK_FILES = sizeof(void*) >= 8 ? 64 : 0;
+
+/** A read-only memory map of a whole blk or rev file, unmapped with its last reference */
+class CMappedBlockFile
+{
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    const char* pdata;
+    size_t nSize;
+
+    CMappedBlockFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    /**
+     * Find the record written at nPos by WriteBlockToDisk() or CBlockUndo::WriteToDisk(),
+     * behind the network magic and its size, followed by nTrailer more bytes. Fails if
+     * the header does not match or the record runs past the mapping.
+     */
+    bool GetRecord(unsigned int nPos, unsigned int nTrailer, const char*& pbegin, const char*& pend) const;
+};
+
+/**
+ * Memory maps of the finished block and undo files, so reading a block or its undo data
+ * is a page cache lookup instead of an open, a seek and buffered reads.
+ *
+ * Only files before the one blocks are being appended to are mapped: those are never
+ * truncated again. Their undo files can still grow when a block stored in them is
+ * connected again, a mapping that ends before a requested position is then renewed.
+ * At most a set number of files stay mapped, the least recently used go first.
+ */
+class CBlockFileCache
+{
+public:
+    typedef std::shared_ptr<const CMappedBlockFile> MappedFilePtr;
+
+private:
+    //! (prefix, file number)
+    typedef std::pair<char, int> FileKey;
+    typedef std::list<std::pair<FileKey, MappedFilePtr> > LruList;
+
+    boost::mutex cs;
+    LruList lru;                                   //! most recently used first
+    std::map<FileKey, LruList::iterator> mapFiles; //! into lru
+    size_t nMaxFiles;
+
+    //! files with a lower number are finished
+    int nFinishedFiles;
+
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMaps;
+
+    void EraseFrom(int nFile);
+
+public:
+    CBlockFileCache() : nMaxFiles(DEFAULT_MMAP_BLOCK_FILES), nFinishedFiles(0), nHits(0), nMaps(0) {}
+
+    //! -mmapblockfiles, 0 reads every file through stdio
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    //! Files before nFile are finished, later ones are unmapped
+    void SetFinishedFiles(int nFile);
+
+    /**
+     * The map of a finished blk or rev file that extends at least to nMinSize, or NULL
+     * when the file is still being written, mapping is disabled or fails.
+     */
+    MappedFilePtr Get(int nFile, const char* prefix, size_t nMinSize);
+
+    //! Unmap all files, they stay in use where still referenced
+    void Clear();
+
+    uint64_t GetHits() const { return nHits; }
+    uint64_t GetMaps() const { return nMaps; }
+};
+
+extern CBlockFileCache blockFileCache;
+
+#endif // BITCOIN_BLOCKFILECACHE_H
@@ -0,0 +1,347 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+CBlockFilterDB* pblockfilterdb = NULL;
+
+namespace
+{
+/** Bits are written most significant first */
+class CBitWriter
+{
+private:
+    std::vector<unsigned char>& vData;
+    unsigned char nBuffer;
+    int nBits;
+
+public:
+    explicit CBitWriter(std::vector<unsigned char>& vDataIn) : vData(vDataIn), nBuffer(0), nBits(0) {}
+
+    void Write(uint64_t nValue, int nCount)
+    {
+        while (nCount > 0) {
+            int nTake = std::min(8 - nBits, nCount);
+            nBuffer |= ((nValue >> (nCount - nTake)) & ((1U << nTake) - 1)) << (8 - nBits - nTake);
+            nBits += nTake;
+            nCount -= nTake;
+            if (nBits == 8)
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits == 0)
+            return;
+        vData.push_back(nBuffer);
+        nBuffer = 0;
+        nBits = 0;
+    }
+};
+
+class CBitReader
+{
+private:
+    const std::vector<unsigned char>& vData;
+    size_t nPos;
+    int nBit;
+
+public:
+    CBitReader(const std::vector<unsigned char>& vDataIn, size_t nPosIn) : vData(vDataIn), nPos(nPosIn), nBit(0) {}
+
+    /** False past the end of the data */
+    bool Read(int nCount, uint64_t& nValue)
+    {
+        nValue = 0;
+        while (nCount > 0) {
+            if (nPos >= vData.size())
+                return false;
+            int nTake = std::min(8 - nBit, nCount);
+            nValue = (nValue << nTake) | ((vData[nPos] >> (8 - nBit - nTake)) & ((1U << nTake) - 1));
+            nBit += nTake;
+            nCount -= nTake;
+            if (nBit == 8) {
+                nPos++;
+                nBit = 0;
+            }
+        }
+        return true;
+    }
+
+    bool ReadGolombRice(int nP, uint64_t& nValue)
+    {
+        uint64_t nQuotient = 0;
+        uint64_t nBit;
+        while (true) {
+            if (!Read(1, nBit))
+                return false;
+            if (!nBit)
+                break;
+            nQuotient++;
+        }
+        uint64_t nRemainder;
+        if (!Read(nP, nRemainder))
+            return false;
+        nValue = (nQuotient << nP) + nRemainder;
+        return true;
+    }
+};
+
+/** x * n / 2^64, spreads a 64-bit hash evenly over [0, n) */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+} // namespace
+
+CBlockFilter::CBlockFilter(const uint256& hashBlockIn, const ElementSet& elements) : hashBlock(hashBlockIn), nElements(elements.size())
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nElements);
+    vEncoded.assign(ss.begin(), ss.end());
+    if (nElements == 0)
+        return;
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(nElements);
+    for (const Element& element : elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CBitWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nHash : vHashes) {
+        uint64_t nDelta = nHash - nLast;
+        nLast = nHash;
+        // Golomb-Rice: the quotient in unary, then the P low bits
+        for (uint64_t nQuotient = nDelta >> P; nQuotient > 0; nQuotient--)
+            writer.Write(1, 1);
+        writer.Write(0, 1);
+        writer.Write(nDelta, P);
+    }
+    writer.Flush();
+}
+
+CBlockFilter::CBlockFilter(const CBlock& block) : CBlockFilter(block.GetHash(), GetBlockElements(block))
+{
+}
+
+bool CBlockFilter::Decode(const uint256& hashBlockIn, const std::vector<unsigned char>& vEncodedIn)
+{
+    try {
+        CDataStream ss(vEncodedIn, SER_NETWORK, PROTOCOL_VERSION);
+        nElements = ReadCompactSize(ss);
+    } catch (const std::exception&) {
+        return false;
+    }
+    hashBlock = hashBlockIn;
+    vEncoded = vEncodedIn;
+    return true;
+}
+
+uint64_t CBlockFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8)).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, nElements * M);
+}
+
+bool CBlockFilter::MatchSorted(const std::vector<uint64_t>& vQueries) const
+{
+    if (nElements == 0 || vQueries.empty())
+        return false;
+
+    CBitReader reader(vEncoded, GetSizeOfCompactSize(nElements));
+    std::vector<uint64_t>::const_iterator it = vQueries.begin();
+    uint64_t nValue = 0;
+    for (uint64_t i = 0; i < nElements; i++) {
+        uint64_t nDelta;
+        if (!reader.ReadGolombRice(P, nDelta))
+            return false;
+        nValue += nDelta;
+        while (*it < nValue) {
+            if (++it == vQueries.end())
+                return false;
+        }
+        if (*it == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CBlockFilter::Match(const Element& element) const
+{
+    if (nElements == 0)
+        return false;
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CBlockFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nElements == 0)
+        return false;
+    std::vector<uint64_t> vQueries;
+    vQueries.reserve(elements.size());
+    for (const Element& element : elements)
+        vQueries.push_back(HashToRange(element));
+    std::sort(vQueries.begin(), vQueries.end());
+    return MatchSorted(vQueries);
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    return Hash(vEncoded.begin(), vEncoded.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& hashPrevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end());
+}
+
+CBlockFilter::ElementSet CBlockFilter::GetBlockElements(const CBlock& block)
+{
+    ElementSet elements;
+    for (const CTransaction& tx : block.vtx) {
+        for (const CTxOut& txout : tx.vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script.IsUnspendable())
+                continue;
+            elements.insert(Element(script.begin(), script.end()));
+        }
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx.vin) {
+            // zerocoin spends have no prevout
+            if (!txin.prevout.IsNull())
+                elements.insert(OutPointElement(txin.prevout));
+        }
+    }
+    return elements;
+}
+
+CBlockFilter::Element CBlockFilter::OutPointElement(const COutPoint& outpoint)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << outpoint;
+    return Element(ss.begin(), ss.end());
+}
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "filter", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, CBlockFilterEntry& entry) const
+{
+    return Read(std::make_pair('f', hashBlock), entry);
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, CBlockFilter& filter) const
+{
+    CBlockFilterEntry entry;
+    return ReadFilter(hashBlock, entry) && filter.Decode(hashBlock, entry.vFilter);
+}
+
+bool CBlockFilterDB::HaveFilter(const uint256& hashBlock) const
+{
+    return Exists(std::make_pair('f', hashBlock));
+}
+
+bool CBlockFilterDB::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read('B', hashBlock);
+}
+
+bool CBlockFilterDB::WriteFilter(const CBlock& block, const CBlockIndex* pindex)
+{
+    uint256 hashPrevHeader = 0;
+    if (pindex->pprev) {
+        CBlockFilterEntry entryPrev;
+        if (!ReadFilter(pindex->pprev->GetBlockHash(), entryPrev))
+            return false;
+        hashPrevHeader = entryPrev.hashHeader;
+    }
+
+    CBlockFilter filter(block);
+    CBlockFilterEntry entry;
+    entry.vFilter = filter.GetEncoded();
+    entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+
+    CLevelDBBatch batch;
+    batch.Write(std::make_pair('f', pindex->GetBlockHash()), entry);
+    batch.Write('B', pindex->GetBlockHash());
+    return WriteBatch(batch);
+}
+
+void ThreadBlockFilterIndex()
+{
+    RenameThread("smnc-blockfilter");
+
+    CBlockIndex* pindex = NULL;
+    uint256 hashBest;
+    {
+        LOCK(cs_main);
+        if (pblockfilterdb->ReadBestBlock(hashBest) && mapBlockIndex.count(hashBest))
+            pindex = mapBlockIndex[hashBest];
+    }
+
+    int64_t nStart = GetTimeMillis();
+    int nBuilt = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Continue after the last block handled, or at the fork if it was reorganized away
+        CBlockIndex* pindexNext;
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            pindexNext = pindex ? chainActive.Next(chainActive.FindFork(pindex)) : chainActive.Genesis();
+            if (pindexNext)
+                pos = pindexNext->GetBlockPos();
+        }
+        if (!pindexNext)
+            break;
+        pindex = pindexNext;
+
+        // ConnectBlock() writes the filters of new blocks once their parent has one
+        if (pblockfilterdb->HaveFilter(pindex->GetBlockHash()))
+            continue;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos) || block.GetHash() != pindex->GetBlockHash()) {
+            LogPrintf("%s : cannot read block %s, filter index stopped\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+        if (!pblockfilterdb->WriteFilter(block, pindex)) {
+            LogPrintf("%s : no filter for the parent of block %s, filter index stopped\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+        if (++nBuilt % 10000 == 0)
+            LogPrintf("Block filter index: built %d filters, at height %d\n", nBuilt, pindex->nHeight);
+    }
+
+    if (nBuilt > 0)
+        LogPrintf("Block filter index: built %d filters in %dms\n", nBuilt, GetTimeMillis() - nStart);
+}
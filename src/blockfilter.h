@@ -0,0 +1,115 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "leveldbwrapper.h"
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Most filters getblockfilters returns at once */
+static const int MAX_BLOCKFILTERS_RESULTS = 1000;
+
+/**
+ * Golomb-Rice coded set of the items of one block, with the parameters of the BIP158
+ * basic filter. Items in the set always match, others with a probability of 1/M.
+ *
+ * A block's items are the scripts of its outputs and the outpoints its inputs spend,
+ * so a wallet can tell from its scripts and outpoints whether the block concerns it.
+ */
+class CBlockFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    static const int P = 19;
+    static const uint64_t M = 784931;
+
+private:
+    uint256 hashBlock;
+    uint64_t nElements;
+    std::vector<unsigned char> vEncoded; // CompactSize number of elements, then the coded deltas
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchSorted(const std::vector<uint64_t>& vQueries) const;
+
+public:
+    CBlockFilter() : nElements(0) {}
+    CBlockFilter(const uint256& hashBlockIn, const ElementSet& elements);
+    explicit CBlockFilter(const CBlock& block);
+
+    /** Take a stored encoding, false if it is malformed */
+    bool Decode(const uint256& hashBlockIn, const std::vector<unsigned char>& vEncodedIn);
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+    uint64_t GetElementCount() const { return nElements; }
+    uint256 GetHash() const;
+    /** The BIP157 filter header: hash of this filter's hash and the previous block's header */
+    uint256 ComputeHeader(const uint256& hashPrevHeader) const;
+
+    bool Match(const Element& element) const;
+    bool MatchAny(const ElementSet& elements) const;
+
+    /** The items of block: non-empty output scripts other than OP_RETURN, and spent outpoints */
+    static ElementSet GetBlockElements(const CBlock& block);
+    static Element OutPointElement(const COutPoint& outpoint);
+};
+
+/** What the filter index keeps for a block */
+struct CBlockFilterEntry {
+    std::vector<unsigned char> vFilter;
+    uint256 hashHeader;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vFilter);
+        READWRITE(hashHeader);
+    }
+};
+
+/** Filters of the blocks of the main chain (blocks/filter/), see -blockfilterindex */
+class CBlockFilterDB : public CLevelDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+
+public:
+    bool ReadFilter(const uint256& hashBlock, CBlockFilterEntry& entry) const;
+    bool ReadFilter(const uint256& hashBlock, CBlockFilter& filter) const;
+    bool HaveFilter(const uint256& hashBlock) const;
+    /** The last block written whose ancestors all have a filter */
+    bool ReadBestBlock(uint256& hashBlock) const;
+    /**
+     * Compute and store the filter of block. False if the filter of its parent is not
+     * stored yet, ThreadBlockFilterIndex() fills those in.
+     */
+    bool WriteFilter(const CBlock& block, const CBlockIndex* pindex);
+};
+
+/** The filter index, NULL unless -blockfilterindex */
+extern CBlockFilterDB* pblockfilterdb;
+
+/** Build the missing filters of the main chain, from the genesis block on the first run */
+void ThreadBlockFilterIndex();
+
+#endif // BITCOIN_BLOCKFILTER_H
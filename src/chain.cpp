@@ -7,8 +7,73 @@
 
 #include "chain.h"
 
+#include "sync.h"
+
+#include <deque>
+#include <map>
+
 using namespace std;
 
+/**
+ * Mint orders of CMintDenominations, never released: only blocks minting out of
+ * denomination order have one, and equal orders are stored once.
+ */
+static CCriticalSection cs_mintOrders;
+static std::deque<std::vector<libzerocoin::CoinDenomination> > dequeMintOrders;
+static std::map<std::vector<libzerocoin::CoinDenomination>, uint32_t> mapMintOrderIds;
+
+uint32_t InternMintOrder(const std::vector<libzerocoin::CoinDenomination>& vMints)
+{
+    LOCK(cs_mintOrders);
+    std::map<std::vector<libzerocoin::CoinDenomination>, uint32_t>::iterator it = mapMintOrderIds.find(vMints);
+    if (it != mapMintOrderIds.end())
+        return it->second;
+    dequeMintOrders.push_back(vMints);
+    uint32_t nId = dequeMintOrders.size();
+    mapMintOrderIds.insert(std::make_pair(vMints, nId));
+    return nId;
+}
+
+const std::vector<libzerocoin::CoinDenomination>& GetMintOrder(uint32_t nId)
+{
+    LOCK(cs_mintOrders);
+    return dequeMintOrders.at(nId - 1);
+}
+
+/**
+ * CBlockIndexArena implementation
+ */
+void* CBlockIndexArena::Allocate()
+{
+    nEntries++;
+    if (!vFree.empty()) {
+        void* p = vFree.back();
+        vFree.pop_back();
+        return p;
+    }
+    if (nSlabUsed == SLAB_ENTRIES) {
+        vSlabs.push_back(::operator new(SLAB_ENTRIES * sizeof(CBlockIndex)));
+        nSlabUsed = 0;
+    }
+    return static_cast<CBlockIndex*>(vSlabs.back()) + nSlabUsed++;
+}
+
+void CBlockIndexArena::Destroy(CBlockIndex* pindex)
+{
+    vFree.push_back(pindex);
+    nEntries--;
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (void* pslab : vSlabs)
+        ::operator delete(pslab);
+    vSlabs.clear();
+    vFree.clear();
+    nSlabUsed = SLAB_ENTRIES;
+    nEntries = 0;
+}
+
 /**
  * CChain implementation
  */
@@ -16,6 +16,11 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -63,6 +68,178 @@ struct CDiskBlockPos {
     bool IsNull() const { return (nFile == -1); }
 };
 
+//! number of zerocoin denominations, the entries of libzerocoin::zerocoinDenomList
+static const int ZEROCOIN_DENOMINATIONS = 8;
+
+/** Position of a denomination in libzerocoin::zerocoinDenomList, -1 for ZQ_ERROR */
+inline int GetDenominationIndex(libzerocoin::CoinDenomination denom)
+{
+    switch (denom) {
+    case libzerocoin::ZQ_ONE: return 0;
+    case libzerocoin::ZQ_FIVE: return 1;
+    case libzerocoin::ZQ_TEN: return 2;
+    case libzerocoin::ZQ_FIFTY: return 3;
+    case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+    case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+    case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+    case libzerocoin::ZQ_FIVE_THOUSAND: return 7;
+    default: return -1;
+    }
+}
+
+/**
+ * Zerocoin supply per denomination, held inline in the block index.
+ * Serialized as the std::map<CoinDenomination, int64_t> it replaces.
+ */
+class CZerocoinSupply
+{
+private:
+    int64_t anSupply[ZEROCOIN_DENOMINATIONS];
+
+    static int CheckedIndex(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = GetDenominationIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range("CZerocoinSupply::at() : invalid denomination");
+        return nIndex;
+    }
+
+public:
+    CZerocoinSupply()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        std::fill(anSupply, anSupply + ZEROCOIN_DENOMINATIONS, 0);
+    }
+
+    int64_t& at(libzerocoin::CoinDenomination denom) { return anSupply[CheckedIndex(denom)]; }
+    const int64_t& at(libzerocoin::CoinDenomination denom) const { return anSupply[CheckedIndex(denom)]; }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(ZEROCOIN_DENOMINATIONS) + ZEROCOIN_DENOMINATIONS * (sizeof(int) + sizeof(int64_t));
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, ZEROCOIN_DENOMINATIONS);
+        for (int i = 0; i < ZEROCOIN_DENOMINATIONS; i++) {
+            ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nVersion);
+            ::Serialize(s, anSupply[i], nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        SetNull();
+        unsigned int nSize = ReadCompactSize(s);
+        for (unsigned int i = 0; i < nSize; i++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nVersion);
+            ::Unserialize(s, nSupply, nType, nVersion);
+            int nIndex = GetDenominationIndex(denom);
+            if (nIndex >= 0)
+                anSupply[nIndex] = nSupply;
+        }
+    }
+};
+
+/** Shared copy of a mint order that is not grouped by denomination, interned so equal orders share an id above 0 */
+uint32_t InternMintOrder(const std::vector<libzerocoin::CoinDenomination>& vMints);
+const std::vector<libzerocoin::CoinDenomination>& GetMintOrder(uint32_t nId);
+
+/**
+ * The denominations of the mints in a block, as a count per denomination
+ * held inline in the block index. Serialized exactly as the
+ * std::vector<CoinDenomination> it replaces: most blocks mint in order of
+ * denomination, the order of the others is interned by InternMintOrder().
+ */
+class CMintDenominations
+{
+private:
+    uint32_t anMints[ZEROCOIN_DENOMINATIONS];
+    uint32_t nMintOrder; //! 0 while the mints are grouped by denomination
+
+public:
+    CMintDenominations()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::fill(anMints, anMints + ZEROCOIN_DENOMINATIONS, 0);
+        nMintOrder = 0;
+    }
+
+    //! The denominations in mint order. ZQ_ERROR is not a denomination a mint can have and is not counted.
+    void assign(const std::vector<libzerocoin::CoinDenomination>& vMints)
+    {
+        clear();
+        int nLastIndex = 0;
+        bool fGrouped = true;
+        for (libzerocoin::CoinDenomination denom : vMints) {
+            int nIndex = GetDenominationIndex(denom);
+            fGrouped &= nIndex >= nLastIndex;
+            if (nIndex >= 0) {
+                anMints[nIndex]++;
+                nLastIndex = nIndex;
+            }
+        }
+        if (!fGrouped)
+            nMintOrder = InternMintOrder(vMints);
+    }
+
+    unsigned int count(libzerocoin::CoinDenomination denom) const
+    {
+        int nIndex = GetDenominationIndex(denom);
+        return nIndex < 0 ? 0 : anMints[nIndex];
+    }
+
+    unsigned int size() const
+    {
+        if (nMintOrder)
+            return GetMintOrder(nMintOrder).size();
+        unsigned int nSize = 0;
+        for (int i = 0; i < ZEROCOIN_DENOMINATIONS; i++)
+            nSize += anMints[i];
+        return nSize;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(size()) + size() * sizeof(int);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        if (nMintOrder) {
+            ::Serialize(s, GetMintOrder(nMintOrder), nType, nVersion);
+            return;
+        }
+        WriteCompactSize(s, size());
+        for (int i = 0; i < ZEROCOIN_DENOMINATIONS; i++) {
+            for (uint32_t n = 0; n < anMints[i]; n++)
+                ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        std::vector<libzerocoin::CoinDenomination> vMints;
+        ::Unserialize(s, vMints, nType, nVersion);
+        assign(vMints);
+    }
+};
+
 enum BlockStatus {
     //! Unused.
     BLOCK_VALID_UNKNOWN = 0,
@@ -181,9 +358,9 @@ public:
     uint32_t nSequenceId;
     
     //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
-    
+    CZerocoinSupply zerocoinSupply;
+    CMintDenominations mintDenominations;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -214,10 +391,8 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        zerocoinSupply.SetNull();
+        mintDenominations.clear();
     }
 
     CBlockIndex()
@@ -295,14 +470,14 @@ public:
     {
         int64_t nTotal = 0;
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * mapZerocoinSupply.at(denom);
+            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * zerocoinSupply.at(denom);
         }
         return nTotal;
     }
 
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return mintDenominations.count(denom) > 0;
     }
 
     uint256 GetBlockHash() const
@@ -481,8 +656,8 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
-            READWRITE(vMintDenominationsInBlock);
+            READWRITE(zerocoinSupply);
+            READWRITE(mintDenominations);
         }
 
     }
@@ -512,6 +687,43 @@ public:
     }
 };
 
+/**
+ * Allocates block index entries in large slabs. Entries keep their address
+ * until Clear(), and those created one after another, mostly in chain order
+ * when the index is loaded, sit next to each other in memory.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t SLAB_ENTRIES = 8192;
+    static_assert(std::is_trivially_destructible<CBlockIndex>::value, "arena entries are released without running destructors");
+
+    std::vector<void*> vSlabs;
+    size_t nSlabUsed; //! entries handed out from the last slab
+    std::vector<void*> vFree;
+    size_t nEntries;
+
+    void* Allocate();
+
+public:
+    CBlockIndexArena() : nSlabUsed(SLAB_ENTRIES), nEntries(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args>
+    CBlockIndex* Create(Args&&... args)
+    {
+        return new (Allocate()) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    //! Give back an entry for reuse by the next Create()
+    void Destroy(CBlockIndex* pindex);
+    //! Release every entry and slab
+    void Clear();
+
+    size_t size() const { return nEntries; }
+    size_t DynamicMemoryUsage() const { return vSlabs.size() * SLAB_ENTRIES * sizeof(CBlockIndex) + vSlabs.capacity() * sizeof(void*) + vFree.capacity() * sizeof(void*); }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
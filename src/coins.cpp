@@ -7,7 +7,9 @@
 
 #include "coins.h"
 
+#include "clientversion.h"
 #include "random.h"
+#include "streams.h"
 
 #include <assert.h>
 
@@ -67,6 +69,79 @@ uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
 bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
 
+/** Serialize the element committed to for one txid: its metadata and every unspent output with its index. */
+static void GetTxOutSetElement(const uint256& txid, const CCoins& coins, CDataStream& ss)
+{
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i + 1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
+
+void CTxOutSetStats::Add(const uint256& txid, const CCoins& coins, CDataStream* pssOrdered)
+{
+    if (coins.IsPruned())
+        return;
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    GetTxOutSetElement(txid, coins, ss);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    if (pssOrdered)
+        pssOrdered->write(&ss[0], ss.size());
+    nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull()) {
+            nTransactionOutputs++;
+            nTotalAmount += coins.vout[i].nValue;
+        }
+    }
+    nSerializedSize += 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+
+void CTxOutSetStats::Remove(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    GetTxOutSetElement(txid, coins, ss);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactions--;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull()) {
+            nTransactionOutputs--;
+            nTotalAmount -= coins.vout[i].nValue;
+        }
+    }
+    nSerializedSize -= 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+
+CTxOutSetStats& CTxOutSetStats::operator+=(const CTxOutSetStats& other)
+{
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nSerializedSize += other.nSerializedSize;
+    nTotalAmount += other.nTotalAmount;
+    muhash *= other.muhash;
+    return *this;
+}
+
+void CTxOutSetStats::GetStats(CCoinsStats& stats) const
+{
+    stats.hashBlock = hashBlock;
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nSerializedSize = nSerializedSize;
+    stats.hashMuHash = muhash.Finalize();
+    stats.nTotalAmount = nTotalAmount;
+}
+
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
 bool CCoinsViewBacked::GetCoins(const uint256& txid, CCoins& coins) const { return base->GetCoins(txid, coins); }
@@ -208,6 +283,21 @@ bool CCoinsViewCache::Flush()
     return fOk;
 }
 
+void CCoinsViewCache::UpdateStats(CTxOutSetStats& stats) const
+{
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+        if (!(it->second.flags & CCoinsCacheEntry::FRESH)) {
+            CCoins coins;
+            if (base->GetCoins(it->first, coins))
+                stats.Remove(it->first, coins);
+        }
+        stats.Add(it->first, it->second.coins);
+    }
+    stats.hashBlock = GetBestBlock();
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const
 {
     return cacheCoins.size();
@@ -9,8 +9,10 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "muhash.h"
 #include "script/standard.h"
 #include "serialize.h"
+#include "streams.h"
 #include "uint256.h"
 #include "undo.h"
 
@@ -326,10 +328,69 @@ struct CCoinsStats {
     uint64_t nTransactions;
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
-    uint256 hashSerialized;
+    uint256 hashSerialized; //! ordered hash of the set, 0 when not scanned
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), hashMuHash(0), nTotalAmount(0) {}
+};
+
+/**
+ * Statistics of an unspent transaction output set, folded per txid with an
+ * order-independent commitment. Partial results computed over disjoint parts
+ * of the set can be merged in any order, and the statistics of a chainstate
+ * can be moved across a block by removing the old and adding the new coins
+ * of every txid the block touches.
+ */
+class CTxOutSetStats
+{
+public:
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    CMuHash3072 muhash;
+
+    CTxOutSetStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nSerializedSize = 0;
+        nTotalAmount = 0;
+        muhash = CMuHash3072();
+    }
+
+    //! Account for the unspent outputs of txid, appending its element to pssOrdered if given. Pruned coins are ignored.
+    void Add(const uint256& txid, const CCoins& coins, CDataStream* pssOrdered = NULL);
+
+    //! Undo a previous Add() of the same txid and coins
+    void Remove(const uint256& txid, const CCoins& coins);
+
+    //! Merge the statistics of a disjoint part of the set
+    CTxOutSetStats& operator+=(const CTxOutSetStats& other);
+
+    //! Fill in everything but the height and the ordered hash
+    void GetStats(CCoinsStats& stats) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
 };
 
 
@@ -455,6 +516,12 @@ public:
      */
     bool Flush();
 
+    /**
+     * Move the statistics of the backing view across the changes held here,
+     * so that they describe this view once it is flushed.
+     */
+    void UpdateStats(CTxOutSetStats& stats) const;
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
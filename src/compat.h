@@ -79,6 +79,16 @@ typedef u_int SOCKET;
 #define MSG_NOSIGNAL 0
 #endif
 
+// select() only takes descriptors below FD_SETSIZE. On Linux sockets are waited on
+// with poll() and epoll instead, which have no such limit.
+#if defined(__linux__)
+#define USE_POLL
+#include <poll.h>
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+#endif
+
 #ifndef WIN32
 // PRIO_MAX is not defined on Solaris
 #ifndef PRIO_MAX
@@ -96,7 +106,7 @@ size_t strnlen( const char *start, size_t max_len);
 
 bool static inline IsSelectableSocket(SOCKET s)
 {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -312,6 +312,23 @@ uint256 SerializeHash(const T& obj, int nType = SER_GETHASH, int nVersion = PROT
     return ss.GetHash();
 }
 
+/** SipHash-2-4, a keyed 64-bit hash */
+class CSipHasher
+{
+private:
+    uint64_t v[4];
+    uint64_t tmp;
+    int count;
+
+public:
+    /** Construct a SipHash calculator initialized with 128-bit key (k0, k1) */
+    CSipHasher(uint64_t k0, uint64_t k1);
+    /** Hash the bytes in data[0..size) */
+    CSipHasher& Write(const unsigned char* data, size_t size);
+    /** The 64-bit hash of the data written so far, the object can be written to further */
+    uint64_t Finalize() const;
+};
+
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
 void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
@@ -18,12 +18,15 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilecache.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "invalid.h"
 #include "key.h"
+#include "logging.h"
 #include "main.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
@@ -34,6 +37,7 @@
 #include "rpc/server.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "socketevents.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
@@ -43,6 +47,7 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #include "zsmncchain.h"
+#include "zkpcache.h"
 
 #ifdef ENABLE_WALLET
 #include "db.h"
@@ -142,6 +147,7 @@ volatile bool fRequestShutdown = false;
 void StartShutdown()
 {
     fRequestShutdown = true;
+    SetLogFlushEachLine();
 }
 bool ShutdownRequested()
 {
@@ -188,6 +194,7 @@ void PrepareShutdown()
 {
     fRequestShutdown = true;  // Needed when we shutdown the wallet
     fRestartRequested = true; // Needed when we restart the wallet
+    SetLogFlushEachLine();    // SIGTERM only sets fRequestShutdown
     LogPrintf("%s: In progress...\n", __func__);
     static CCriticalSection cs_Shutdown;
     TRY_LOCK(cs_Shutdown, lockShutdown);
@@ -230,6 +237,10 @@ void PrepareShutdown()
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
 
+            // lets the next start skip walking the block tree
+            if (GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEXSNAPSHOT))
+                pblocktree->WriteBlockIndexSnapshot(pcoinsTip->GetBestBlock());
+
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
         }
@@ -245,6 +256,8 @@ void PrepareShutdown()
         zerocoinDB = NULL;
         delete pSporkDB;
         pSporkDB = NULL;
+        delete pblockfilterdb;
+        pblockfilterdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -295,6 +308,7 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopAsyncLogger();
 }
 
 /**
@@ -364,9 +378,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of compact block filters, used by rescans and the getblockfilters rpc call (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-blockhashcache", strprintf(_("Memoize block header hashes instead of recomputing them on every use (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Write the block index to a flat file at shutdown to load it faster on the next start (default: %u)"), DEFAULT_BLOCKINDEXSNAPSHOT));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain the UTXO set statistics block by block so the gettxoutsetinfo rpc call returns immediately (default: %u)"), DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "smnc.conf"));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -375,9 +393,15 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbcompression", strprintf(_("Compress new database tables with Snappy when the build supports it (default: %u)"), DEFAULT_DBCOMPRESSION));
+    strUsage += HelpMessageOpt("-dbprofile=<[db:]profile>", _("Tune databases for a workload: balanced, read, write or bulk (default: balanced). "
+        "Prefix a database name (chainstate, index, zerocoin, sporks, filter) to tune only that one; bulk databases are compacted once the initial sync is done. Can be specified multiple times"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes of transactions (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-mmapblockfiles=<n>", strprintf(_("Read finished block and undo files through up to <n> memory maps, 0 to read them through stdio (default: %u)"), DEFAULT_MMAP_BLOCK_FILES));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "smncd.pid"));
@@ -385,6 +409,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the SMNC and zsmnc money supply statistics") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-reindexpubcoins", _("Index the zerocoin mints of blocks connected before the pubcoin index existed") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
@@ -408,6 +433,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), 125));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Number of threads processing peer messages, each serving a fixed share of the peers (1 to %d, default: %d)"), MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
@@ -416,6 +442,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for network sockets with <mode>: epoll (Linux only) or select. select limits the number of connections (default: %s)"), DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -443,6 +470,7 @@ std::string HelpMessage(HelpMessageMode mode)
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in SMNC/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading blocks during a rescan (0 = one per core, up to %d, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -496,12 +524,20 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), 1));
 #endif
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-logbufferlines=<n>", strprintf(_("Keep the last <n> lines of each debug category in memory for the getlogbuffer RPC (default: %u)"), DEFAULT_LOG_BUFFER_LINES));
+    strUsage += HelpMessageOpt("-logflushinterval=<n>", strprintf(_("Write debug output from a background thread at least every <n> milliseconds, 0 to write each line as it is logged (default: %u)"), DEFAULT_LOG_FLUSH_INTERVAL));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-logqueuesize=<n>", strprintf(_("Maximum number of debug output lines waiting for the background thread, further lines are dropped (default: %u)"), DEFAULT_LOG_QUEUE_SIZE));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), 1));
     if (GetBoolArg("-help-debug", false)) {
+        strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
+        strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-zkpcachesize=<n>", strprintf(_("Limit size of the verified zerocoin spend cache to <n> entries (default: %u)"), DEFAULT_ZKP_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in SMNC/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0));
@@ -521,6 +557,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), 1));
     strUsage += HelpMessageOpt("-SMNCstake=<n>", strprintf(_("Enable or disable staking functionality for SMNC inputs (0-1, default: %u)"), 1));
     strUsage += HelpMessageOpt("-reservebalance=<amt>", _("Keep the specified amount available for spending at all times (default: 0)"));
+    strUsage += HelpMessageOpt("-stakethreads=<n>", strprintf(_("Number of threads searching stake kernels, at most one per core (0 = auto, default: %d)"), 0));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-printstakemodifier", _("Display the stake modifier calculations in the debug.log file."));
         strUsage += HelpMessageOpt("-printcoinstake", _("Display verbose coin stake messages in the debug.log file."));
@@ -682,6 +719,21 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     }
 }
 
+/** Compact the -dbprofile=bulk databases once, after the initial sync that deferred their merging */
+void ThreadCompactBulkLevelDB()
+{
+    RenameThread("smnc-dbcompact");
+
+    while (IsInitialBlockDownload()) {
+        boost::this_thread::interruption_point();
+        MilliSleep(10000);
+    }
+    ForEachLevelDB("", [](CLevelDBWrapper& db) {
+        if (db.GetProfile() == DB_PROFILE_BULK)
+            db.CompactFull();
+    });
+}
+
 /** Sanity checks
  *  Ensure that SupportMasterNodeCommunity is running in a usable environment with all
  *  necessary library support.
@@ -850,11 +902,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return false;
         }
     }
+    nStakeSearchThreads = std::max(0, (int)GetArg("-stakethreads", 0));
+
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!InitSocketEvents(strSocketEvents))
+        return InitError(strprintf(_("Unknown or unavailable mode specified in -socketevents: '%s'"), strSocketEvents));
 
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (strSocketEvents == "select")
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -889,6 +948,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
+    fBlockHashCache = GetBoolArg("-blockhashcache", false);
+    blockFileCache.SetMaxFiles(std::max(GetArg("-mmapblockfiles", DEFAULT_MMAP_BLOCK_FILES), (int64_t)0));
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -975,6 +1036,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nMaxDatacarrierBytes = GetArg("-datacarriersize", nMaxDatacarrierBytes);
 
     fAlerts = GetBoolArg("-alerts", DEFAULT_ALERTS);
+    fCoinStatsIndex = GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
+
+    BOOST_FOREACH (const std::string& strProfile, mapMultiArgs["-dbprofile"]) {
+        if (!CheckDBProfileArg(strProfile))
+            return InitError(strprintf(_("Invalid -dbprofile value: '%s'"), strProfile));
+    }
 
 
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
@@ -1011,6 +1078,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 #endif
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    if (fPrintToDebugLog && !fPrintToConsole)
+        StartAsyncLogger(GetArg("-logflushinterval", DEFAULT_LOG_FLUSH_INTERVAL),
+            std::max(GetArg("-logqueuesize", DEFAULT_LOG_QUEUE_SIZE), (int64_t)1),
+            std::max(GetArg("-logbufferlines", DEFAULT_LOG_BUFFER_LINES), (int64_t)0));
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("SupportMasterNodeCommunity version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
@@ -1025,12 +1096,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and zerocoin spend verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // Shared by the stake kernel search and the masternode score tables
+    nParallelThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+    LogPrintf("Using %u threads for parallel work\n", nParallelThreads);
+    for (int i = 0; i < nParallelThreads - 1; i++)
+        threadGroup.create_thread(&ThreadParallelWork);
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1370,6 +1447,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    size_t nBlockFilterDBCache = 0;
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        nBlockFilterDBCache = std::min(nTotalCache / 8, (size_t)(1 << 23)); // filters are read once per rescan
+        nTotalCache -= nBlockFilterDBCache;
+    }
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
@@ -1391,10 +1473,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pblocktree;
                 delete zerocoinDB;
                 delete pSporkDB;
+                delete pblockfilterdb;
 
                 //SupportMasterNodeCommunity specific: zerocoin and spork DB's
                 zerocoinDB = new CZerocoinDB(0, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
+                pblockfilterdb = GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) ? new CBlockFilterDB(nBlockFilterDBCache, false, fReindex) : NULL;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
@@ -1448,6 +1532,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     RecalculateSMNCSupply(1);
                 }
 
+                // One-time backfill of the per-block pubcoin index used by the accumulator code
+                if (GetBoolArg("-reindexpubcoins", false)) {
+                    if (chainActive.Height() > Params().Zerocoin_StartHeight()) {
+                        uiInterface.InitMessage(_("Indexing zerocoin pubcoins..."));
+                        string strError = BackfillPubcoinIndex();
+                        if (!strError.empty())
+                            return InitError(strError);
+                    }
+                }
+
                 // Force recalculation of accumulators.
                 if (GetBoolArg("-reindexaccumulators", false)) {
                     if (chainActive.Height() > Params().Zerocoin_Block_V2_Start()) {
@@ -1481,6 +1575,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     fVerifyingBlocks = false;
                     break;
                 }
+
+                if (fCoinStatsIndex) {
+                    uiInterface.InitMessage(_("Loading coin statistics..."));
+                    if (!LoadCoinStatsIndex(pcoinsdbview)) {
+                        strLoadError = _("Error loading coin statistics");
+                        fVerifyingBlocks = false;
+                        break;
+                    }
+                }
             } catch (std::exception& e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1520,6 +1623,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // Keep cached zerocoin witnesses up to date as blocks connect, folding them off the validation thread
+    if (!witnessCache.Load())
+        LogPrintf("Failed to load the accumulator witness cache, witnesses will be rebuilt\n");
+    RegisterValidationInterface(&witnessCache);
+    scheduler.scheduleEvery(boost::bind(&CAccumulatorWitnessCache::Fold, &witnessCache), WITNESS_FOLD_INTERVAL);
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1875,6 +1984,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     StartNode(threadGroup, scheduler);
 
+    if (pblockfilterdb)
+        threadGroup.create_thread(&ThreadBlockFilterIndex);
+
+    int nBulkDBs = 0;
+    ForEachLevelDB("", [&nBulkDBs](CLevelDBWrapper& db) {
+        if (db.GetProfile() == DB_PROFILE_BULK)
+            nBulkDBs++;
+    });
+    if (nBulkDBs > 0)
+        threadGroup.create_thread(&ThreadCompactBulkLevelDB);
+
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     if (pwalletMain)
@@ -7,7 +7,11 @@
 
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
+#include <atomic>
+
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -18,6 +22,7 @@
 
 using namespace std;
 
+int nStakeSearchThreads = 0;
 bool fTestNet = false; //Params().NetworkID() == CBaseChainParams::TESTNET;
 
 // Modifier interval: time to elapse before new modifier is computed
@@ -317,7 +322,7 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
     bool fSuccess = false;
     unsigned int nTryTime = 0;
     int nHeightStart = chainActive.Height();
-    int nHashDrift = 30;
+    int nHashDrift = STAKE_HASH_DRIFT;
     CDataStream ssUniqueID = stakeInput->GetUniqueness();
     CAmount nValueIn = stakeInput->GetValue();
     for (int i = 0; i < nHashDrift; i++) //iterate the hashing
@@ -344,6 +349,145 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
     return fSuccess;
 }
 
+bool CStakeKernel::Init(CStakeInput* stakeInputIn, unsigned int nTimeBlockFromIn)
+{
+    uint64_t nStakeModifier = 0;
+    if (!stakeInputIn->GetModifier(nStakeModifier))
+        return error("failed to get kernel stake modifier");
+
+    stakeInput = stakeInputIn;
+    nTimeBlockFrom = nTimeBlockFromIn;
+    nValueIn = stakeInput->GetValue();
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << stakeInput->GetUniqueness();
+    hasherPrefix.Reset();
+    hasherPrefix.Write((const unsigned char*)&ss[0], ss.size());
+    return true;
+}
+
+uint256 CStakeKernel::GetHashProofOfStake(unsigned int nTimeTx) const
+{
+    // Same bytes as CheckStake(): the prefix followed by the serialized nTimeTx
+    unsigned char vchTime[4];
+    WriteLE32(vchTime, nTimeTx);
+
+    uint256 hashProofOfStake;
+    CHash256 hasher(hasherPrefix);
+    hasher.Write(vchTime, sizeof(vchTime)).Finalize((unsigned char*)&hashProofOfStake);
+    return hashProofOfStake;
+}
+
+static CCriticalSection cs_stakeSearchStats;
+static CStakeSearchStats stakeSearchStats;
+
+CStakeSearchStats GetStakeSearchStats()
+{
+    LOCK(cs_stakeSearchStats);
+    return stakeSearchStats;
+}
+
+namespace
+{
+/** State shared by the workers of one SearchStakeKernels() pass */
+struct CStakeSearch {
+    const std::vector<CStakeKernel>& vKernels;
+    uint256 bnTargetPerCoinDay;
+    unsigned int nTimeTx;
+    int nHeightStart;
+
+    std::atomic<size_t> nNext;
+    std::atomic<size_t> nBest;
+    std::atomic<uint64_t> nHashes;
+    std::atomic<bool> fCancelled;
+    boost::mutex mutexResult;
+    unsigned int nTimeFound;
+    uint256 hashProofOfStake;
+
+    CStakeSearch(const std::vector<CStakeKernel>& vKernelsIn, size_t nStart) : vKernels(vKernelsIn), nNext(nStart),
+        nBest(vKernelsIn.size()), nHashes(0), fCancelled(false), nTimeFound(0) {}
+
+    void Run()
+    {
+        static const size_t nBatchSize = 16;
+        uint64_t nHashesDone = 0;
+        while (!fCancelled) {
+            // Inputs before the best hit found so far must still be searched, the rest may be skipped
+            size_t nBegin = nNext.fetch_add(nBatchSize);
+            if (nBegin >= nBest)
+                break;
+            {
+                // Poll the tip without waiting for cs_main; a block being connected is seen on the next batch
+                TRY_LOCK(cs_main, lockMain);
+                if (lockMain && chainActive.Height() != nHeightStart) {
+                    fCancelled = true;
+                    break;
+                }
+            }
+            size_t nEnd = std::min(nBegin + nBatchSize, vKernels.size());
+            for (size_t i = nBegin; i < nEnd && i < nBest; i++) {
+                const CStakeKernel& kernel = vKernels[i];
+                for (int j = 0; j < STAKE_HASH_DRIFT; j++) {
+                    unsigned int nTryTime = nTimeTx + STAKE_HASH_DRIFT - j;
+                    uint256 hash = kernel.GetHashProofOfStake(nTryTime);
+                    nHashesDone++;
+                    if (!stakeTargetHit(hash, kernel.nValueIn, bnTargetPerCoinDay))
+                        continue;
+
+                    boost::lock_guard<boost::mutex> lock(mutexResult);
+                    if (i < nBest) {
+                        nBest = i;
+                        nTimeFound = nTryTime;
+                        hashProofOfStake = hash;
+                    }
+                    break;
+                }
+            }
+        }
+        nHashes += nHashesDone;
+    }
+};
+} // namespace
+
+bool SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, size_t nStart, unsigned int nBits, unsigned int nTimeTx, int nHeight,
+                        size_t& nFound, unsigned int& nTimeFound, uint256& hashProofOfStake)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    CStakeSearch search(vKernels, nStart);
+    search.bnTargetPerCoinDay.SetCompact(nBits);
+    search.nTimeTx = nTimeTx;
+    search.nHeightStart = nHeight;
+
+    // Only fan out when there is enough work to make up for handing it to the workers
+    int nThreads = nStakeSearchThreads > 0 ? nStakeSearchThreads : nParallelThreads;
+    nThreads = std::max(1, std::min(nThreads, (int)((vKernels.size() - std::min(nStart, vKernels.size())) / 64)));
+    RunParallel(nThreads, [&search](uint32_t) {
+        search.Run();
+        return true;
+    });
+
+    {
+        LOCK(cs_stakeSearchStats);
+        stakeSearchStats.nTime = nTimeStart / 1000000;
+        stakeSearchStats.nDurationMicros = GetTimeMicros() - nTimeStart;
+        stakeSearchStats.nKernels = vKernels.size() - std::min(nStart, vKernels.size());
+        stakeSearchStats.nHashes = search.nHashes;
+        stakeSearchStats.nThreads = nThreads;
+    }
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+
+    if (search.fCancelled || search.nBest >= vKernels.size())
+        return false;
+
+    nFound = search.nBest;
+    nTimeFound = search.nTimeFound;
+    hashProofOfStake = search.hashProofOfStake;
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake)
 {
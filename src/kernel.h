@@ -7,6 +7,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 #include "stakeinput.h"
 
@@ -29,6 +30,48 @@ bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
 bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake);
 
+// Number of timestamps tried per stake input by Stake() and SearchStakeKernels()
+static const int STAKE_HASH_DRIFT = 30;
+// Number of threads used by SearchStakeKernels() (-stakethreads, 0 = auto)
+extern int nStakeSearchThreads;
+
+/** A stake input prepared for kernel search. The modifier, block time and
+ *  uniqueness stream are serialized and hashed once; each tried timestamp
+ *  only finishes a copy of that hasher. */
+class CStakeKernel
+{
+public:
+    CStakeInput* stakeInput;
+    unsigned int nTimeBlockFrom;
+    CAmount nValueIn;
+    CHash256 hasherPrefix;
+
+    CStakeKernel() : stakeInput(NULL), nTimeBlockFrom(0), nValueIn(0) {}
+
+    bool Init(CStakeInput* stakeInputIn, unsigned int nTimeBlockFromIn);
+    uint256 GetHashProofOfStake(unsigned int nTimeTx) const;
+};
+
+/** Timings of the last SearchStakeKernels() pass, reported by getstakingstatus */
+struct CStakeSearchStats {
+    int64_t nTime;           // time the pass started
+    int64_t nDurationMicros; // wall clock time spent in the pass
+    uint64_t nKernels;       // stake inputs searched
+    uint64_t nHashes;        // kernel hashes computed
+    int nThreads;            // workers used
+
+    CStakeSearchStats() : nTime(0), nDurationMicros(0), nKernels(0), nHashes(0), nThreads(0) {}
+};
+CStakeSearchStats GetStakeSearchStats();
+
+// Search vKernels from nStart for the first input whose kernel hash meets the
+// target, trying the same timestamps in the same order as Stake(). Returns the
+// index of that input in nFound. nHeight is the chain height the kernels were
+// prepared at, read under cs_main; the search is abandoned when the tip moves on.
+// Runs on the RunParallel() workers.
+bool SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, size_t nStart, unsigned int nBits, unsigned int nTimeTx, int nHeight,
+                        size_t& nFound, unsigned int& nTimeFound, uint256& hashProofOfStake);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake);
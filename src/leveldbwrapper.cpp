@@ -6,7 +6,12 @@
 
 #include "util.h"
 
+#include <algorithm>
+
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +32,94 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+bool ParseDBProfile(const std::string& str, DBProfile& profile)
+{
+    if (str == "balanced")
+        profile = DB_PROFILE_BALANCED;
+    else if (str == "read")
+        profile = DB_PROFILE_READ;
+    else if (str == "write")
+        profile = DB_PROFILE_WRITE;
+    else if (str == "bulk")
+        profile = DB_PROFILE_BULK;
+    else
+        return false;
+    return true;
+}
+
+const char* GetDBProfileName(DBProfile profile)
+{
+    switch (profile) {
+    case DB_PROFILE_BALANCED:
+        return "balanced";
+    case DB_PROFILE_READ:
+        return "read";
+    case DB_PROFILE_WRITE:
+        return "write";
+    case DB_PROFILE_BULK:
+        return "bulk";
+    }
+    return "unknown";
+}
+
+bool CheckDBProfileArg(const std::string& strArg)
+{
+    DBProfile profile;
+    size_t nColon = strArg.find(':');
+    if (nColon == 0)
+        return false;
+    return ParseDBProfile(nColon == std::string::npos ? strArg : strArg.substr(nColon + 1), profile);
+}
+
+/** The profile for a database: its own -dbprofile=<db>:<profile>, else a plain -dbprofile=<profile> */
+static DBProfile GetDBProfileArg(const std::string& strName)
+{
+    DBProfile profile = DB_PROFILE_BALANCED;
+    DBProfile profileAll = DB_PROFILE_BALANCED;
+    bool fOwn = false;
+    BOOST_FOREACH (const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        size_t nColon = strArg.find(':');
+        if (nColon == std::string::npos)
+            ParseDBProfile(strArg, profileAll);
+        else if (strArg.substr(0, nColon) == strName && ParseDBProfile(strArg.substr(nColon + 1), profile))
+            fOwn = true;
+    }
+    return fOwn ? profile : profileAll;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, DBProfile profile, size_t& nBlockCacheSize)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    switch (profile) {
+    case DB_PROFILE_READ:
+        nBlockCacheSize = nCacheSize * 3 / 4;
+        options.write_buffer_size = nCacheSize / 8;
+        break;
+    case DB_PROFILE_WRITE:
+    case DB_PROFILE_BULK:
+        nBlockCacheSize = nCacheSize / 4;
+        options.write_buffer_size = nCacheSize * 3 / 8; // up to two write buffers may be held in memory simultaneously
+        // Larger tables mean fewer of them to merge per compaction
+        options.max_file_size = profile == DB_PROFILE_BULK ? 32 << 20 : 8 << 20;
+        break;
+    case DB_PROFILE_BALANCED:
+        nBlockCacheSize = nCacheSize / 2;
+        options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+        break;
+    }
+    options.block_cache = leveldb::NewLRUCache(nBlockCacheSize);
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // Blocks that do not shrink by at least 12.5% are stored raw, and builds
+    // without Snappy store everything raw; tables of either kind can be read.
+    options.compression = GetBoolArg("-dbcompression", DEFAULT_DBCOMPRESSION) ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+#ifndef WIN32
+    // LevelDB maps up to 1000 tables on 64-bit hosts and closes their
+    // descriptors, past that it keeps at most a fifth of the descriptor limit
+    // open, so its default of 1000 tables does not starve connections.
+    // 32-bit hosts keep tables open as files.
+    if (sizeof(void*) < 8)
+        options.max_open_files = 64;
+#endif
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +128,37 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
+namespace
+{
+boost::mutex csLevelDBs;
+std::vector<CLevelDBWrapper*> vLevelDBs;
+} // anonymous namespace
+
+int ForEachLevelDB(const std::string& strName, const std::function<void(CLevelDBWrapper&)>& fn)
+{
+    boost::lock_guard<boost::mutex> lock(csLevelDBs);
+    int nVisited = 0;
+    BOOST_FOREACH (CLevelDBWrapper* pdb, vLevelDBs) {
+        if (strName.empty() || pdb->GetName() == strName) {
+            fn(*pdb);
+            nVisited++;
+        }
+    }
+    return nVisited;
+}
+
 CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
 {
     penv = NULL;
-    readoptions.verify_checksums = true;
-    iteroptions.verify_checksums = true;
+    strName = path.filename().string();
+    profile = GetDBProfileArg(strName);
+    // Unverified reads still fail on corruption in the parts of a block they use
+    bool fVerify = profile == DB_PROFILE_BALANCED || profile == DB_PROFILE_WRITE;
+    readoptions.verify_checksums = fVerify;
+    iteroptions.verify_checksums = fVerify;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile, nBlockCacheSize);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -61,15 +169,22 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
             leveldb::DestroyDB(path.string(), options);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (profile %s)\n", path.string(), GetDBProfileName(profile));
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+
+    boost::lock_guard<boost::mutex> lock(csLevelDBs);
+    vLevelDBs.push_back(this);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    {
+        boost::lock_guard<boost::mutex> lock(csLevelDBs);
+        vLevelDBs.erase(std::remove(vLevelDBs.begin(), vLevelDBs.end(), this), vLevelDBs.end());
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -80,6 +195,29 @@ CLevelDBWrapper::~CLevelDBWrapper()
     options.env = NULL;
 }
 
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CLevelDBWrapper::GetApproximateSize() const
+{
+    // All keys start with a type byte below 0xff
+    const char chEnd[2] = {'\xff', '\xff'};
+    leveldb::Range range(leveldb::Slice(), leveldb::Slice(chEnd, sizeof(chEnd)));
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CLevelDBWrapper::CompactFull()
+{
+    int64_t nStart = GetTimeMillis();
+    uint64_t nSizeBefore = GetApproximateSize();
+    pdb->CompactRange(NULL, NULL);
+    LogPrintf("Compacted LevelDB %s from %u to %u bytes in %dms\n", strName, nSizeBefore, GetApproximateSize(), GetTimeMillis() - nStart);
+}
+
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
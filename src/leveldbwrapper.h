@@ -11,6 +11,9 @@
 #include "util.h"
 #include "version.h"
 
+#include <functional>
+#include <string>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -24,6 +27,23 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+/** LevelDB tuning, selected per database with -dbprofile */
+enum DBProfile {
+    DB_PROFILE_BALANCED, //!< half the cache for table blocks, a quarter for the write buffer
+    DB_PROFILE_READ,     //!< most of the cache for table blocks, reads not verified
+    DB_PROFILE_WRITE,    //!< large write buffers and table files, fewer compactions
+    DB_PROFILE_BULK,     //!< initial sync: as write with larger tables, reads not verified, compacted once synced
+};
+
+//! -dbcompression default
+static const bool DEFAULT_DBCOMPRESSION = true;
+
+bool ParseDBProfile(const std::string& str, DBProfile& profile);
+const char* GetDBProfileName(DBProfile profile);
+
+//! Check a -dbprofile value, [<db>:]<profile>
+bool CheckDBProfileArg(const std::string& strArg);
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -85,12 +105,49 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! name of the database directory, selects its -dbprofile
+    std::string strName;
+
+    //! tuning the database was opened with
+    DBProfile profile;
+    size_t nBlockCacheSize;
+
 public:
     CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    const std::string& GetName() const { return strName; }
+    DBProfile GetProfile() const { return profile; }
+    size_t GetWriteBufferSize() const { return options.write_buffer_size; }
+    size_t GetBlockCacheSize() const { return nBlockCacheSize; }
+
+    //! One of LevelDB's internal properties, such as leveldb.stats
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    //! Approximate size of all tables on disk
+    uint64_t GetApproximateSize() const;
+
+    //! Compact the whole key space, blocking until done
+    void CompactFull();
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
+    {
+        return Read(key, value, readoptions);
+    }
+
+    //! Read as of a snapshot taken with GetSnapshot()
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot) const
+    {
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
+        return Read(key, value, options);
+    }
+
+private:
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const leveldb::ReadOptions& options) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
@@ -98,7 +155,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -114,6 +171,7 @@ public:
         return true;
     }
 
+public:
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -168,6 +226,32 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Iterate over the database as of a snapshot taken with GetSnapshot()
+    leveldb::Iterator* NewIterator(const leveldb::Snapshot* snapshot) const
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return pdb->NewIterator(options);
+    }
+
+    //! Consistent read-only view of the database, to be released with ReleaseSnapshot()
+    const leveldb::Snapshot* GetSnapshot() const
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot) const
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
 };
 
+/**
+ * Call fn on every open database, or only on the one named strName when it
+ * is not empty. Databases are not closed while being visited. Returns the
+ * number of databases visited.
+ */
+int ForEachLevelDB(const std::string& strName, const std::function<void(CLevelDBWrapper&)>& fn);
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
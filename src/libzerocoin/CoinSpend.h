@@ -116,7 +116,8 @@ public:
     SpendType getSpendType() const { return spendType; }
     std::vector<unsigned char> getSignature() const { return vchSig; }
 
-    bool Verify(const Accumulator& a) const;
+    /** @param runRounds evaluates the rounds of the serial number proof, see SerialNumberSignatureOfKnowledge::Verify() */
+    bool Verify(const Accumulator& a, const RoundRunner& runRounds = RoundRunner()) const;
     bool HasValidSerial(ZerocoinParams* params) const;
     bool HasValidSignature() const;
     CBigNum CalculateValidSerial(ZerocoinParams* params);
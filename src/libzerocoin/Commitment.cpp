@@ -21,14 +21,14 @@ namespace libzerocoin {
 Commitment::Commitment(const IntegerGroupParams* p,
                                    const CBigNum& value): params(p), contents(value) {
 	this->randomness = CBigNum::randBignum(params->groupOrder);
-	this->commitmentValue = (params->g.pow_mod(this->contents, params->modulus).mul_mod(
-	                         params->h.pow_mod(this->randomness, params->modulus), params->modulus));
+	this->commitmentValue = (params->powG(this->contents).mul_mod(
+	                         params->powH(this->randomness), params->modulus));
 }
 
 Commitment::Commitment(const IntegerGroupParams* p, const CBigNum& bnSerial, const CBigNum& bnRandomness): params(p), contents(bnSerial) {
     this->randomness = bnRandomness;
-    this->commitmentValue = (params->g.pow_mod(this->contents, params->modulus).mul_mod(
-        params->h.pow_mod(this->randomness, params->modulus), params->modulus));
+    this->commitmentValue = (params->powG(this->contents).mul_mod(
+        params->powH(this->randomness), params->modulus));
 }
 
 const CBigNum& Commitment::getCommitmentValue() const {
@@ -79,8 +79,8 @@ CommitmentProofOfKnowledge::CommitmentProofOfKnowledge(const IntegerGroupParams*
 	// T2 = g2^r1 * h2^r3 mod p2
 	//
 	// Where (g1, h1, p1) are from "aParams" and (g2, h2, p2) are from "bParams".
-	CBigNum T1 = this->ap->g.pow_mod(r1, this->ap->modulus).mul_mod((this->ap->h.pow_mod(r2, this->ap->modulus)), this->ap->modulus);
-	CBigNum T2 = this->bp->g.pow_mod(r1, this->bp->modulus).mul_mod((this->bp->h.pow_mod(r3, this->bp->modulus)), this->bp->modulus);
+	CBigNum T1 = this->ap->powG(r1).mul_mod(this->ap->powH(r2), this->ap->modulus);
+	CBigNum T2 = this->bp->powG(r1).mul_mod(this->bp->powH(r3), this->bp->modulus);
 
 	// Now hash commitment "A" with commitment "B" as well as the
 	// parameters and the two ephemeral commitments "T1, T2" we just generated
@@ -126,12 +126,12 @@ bool CommitmentProofOfKnowledge::Verify(const CBigNum& A, const CBigNum& B) cons
 
 	// Compute T1 = g1^S1 * h1^S2 * inverse(A^{challenge}) mod p1
 	CBigNum T1 = A.pow_mod(this->challenge, ap->modulus).inverse(ap->modulus).mul_mod(
-	                (ap->g.pow_mod(S1, ap->modulus).mul_mod(ap->h.pow_mod(S2, ap->modulus), ap->modulus)),
+	                (ap->powG(S1).mul_mod(ap->powH(S2), ap->modulus)),
 	                ap->modulus);
 
 	// Compute T2 = g2^S1 * h2^S3 * inverse(B^{challenge}) mod p2
 	CBigNum T2 = B.pow_mod(this->challenge, bp->modulus).inverse(bp->modulus).mul_mod(
-	                (bp->g.pow_mod(S1, bp->modulus).mul_mod(bp->h.pow_mod(S3, bp->modulus), bp->modulus)),
+	                (bp->powG(S1).mul_mod(bp->powH(S3), bp->modulus)),
 	                bp->modulus);
 
 	// Hash T1 and T2 along with all of the public parameters
@@ -15,8 +15,107 @@
 #include "Params.h"
 #include "ParamGeneration.h"
 
+#include <algorithm>
+#include <mutex>
+
 namespace libzerocoin {
 
+// Tables grow in steps of this many exponent bits
+static const unsigned int FIXED_BASE_TABLE_STEP_BITS = 256;
+// Honest exponents stay below twice the modulus size (plus challenge and
+// statistical margins); larger ones are attacker-chosen and are not worth
+// the memory, so they go through pow_mod.
+static const unsigned int FIXED_BASE_TABLE_MARGIN_BITS = 512;
+
+static std::mutex cs_fixedBaseTables;
+
+std::atomic<bool> IntegerGroupParams::fUseFixedBaseTables(true);
+
+FixedBaseTable::FixedBaseTable(const CBigNum& base, const CBigNum& modulus, unsigned int nMaxBits) :
+	base(base), modulus(modulus), nMaxBits(nMaxBits)
+{
+	mont = BN_MONT_CTX_new();
+	if (!mont)
+		throw bignum_error("FixedBaseTable : BN_MONT_CTX_new failed");
+	try {
+		modulus.mont_init(mont);
+	} catch (...) {
+		BN_MONT_CTX_free(mont);
+		throw;
+	}
+
+	const unsigned int nDigits = 1 << WINDOW_BITS;
+	const unsigned int nWindows = (nMaxBits + WINDOW_BITS - 1) / WINDOW_BITS;
+	vTable.reserve(nWindows * (nDigits - 1));
+
+	// x walks through base^(2^(w*i)); row i holds x^1 .. x^(2^w - 1)
+	// Reduce into [0, modulus) the way BN_mod_exp does for negative bases
+	CBigNum bnBase = base % modulus;
+	if (bnBase < 0)
+		bnBase += modulus;
+
+	CAutoBN_CTX pctx;
+	CBigNum x = bnBase.to_mont(mont, pctx);
+	for (unsigned int i = 0; i < nWindows; i++) {
+		CBigNum acc = x;
+		vTable.push_back(acc);
+		for (unsigned int j = 2; j < nDigits; j++) {
+			acc.mul_mont(x, mont, pctx);
+			vTable.push_back(acc);
+		}
+		// x^(2^w) = x^(2^w - 1) * x
+		acc.mul_mont(x, mont, pctx);
+		x = acc;
+	}
+}
+
+FixedBaseTable::~FixedBaseTable()
+{
+	BN_MONT_CTX_free(mont);
+}
+
+bool FixedBaseTable::Covers(const CBigNum& base, const CBigNum& modulus, unsigned int nBits) const
+{
+	return nBits <= nMaxBits && this->base == base && this->modulus == modulus;
+}
+
+CBigNum FixedBaseTable::pow_mod(const CBigNum& e) const
+{
+	if (e < 0 || (unsigned int)e.bitSize() > nMaxBits)
+		throw std::range_error("FixedBaseTable::pow_mod : exponent out of range");
+
+	const unsigned int nRow = (1 << WINDOW_BITS) - 1;
+	const int nBits = e.bitSize();
+
+	CAutoBN_CTX pctx;
+	CBigNum acc;
+	bool fFirst = true;
+	for (int nWindow = 0; nWindow * (int)WINDOW_BITS < nBits; nWindow++) {
+		unsigned int nDigit = 0;
+		for (int k = WINDOW_BITS - 1; k >= 0; k--)
+			nDigit = (nDigit << 1) | (e.isBitSet(nWindow * WINDOW_BITS + k) ? 1 : 0);
+		if (!nDigit)
+			continue;
+		const CBigNum& entry = vTable[nWindow * nRow + nDigit - 1];
+		if (fFirst) {
+			acc = entry;
+			fFirst = false;
+		} else {
+			acc.mul_mont(entry, mont, pctx);
+		}
+	}
+
+	// Same result as BN_mod_exp for a zero exponent
+	if (fFirst)
+		return CBigNum(1) % modulus;
+	return acc.from_mont(mont, pctx);
+}
+
+size_t FixedBaseTable::DynamicMemoryUsage() const
+{
+	return vTable.size() * ((modulus.bitSize() + 7) / 8);
+}
+
 ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	this->zkp_hash_len = securityLevel;
 	this->zkp_iterations = securityLevel;
@@ -43,7 +142,46 @@ CBigNum IntegerGroupParams::randomElement() const {
 	// The generator of the group raised
 	// to a random number less than the order of the group
 	// provides us with a uniformly distributed random number.
-	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
+	return powG(CBigNum::randBignum(this->groupOrder));
+}
+
+CBigNum IntegerGroupParams::powG(const CBigNum& e, const CBigNum& m) const {
+	return powFixedBase(g, tableG, e, m);
+}
+
+CBigNum IntegerGroupParams::powH(const CBigNum& e, const CBigNum& m) const {
+	return powFixedBase(h, tableH, e, m);
+}
+
+CBigNum IntegerGroupParams::powFixedBase(const CBigNum& base, std::shared_ptr<const FixedBaseTable>& table,
+	const CBigNum& e, const CBigNum& m) const {
+	CBigNum bnAbs = e < 0 ? CBigNum(0) - e : e;
+	const unsigned int nBits = bnAbs.bitSize();
+	const unsigned int nCap = 2 * m.bitSize() + FIXED_BASE_TABLE_MARGIN_BITS;
+
+	// Montgomery form needs an odd modulus
+	if (!fUseFixedBaseTables || nBits > nCap || !m.isOdd())
+		return base.pow_mod(e, m);
+
+	std::shared_ptr<const FixedBaseTable> ptable = std::atomic_load(&table);
+	if (!ptable || !ptable->Covers(base, m, nBits)) {
+		std::lock_guard<std::mutex> lock(cs_fixedBaseTables);
+		ptable = std::atomic_load(&table);
+		if (!ptable || !ptable->Covers(base, m, nBits)) {
+			unsigned int nTableBits = nBits;
+			if (ptable && ptable->Covers(base, m, 0))
+				nTableBits = std::max(nTableBits, ptable->MaxBits());
+			nTableBits = (nTableBits / FIXED_BASE_TABLE_STEP_BITS + 1) * FIXED_BASE_TABLE_STEP_BITS;
+			ptable = std::make_shared<const FixedBaseTable>(base, m, std::min(nTableBits, nCap));
+			std::atomic_store(&table, ptable);
+		}
+	}
+
+	// g^-x = (g^x)^-1, which is the same element pow_mod returns as (g^-1)^x
+	CBigNum ret = ptable->pow_mod(bnAbs);
+	if (e < 0)
+		return ret.inverse(m);
+	return ret;
 }
 
 } /* namespace libzerocoin */
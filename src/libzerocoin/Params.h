@@ -18,8 +18,45 @@
 #include "bignum.h"
 #include "ZerocoinDefines.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 namespace libzerocoin {
 
+/**
+ * Fixed-base exponentiation table for one group generator.
+ * Holds base^(j * 2^(w*i)) in Montgomery form for every w-bit window
+ * position i and digit j, so base^e costs one Montgomery multiplication
+ * per non-zero window of e instead of a full square-and-multiply.
+ */
+class FixedBaseTable {
+public:
+	static const unsigned int WINDOW_BITS = 4;
+
+	FixedBaseTable(const CBigNum& base, const CBigNum& modulus, unsigned int nMaxBits);
+	~FixedBaseTable();
+
+	/** True if this table was built for base/modulus and holds exponents of nBits */
+	bool Covers(const CBigNum& base, const CBigNum& modulus, unsigned int nBits) const;
+
+	/** base^e mod modulus for 0 <= e < 2^MaxBits() */
+	CBigNum pow_mod(const CBigNum& e) const;
+
+	unsigned int MaxBits() const { return nMaxBits; }
+	size_t DynamicMemoryUsage() const;
+
+private:
+	FixedBaseTable(const FixedBaseTable&);
+	FixedBaseTable& operator=(const FixedBaseTable&);
+
+	CBigNum base;
+	CBigNum modulus;
+	unsigned int nMaxBits;
+	BN_MONT_CTX* mont;
+	std::vector<CBigNum> vTable; // (2^w - 1) entries per window
+};
+
 class IntegerGroupParams {
 public:
 	/** @brief Integer group class, default constructor
@@ -57,6 +94,21 @@ public:
 	 */
 	CBigNum groupOrder;
 
+	/**
+	 * g^e and h^e mod modulus through fixed-base tables that are built
+	 * on first use. Exponents beyond the table cap fall back to pow_mod.
+	 * Negative exponents give the same result as CBigNum::pow_mod.
+	 * @param m the modulus, for groups that live mod a modulus held elsewhere
+	 * (the QRN group is used mod accumulatorModulus)
+	 */
+	CBigNum powG(const CBigNum& e) const { return powG(e, modulus); }
+	CBigNum powH(const CBigNum& e) const { return powH(e, modulus); }
+	CBigNum powG(const CBigNum& e, const CBigNum& m) const;
+	CBigNum powH(const CBigNum& e, const CBigNum& m) const;
+
+	/** Switch for benchmarks comparing against plain pow_mod */
+	static std::atomic<bool> fUseFixedBaseTables;
+
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 		    READWRITE(initialized);
@@ -65,6 +117,13 @@ public:
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
 	}	
+
+private:
+	CBigNum powFixedBase(const CBigNum& base, std::shared_ptr<const FixedBaseTable>& table, const CBigNum& e, const CBigNum& m) const;
+
+	// Not serialized, rebuilt lazily (and shared between copies of the params)
+	mutable std::shared_ptr<const FixedBaseTable> tableG;
+	mutable std::shared_ptr<const FixedBaseTable> tableH;
 };
 
 class AccumulatorAndProofParams {
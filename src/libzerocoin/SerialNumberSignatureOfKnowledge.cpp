@@ -15,6 +15,9 @@
 #include <streams.h>
 #include "SerialNumberSignatureOfKnowledge.h"
 
+#include <functional>
+#include <memory>
+
 namespace libzerocoin {
 
 SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const ZerocoinParams* p): params(p) { }
@@ -49,11 +52,6 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 		throw std::runtime_error("Groups are not structured correctly.");
 	}
 
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
 	CHashWriter hasher(0,0);
 	hasher << *params << commitmentToCoin.getCommitmentValue() << coin.getSerialNumber() << msghash;
 
@@ -104,7 +102,7 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 		} else {
 			s_notprime[i]       = r[i] - coin.getRandomness();
 			sprime[i]           = v_expanded[i] - (commitmentToCoin.getRandomness() *
-			                              b.pow_mod(r[i] - coin.getRandomness(), params->serialNumberSoKCommitmentGroup.groupOrder));
+			                              params->coinCommitmentGroup.powH(r[i] - coin.getRandomness(), params->serialNumberSoKCommitmentGroup.groupOrder));
 		}
 	}
 }
@@ -112,42 +110,78 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
         const CBigNum& h_exp) const {
 
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
+	// a and b (the coin commitment generators) live mod the order of the SoK group
+	CBigNum exponent = (params->coinCommitmentGroup.powG(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder)
+	                   * params->coinCommitmentGroup.powH(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
 
-	CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder)
-	                   * b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+	return (params->serialNumberSoKCommitmentGroup.powG(exponent) * params->serialNumberSoKCommitmentGroup.powH(h_exp)) % params->serialNumberSoKCommitmentGroup.modulus;
+}
 
-	return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+// Below this many commitment rounds a per-proof table costs more than it saves
+static const uint32_t SOK_COMMITMENT_TABLE_MIN_ROUNDS = 8;
+
+// The RoundRunner used when the caller passes none
+static bool RunRoundsInOrder(uint32_t n, const std::function<bool(uint32_t)>& fn)
+{
+	try {
+		for (uint32_t i = 0; i < n; i++)
+			if (!fn(i))
+				return false;
+	} catch (...) {
+		return false;
+	}
+	return true;
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
-        const uint256 msghash) const {
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
+        const uint256 msghash, const RoundRunner& runRounds) const {
+	// Only guards the reads below, responses past zkp_iterations are ignored as they always were
+	if (s_notprime.size() < params->zkp_iterations || sprime.size() < params->zkp_iterations)
+		return false;
+
+	const IntegerGroupParams& coinGroup = params->coinCommitmentGroup;
+	const IntegerGroupParams& sokGroup = params->serialNumberSoKCommitmentGroup;
+
 	CHashWriter hasher(0,0);
 	hasher << *params << valueOfCommitmentToCoin << coinSerialNumber << msghash;
 
 	vector<CBigNum> tprime(params->zkp_iterations);
 	unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+	vector<bool> vChallengeBits(params->zkp_iterations);
+	uint32_t nCommitmentRounds = 0;
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
 		int bit = i % 8;
 		int byte = i / 8;
-		bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
-		if(challenge_bit) {
-			tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
+		vChallengeBits[i] = ((hashbytes[byte] >> bit) & 0x01);
+		if (!vChallengeBits[i])
+			nCommitmentRounds++;
+	}
+
+	// Every challenge round computes g^{a^x b^s} with the same serial x, so
+	// a^x mod q is shared. Every other round raises the commitment to some
+	// b^s mod q < q, so one table on the commitment serves all of them.
+	// Both give the same values as challengeCalculation() and pow_mod.
+	const CBigNum bnSerialTerm = coinGroup.powG(coinSerialNumber, sokGroup.groupOrder);
+	std::unique_ptr<FixedBaseTable> ptableCommitment;
+	if (IntegerGroupParams::fUseFixedBaseTables && sokGroup.modulus.isOdd() && nCommitmentRounds >= SOK_COMMITMENT_TABLE_MIN_ROUNDS)
+		ptableCommitment.reset(new FixedBaseTable(valueOfCommitmentToCoin, sokGroup.modulus, sokGroup.groupOrder.bitSize()));
+
+	// The rounds are independent; only the hash below needs them in order
+	std::function<bool(uint32_t)> fnRound = [&](uint32_t i) {
+		CBigNum exp = coinGroup.powH(s_notprime[i], sokGroup.groupOrder);
+		if(vChallengeBits[i]) {
+			exp = (bnSerialTerm * exp) % sokGroup.groupOrder;
+			tprime[i] = (sokGroup.powG(exp) * sokGroup.powH(SeedTo1024(sprime[i].getuint256()))) % sokGroup.modulus;
 		} else {
-			CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-			tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus) *
-			             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus)) %
-			            params->serialNumberSoKCommitmentGroup.modulus;
+			CBigNum bnCommitmentTerm = ptableCommitment ? ptableCommitment->pow_mod(exp) : valueOfCommitmentToCoin.pow_mod(exp, sokGroup.modulus);
+			tprime[i] = (bnCommitmentTerm * sokGroup.powH(sprime[i])) % sokGroup.modulus;
 		}
-	}
+		return true;
+	};
+	if (!(runRounds ? runRounds(params->zkp_iterations, fnRound) : RunRoundsInOrder(params->zkp_iterations, fnRound)))
+		return false;
+
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
 		hasher << tprime[i];
 	}
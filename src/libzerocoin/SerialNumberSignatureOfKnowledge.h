@@ -18,6 +18,7 @@
 #include <list>
 #include <vector>
 #include <bitset>
+#include <functional>
 #include "Params.h"
 #include "Coin.h"
 #include "Commitment.h"
@@ -29,6 +30,11 @@
 using namespace std;
 namespace libzerocoin {
 
+/** Runs fn(i) for every round i in [0, n), in any order and possibly in parallel.
+ *  Returns false if one of the calls returned false or threw.
+ */
+typedef std::function<bool(uint32_t n, const std::function<bool(uint32_t)>& fn)> RoundRunner;
+
 /**A Signature of knowledge on the hash of metadata attesting that the signer knows the values
  *  necessary to open a commitment which contains a coin(which it self is of course a commitment)
  * with a given serial number.
@@ -48,9 +54,10 @@ public:
 	/** Verifies the Signature of knowledge.
 	 *
 	 * @param msghash hash of meta data to create a signature of knowledge on.
+	 * @param runRounds evaluates the independent rounds, one after another in this thread when empty
 	 * @return
 	 */
-	bool Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,const uint256 msghash) const;
+	bool Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,const uint256 msghash, const RoundRunner& runRounds = RoundRunner()) const;
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 	    READWRITE(s_notprime);
@@ -474,6 +474,42 @@ public:
         return ret;
     }
 
+    /**
+     * Sets up a Montgomery context with this element as the (odd) modulus
+     * @param mont context allocated with BN_MONT_CTX_new
+     */
+    void mont_init(BN_MONT_CTX* mont) const {
+        CAutoBN_CTX pctx;
+        if (!BN_MONT_CTX_set(mont, bn, pctx))
+            throw bignum_error("CBigNum::mont_init : BN_MONT_CTX_set failed");
+    }
+
+    /**
+     * Converts this element into / out of Montgomery form under mont
+     */
+    CBigNum to_mont(BN_MONT_CTX* mont, BN_CTX* pctx) const {
+        CBigNum ret;
+        if (!BN_to_montgomery(ret.bn, bn, mont, pctx))
+            throw bignum_error("CBigNum::to_mont : BN_to_montgomery failed");
+        return ret;
+    }
+
+    CBigNum from_mont(BN_MONT_CTX* mont, BN_CTX* pctx) const {
+        CBigNum ret;
+        if (!BN_from_montgomery(ret.bn, bn, mont, pctx))
+            throw bignum_error("CBigNum::from_mont : BN_from_montgomery failed");
+        return ret;
+    }
+
+    /**
+     * In-place Montgomery multiplication: this = this * b * R^-1 mod m,
+     * both operands in Montgomery form under mont
+     */
+    void mul_mont(const CBigNum& b, BN_MONT_CTX* mont, BN_CTX* pctx) {
+        if (!BN_mod_mul_montgomery(bn, bn, b.bn, mont, pctx))
+            throw bignum_error("CBigNum::mul_mont : BN_mod_mul_montgomery failed");
+    }
+
     /**
      * Generates a random (safe) prime of numBits bits
      * @param numBits the number of bits
@@ -519,6 +555,15 @@ public:
         return BN_is_one(bn);
     }
 
+    bool isOdd() const {
+        return BN_is_odd(bn);
+    }
+
+    /** Tests bit n of the absolute value */
+    bool isBitSet(int n) const {
+        return BN_is_bit_set(bn, n);
+    }
+
 
 
     bool operator!() const
@@ -0,0 +1,343 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logging.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <csignal>
+#include <exception>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * LogPrintf() has been broken a couple of times now
+ * by well-meaning people adding mutexes in the most straightforward way.
+ * It breaks because it may be called by global destructors during shutdown.
+ * Since the order of destruction of static/global objects is undefined,
+ * defining a mutex as a global object doesn't work (the mutex gets
+ * destroyed, and then some later destructor calls OutputDebugStringF,
+ * maybe indirectly, and you get a core dump at shutdown trying to lock
+ * the mutex).
+ */
+namespace
+{
+struct CLogLine {
+    int64_t nTime;
+    std::string strCategory;
+    std::string str;
+};
+
+/** The most recent lines of one category */
+class CLogRing
+{
+private:
+    std::vector<std::string> vLines;
+    size_t nNext;
+
+public:
+    CLogRing() : nNext(0) {}
+
+    void Add(const std::string& strLine, size_t nMaxLines)
+    {
+        if (vLines.size() < nMaxLines) {
+            vLines.push_back(strLine);
+            return;
+        }
+        vLines[nNext] = strLine;
+        nNext = (nNext + 1) % vLines.size();
+    }
+
+    std::vector<std::string> Get() const
+    {
+        std::vector<std::string> vRet(vLines.begin() + nNext, vLines.end());
+        vRet.insert(vRet.end(), vLines.begin(), vLines.begin() + nNext);
+        return vRet;
+    }
+};
+
+/** The background writer, see StartAsyncLogger() */
+struct CAsyncLogger {
+    CBoundedMPSCQueue<CLogLine> queue;
+    int64_t nFlushInterval;
+    boost::mutex mutexWake;
+    boost::condition_variable condWake;
+    bool fStop;
+    boost::thread thread;
+
+    CAsyncLogger(int64_t nFlushIntervalIn, size_t nQueueSize) : queue(nQueueSize), nFlushInterval(nFlushIntervalIn), fStop(false) {}
+};
+
+boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
+/**
+ * We use boost::call_once() to make sure these are initialized
+ * in a thread-safe manner the first time called:
+ */
+FILE* fileout = NULL;
+/** Guards writing to fileout and everything below */
+boost::mutex* mutexDebugLog = NULL;
+std::map<std::string, CLogRing>* pmapLogRings = NULL;
+size_t nLogRingLines = 0;
+bool fStartedNewLine = true;
+int64_t nTimestampTime = -1;
+std::string* pstrTimestamp = NULL;
+
+CAsyncLogger* plogger = NULL;
+std::atomic<bool> fAsync(false);
+/** Threads between checking fAsync and being done with plogger */
+std::atomic<int> nLogProducers(0);
+std::atomic<uint64_t> nLogWritten(0);
+std::atomic<uint64_t> nLogDropped(0);
+std::atomic<uint64_t> nLogFlushes(0);
+/** Drops already reported in debug.log. Requires mutexDebugLog. */
+uint64_t nLogDroppedReported = 0;
+/** Write each line as it is logged while the logger thread runs, see SetLogFlushEachLine() */
+std::atomic<bool> fFlushEachLine(false);
+std::terminate_handler prevTerminateHandler = NULL;
+
+void DebugPrintInit()
+{
+    assert(fileout == NULL);
+    assert(mutexDebugLog == NULL);
+
+    boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+    fileout = fopen(pathDebug.string().c_str(), "a");
+    if (fileout) setbuf(fileout, NULL); // unbuffered
+
+    mutexDebugLog = new boost::mutex();
+    pmapLogRings = new std::map<std::string, CLogRing>();
+    pstrTimestamp = new std::string();
+}
+
+/** Timestamp of nTime, formatted once per second rather than once per line. Requires mutexDebugLog. */
+const std::string& FormatTimestamp(int64_t nTime)
+{
+    if (nTime != nTimestampTime) {
+        *pstrTimestamp = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime);
+        nTimestampTime = nTime;
+    }
+    return *pstrTimestamp;
+}
+
+/** Append one log string to strOut and to its category's ring. Requires mutexDebugLog. */
+void FormatLine(const CLogLine& line, std::string& strOut)
+{
+    if (fLogTimestamps && fStartedNewLine)
+        strOut += FormatTimestamp(line.nTime) + " ";
+    fStartedNewLine = !line.str.empty() && line.str[line.str.size() - 1] == '\n';
+    strOut += line.str;
+
+    if (nLogRingLines > 0) {
+        std::string strLine = FormatTimestamp(line.nTime) + " " + line.str;
+        if (fStartedNewLine)
+            strLine.resize(strLine.size() - 1);
+        (*pmapLogRings)[line.strCategory.empty() ? "default" : line.strCategory].Add(strLine, nLogRingLines);
+    }
+}
+
+/** Requires mutexDebugLog */
+int WriteToFile(const std::string& str)
+{
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
+            setbuf(fileout, NULL); // unbuffered
+    }
+    return fwrite(str.data(), 1, str.size(), fileout);
+}
+
+/** Write everything queued in one go. With fTryLock, give up if another thread is writing. */
+void FlushQueue(CAsyncLogger& logger, bool fTryLock = false)
+{
+    std::string strBatch;
+    uint64_t nLines = 0;
+    CLogLine line;
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog, boost::defer_lock);
+    if (!fTryLock)
+        scoped_lock.lock();
+    else if (!scoped_lock.try_lock())
+        return;
+    while (logger.queue.Pop(line)) {
+        FormatLine(line, strBatch);
+        nLines++;
+    }
+
+    // Say where lines went missing, after those that were queued before them
+    uint64_t nDropped = nLogDropped;
+    if (nDropped > nLogDroppedReported) {
+        if (!fStartedNewLine)
+            strBatch += "\n";
+        fStartedNewLine = true;
+        CLogLine lineDropped;
+        lineDropped.nTime = GetTime();
+        lineDropped.str = strprintf("%u log lines dropped\n", nDropped - nLogDroppedReported);
+        FormatLine(lineDropped, strBatch);
+        nLogDroppedReported = nDropped;
+    }
+    if (strBatch.empty())
+        return;
+    WriteToFile(strBatch);
+    nLogWritten += nLines;
+    nLogFlushes++;
+}
+
+/** Write what is queued from the calling thread, if the logger thread runs */
+void FlushAsyncLoggerNow(bool fTryLock)
+{
+    // keeps plogger alive, see StopAsyncLogger()
+    nLogProducers++;
+    if (fAsync)
+        FlushQueue(*plogger, fTryLock);
+    nLogProducers--;
+}
+
+/** The lines explaining an assert or an uncaught exception may still be queued */
+void LogAbortHandler(int nSignal)
+{
+    FlushAsyncLoggerNow(true);
+    std::signal(nSignal, SIG_DFL);
+    std::raise(nSignal);
+}
+
+void LogTerminateHandler()
+{
+    FlushAsyncLoggerNow(true);
+    if (prevTerminateHandler)
+        prevTerminateHandler();
+    std::abort();
+}
+
+void ThreadAsyncLogger(CAsyncLogger* plogger)
+{
+    RenameThread("smnc-logger");
+    while (true) {
+        bool fStop;
+        {
+            boost::unique_lock<boost::mutex> lock(plogger->mutexWake);
+            if (!plogger->fStop)
+                plogger->condWake.timed_wait(lock, boost::posix_time::milliseconds(plogger->nFlushInterval));
+            fStop = plogger->fStop;
+        }
+        FlushQueue(*plogger);
+        if (fStop)
+            break;
+    }
+}
+} // namespace
+
+int WriteDebugLog(const std::string& str, const char* category)
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+
+    if (fileout == NULL)
+        return 0;
+
+    CLogLine line;
+    line.nTime = GetTime();
+    if (category)
+        line.strCategory = category;
+
+    nLogProducers++;
+    if (fAsync) {
+        CAsyncLogger& logger = *plogger;
+        line.str = str;
+        bool fQueued = logger.queue.Push(line);
+        if (!fQueued)
+            nLogDropped++;
+        else if (fFlushEachLine)
+            FlushQueue(logger);
+        else if (logger.queue.Size() > logger.queue.Capacity() / 2)
+            logger.condWake.notify_one(); // don't wait for the flush interval to avoid dropping lines
+        nLogProducers--;
+        return fQueued ? str.size() : 0;
+    }
+    nLogProducers--;
+
+    line.str = str;
+    std::string strOut;
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+    FormatLine(line, strOut);
+    return WriteToFile(strOut);
+}
+
+void StartAsyncLogger(int64_t nFlushIntervalMs, size_t nQueueSize, size_t nBufferLines)
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    StopAsyncLogger();
+    {
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        nLogRingLines = nBufferLines;
+        if (nBufferLines == 0)
+            pmapLogRings->clear();
+    }
+
+    if (nFlushIntervalMs <= 0 || fileout == NULL)
+        return;
+    plogger = new CAsyncLogger(nFlushIntervalMs, nQueueSize);
+    plogger->thread = boost::thread(&ThreadAsyncLogger, plogger);
+    fFlushEachLine = false;
+    fAsync = true;
+
+    // assert() ends in abort()
+    std::signal(SIGABRT, LogAbortHandler);
+    prevTerminateHandler = std::set_terminate(LogTerminateHandler);
+}
+
+void StopAsyncLogger()
+{
+    if (!plogger)
+        return;
+
+    std::set_terminate(prevTerminateHandler);
+    std::signal(SIGABRT, SIG_DFL);
+
+    // After this no thread starts pushing, wait for those that are still at it
+    fAsync = false;
+    while (nLogProducers > 0)
+        boost::this_thread::yield();
+
+    {
+        boost::lock_guard<boost::mutex> lock(plogger->mutexWake);
+        plogger->fStop = true;
+    }
+    plogger->condWake.notify_one();
+    plogger->thread.join();
+    delete plogger;
+    plogger = NULL;
+}
+
+void SetLogFlushEachLine()
+{
+    FlushAsyncLoggerNow(false);
+    fFlushEachLine = true;
+}
+
+CLogStats GetLogStats()
+{
+    CLogStats stats;
+    stats.fAsync = fAsync;
+    // plogger is only changed by StartAsyncLogger()/StopAsyncLogger() during init and shutdown
+    stats.nQueueCapacity = plogger ? plogger->queue.Capacity() : 0;
+    stats.nQueued = plogger ? plogger->queue.Size() : 0;
+    stats.nWritten = nLogWritten;
+    stats.nDropped = nLogDropped;
+    stats.nFlushes = nLogFlushes;
+    return stats;
+}
+
+std::map<std::string, std::vector<std::string> > GetLogBuffers(const std::string& strCategory)
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+
+    std::map<std::string, std::vector<std::string> > mapRet;
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+    for (const std::pair<const std::string, CLogRing>& ring : *pmapLogRings)
+        if (strCategory.empty() || ring.first == strCategory)
+            mapRet[ring.first] = ring.second.Get();
+    return mapRet;
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LOGGING_H
+#define BITCOIN_LOGGING_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Default for -logflushinterval, in milliseconds */
+static const int64_t DEFAULT_LOG_FLUSH_INTERVAL = 100;
+/** Default for -logqueuesize */
+static const int DEFAULT_LOG_QUEUE_SIZE = 65536;
+/** Default for -logbufferlines */
+static const int DEFAULT_LOG_BUFFER_LINES = 256;
+
+/**
+ * Bounded queue that any number of threads may push to and one thread pops from,
+ * without locks (D. Vyukov's bounded queue). Pushing to a full queue fails instead of waiting.
+ */
+template <typename T>
+class CBoundedMPSCQueue
+{
+private:
+    struct Cell {
+        std::atomic<size_t> nSequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t nMask;
+    std::atomic<size_t> nPushPos;
+    std::atomic<size_t> nPopPos;
+
+public:
+    /** nCapacity is rounded up to a power of two */
+    explicit CBoundedMPSCQueue(size_t nCapacity) : nPushPos(0), nPopPos(0)
+    {
+        size_t nSize = 2;
+        while (nSize < nCapacity)
+            nSize <<= 1;
+        cells.reset(new Cell[nSize]);
+        for (size_t i = 0; i < nSize; i++)
+            cells[i].nSequence.store(i, std::memory_order_relaxed);
+        nMask = nSize - 1;
+    }
+
+    size_t Capacity() const { return nMask + 1; }
+
+    /** Approximate number of queued values */
+    size_t Size() const
+    {
+        size_t nPush = nPushPos.load(std::memory_order_relaxed);
+        size_t nPop = nPopPos.load(std::memory_order_relaxed);
+        return nPush > nPop ? nPush - nPop : 0;
+    }
+
+    /** Any thread. False if the queue is full, value is left untouched then. */
+    bool Push(T& value)
+    {
+        Cell* cell;
+        size_t nPos = nPushPos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[nPos & nMask];
+            size_t nSequence = cell->nSequence.load(std::memory_order_acquire);
+            intptr_t nDiff = (intptr_t)nSequence - (intptr_t)nPos;
+            if (nDiff == 0) {
+                if (nPushPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (nDiff < 0) {
+                return false;
+            } else {
+                nPos = nPushPos.load(std::memory_order_relaxed);
+            }
+        }
+        std::swap(cell->value, value);
+        cell->nSequence.store(nPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer thread only. False if there is nothing to pop. */
+    bool Pop(T& value)
+    {
+        size_t nPos = nPopPos.load(std::memory_order_relaxed);
+        Cell* cell = &cells[nPos & nMask];
+        size_t nSequence = cell->nSequence.load(std::memory_order_acquire);
+        if ((intptr_t)nSequence - (intptr_t)(nPos + 1) < 0)
+            return false;
+        std::swap(value, cell->value);
+        cell->value = T();
+        cell->nSequence.store(nPos + nMask + 1, std::memory_order_release);
+        nPopPos.store(nPos + 1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+struct CLogStats {
+    bool fAsync;            // written by the logger thread
+    size_t nQueueCapacity;
+    size_t nQueued;         // waiting to be written
+    uint64_t nWritten;      // lines written by the logger thread
+    uint64_t nDropped;      // lines lost because the queue was full, debug.log says how many
+    uint64_t nFlushes;
+};
+
+/** Write str to debug.log, through the logger thread when it runs. category is NULL for unconditional output. */
+int WriteDebugLog(const std::string& str, const char* category);
+
+/**
+ * Move writing debug.log to a background thread. Lines are queued without blocking and
+ * written in batches at least every nFlushIntervalMs; when more than nQueueSize lines are
+ * waiting, new ones are dropped and the next batch says how many. What is queued is also
+ * written on abort() and std::terminate(). The last nBufferLines lines of each category
+ * are kept in memory. With nFlushIntervalMs 0 lines are still written by the thread that
+ * logs them, only the in-memory buffers are set up.
+ */
+void StartAsyncLogger(int64_t nFlushIntervalMs, size_t nQueueSize, size_t nBufferLines);
+/** Write what is queued and go back to writing from the calling thread */
+void StopAsyncLogger();
+/**
+ * Once shutdown is requested, write each line before WriteDebugLog() returns, so that
+ * a crash during shutdown does not lose the lines queued before it. Lines still go
+ * through the queue to keep their order.
+ */
+void SetLogFlushEachLine();
+
+CLogStats GetLogStats();
+/** The recent lines of strCategory, or of all categories if it is empty, oldest first */
+std::map<std::string, std::vector<std::string> > GetLogBuffers(const std::string& strCategory);
+
+#endif // BITCOIN_LOGGING_H
@@ -13,6 +13,8 @@
 #include "accumulatormap.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilecache.h"
+#include "blockfilter.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -36,11 +38,13 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #include "zsmncchain.h"
+#include "zkpcache.h"
 
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
 #include "invalid.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -64,6 +68,7 @@ using namespace libzerocoin;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CBlockIndexArena blockIndexArena;
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 map<unsigned int, unsigned int> mapHashedBlocks;
@@ -73,6 +78,7 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nParallelThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
@@ -81,6 +87,7 @@ bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
+bool fCoinStatsIndex = DEFAULT_COINSTATSINDEX;
 
 unsigned int nStakeMinAge = 60 * 60;
 int64_t nReserveBalance = 0;
@@ -1076,7 +1083,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const Coi
 	return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
 	//max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
 	if (tx.vout.size() > 2) {
@@ -1131,11 +1138,16 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
 				return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
 			}
 
-			Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-				newSpend.getDenomination(), bnAccumulatorValue);
+			bool fV1Params = chainActive.Height() < Params().Zerocoin_Block_V2_Start();
 
-			//Check that the coin has been accumulated
-			if (!newSpend.Verify(accumulator))
+			//Check that the coin has been accumulated, deferring the proof checks to the caller's queue if it has one.
+			//Spends proven outside of block validation are remembered so that the block containing them can skip the proofs.
+			//Queued checks already run side by side; a lone check spreads its proof over the script check threads instead.
+			CZerocoinSpendCheck check(newSpend, fV1Params, bnAccumulatorValue, !pvChecks, !pvChecks);
+			if (pvChecks) {
+				pvChecks->push_back(CZerocoinSpendCheck());
+				check.swap(pvChecks->back());
+			} else if (!check())
 				return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
 		}
 
@@ -1156,7 +1168,20 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
 	return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state)
+bool VerifyZerocoinSpends()
+{
+	// Do not require signature verification if this is initial sync and a block over 24 hours old
+	LOCK(cs_main);
+	return !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60 * 60 * 24));
+}
+
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
+{
+	bool fVerifyZerocoinSpends = fZerocoinActive && tx.IsZerocoinSpend() && VerifyZerocoinSpends();
+	return CheckTransaction(tx, fZerocoinActive, fRejectBadUTXO, fVerifyZerocoinSpends, state, pvZerocoinChecks);
+}
+
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, bool fVerifyZerocoinSpends, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
 {
 	// Basic checks that don't depend on any context
 	if (tx.vin.empty())
@@ -1210,9 +1235,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 						error("CheckTransaction() : zerocoinspend contains inputs that are not zerocoins"));
 			}
 
-			// Do not require signature verification if this is initial sync and a block over 24 hours old
-			bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60 * 60 * 24));
-			if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+			if (!CheckZerocoinSpend(tx, fVerifyZerocoinSpends, state, pvZerocoinChecks))
 				return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
 		}
 	}
@@ -1307,8 +1330,16 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 	return nMinFee;
 }
 
+/** Expire old transactions, then trim the pool to -maxmempool */
+static void LimitMempoolSize(CTxMemPool& pool)
+{
+	int nExpired = pool.Expire(GetTime() - GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+	if (nExpired != 0)
+		LogPrint("mempool", "Expired %i transactions from the memory pool\n", nExpired);
+	pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+}
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, bool fLimitMempool)
 {
 	AssertLockHeld(cs_main);
 	if (pfMissingInputs)
@@ -1472,7 +1503,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 		CAmount nFees = nValueIn - nValueOut;
 		double dPriority = 0;
 		if (!tx.IsZerocoinSpend())
-			view.GetPriority(tx, chainActive.Height());
+			dPriority = view.GetPriority(tx, chainActive.Height());
 
 		CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
 		unsigned int nSize = entry.GetTxSize();
@@ -1489,6 +1520,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 					hash.ToString(), nFees, txMinFee),
 					REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+			// A full mempool asks for more than the fee rate of what it evicted last
+			CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+			if (mempoolRejectFee > 0 && nFees < mempoolRejectFee && !tx.IsZerocoinSpend())
+				return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+					hash.ToString(), nFees, mempoolRejectFee),
+					REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
 			// Require that free transactions have sufficient priority to be mined in the next block.
 			if (tx.IsZerocoinMint()) {
 				if (nFees < Params().Zerocoin_MintFee() * tx.GetZerocoinMintCount())
@@ -1527,6 +1565,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 				hash.ToString(),
 				nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+		// Calculate in-mempool ancestors, up to a limit.
+		CTxMemPool::setEntries setAncestors;
+		size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+		size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+		size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+		size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+		std::string errString;
+		if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+			return state.DoS(0, error("AcceptToMemoryPool : too long mempool chain %s, %s", hash.ToString(), errString),
+				REJECT_NONSTANDARD, "too-long-mempool-chain");
+		}
+
 		// Check against previous transactions
 		// This is done last to help prevent CPU exhaustion denial-of-service attacks.
 		if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -1547,7 +1597,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 		}
 
 		// Store transaction in memory
-		pool.addUnchecked(hash, entry);
+		pool.addUnchecked(hash, entry, setAncestors);
+
+		// Trim the pool and check the new one was not evicted
+		if (fLimitMempool) {
+			LimitMempoolSize(pool);
+			if (!pool.exists(hash))
+				return state.DoS(0, error("AcceptToMemoryPool : mempool full, %s not accepted", hash.ToString()),
+					REJECT_INSUFFICIENTFEE, "mempool full");
+		}
 	}
 
 	SyncWithWallets(tx, NULL);
@@ -1759,6 +1817,15 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 	return true;
 }
 
+/** The record at pos in a finished blk or rev file from its memory map, null when the file is not mapped */
+static CBlockFileCache::MappedFilePtr GetMappedRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer, const char*& pbegin, const char*& pend)
+{
+	CBlockFileCache::MappedFilePtr pfile = blockFileCache.Get(pos.nFile, prefix, pos.nPos);
+	if (pfile && !pfile->GetRecord(pos.nPos, nTrailer, pbegin, pend))
+		pfile.reset();
+	return pfile;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
@@ -1774,17 +1841,32 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 		if (fTxIndex) {
 			CDiskTxPos postx;
 			if (pblocktree->ReadTxIndex(hash, postx)) {
-				CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-				if (file.IsNull())
-					return error("%s: OpenBlockFile failed", __func__);
 				CBlockHeader header;
-				try {
-					file >> header;
-					fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-					file >> txOut;
-				}
-				catch (std::exception& e) {
-					return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+				const char* pbegin;
+				const char* pend;
+				CBlockFileCache::MappedFilePtr pfile = GetMappedRecord(postx, "blk", 0, pbegin, pend);
+				if (pfile) {
+					try {
+						CMemoryReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+						reader >> header;
+						reader.ignore(postx.nTxOffset);
+						reader >> txOut;
+					}
+					catch (std::exception& e) {
+						return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+					}
+				} else {
+					CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+					if (file.IsNull())
+						return error("%s: OpenBlockFile failed", __func__);
+					try {
+						file >> header;
+						fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+						file >> txOut;
+					}
+					catch (std::exception& e) {
+						return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+					}
 				}
 				hashBlock = header.GetHash();
 				if (txOut.GetHash() != hash)
@@ -1856,17 +1938,29 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
 	block.SetNull();
 
-	// Open history file to read
-	CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-	if (filein.IsNull())
-		return error("ReadBlockFromDisk : OpenBlockFile failed");
+	const char* pbegin;
+	const char* pend;
+	CBlockFileCache::MappedFilePtr pfile = GetMappedRecord(pos, "blk", 0, pbegin, pend);
+	if (pfile) {
+		try {
+			CMemoryReader(pbegin, pend, SER_DISK, CLIENT_VERSION) >> block;
+		}
+		catch (std::exception& e) {
+			return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+		}
+	} else {
+		// Open history file to read
+		CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+		if (filein.IsNull())
+			return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-	// Read block
-	try {
-		filein >> block;
-	}
-	catch (std::exception& e) {
-		return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+		// Read block
+		try {
+			filein >> block;
+		}
+		catch (std::exception& e) {
+			return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+		}
 	}
 
 	// Check the header
@@ -1878,6 +1972,59 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 	return true;
 }
 
+bool ReadRawBlockFromDisk(CNetSerializeData& vData, const CDiskBlockPos& pos)
+{
+	// The block is preceded by the network magic and its size, see WriteBlockToDisk()
+	if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+		return error("ReadRawBlockFromDisk : invalid block position %d:%u", pos.nFile, pos.nPos);
+
+	const char* pbegin;
+	const char* pend;
+	CBlockFileCache::MappedFilePtr pfile = GetMappedRecord(pos, "blk", 0, pbegin, pend);
+	if (pfile) {
+		size_t nSize = pend - pbegin;
+		if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+			return error("ReadRawBlockFromDisk : invalid block size %u at %d:%u", nSize, pos.nFile, pos.nPos);
+		vData.insert(vData.end(), pbegin, pend);
+		return true;
+	}
+
+	CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+	if (filein.IsNull())
+		return error("ReadRawBlockFromDisk : OpenBlockFile failed");
+
+	try {
+		MessageStartChars pchMessageStart;
+		unsigned int nSize;
+		filein >> FLATDATA(pchMessageStart) >> nSize;
+		if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+			return error("ReadRawBlockFromDisk : block magic mismatch at %d:%u", pos.nFile, pos.nPos);
+		if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+			return error("ReadRawBlockFromDisk : invalid block size %u at %d:%u", nSize, pos.nFile, pos.nPos);
+
+		size_t nOffset = vData.size();
+		vData.resize(nOffset + nSize);
+		filein.read(&vData[nOffset], nSize);
+	}
+	catch (std::exception& e) {
+		return error("%s : I/O error - %s", __func__, e.what());
+	}
+
+	return true;
+}
+
+bool ReadRawBlockFromDisk(CNetSerializeData& vData, const CBlockIndex* pindex)
+{
+	size_t nOffset = vData.size();
+	if (!ReadRawBlockFromDisk(vData, pindex->GetBlockPos()))
+		return false;
+
+	uint256 hash;
+	if (!GetSerializedBlockHeaderHash(&vData[nOffset], vData.size() - nOffset, hash) || hash != pindex->GetBlockHash())
+		return error("ReadRawBlockFromDisk : GetHash() doesn't match index for %s at %d:%u", pindex->GetBlockHash().ToString(), pindex->GetBlockPos().nFile, pindex->GetBlockPos().nPos);
+	return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
 	if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2133,6 +2280,8 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 
 bool CScriptCheck::operator()()
 {
+	if (fnCheck)
+		return fnCheck();
 	const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
 	if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
 		return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
@@ -2140,6 +2289,36 @@ bool CScriptCheck::operator()()
 	return true;
 }
 
+static bool RunRoundsOnScriptCheckQueue(uint32_t n, const std::function<bool(uint32_t)>& fn);
+
+bool CZerocoinSpendCheck::operator()()
+{
+	int64_t nTimeStart = GetTimeMicros();
+	bool fValid = Check();
+	if (pnTimeVerify)
+		*pnTimeVerify += GetTimeMicros() - nTimeStart;
+	return fValid;
+}
+
+bool CZerocoinSpendCheck::Check()
+{
+	uint256 hashSpend = SerializeHash(*pspend);
+	if (IsZerocoinSpendVerified(hashSpend, pspend->getAccumulatorChecksum(), fV1Params))
+		return true;
+
+	try {
+		Accumulator accumulator(Params().Zerocoin_Params(fV1Params), pspend->getDenomination(), bnAccumulatorValue);
+		if (!pspend->Verify(accumulator, fParallel ? libzerocoin::RoundRunner(RunRoundsOnScriptCheckQueue) : libzerocoin::RoundRunner()))
+			return ::error("CZerocoinSpendCheck(): spend of serial %s did not verify", pspend->getCoinSerialNumber().GetHex());
+	} catch (std::exception& e) {
+		return ::error("CZerocoinSpendCheck(): %s", e.what());
+	}
+
+	if (cacheStore)
+		SetZerocoinSpendVerified(hashSpend, pspend->getAccumulatorChecksum(), fV1Params);
+	return true;
+}
+
 CBitcoinAddress addressExp1("DQZzqnSR6PXxagep1byLiRg9ZurCZ5KieQ");
 CBitcoinAddress addressExp2("DTQYdnNqKuEHXyNeeYhPQGGGdqHbXYwjpj");
 
@@ -2439,6 +2618,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 	view.SetBestBlock(pindex->pprev->GetBlockHash());
 
 	if (!fVerifyingBlocks) {
+		if (pindex->nHeight >= Params().Zerocoin_StartHeight() && !zerocoinDB->EraseBlockPubcoins(pindex->nHeight))
+			return error("DisconnectBlock(): Failed to erase block pubcoins");
+
 		//if block is an accumulator checkpoint block, remove checkpoint and checksums from db
 		uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
 		if (nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2482,6 +2664,8 @@ void static FlushBlockFile(bool fFinalize = false)
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+//! held by whoever controls scriptcheckqueue, CheckBlock() may use it outside of cs_main
+static CCriticalSection cs_scriptcheckqueue;
 
 void ThreadScriptCheck()
 {
@@ -2489,6 +2673,67 @@ void ThreadScriptCheck()
 	scriptcheckqueue.Thread();
 }
 
+/** Evaluate the rounds of one zerocoin proof on the -par threads, or in order here while they are busy */
+static bool RunRoundsOnScriptCheckQueue(uint32_t n, const std::function<bool(uint32_t)>& fn)
+{
+	TRY_LOCK(cs_scriptcheckqueue, lockScriptCheckQueue);
+	if (!lockScriptCheckQueue || !nScriptCheckThreads || !scriptcheckqueue.IsIdle()) {
+		try {
+			for (uint32_t i = 0; i < n; i++)
+				if (!fn(i))
+					return false;
+		} catch (...) {
+			return false;
+		}
+		return true;
+	}
+
+	CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+	std::vector<CScriptCheck> vChecks;
+	vChecks.reserve(n);
+	for (uint32_t i = 0; i < n; i++) {
+		vChecks.push_back(CScriptCheck([&fn, i]() {
+			try {
+				return fn(i);
+			} catch (...) {
+				return false;
+			}
+		}));
+	}
+	control.Add(vChecks);
+	return control.Wait();
+}
+
+//! jobs of RunParallel(), one per worker; each may run for a while, so they are handed out one at a time
+static CCheckQueue<CScriptCheck> parallelqueue(1);
+//! held by whoever controls parallelqueue
+static CCriticalSection cs_parallelqueue;
+
+void ThreadParallelWork()
+{
+	RenameThread("smnc-parallel");
+	parallelqueue.Thread();
+}
+
+bool RunParallel(uint32_t n, const std::function<bool(uint32_t)>& fn)
+{
+	TRY_LOCK(cs_parallelqueue, lockParallelQueue);
+	if (!lockParallelQueue || nParallelThreads < 2 || n < 2) {
+		for (uint32_t i = 0; i < n; i++)
+			if (!fn(i))
+				return false;
+		return true;
+	}
+
+	CCheckQueueControl<CScriptCheck> control(&parallelqueue);
+	std::vector<CScriptCheck> vChecks;
+	vChecks.reserve(n);
+	for (uint32_t i = 0; i < n; i++)
+		vChecks.push_back(CScriptCheck([&fn, i]() { return fn(i); }));
+	control.Add(vChecks);
+	return control.Wait();
+}
+
 void RecalculateZSMNCMinted()
 {
 	CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
@@ -2504,10 +2749,10 @@ void RecalculateZSMNCMinted()
 		std::list<CZerocoinMint> listMints;
 		BlockToZerocoinMintList(block, listMints, true);
 
-		vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-		pindex->vMintDenominationsInBlock.clear();
+		std::vector<libzerocoin::CoinDenomination> vMints;
 		for (auto mint : listMints)
-			pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+			vMints.push_back(mint.GetDenomination());
+		pindex->mintDenominations.assign(vMints);
 
 		if (pindex->nHeight < nHeightEnd)
 			pindex = chainActive.Next(pindex);
@@ -2530,17 +2775,17 @@ void RecalculateZSMNCSpent()
 		list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
 		//Reset the supply to previous block
-		pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+		pindex->zerocoinSupply = pindex->pprev->zerocoinSupply;
 
 		//Add mints to zsmnc supply
 		for (auto denom : libzerocoin::zerocoinDenomList) {
-			long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-			pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+			long nDenomAdded = pindex->mintDenominations.count(denom);
+			pindex->zerocoinSupply.at(denom) += nDenomAdded;
 		}
 
 		//Remove spends from zsmnc supply
 		for (auto denom : listDenomsSpent)
-			pindex->mapZerocoinSupply.at(denom)--;
+			pindex->zerocoinSupply.at(denom)--;
 
 		//Rewrite money supply
 		assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2682,19 +2927,20 @@ bool UpdateZSMNCSupply(const CBlock& block, CBlockIndex* pindex)
 	// Initialize zerocoin supply to the supply from previous block
 	if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
 		for (auto& denom : zerocoinDenomList) {
-			pindex->mapZerocoinSupply.at(denom) = pindex->pprev->mapZerocoinSupply.at(denom);
+			pindex->zerocoinSupply.at(denom) = pindex->pprev->zerocoinSupply.at(denom);
 		}
 	}
 
 	// Track zerocoin money supply
 	CAmount nAmountZerocoinSpent = 0;
-	pindex->vMintDenominationsInBlock.clear();
+	pindex->mintDenominations.clear();
 	if (pindex->pprev) {
 		std::set<uint256> setAddedToWallet;
+		std::vector<libzerocoin::CoinDenomination> vMints;
 		for (auto& m : listMints) {
 			libzerocoin::CoinDenomination denom = m.GetDenomination();
-			pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-			pindex->mapZerocoinSupply.at(denom)++;
+			vMints.push_back(denom);
+			pindex->zerocoinSupply.at(denom)++;
 
 			//Remove any of our own mints from the mintpool
 			if (pwalletMain) {
@@ -2717,19 +2963,20 @@ bool UpdateZSMNCSupply(const CBlock& block, CBlockIndex* pindex)
 				}
 			}
 		}
+		pindex->mintDenominations.assign(vMints);
 
 		for (auto& denom : listSpends) {
-			pindex->mapZerocoinSupply.at(denom)--;
+			pindex->zerocoinSupply.at(denom)--;
 			nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
 			// zerocoin failsafe
-			if (pindex->mapZerocoinSupply.at(denom) < 0)
+			if (pindex->zerocoinSupply.at(denom) < 0)
 				return error("Block contains zerocoins that spend more than are in the available supply to spend");
 		}
 	}
 
 	for (auto& denom : zerocoinDenomList)
-		LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+		LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->zerocoinSupply.at(denom));
 
 	return true;
 }
@@ -2794,6 +3041,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 		}
 	}
 
+	LOCK(cs_scriptcheckqueue);
 	CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
 	int64_t nTimeStart = GetTimeMicros();
@@ -3029,6 +3277,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 	if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
 	if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
 
+	// Index the pubcoins of this block so accumulator code does not need to read it back from disk
+	CBlockPubcoins blockPubcoins;
+	if (pindex->nHeight >= Params().Zerocoin_StartHeight() && BlockToBlockPubcoins(block, blockPubcoins)) {
+		if (!zerocoinDB->WriteBlockPubcoins(pindex->nHeight, blockPubcoins))
+			return state.Abort(("Failed to record block pubcoins to database"));
+	}
+
 	//Record accumulator checksums
 	DatabaseChecksums(mapAccumulators);
 
@@ -3036,6 +3291,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 		if (!pblocktree->WriteTxIndex(vPos))
 			return state.Abort("Failed to write transaction index");
 
+	// Fails while ThreadBlockFilterIndex() is still catching up, it writes this one then
+	if (pblockfilterdb)
+		pblockfilterdb->WriteFilter(block, pindex);
+
 	// add this block to the view's block chain
 	view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3077,6 +3336,11 @@ enum FlushStateMode {
 * The caches and indexes are flushed if either they're too large, forceWrite is set, or
 * fast is not set and it's been a while since the last write.
 */
+/** UTXO set statistics of pcoinsTip, maintained by ConnectTip and DisconnectTip (-coinstatsindex) */
+static CTxOutSetStats coinStatsTip;
+static bool fCoinStatsTip = false;
+static CCoinsViewDB* pcoinsStatsDB = NULL;
+
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
 	LOCK(cs_main);
@@ -3116,6 +3380,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 			// Finally flush the chainstate (which may refer to block index entries).
 			if (!pcoinsTip->Flush())
 				return state.Abort("Failed to write to coin database");
+			if (fCoinStatsTip && !pcoinsStatsDB->WriteTxOutSetStats(coinStatsTip))
+				return state.Abort("Failed to write coin statistics");
 			// Update best block in wallet (so we can detect restored wallets).
 			if (mode != FLUSH_STATE_IF_NEEDED) {
 				GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3135,6 +3401,53 @@ void FlushStateToDisk()
 	FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+bool LoadCoinStatsIndex(CCoinsViewDB* pcoinsdb)
+{
+	LOCK(cs_main);
+	FlushStateToDisk();
+	pcoinsStatsDB = pcoinsdb;
+	fCoinStatsTip = false;
+	const uint256 hashBestChain = pcoinsTip->GetBestBlock();
+	if (pcoinsdb->ReadTxOutSetStats(coinStatsTip) && coinStatsTip.hashBlock == hashBestChain) {
+		fCoinStatsTip = true;
+		return true;
+	}
+
+	int64_t nStart = GetTimeMillis();
+	if (!pcoinsdb->GetTxOutSetStats(coinStatsTip) || coinStatsTip.hashBlock != hashBestChain)
+		return error("%s : failed to scan the chainstate", __func__);
+	if (!pcoinsdb->WriteTxOutSetStats(coinStatsTip))
+		return error("%s : failed to write coin statistics", __func__);
+	fCoinStatsTip = true;
+	LogPrintf("%s : scanned %u transactions in %dms\n", __func__, coinStatsTip.nTransactions, GetTimeMillis() - nStart);
+	return true;
+}
+
+bool GetCoinStatsIndex(CCoinsStats& stats)
+{
+	AssertLockHeld(cs_main);
+	if (!fCoinStatsTip)
+		return false;
+	coinStatsTip.GetStats(stats);
+	BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+	if (mi != mapBlockIndex.end())
+		stats.nHeight = mi->second->nHeight;
+	return true;
+}
+
+/** Move the -coinstatsindex statistics across a block about to be flushed from view into pcoinsTip. */
+void static UpdateCoinStatsTip(const CCoinsViewCache& view)
+{
+	if (!fCoinStatsTip)
+		return;
+	if (coinStatsTip.hashBlock != pcoinsTip->GetBestBlock()) {
+		LogPrintf("%s : coin statistics are at %s, chainstate at %s, disabling\n", __func__, coinStatsTip.hashBlock.GetHex(), pcoinsTip->GetBestBlock().GetHex());
+		fCoinStatsTip = false;
+		return;
+	}
+	view.UpdateStats(coinStatsTip);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -3189,18 +3502,20 @@ bool static DisconnectTip(CValidationState& state)
 		CCoinsViewCache view(pcoinsTip);
 		if (!DisconnectBlock(block, state, pindexDelete, view))
 			return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+		UpdateCoinStatsTip(view);
 		assert(view.Flush());
 	}
 	LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
 	// Write the chain state to disk, if necessary.
 	if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
 		return false;
-	// Resurrect mempool transactions from the disconnected block.
+	// Resurrect mempool transactions from the disconnected block. The pool is not limited
+	// until the reorg is done, trimming now could evict parents of what comes back later.
 	BOOST_FOREACH(const CTransaction& tx, block.vtx) {
 		// ignore validation errors in resurrected transactions
 		list<CTransaction> removed;
 		CValidationState stateDummy;
-		if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+		if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, false, false, false))
 			mempool.remove(tx, removed, true);
 	}
 	mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
@@ -3260,6 +3575,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
 		nTime3 = GetTimeMicros();
 		nTimeConnectTotal += nTime3 - nTime2;
 		LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+		UpdateCoinStatsTip(view);
 		assert(view.Flush());
 	}
 	int64_t nTime4 = GetTimeMicros();
@@ -3309,6 +3625,7 @@ bool DisconnectBlocksAndReprocess(int blocks)
 	LogPrintf("DisconnectBlocksAndReprocess: Got command to replay %d blocks\n", blocks);
 	for (int i = 0; i <= blocks; i++)
 		DisconnectTip(state);
+	LimitMempoolSize(mempool);
 
 	return true;
 }
@@ -3378,6 +3695,7 @@ bool DisconnectBlockAndInputs(CValidationState& state, CTransaction txLock)
 			LogPrintf(" -- disconnect %s\n", pindex->GetBlockHash().ToString());
 			DisconnectTip(state);
 		}
+		LimitMempoolSize(mempool);
 	}
 
 	return true;
@@ -3471,10 +3789,14 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
 	const CBlockIndex* pindexFork = chainActive.FindFork(pindexMostWork);
 
 	// Disconnect active blocks which are no longer in the best chain.
+	bool fBlocksDisconnected = false;
 	while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
 		if (!DisconnectTip(state))
 			return false;
+		fBlocksDisconnected = true;
 	}
+	if (fBlocksDisconnected)
+		LimitMempoolSize(mempool);
 
 	// Build list of new blocks to connect.
 	std::vector<CBlockIndex*> vpindexToConnect;
@@ -3620,6 +3942,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex* pindex)
 			return false;
 		}
 	}
+	LimitMempoolSize(mempool);
 
 	// The resulting new best tip may not be in setBlockIndexCandidates anymore, so
 	// add them again.
@@ -3678,8 +4001,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 		return it->second;
 
 	// Construct new block index object
-	CBlockIndex* pindexNew = new CBlockIndex(block);
-	assert(pindexNew);
+	CBlockIndex* pindexNew = blockIndexArena.Create(block);
 	// We assign the sequence id to blocks only when the full data is available,
 	// to avoid miners withholding blocks but broadcasting headers, to get a
 	// competitive advantage.
@@ -3810,6 +4132,7 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
 	}
 
 	nLastBlockFile = nFile;
+	blockFileCache.SetFinishedFiles(nLastBlockFile);
 	vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
 	if (fKnown)
 		vinfoBlockFile[nFile].nSize = std::max(pos.nPos + nAddSize, vinfoBlockFile[nFile].nSize);
@@ -3888,6 +4211,8 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
 	return true;
 }
 
+static std::atomic<int64_t> nTimeZerocoinVerify(0);
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
 {
 	// These are checks that are independent of context.
@@ -4006,12 +4331,38 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 		}
 	}
 
-	// Check transactions
+	// Whatever takes cs_main is looked at before the script check queue is claimed: ConnectBlock()
+	// waits for the queue while it holds cs_main, and we may be called without it
 	bool fZerocoinActive = block.GetBlockTime() > Params().Zerocoin_StartTime();
+	bool fRejectBadUTXO = chainActive.Height() + 1 >= Params().Zerocoin_Block_EnforceSerialRange();
+	bool fVerifyZerocoinSpends = fZerocoinActive &&
+		std::any_of(block.vtx.begin(), block.vtx.end(), [](const CTransaction& tx) { return tx.IsZerocoinSpend(); }) &&
+		VerifyZerocoinSpends();
+
+	// Check transactions, zerocoin spend proofs are verified on the script check threads when no other caller uses them
+	std::atomic<int64_t> nTimeVerify(0);
+	TRY_LOCK(cs_scriptcheckqueue, lockScriptCheckQueue);
+	bool fZerocoinQueue = lockScriptCheckQueue && nScriptCheckThreads;
+	CCheckQueueControl<CScriptCheck> control(fZerocoinQueue ? &scriptcheckqueue : NULL);
 	vector<CBigNum> vBlockSerials;
 	for (const CTransaction& tx : block.vtx) {
-		if (!CheckTransaction(tx, fZerocoinActive, chainActive.Height() + 1 >= Params().Zerocoin_Block_EnforceSerialRange(), state))
+		std::vector<CZerocoinSpendCheck> vZerocoinChecks;
+		if (!CheckTransaction(tx, fZerocoinActive, fRejectBadUTXO, fVerifyZerocoinSpends, state, &vZerocoinChecks))
 			return error("CheckBlock() : CheckTransaction failed");
+		std::vector<CScriptCheck> vChecks;
+		for (CZerocoinSpendCheck& check : vZerocoinChecks) {
+			check.SetTimer(&nTimeVerify);
+			if (!fZerocoinQueue) {
+				if (!check())
+					return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"),
+						REJECT_INVALID, "bad-zc-spend");
+				continue;
+			}
+			std::shared_ptr<CZerocoinSpendCheck> pcheck = std::make_shared<CZerocoinSpendCheck>();
+			pcheck->swap(check);
+			vChecks.push_back(CScriptCheck([pcheck]() { return (*pcheck)(); }));
+		}
+		control.Add(vChecks);
 
 		// double check that there are no double spent zsmnc spends in this block
 		if (tx.IsZerocoinSpend()) {
@@ -4027,6 +4378,16 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 		}
 	}
 
+	if (!control.Wait())
+		return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"),
+			REJECT_INVALID, "bad-zc-spend");
+
+	if (!vBlockSerials.empty()) {
+		// Summed over the threads the proofs ran on
+		int64_t nTime = nTimeVerify;
+		nTimeZerocoinVerify += nTime;
+		LogPrint("bench", "    - Verify %u zerocoin spends: %.2fms (%.3fms/spend) [%.2fs]\n", (unsigned)vBlockSerials.size(), 0.001 * nTime, 0.001 * nTime / vBlockSerials.size(), nTimeZerocoinVerify * 0.000001);
+	}
 
 	unsigned int nSigOps = 0;
 	BOOST_FOREACH(const CTransaction& tx, block.vtx) {
@@ -4790,9 +5151,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 		return (*mi).second;
 
 	// Create new
-	CBlockIndex* pindexNew = new CBlockIndex();
-	if (!pindexNew)
-		throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+	CBlockIndex* pindexNew = blockIndexArena.Create();
 	mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
 	//mark as PoS seen
@@ -4806,10 +5165,12 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(string& strError)
 {
-	if (!pblocktree->LoadBlockIndexGuts())
+	int64_t nTimeStart = GetTimeMillis();
+	if (!pblocktree->LoadBlockIndexGuts(pcoinsTip->GetBestBlock()))
 		return false;
 
 	boost::this_thread::interruption_point();
+	int64_t nTimeGuts = GetTimeMillis();
 
 	// Calculate nChainWork
 	vector<pair<int, CBlockIndex*> > vSortedByHeight;
@@ -4846,8 +5207,11 @@ bool static LoadBlockIndexDB(string& strError)
 			pindexBestHeader = pindex;
 	}
 
+	int64_t nTimeChainWork = GetTimeMillis();
+
 	// Load block file info
 	pblocktree->ReadLastBlockFile(nLastBlockFile);
+	blockFileCache.SetFinishedFiles(nLastBlockFile);
 	vinfoBlockFile.resize(nLastBlockFile + 1);
 	LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
 	for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
@@ -4879,6 +5243,9 @@ bool static LoadBlockIndexDB(string& strError)
 			return false;
 		}
 	}
+	LogPrintf("%s: block index %dms (%u entries, %u kB), chain work %dms, block files %dms\n", __func__,
+		nTimeGuts - nTimeStart, blockIndexArena.size(), blockIndexArena.DynamicMemoryUsage() / 1024,
+		nTimeChainWork - nTimeGuts, GetTimeMillis() - nTimeChainWork);
 
 	//Check if the shutdown procedure was followed on last client exit
 	bool fLastShutdownWasPrepared = true;
@@ -5007,6 +5374,9 @@ void UnloadBlockIndex()
 	setBlockIndexCandidates.clear();
 	chainActive.SetTip(NULL);
 	pindexBestInvalid = NULL;
+	fCoinStatsTip = false;
+	pcoinsStatsDB = NULL;
+	blockFileCache.Clear();
 }
 
 bool LoadBlockIndex(string& strError)
@@ -5386,47 +5756,63 @@ bool static AlreadyHave(const CInv& inv)
 			mapTxLockReqRejected.count(inv.hash);
 	case MSG_TXLOCK_VOTE:
 		return mapTxLockVote.count(inv.hash);
-	case MSG_SPORK:
+	case MSG_SPORK: {
+		LOCK(cs_mapSporks);
 		return mapSporks.count(inv.hash);
-	case MSG_MASTERNODE_WINNER:
+	}
+	case MSG_MASTERNODE_WINNER: {
+		LOCK(cs_mapMasternodePayeeVotes);
 		if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
 			masternodeSync.AddedMasternodeWinner(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_BUDGET_VOTE:
+	}
+	case MSG_BUDGET_VOTE: {
+		LOCK(budget.cs_mapSeen);
 		if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
 			masternodeSync.AddedBudgetItem(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_BUDGET_PROPOSAL:
+	}
+	case MSG_BUDGET_PROPOSAL: {
+		LOCK(budget.cs_mapSeen);
 		if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
 			masternodeSync.AddedBudgetItem(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_BUDGET_FINALIZED_VOTE:
+	}
+	case MSG_BUDGET_FINALIZED_VOTE: {
+		LOCK(budget.cs_mapSeen);
 		if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
 			masternodeSync.AddedBudgetItem(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_BUDGET_FINALIZED:
+	}
+	case MSG_BUDGET_FINALIZED: {
+		LOCK(budget.cs_mapSeen);
 		if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
 			masternodeSync.AddedBudgetItem(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_MASTERNODE_ANNOUNCE:
+	}
+	case MSG_MASTERNODE_ANNOUNCE: {
+		LOCK(mnodeman.cs_mapSeen);
 		if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
 			masternodeSync.AddedMasternodeList(inv.hash);
 			return true;
 		}
 		return false;
-	case MSG_MASTERNODE_PING:
+	}
+	case MSG_MASTERNODE_PING: {
+		LOCK(mnodeman.cs_mapSeen);
 		return mnodeman.mapSeenMasternodePing.count(inv.hash);
 	}
+	}
 	// Don't know what it is, just say we already got one
 	return true;
 }
@@ -5471,13 +5857,18 @@ void static ProcessGetData(CNode* pfrom)
 				// Don't send not-validated blocks
 				if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
 					// Send block from disk
-					CBlock block;
-					if (!ReadBlockFromDisk(block, (*mi).second))
-						assert(!"cannot load block from disk");
-					if (inv.type == MSG_BLOCK)
-						pfrom->PushMessage("block", block);
+					if (inv.type == MSG_BLOCK) {
+						// Blocks are stored serialized as on the wire, so send the bytes as they are
+						CNetSerializeData vMessage(CMessageHeader::HEADER_SIZE);
+						if (!ReadRawBlockFromDisk(vMessage, (*mi).second))
+							assert(!"cannot load block from disk");
+						pfrom->PushRawMessage("block", vMessage);
+					}
 					else // MSG_FILTERED_BLOCK)
 					{
+						CBlock block;
+						if (!ReadBlockFromDisk(block, (*mi).second))
+							assert(!"cannot load block from disk");
 						LOCK(pfrom->cs_filter);
 						if (pfrom->pfilter) {
 							CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5550,81 +5941,113 @@ void static ProcessGetData(CNode* pfrom)
 					}
 				}
 				if (!pushed && inv.type == MSG_SPORK) {
-					if (mapSporks.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << mapSporks[inv.hash];
-						pfrom->PushMessage("spork", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(cs_mapSporks);
+						if (mapSporks.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << mapSporks[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("spork", ss);
 				}
 				if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-					if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-						pfrom->PushMessage("mnw", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(cs_mapMasternodePayeeVotes);
+						if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("mnw", ss);
 				}
 				if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-					if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-						pfrom->PushMessage("mvote", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(budget.cs_mapSeen);
+						if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("mvote", ss);
 				}
 
 				if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-					if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-						pfrom->PushMessage("mprop", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(budget.cs_mapSeen);
+						if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("mprop", ss);
 				}
 
 				if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-					if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-						pfrom->PushMessage("fbvote", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(budget.cs_mapSeen);
+						if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("fbvote", ss);
 				}
 
 				if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-					if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << budget.mapSeenFinalizedBudgets[inv.hash];
-						pfrom->PushMessage("fbs", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(budget.cs_mapSeen);
+						if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << budget.mapSeenFinalizedBudgets[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("fbs", ss);
 				}
 
 				if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-					if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-						pfrom->PushMessage("mnb", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(mnodeman.cs_mapSeen);
+						if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("mnb", ss);
 				}
 
 				if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-					if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-						CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-						ss.reserve(1000);
-						ss << mnodeman.mapSeenMasternodePing[inv.hash];
-						pfrom->PushMessage("mnp", ss);
-						pushed = true;
+					CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+					{
+						LOCK(mnodeman.cs_mapSeen);
+						if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
+							ss.reserve(1000);
+							ss << mnodeman.mapSeenMasternodePing[inv.hash];
+							pushed = true;
+						}
 					}
+					if (pushed)
+						pfrom->PushMessage("mnp", ss);
 				}
 
 				if (!pushed && inv.type == MSG_DSTX) {
@@ -6207,7 +6630,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 			return true;
 		}
 		CBlockIndex* pindexLast = NULL;
-		BOOST_FOREACH(const CBlockHeader& header, headers) {
+		for (unsigned int n = 0; n < nCount; n++) {
+			const CBlockHeader& header = headers[n];
 			CValidationState state;
 			if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
 				Misbehaving(pfrom->GetId(), 20);
@@ -6217,12 +6641,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 			/*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
 			* before headers are reimplemented on mainnet
 			*/
-			if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+			CBlock block(header);
+			if (!AcceptBlockHeader(block, state, &pindexLast)) {
 				int nDoS;
 				if (state.IsInvalid(nDoS)) {
 					if (nDoS > 0)
 						Misbehaving(pfrom->GetId(), nDoS);
-					std::string strError = "invalid header received " + header.GetHash().ToString();
+					std::string strError = "invalid header received " + block.GetHash().ToString();
 					return error(strError.c_str());
 				}
 			}
@@ -6547,6 +6972,34 @@ int ActiveProtocol()
 	return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+// Message processing runs on several threads, see ThreadMessageHandler(). These
+// locks decide what may run side by side.
+static CCriticalSection cs_processCore;
+static CCriticalSection cs_processMasternode;
+static CCriticalSection cs_processBudget;
+static CCriticalSection cs_processSpork;
+
+/**
+ * The lock a message is processed under. Masternode, budget and spork messages are
+ * handled by managers that do their own locking, so each group only excludes itself.
+ * The seen maps that core message handling shares with them have their own locks,
+ * taken after cs_main and the manager locks. Everything else, including getdata
+ * replies and SendMessages(), shares one lock and runs one at a time as it did on
+ * the single message handler thread.
+ */
+static CCriticalSection& GetProcessLock(const std::string& strCommand)
+{
+	if (strCommand == "mnb" || strCommand == "mnp" || strCommand == "dseg" ||
+		strCommand == "mnget" || strCommand == "mnw")
+		return cs_processMasternode;
+	if (strCommand == "mnvs" || strCommand == "mprop" || strCommand == "mvote" ||
+		strCommand == "fbs" || strCommand == "fbvote")
+		return cs_processBudget;
+	if (strCommand == "spork" || strCommand == "getsporks")
+		return cs_processSpork;
+	return cs_processCore;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6563,8 +7016,10 @@ bool ProcessMessages(CNode* pfrom)
 	//
 	bool fOk = true;
 
-	if (!pfrom->vRecvGetData.empty())
+	if (!pfrom->vRecvGetData.empty()) {
+		LOCK(cs_processCore);
 		ProcessGetData(pfrom);
+	}
 
 	// this maintains the order of responses
 	if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -6622,7 +7077,10 @@ bool ProcessMessages(CNode* pfrom)
 		// Process message
 		bool fRet = false;
 		try {
+			LOCK(GetProcessLock(strCommand));
+			int64_t nStart = GetTimeMicros();
 			fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+			pfrom->RecordProcessTime(strCommand, GetTimeMicros() - nStart);
 			boost::this_thread::interruption_point();
 		}
 		catch (std::ios_base::failure& e) {
@@ -6670,6 +7128,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 		if (pto->nVersion == 0)
 			return true;
 
+		// Same order as message processing: process lock first, then cs_vSend
+		LOCK(cs_processCore);
+		TRY_LOCK(pto->cs_vSend, lockSend);
+		if (!lockSend)
+			return true;
+
 		//
 		// Message: ping
 		//
@@ -6920,19 +7384,33 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-	// Open history file to read
-	CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-	if (filein.IsNull())
-		return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-	// Read block
 	uint256 hashChecksum;
-	try {
-		filein >> *this;
-		filein >> hashChecksum;
-	}
-	catch (std::exception& e) {
-		return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+	const char* pbegin;
+	const char* pend;
+	CBlockFileCache::MappedFilePtr pfile = GetMappedRecord(pos, "rev", sizeof(hashChecksum), pbegin, pend);
+	if (pfile) {
+		try {
+			CMemoryReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+			reader >> *this;
+			reader >> hashChecksum;
+		}
+		catch (std::exception& e) {
+			return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+		}
+	} else {
+		// Open history file to read
+		CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+		if (filein.IsNull())
+			return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+
+		// Read block
+		try {
+			filein >> *this;
+			filein >> hashChecksum;
+		}
+		catch (std::exception& e) {
+			return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+		}
 	}
 
 	// Verify checksum
@@ -6958,10 +7436,8 @@ public:
 	~CMainCleanup()
 	{
 		// block headers
-		BlockMap::iterator it1 = mapBlockIndex.begin();
-		for (; it1 != mapBlockIndex.end(); it1++)
-			delete (*it1).second;
 		mapBlockIndex.clear();
+		blockIndexArena.Clear();
 
 		// orphan transactions
 		mapOrphanTransactions.clear();
@@ -33,8 +33,11 @@
 #include "undo.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -47,11 +50,13 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -65,6 +70,8 @@ static const unsigned int DEFAULT_BLOCK_MIN_SIZE = 0;
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = 50000;
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
+/** Default for -coinstatsindex, maintaining the UTXO set statistics block by block. */
+static const bool DEFAULT_COINSTATSINDEX = false;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
 static const unsigned int MAX_ZEROCOIN_TX_SIZE = 150000;
@@ -138,6 +145,7 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -147,12 +155,14 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nParallelThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
+extern bool fCoinStatsIndex;
 extern bool fVerifyingBlocks;
 
 extern bool fLargeWorkForkFound;
@@ -220,6 +230,14 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the shared worker thread used by RunParallel() */
+void ThreadParallelWork();
+/**
+ * Run fn(0) .. fn(n - 1) on the shared worker threads and this one, which are started once at init.
+ * Runs them in order here when there are no workers or another caller is using them. Returns false if any call did.
+ * fn must not throw.
+ */
+bool RunParallel(uint32_t n, const std::function<bool(uint32_t)>& fn);
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -248,10 +266,14 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Start maintaining the UTXO set statistics at the tip, from the chainstate database or a full scan */
+bool LoadCoinStatsIndex(CCoinsViewDB* pcoinsdb);
+/** UTXO set statistics at the tip as maintained by -coinstatsindex, false when not available */
+bool GetCoinStatsIndex(CCoinsStats& stats);
 
 
-/** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
+/** (try to) add transaction to memory pool, without expiring or trimming the pool when !fLimitMempool **/
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false, bool fLimitMempool = true);
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
@@ -346,9 +368,13 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = NULL);
+/** As above with VerifyZerocoinSpends() evaluated by the caller, for callers that must not take cs_main */
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, bool fVerifyZerocoinSpends, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks);
+/** Whether zerocoin spend signatures are verified, not during initial sync while the tip is over a day old. Takes cs_main. */
+bool VerifyZerocoinSpends();
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -399,6 +425,9 @@ public:
 /**
 * Closure representing one script verification
 * Note that this stores references to the spending transaction
+*
+* Other checks, such as zerocoin spend proofs, run on the same -par threads as a
+* CScriptCheck wrapping them.
 */
 class CScriptCheck
 {
@@ -409,16 +438,19 @@ private:
 	unsigned int nFlags;
 	bool cacheStore;
 	ScriptError error;
+	std::function<bool()> fnCheck; //run instead of the script when set
 
 public:
 	CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
 	CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
 		ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+	explicit CScriptCheck(const std::function<bool()>& fnCheckIn) : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), fnCheck(fnCheckIn) {}
 
 	bool operator()();
 
 	void swap(CScriptCheck& check)
 	{
+		fnCheck.swap(check.fnCheck);
 		scriptPubKey.swap(check.scriptPubKey);
 		std::swap(ptxTo, check.ptxTo);
 		std::swap(nIn, check.nIn);
@@ -430,11 +462,51 @@ public:
 	ScriptError GetScriptError() const { return error; }
 };
 
+/**
+* Closure representing the proof verification of one zerocoin spend
+* against the accumulator value it claims membership in
+*/
+class CZerocoinSpendCheck
+{
+private:
+	std::shared_ptr<const libzerocoin::CoinSpend> pspend;
+	bool fV1Params;
+	CBigNum bnAccumulatorValue;
+	bool cacheStore;
+	bool fParallel; //spread the proof's rounds over the script check threads, false when run from the check queue
+	std::atomic<int64_t>* pnTimeVerify; //when set, microseconds spent are added to it
+
+	bool Check();
+
+public:
+	CZerocoinSpendCheck() : fV1Params(false), cacheStore(false), fParallel(false), pnTimeVerify(NULL) {}
+	CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, bool fV1ParamsIn, const CBigNum& bnAccumulatorValueIn, bool cacheIn, bool fParallelIn = false) :
+		pspend(std::make_shared<const libzerocoin::CoinSpend>(spendIn)), fV1Params(fV1ParamsIn), bnAccumulatorValue(bnAccumulatorValueIn), cacheStore(cacheIn), fParallel(fParallelIn), pnTimeVerify(NULL) {}
+
+	bool operator()();
+
+	void SetTimer(std::atomic<int64_t>* pnTimeVerifyIn) { pnTimeVerify = pnTimeVerifyIn; }
+
+	void swap(CZerocoinSpendCheck& check)
+	{
+		pspend.swap(check.pspend);
+		std::swap(fV1Params, check.fV1Params);
+		std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+		std::swap(cacheStore, check.cacheStore);
+		std::swap(fParallel, check.fParallel);
+		std::swap(pnTimeVerify, check.pnTimeVerify);
+	}
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Append the block at pos to vData as stored on disk, which is also its network serialization */
+bool ReadRawBlockFromDisk(CNetSerializeData& vData, const CDiskBlockPos& pos);
+/** As above, checking that the stored header hashes to pindex's block hash */
+bool ReadRawBlockFromDisk(CNetSerializeData& vData, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
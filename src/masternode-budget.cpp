@@ -202,7 +202,12 @@ void CBudgetManager::SubmitFinalBudget()
     }
 
     CFinalizedBudgetBroadcast tempBudget(strBudgetName, nBlockStart, vecTxBudgetPayments, 0);
-    if (mapSeenFinalizedBudgets.count(tempBudget.GetHash())) {
+    bool fSeen;
+    {
+        LOCK(cs_mapSeen);
+        fSeen = mapSeenFinalizedBudgets.count(tempBudget.GetHash());
+    }
+    if (fSeen) {
         LogPrint("mnbudget","CBudgetManager::SubmitFinalBudget - Budget already exists - %s\n", tempBudget.GetHash().ToString());
         nSubmittedHeight = nCurrentHeight;
         return; //already exists
@@ -268,7 +273,10 @@ void CBudgetManager::SubmitFinalBudget()
     }
 
     LOCK(cs);
-    mapSeenFinalizedBudgets.insert(make_pair(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast));
+    {
+        LOCK(cs_mapSeen);
+        mapSeenFinalizedBudgets.insert(make_pair(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast));
+    }
     finalizedBudgetBroadcast.Relay();
     budget.AddFinalizedBudget(finalizedBudgetBroadcast);
     nSubmittedHeight = nCurrentHeight;
@@ -287,7 +295,7 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
+    LOCK2(objToSave.cs, objToSave.cs_mapSeen);
 
     int64_t nStart = GetTimeMillis();
 
@@ -384,6 +392,7 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
         }
 
         // de-serialize data into CBudgetManager object
+        LOCK(objToLoad.cs_mapSeen);
         ssObj >> objToLoad;
     } catch (std::exception& e) {
         objToLoad.Clear();
@@ -432,9 +441,11 @@ void DumpBudgets()
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
+    // validated before locking, the collateral check needs cs_main
     std::string strError = "";
     if (!finalizedBudget.IsValid(strError)) return false;
 
+    LOCK(cs);
     if (mapFinalizedBudgets.count(finalizedBudget.GetHash())) {
         return false;
     }
@@ -445,13 +456,14 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 
 bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
 {
-    LOCK(cs);
+    // validated before locking, the collateral check needs cs_main
     std::string strError = "";
     if (!budgetProposal.IsValid(strError)) {
         LogPrint("mnbudget","CBudgetManager::AddProposal - invalid budget proposal - %s\n", strError);
         return false;
     }
 
+    LOCK(cs);
     if (mapProposals.count(budgetProposal.GetHash())) {
         return false;
     }
@@ -959,6 +971,8 @@ CAmount CBudgetManager::GetTotalBudget(int nHeight)
 
 void CBudgetManager::NewBlock()
 {
+    // the collateral checks below need cs_main, which block validation takes before cs
+    LOCK(cs_main);
     TRY_LOCK(cs, fBudgetNewBlock);
     if (!fBudgetNewBlock) return;
 
@@ -1100,7 +1114,12 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CBudgetProposalBroadcast budgetProposalBroadcast;
         vRecv >> budgetProposalBroadcast;
 
-        if (mapSeenMasternodeBudgetProposals.count(budgetProposalBroadcast.GetHash())) {
+        bool fSeen;
+        {
+            LOCK(cs_mapSeen);
+            fSeen = mapSeenMasternodeBudgetProposals.count(budgetProposalBroadcast.GetHash());
+        }
+        if (fSeen) {
             masternodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
             return;
         }
@@ -1113,7 +1132,10 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        mapSeenMasternodeBudgetProposals.insert(make_pair(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast));
+        {
+            LOCK(cs_mapSeen);
+            mapSeenMasternodeBudgetProposals.insert(make_pair(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast));
+        }
 
         if (!budgetProposalBroadcast.IsValid(strError)) {
             LogPrint("mnbudget","mprop - invalid budget proposal - %s\n", strError);
@@ -1137,7 +1159,12 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
-        if (mapSeenMasternodeBudgetVotes.count(vote.GetHash())) {
+        bool fSeen;
+        {
+            LOCK(cs_mapSeen);
+            fSeen = mapSeenMasternodeBudgetVotes.count(vote.GetHash());
+        }
+        if (fSeen) {
             masternodeSync.AddedBudgetItem(vote.GetHash());
             return;
         }
@@ -1150,7 +1177,10 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         }
 
 
-        mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        {
+            LOCK(cs_mapSeen);
+            mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        }
         if (!vote.SignatureValid(true)) {
             if (masternodeSync.IsSynced()) {
                 LogPrintf("CBudgetManager::ProcessMessage() : mvote - signature invalid\n");
@@ -1174,7 +1204,12 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CFinalizedBudgetBroadcast finalizedBudgetBroadcast;
         vRecv >> finalizedBudgetBroadcast;
 
-        if (mapSeenFinalizedBudgets.count(finalizedBudgetBroadcast.GetHash())) {
+        bool fSeen;
+        {
+            LOCK(cs_mapSeen);
+            fSeen = mapSeenFinalizedBudgets.count(finalizedBudgetBroadcast.GetHash());
+        }
+        if (fSeen) {
             masternodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
             return;
         }
@@ -1188,7 +1223,10 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        mapSeenFinalizedBudgets.insert(make_pair(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast));
+        {
+            LOCK(cs_mapSeen);
+            mapSeenFinalizedBudgets.insert(make_pair(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast));
+        }
 
         if (!finalizedBudgetBroadcast.IsValid(strError)) {
             LogPrint("mnbudget","fbs - invalid finalized budget - %s\n", strError);
@@ -1212,7 +1250,12 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
-        if (mapSeenFinalizedBudgetVotes.count(vote.GetHash())) {
+        bool fSeen;
+        {
+            LOCK(cs_mapSeen);
+            fSeen = mapSeenFinalizedBudgetVotes.count(vote.GetHash());
+        }
+        if (fSeen) {
             masternodeSync.AddedBudgetItem(vote.GetHash());
             return;
         }
@@ -1224,7 +1267,10 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        {
+            LOCK(cs_mapSeen);
+            mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        }
         if (!vote.SignatureValid(true)) {
             if (masternodeSync.IsSynced()) {
                 LogPrintf("CBudgetManager::ProcessMessage() : fbvote - signature invalid\n");
@@ -1256,7 +1302,7 @@ bool CBudgetManager::PropExists(uint256 nHash)
 //mark that a full sync is needed
 void CBudgetManager::ResetSync()
 {
-    LOCK(cs);
+    LOCK2(cs, cs_mapSeen);
 
 
     std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
@@ -1290,7 +1336,7 @@ void CBudgetManager::ResetSync()
 
 void CBudgetManager::MarkSynced()
 {
-    LOCK(cs);
+    LOCK2(cs, cs_mapSeen);
 
     /*
         Mark that we've sent all valid items
@@ -1330,7 +1376,7 @@ void CBudgetManager::MarkSynced()
 
 void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 {
-    LOCK(cs);
+    LOCK2(cs, cs_mapSeen);
 
     /*
         Sync with a client on the network
@@ -2198,7 +2244,10 @@ void CFinalizedBudget::SubmitVote()
     if (budget.UpdateFinalizedBudget(vote, NULL, strError)) {
         LogPrint("mnbudget","CFinalizedBudget::SubmitVote  - new finalized budget vote - %s\n", vote.GetHash().ToString());
 
-        budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        {
+            LOCK(budget.cs_mapSeen);
+            budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        }
         vote.Relay();
     } else {
         LogPrint("mnbudget","CFinalizedBudget::SubmitVote : Error submitting vote - %s\n", strError);
@@ -2314,6 +2363,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 
 std::string CBudgetManager::ToString() const
 {
+    LOCK(cs_mapSeen);
     std::ostringstream info;
 
     info << "Proposals: " << (int)mapProposals.size() << ", Budgets: " << (int)mapFinalizedBudgets.size() << ", Seen Budgets: " << (int)mapSeenMasternodeBudgetProposals.size() << ", Seen Budget Votes: " << (int)mapSeenMasternodeBudgetVotes.size() << ", Seen Final Budgets: " << (int)mapSeenFinalizedBudgets.size() << ", Seen Final Budget Votes: " << (int)mapSeenFinalizedBudgetVotes.size();
@@ -192,6 +192,9 @@ private:
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
+    // protects the mapSeen* maps, which the core message handlers read too; taken after cs,
+    // only masternodeSync.cs and the peer send locks are taken while holding it
+    mutable CCriticalSection cs_mapSeen;
 
     // keep track of the scanning errors I've seen
     map<uint256, CBudgetProposal> mapProposals;
@@ -212,6 +215,7 @@ public:
 
     void ClearSeen()
     {
+        LOCK(cs_mapSeen);
         mapSeenMasternodeBudgetProposals.clear();
         mapSeenMasternodeBudgetVotes.clear();
         mapSeenFinalizedBudgets.clear();
@@ -252,7 +256,7 @@ public:
     void CheckOrphanVotes();
     void Clear()
     {
-        LOCK(cs);
+        LOCK2(cs, cs_mapSeen);
 
         LogPrintf("Budget object cleared\n");
         mapProposals.clear();
@@ -410,7 +410,12 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
         ExtractDestination (winner.payee, masternodeAddress);
         CBitcoinAddress payee_addr (masternodeAddress);
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
+        bool fSeen;
+        {
+            LOCK(cs_mapMasternodePayeeVotes);
+            fSeen = masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash());
+        }
+        if (fSeen) {
             LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
             masternodeSync.AddedMasternodeWinner(winner.GetHash());
             return;
@@ -610,6 +615,10 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         return false;
     }
 
+    // looked up before locking, they may need cs_main
+    CScript payee = winnerIn.GetPayeeScript ();
+    unsigned int nPhase = winnerIn.GetPayeePhase ();
+
     {
         LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
@@ -623,9 +632,9 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
-    }
 
-    mapMasternodeBlocks [winnerIn.nBlockHeight].AddPayee (winnerIn.GetPayeeScript (), winnerIn.GetPayeePhase (), 1);
+        mapMasternodeBlocks [winnerIn.nBlockHeight].AddPayee (payee, nPhase, 1);
+    }
 
     return true;
 }
@@ -770,6 +779,7 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
+    LOCK(masternodeSync.cs);
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
         CMasternodePaymentWinner winner = (*it).second;
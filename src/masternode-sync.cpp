@@ -23,7 +23,7 @@ CMasternodeSync masternodeSync;
 
 CMasternodeSync::CMasternodeSync()
 {
-    Reset();
+    Clear();
 }
 
 bool CMasternodeSync::IsSynced()
@@ -63,6 +63,12 @@ bool CMasternodeSync::IsBlockchainSynced()
 }
 
 void CMasternodeSync::Reset()
+{
+    LOCK(cs);
+    Clear();
+}
+
+void CMasternodeSync::Clear()
 {
     lastMasternodeList = 0;
     lastMasternodeWinner = 0;
@@ -87,7 +93,14 @@ void CMasternodeSync::Reset()
 
 void CMasternodeSync::AddedMasternodeList(uint256 hash)
 {
-    if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+    bool fSeen;
+    {
+        LOCK(mnodeman.cs_mapSeen);
+        fSeen = mnodeman.mapSeenMasternodeBroadcast.count(hash);
+    }
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNB[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeList = GetTime();
             mapSeenSyncMNB[hash]++;
@@ -100,7 +113,14 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
 
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
-    if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
+    bool fSeen;
+    {
+        LOCK(cs_mapMasternodePayeeVotes);
+        fSeen = masternodePayments.mapMasternodePayeeVotes.count(hash);
+    }
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -113,8 +133,15 @@ void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 
 void CMasternodeSync::AddedBudgetItem(uint256 hash)
 {
-    if (budget.mapSeenMasternodeBudgetProposals.count(hash) || budget.mapSeenMasternodeBudgetVotes.count(hash) ||
-        budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash)) {
+    bool fSeen;
+    {
+        LOCK(budget.cs_mapSeen);
+        fSeen = budget.mapSeenMasternodeBudgetProposals.count(hash) || budget.mapSeenMasternodeBudgetVotes.count(hash) ||
+                budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash);
+    }
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncBudget[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastBudgetItem = GetTime();
             mapSeenSyncBudget[hash]++;
@@ -189,6 +216,7 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         int nCount;
         vRecv >> nItemID >> nCount;
 
+        LOCK(cs);
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
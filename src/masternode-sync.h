@@ -8,6 +8,8 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "sync.h"
+
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
 #define MASTERNODE_SYNC_LIST 2
@@ -31,6 +33,10 @@ extern CMasternodeSync masternodeSync;
 class CMasternodeSync
 {
 public:
+    // protects the mapSeenSync* maps and the item counters, which every masternode message
+    // group updates; no other lock is taken while holding it
+    mutable CCriticalSection cs;
+
     std::map<uint256, int> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
     std::map<uint256, int> mapSeenSyncBudget;
@@ -76,6 +82,9 @@ public:
     bool IsBlockchainSynced();
     bool IsMasternodeListSynced() { return RequestedMasternodeAssets > MASTERNODE_SYNC_LIST; }
     void ClearFulfilledRequest();
+
+private:
+    void Clear();
 };
 
 #endif
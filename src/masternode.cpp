@@ -79,6 +79,7 @@ CMasternode::CMasternode()
     nLastDsq = 0;
     nScanningErrorCount = 0;
     nLastScanningErrorBlockHeight = 0;
+    nCollateralAmount = 0;
     lastTimeChecked = 0;
 }
 
@@ -102,6 +103,7 @@ CMasternode::CMasternode(const CMasternode& other)
     nLastDsq = other.nLastDsq;
     nScanningErrorCount = other.nScanningErrorCount;
     nLastScanningErrorBlockHeight = other.nLastScanningErrorBlockHeight;
+    nCollateralAmount = other.nCollateralAmount;
     lastTimeChecked = 0;
 }
 
@@ -125,20 +127,30 @@ CMasternode::CMasternode(const CMasternodeBroadcast& mnb)
     nLastDsq = mnb.nLastDsq;
     nScanningErrorCount = 0;
     nLastScanningErrorBlockHeight = 0;
+    nCollateralAmount = mnb.nCollateralAmount;
     lastTimeChecked = 0;
 }
 
 unsigned int CMasternode::GetPhase (unsigned int atBlockHeight) {
-    CTransaction prevTx;
-    uint256 hashBlock = 0;
-    
-    if (!GetTransaction (vin.prevout.hash, prevTx, hashBlock, true))
-        return 0;
-    
-    if (vin.prevout.n >= prevTx.vout.size ())
-        return 0;
+    if (nCollateralAmount == 0) {
+        // callers may hold mnodeman's lock, which block validation takes under cs_main
+        TRY_LOCK (cs_main, lockMain);
+        if (!lockMain)
+            return 0;
+
+        CTransaction prevTx;
+        uint256 hashBlock = 0;
+        
+        if (!GetTransaction (vin.prevout.hash, prevTx, hashBlock, true))
+            return 0;
+        
+        if (vin.prevout.n >= prevTx.vout.size ())
+            return 0;
+
+        nCollateralAmount = prevTx.vout [vin.prevout.n].nValue;
+    }
     
-    return Params ().getMasternodePhase (prevTx.vout [vin.prevout.n].nValue, atBlockHeight);
+    return Params ().getMasternodePhase (nCollateralAmount, atBlockHeight);
 }
 
 //
@@ -157,6 +169,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
         int nDoS = 0;
         if (mnb.lastPing == CMasternodePing() || (mnb.lastPing != CMasternodePing() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
             lastPing = mnb.lastPing;
+            LOCK(mnodeman.cs_mapSeen);
             mnodeman.mapSeenMasternodePing.insert(make_pair(lastPing.GetHash(), lastPing));
         }
         return true;
@@ -174,19 +187,25 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     if (chainActive.Tip() == NULL) return 0;
 
     uint256 hash = 0;
-    uint256 aux = vin.prevout.hash + vin.prevout.n;
 
     if (!GetBlockHash(hash, nBlockHeight)) {
         LogPrint("masternode","CalculateScore ERROR - nHeight %d - Returned 0\n", nBlockHeight);
         return 0;
     }
 
+    return CalculateScore(hash);
+}
+
+uint256 CMasternode::CalculateScore(const uint256& hashBlock) const
+{
+    uint256 aux = vin.prevout.hash + vin.prevout.n;
+
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    ss << hash;
+    ss << hashBlock;
     uint256 hash2 = ss.GetHash();
 
     CHashWriter ss2(SER_GETHASH, PROTOCOL_VERSION);
-    ss2 << hash;
+    ss2 << hashBlock;
     ss2 << aux;
     uint256 hash3 = ss2.GetHash();
 
@@ -235,6 +254,8 @@ void CMasternode::Check(bool forceCheck)
             
             return;
         }
+
+        nCollateralAmount = coins->vout [vin.prevout.n].nValue;
     }
 
     activeState = MASTERNODE_ENABLED; // OK
@@ -595,6 +616,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
         TRY_LOCK(cs_main, lockMain);
         if (!lockMain) {
             // not mnb fault, let it to be checked again later
+            LOCK2(mnodeman.cs_mapSeen, masternodeSync.cs);
             mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
             masternodeSync.mapSeenSyncMNB.erase(GetHash());
             return false;
@@ -615,6 +637,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
         LogPrint("masternode","mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
         // maybe we miss few blocks, let this mnb to be checked again later
+        LOCK2(mnodeman.cs_mapSeen, masternodeSync.cs);
         mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
         masternodeSync.mapSeenSyncMNB.erase(GetHash());
         return false;
@@ -816,8 +839,11 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
             //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
             CMasternodeBroadcast mnb(*pmn);
             uint256 hash = mnb.GetHash();
-            if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
-                mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = *this;
+            {
+                LOCK(mnodeman.cs_mapSeen);
+                if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+                    mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = *this;
+                }
             }
 
             pmn->Check(true);
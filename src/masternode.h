@@ -145,6 +145,8 @@ public:
     int nScanningErrorCount;
     int nLastScanningErrorBlockHeight;
     CMasternodePing lastPing;
+    // value of the collateral output, 0 until Check() or GetPhase() has seen it
+    CAmount nCollateralAmount;
 
     CMasternode();
     CMasternode(const CMasternode& other);
@@ -175,6 +177,7 @@ public:
         swap(first.nLastDsq, second.nLastDsq);
         swap(first.nScanningErrorCount, second.nScanningErrorCount);
         swap(first.nLastScanningErrorBlockHeight, second.nLastScanningErrorBlockHeight);
+        swap(first.nCollateralAmount, second.nCollateralAmount);
     }
 
     CMasternode& operator=(CMasternode from)
@@ -192,6 +195,8 @@ public:
     }
 
     uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    /// Score against a block hash the caller already looked up
+    uint256 CalculateScore(const uint256& hashBlock) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -13,6 +13,7 @@
 #include "spork.h"
 #include "util.h"
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
@@ -27,22 +28,6 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-        const pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 //
 // CMasternodeDB
 //
@@ -197,6 +182,7 @@ void DumpMasternodes()
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    nListVersion = 0;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -210,6 +196,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        nListVersion++;
         return true;
     }
 
@@ -259,13 +246,16 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
-            map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
-            while (it3 != mapSeenMasternodeBroadcast.end()) {
-                if ((*it3).second.vin == (*it).vin) {
-                    masternodeSync.mapSeenSyncMNB.erase((*it3).first);
-                    mapSeenMasternodeBroadcast.erase(it3++);
-                } else {
-                    ++it3;
+            {
+                LOCK2(cs_mapSeen, masternodeSync.cs);
+                map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
+                while (it3 != mapSeenMasternodeBroadcast.end()) {
+                    if ((*it3).second.vin == (*it).vin) {
+                        masternodeSync.mapSeenSyncMNB.erase((*it3).first);
+                        mapSeenMasternodeBroadcast.erase(it3++);
+                    } else {
+                        ++it3;
+                    }
                 }
             }
 
@@ -280,6 +270,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -315,12 +306,14 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
+    LOCK2(cs_mapSeen, masternodeSync.cs);
+
     // remove expired mapSeenMasternodeBroadcast
     map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
     while (it3 != mapSeenMasternodeBroadcast.end()) {
         if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
+            masternodeSync.mapSeenSyncMNB.erase((*it3).first);
             mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
         } else {
             ++it3;
         }
@@ -339,8 +332,9 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 
 void CMasternodeMan::Clear()
 {
-    LOCK(cs);
+    LOCK2(cs, cs_mapSeen);
     vMasternodes.clear();
+    nListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -551,11 +545,15 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment (int nBlockHeigh
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
+    std::shared_ptr<const CMasternodeScoreTable> pscores = GetScoreTable(nBlockHeight - 100);
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeLastPaid) {
-        CMasternode* pmn = Find(s.second);
+        std::map<COutPoint, size_t>::const_iterator itPos = pscores->mapPosition.find(s.second.prevout);
+        if (itPos == pscores->mapPosition.end()) break;
+        const CMasternodeScoreTable::CEntry& entry = pscores->vEntries[itPos->second];
+        CMasternode* pmn = GetScoreTableEntry(entry);
         if (!pmn) break;
 
-        uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
+        uint256 n = entry.nScore;
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -631,9 +629,72 @@ CMasternode* CMasternodeMan::GetCurrentMasternodeOnLevel (unsigned int masternod
     return winner;
 }
 
+std::shared_ptr<const CMasternodeScoreTable> CMasternodeMan::GetScoreTable(int64_t nBlockHeight)
+{
+    // CalculateScore() scores every masternode 0 when the block is unknown
+    uint256 hashBlock = 0;
+    if (chainActive.Tip() == NULL || !GetBlockHash(hashBlock, nBlockHeight))
+        hashBlock = 0;
+
+    LOCK(cs_scoreTables);
+
+    std::map<int64_t, std::shared_ptr<const CMasternodeScoreTable> >::iterator it = mapScoreTables.find(nBlockHeight);
+    if (it != mapScoreTables.end() && it->second->hashBlock == hashBlock && it->second->nListVersion == nListVersion &&
+        it->second->vEntries.size() == vMasternodes.size())
+        return it->second;
+
+    std::shared_ptr<CMasternodeScoreTable> pscores = std::make_shared<CMasternodeScoreTable>();
+    pscores->hashBlock = hashBlock;
+    pscores->nListVersion = nListVersion;
+    pscores->vEntries.resize(vMasternodes.size());
+
+    // Two hashes per masternode; large lists are split over threads
+    std::vector<CMasternodeScoreTable::CEntry>& vEntries = pscores->vEntries;
+    auto scoreRange = [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CMasternodeScoreTable::CEntry& entry = vEntries[i];
+            entry.nScore = hashBlock == 0 ? uint256(0) : vMasternodes[i].CalculateScore(hashBlock);
+            entry.nCompactScore = entry.nScore.GetCompact(false);
+            entry.prevout = vMasternodes[i].vin.prevout;
+            entry.nIndex = i;
+        }
+    };
+    if (vEntries.size() < MASTERNODES_SCORE_PARALLEL_MIN || nParallelThreads < 2) {
+        scoreRange(0, vEntries.size());
+    } else {
+        size_t nChunk = (vEntries.size() + nParallelThreads - 1) / nParallelThreads;
+        RunParallel((vEntries.size() + nChunk - 1) / nChunk, [&scoreRange, nChunk, &vEntries](uint32_t n) {
+            scoreRange(n * nChunk, std::min((n + 1) * nChunk, vEntries.size()));
+            return true;
+        });
+    }
+
+    // Best first. The full score breaks ties between equal compact scores,
+    // so every node orders the same list the same way.
+    std::sort(vEntries.begin(), vEntries.end(), [](const CMasternodeScoreTable::CEntry& a, const CMasternodeScoreTable::CEntry& b) {
+        if (a.nScore != b.nScore)
+            return a.nScore > b.nScore;
+        return a.prevout < b.prevout;
+    });
+    for (size_t i = 0; i < vEntries.size(); i++)
+        pscores->mapPosition[vEntries[i].prevout] = i;
+
+    mapScoreTables[nBlockHeight] = pscores;
+    if (mapScoreTables.size() > MASTERNODES_SCORE_TABLES)
+        mapScoreTables.erase(mapScoreTables.begin());
+
+    return pscores;
+}
+
+CMasternode* CMasternodeMan::GetScoreTableEntry(const CMasternodeScoreTable::CEntry& entry)
+{
+    if (entry.nIndex >= vMasternodes.size() || vMasternodes[entry.nIndex].vin.prevout != entry.prevout)
+        return NULL;
+    return &vMasternodes[entry.nIndex];
+}
+
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -641,14 +702,22 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    std::shared_ptr<const CMasternodeScoreTable> pscores = GetScoreTable(nBlockHeight);
+    std::map<COutPoint, size_t>::const_iterator itPos = pscores->mapPosition.find(vin.prevout);
+    if (itPos == pscores->mapPosition.end()) return -1;
+
+    // Apply the filters, and refresh the state with Check(), over the whole list as the
+    // scan without score tables did, whatever rank the masternodes turn out to have
+    bool fCheckAge = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    std::vector<bool> vCounted(vMasternodes.size(), false);
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        CMasternode& mn = vMasternodes[i];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+        if (fCheckAge) {
             nMasternode_Age = GetAdjustedTime() - mn.sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
@@ -659,18 +728,17 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
+        vCounted[i] = true;
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
+    // count the masternodes scored at or above this one that pass the filters
     int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
+    for (size_t i = 0; i <= itPos->second; i++) {
+        const CMasternodeScoreTable::CEntry& entry = pscores->vEntries[i];
+        if (!GetScoreTableEntry(entry) || !vCounted[entry.nIndex]) continue;
+
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (i == itPos->second) {
             return rank;
         }
     }
@@ -687,8 +755,13 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    // scan for winner, in score order
+    std::shared_ptr<const CMasternodeScoreTable> pscores = GetScoreTable(nBlockHeight);
+    for (const CMasternodeScoreTable::CEntry& entry : pscores->vEntries) {
+        CMasternode* pmn = GetScoreTableEntry(entry);
+        if (!pmn) continue;
+        CMasternode& mn = *pmn;
+
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -698,13 +771,13 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        vecMasternodeScores.push_back(make_pair(entry.nCompactScore, mn));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    // only moves the disabled entries, the rest is already sorted
+    std::stable_sort(vecMasternodeScores.begin(), vecMasternodeScores.end(), [](const pair<int64_t, CMasternode>& a, const pair<int64_t, CMasternode>& b) {
+        return a.first > b.first;
+    });
 
     int rank = 0;
     for (PAIRTYPE(int64_t, CMasternode) & s : vecMasternodeScores) {
@@ -717,29 +790,22 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    std::shared_ptr<const CMasternodeScoreTable> pscores = GetScoreTable(nBlockHeight);
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
+    int rank = 0;
+    for (const CMasternodeScoreTable::CEntry& entry : pscores->vEntries) {
+        CMasternode* pmn = GetScoreTableEntry(entry);
+        if (!pmn) continue;
+
+        if (pmn->protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
+            pmn->Check();
+            if (!pmn->IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return pmn;
         }
     }
 
@@ -773,11 +839,15 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
+        bool fSeen;
+        {
+            LOCK(cs_mapSeen);
+            fSeen = !mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb)).second;
+        }
+        if (fSeen) {
             masternodeSync.AddedMasternodeList(mnb.GetHash());
             return;
         }
-        mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
 
         int nDoS = 0;
         if (!mnb.CheckAndUpdate(nDoS)) {
@@ -816,8 +886,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         LogPrint("masternode", "mnp - Masternode ping, vin: %s\n", mnp.vin.prevout.hash.ToString());
 
-        if (mapSeenMasternodePing.count(mnp.GetHash())) return; //seen
-        mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp));
+        {
+            LOCK(cs_mapSeen);
+            if (!mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp)).second) return; //seen
+        }
 
         int nDoS = 0;
         if (mnp.CheckAndUpdate(nDoS)) return;
@@ -874,7 +946,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
                     nInvCount++;
 
-                    if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+                    {
+                        LOCK(cs_mapSeen);
+                        mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+                    }
 
                     if (vin == mn.vin) {
                         LogPrint("masternode", "dseg - Sent 1 Masternode entry to peer %i\n", pfrom->GetId());
@@ -900,6 +975,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
@@ -908,8 +984,11 @@ void CMasternodeMan::Remove(CTxIn vin)
 
 void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
 {
-	mapSeenMasternodePing.insert(make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
-	mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+	{
+		LOCK(cs_mapSeen);
+		mapSeenMasternodePing.insert(make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
+		mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+	}
 	masternodeSync.AddedMasternodeList(mnb.GetHash());
 
     LogPrint("masternode","CMasternodeMan::UpdateMasternodeList() -- masternode=%s\n", mnb.vin.prevout.ToString());
@@ -16,8 +16,14 @@
 #include "sync.h"
 #include "util.h"
 
+#include <memory>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+/** Number of block heights CMasternodeMan keeps score tables for */
+#define MASTERNODES_SCORE_TABLES 20
+/** Lists at least this long are scored on several threads */
+#define MASTERNODES_SCORE_PARALLEL_MIN 1000
 
 using namespace std;
 
@@ -50,6 +56,24 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Scores of every listed masternode against one block, best first
+ */
+class CMasternodeScoreTable
+{
+public:
+    struct CEntry {
+        uint256 nScore;
+        int64_t nCompactScore;
+        COutPoint prevout;
+        size_t nIndex; // position in CMasternodeMan::vMasternodes
+    };
+
+    uint256 hashBlock;
+    uint64_t nListVersion;
+    std::vector<CEntry> vEntries;
+    std::map<COutPoint, size_t> mapPosition; // position in vEntries
+};
+
 class CMasternodeMan
 {
 private:
@@ -68,7 +92,24 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // bumped whenever entries are added to or removed from vMasternodes
+    uint64_t nListVersion;
+    // protects mapScoreTables; no other lock is taken while holding it
+    mutable CCriticalSection cs_scoreTables;
+    // score tables by block height, see GetScoreTable()
+    std::map<int64_t, std::shared_ptr<const CMasternodeScoreTable> > mapScoreTables;
+
+    /// Scores of the current list for nBlockHeight, computed once per height and list version
+    std::shared_ptr<const CMasternodeScoreTable> GetScoreTable(int64_t nBlockHeight);
+    /// The masternode behind a table entry, NULL if the list changed underneath
+    CMasternode* GetScoreTableEntry(const CMasternodeScoreTable::CEntry& entry);
+
 public:
+    // protects mapSeenMasternodeBroadcast and mapSeenMasternodePing, which the payment, budget and
+    // core message handlers read too; taken after cs and cs_main, only masternodeSync.cs and the
+    // peer send locks are taken while holding it
+    mutable CCriticalSection cs_mapSeen;
+
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
@@ -82,8 +123,10 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        LOCK(cs);
+        LOCK2(cs, cs_mapSeen);
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            nListVersion++;
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
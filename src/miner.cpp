@@ -32,8 +32,13 @@
 #include "zsmncchain.h"
 
 
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <set>
+
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 
 using namespace std;
 
@@ -42,62 +47,419 @@ using namespace std;
 // SupportMasterNodeCommunityMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
+uint64_t nLastBlockTx = 0;
+uint64_t nLastBlockSize = 0;
+int64_t nLastCoinStakeSearchInterval = 0;
+
+void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
+{
+	pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+
+	// Updating time can change work required on testnet:
+	if (Params().AllowMinDifficultyBlocks())
+		pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+	pblock->InvalidateHash();
+}
+
+//! Rebuild the cached template from scratch when the mempool changed and it is older than this, in seconds
+static const int64_t BLOCK_ASSEMBLY_REBUILD_INTERVAL = 60;
+
+namespace
+{
+/**
+ * The mempool transactions for the next block. The template is kept between calls to
+ * CreateNewBlock() and only extended with what entered the mempool since, so that a
+ * staker that finds a kernel just puts its coinbase and coinstake in front of it.
+ * Valid as long as the tip does not change; protected by cs_main.
+ */
+class CBlockAssembly
 {
 public:
-	const CTransaction* ptx;
-	set<uint256> setDependsOn;
-	CFeeRate feeRate;
-	double dPriority;
+	uint256 hashPrevBlock;
+	const CCoinsViewCache* pcoinsBase;
+	unsigned int nTransactionsUpdated;
+	int64_t nTimeRebuilt;
+
+	std::vector<CTransaction> vtx;
+	std::vector<CAmount> vTxFees;
+	std::vector<int64_t> vTxSigOps;
+	uint64_t nBlockSize;
+	int nBlockSigOps;
+	CAmount nFees;
+
+	CBlockAssembly() : hashPrevBlock(0), pcoinsBase(NULL), nTransactionsUpdated(0), nTimeRebuilt(0), nBlockSize(0), nBlockSigOps(0), nFees(0) {}
+
+	/** Start an empty template on top of pindexPrev, with the inputs of ptxReserved spent if it is given */
+	void Reset(const CBlockIndex* pindexPrev, const CTransaction* ptxReserved);
+	/** Add the mempool transactions that are not in the template yet, as far as they fit */
+	void AddTransactions(int nHeight);
+	/** Whether tx spends an input or zerocoin serial the template spends */
+	bool ConflictsWith(const CTransaction& tx) const;
+	void Invalidate() { hashPrevBlock = 0; }
+
+private:
+	std::unique_ptr<CCoinsViewCache> pview;
+	std::set<uint256> setInBlock;
+	vector<CBigNum> vBlockSerials;
+
+	bool ParentsInBlock(CTxMemPool::txiter iter) const;
+	void GetPackage(CTxMemPool::txiter iter, std::vector<CTxMemPool::txiter>& vPackage, CAmount& nPackageFees, uint64_t& nPackageSize) const;
+	bool AddToBlock(CTxMemPool::txiter iter, int nHeight, unsigned int nBlockMaxSize, CCoinsViewCache& view);
+	void Truncate(size_t nTx, size_t nSerials);
+};
 
-	COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-	{
+void CBlockAssembly::Reset(const CBlockIndex* pindexPrev, const CTransaction* ptxReserved)
+{
+	hashPrevBlock = pindexPrev->GetBlockHash();
+	pcoinsBase = pcoinsTip;
+	nTimeRebuilt = GetTime();
+	vtx.clear();
+	vTxFees.clear();
+	vTxSigOps.clear();
+	setInBlock.clear();
+	vBlockSerials.clear();
+	nBlockSize = 1000;
+	nBlockSigOps = 100;
+	nFees = 0;
+	pview.reset(new CCoinsViewCache(pcoinsTip));
+
+	if (ptxReserved) {
+		if (ptxReserved->IsZerocoinSpend()) {
+			for (const CTxIn& txIn : ptxReserved->vin) {
+				if (txIn.scriptSig.IsZerocoinSpend())
+					vBlockSerials.emplace_back(TxInToZerocoinSpend(txIn).getCoinSerialNumber());
+			}
+		} else {
+			CValidationState state;
+			CTxUndo txundo;
+			UpdateCoins(*ptxReserved, state, *pview, txundo, pindexPrev->nHeight + 1);
+		}
 	}
-};
+}
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockSize = 0;
-int64_t nLastCoinStakeSearchInterval = 0;
+bool CBlockAssembly::ConflictsWith(const CTransaction& tx) const
+{
+	if (tx.IsZerocoinSpend()) {
+		for (const CTxIn& txIn : tx.vin) {
+			if (txIn.scriptSig.IsZerocoinSpend() && count(vBlockSerials.begin(), vBlockSerials.end(), TxInToZerocoinSpend(txIn).getCoinSerialNumber()))
+				return true;
+		}
+		return false;
+	}
+	return !pview->HaveInputs(tx);
+}
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+// An entry can go in once all its in-mempool parents are in the block
+bool CBlockAssembly::ParentsInBlock(CTxMemPool::txiter iter) const
 {
-	bool byFee;
+	for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(iter)) {
+		if (!setInBlock.count(parent->GetTx().GetHash()))
+			return false;
+	}
+	return true;
+}
 
-public:
-	TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
+// The entry and its in-mempool ancestors that are not in the block yet, parents before children
+void CBlockAssembly::GetPackage(CTxMemPool::txiter iter, std::vector<CTxMemPool::txiter>& vPackage, CAmount& nPackageFees, uint64_t& nPackageSize) const
+{
+	vPackage.clear();
+	nPackageFees = iter->GetModifiedFee();
+	nPackageSize = iter->GetTxSize();
+	if (ParentsInBlock(iter)) {
+		vPackage.push_back(iter);
+		return;
+	}
 
-	bool operator()(const TxPriority& a, const TxPriority& b)
-	{
-		if (byFee) {
-			if (a.get<1>() == b.get<1>())
-				return a.get<0>() < b.get<0>();
-			return a.get<1>() < b.get<1>();
+	CTxMemPool::setEntries setAncestors;
+	uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+	std::string dummy;
+	mempool.CalculateMemPoolAncestors(*iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+	for (CTxMemPool::txiter ancestor : setAncestors) {
+		if (setInBlock.count(ancestor->GetTx().GetHash()))
+			continue;
+		vPackage.push_back(ancestor);
+		nPackageFees += ancestor->GetModifiedFee();
+		nPackageSize += ancestor->GetTxSize();
+	}
+
+	// An entry has more in-mempool ancestors than any of its parents
+	std::sort(vPackage.begin(), vPackage.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+		return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+	});
+	vPackage.push_back(iter);
+}
+
+// Add an entry to the block if it fits and is valid on top of the ones before it, spending its inputs in view
+bool CBlockAssembly::AddToBlock(CTxMemPool::txiter iter, int nHeight, unsigned int nBlockMaxSize, CCoinsViewCache& view)
+{
+	const CTransaction& tx = iter->GetTx();
+	if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+		return false;
+	if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+		return false;
+
+	// Size limits
+	unsigned int nTxSize = iter->GetTxSize();
+	if (nBlockSize + nTxSize >= nBlockMaxSize)
+		return false;
+
+	// Legacy limits on sigOps:
+	unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+	unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+	if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+		return false;
+
+	//Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+	if (!tx.IsZerocoinSpend()) {
+		for (const CTxIn& txin : tx.vin) {
+			if (invalid_out::ContainsOutPoint(txin.prevout)) {
+				LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+				return false;
+			}
 		}
-		else {
-			if (a.get<0>() == b.get<0>())
-				return a.get<1>() < b.get<1>();
-			return a.get<0>() < b.get<0>();
+	}
+
+	if (!view.HaveInputs(tx))
+		return false;
+
+	// double check that there are no double spent zsmnc spends in this block or tx
+	vector<CBigNum> vTxSerials;
+	if (tx.IsZerocoinSpend()) {
+		int nHeightTx = 0;
+		if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+			return false;
+
+		for (const CTxIn& txIn : tx.vin) {
+			if (txIn.scriptSig.IsZerocoinSpend()) {
+				libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+				bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend.getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+				if (!spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
+					return false;
+				//This zsmnc serial has already been included in the block, do not add this tx.
+				if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
+					return false;
+				if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber()))
+					return false;
+				vTxSerials.emplace_back(spend.getCoinSerialNumber());
+			}
 		}
 	}
-};
 
-void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
+	CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+	nTxSigOps += GetP2SHSigOpCount(tx, view);
+	if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+		return false;
+
+	// Note that flags: we don't want to set mempool/IsStandard()
+	// policy here, but we still have to ensure that the block we
+	// create only contains transactions that are valid in new blocks.
+	CValidationState state;
+	if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+		return false;
+
+	CTxUndo txundo;
+	UpdateCoins(tx, state, view, txundo, nHeight);
+
+	// Added
+	vtx.push_back(tx);
+	vTxFees.push_back(nTxFees);
+	vTxSigOps.push_back(nTxSigOps);
+	nBlockSize += nTxSize;
+	nBlockSigOps += nTxSigOps;
+	nFees += nTxFees;
+	setInBlock.insert(tx.GetHash());
+
+	for (const CBigNum& bnSerial : vTxSerials)
+		vBlockSerials.emplace_back(bnSerial);
+
+	if (GetBoolArg("-printpriority", false)) {
+		LogPrintf("priority %.1f fee %s txid %s\n",
+			iter->GetPriority(nHeight), CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
+	}
+	return true;
+}
+
+// Take the entries from position nTx on out of the block again, and the zerocoin serials from nSerials on
+void CBlockAssembly::Truncate(size_t nTx, size_t nSerials)
 {
-	pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+	for (size_t i = nTx; i < vtx.size(); i++) {
+		setInBlock.erase(vtx[i].GetHash());
+		nBlockSize -= ::GetSerializeSize(vtx[i], SER_NETWORK, PROTOCOL_VERSION);
+		nBlockSigOps -= vTxSigOps[i];
+		nFees -= vTxFees[i];
+	}
+	vtx.erase(vtx.begin() + nTx, vtx.end());
+	vTxFees.erase(vTxFees.begin() + nTx, vTxFees.end());
+	vTxSigOps.erase(vTxSigOps.begin() + nTx, vTxSigOps.end());
+	vBlockSerials.erase(vBlockSerials.begin() + nSerials, vBlockSerials.end());
+}
 
-	// Updating time can change work required on testnet:
-	if (Params().AllowMinDifficultyBlocks())
-		pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+void CBlockAssembly::AddTransactions(int nHeight)
+{
+	AssertLockHeld(mempool.cs);
+
+	// Largest block you're willing to create:
+	unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+	// Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+	unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
+	nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
+
+	// How much of the block should be dedicated to high-priority transactions,
+	// included regardless of the fees they pay
+	unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+	nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+	// Minimum block size you want to create; block will be filled with free transactions
+	// until there are no more or the block reaches this size:
+	unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+	nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+	// In the priority pass, an entry whose
+	// in-mempool parents are not in the block yet waits in waitSet until they are
+	CTxMemPool::setEntries waitSet;
+	std::deque<CTxMemPool::txiter> clearedTxs;
+
+	// Zerocoin spends first, oldest first, then as long as there is room for
+	// them the transactions with the highest priority, included regardless of
+	// their fees. The index orders by starting priority; the priority of the
+	// entry at this height decides whether it is still high enough.
+	bool fPriorityBlock = nBlockPrioritySize > 0;
+	typedef CTxMemPool::indexed_transaction_set::index<priority>::type::iterator priority_iter;
+	priority_iter mi = mempool.mapTx.get<priority>().begin();
+	while (mi != mempool.mapTx.get<priority>().end() || !clearedTxs.empty()) {
+		CTxMemPool::txiter iter;
+		if (!clearedTxs.empty()) {
+			iter = clearedTxs.front();
+			clearedTxs.pop_front();
+		} else {
+			iter = mempool.mapTx.project<0>(mi++);
+		}
+		const CTransaction& tx = iter->GetTx();
+		if (setInBlock.count(tx.GetHash()))
+			continue;
+
+		if (!tx.IsZerocoinSpend()) {
+			if (!fPriorityBlock)
+				break;
+			double dPriority = iter->GetPriority(nHeight);
+			double dPriorityDelta = 0;
+			CAmount nFeeDelta = 0;
+			mempool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nFeeDelta);
+			if (nBlockSize + iter->GetTxSize() >= nBlockPrioritySize || !AllowFree(dPriority + dPriorityDelta))
+				break;
+		}
+
+		if (!ParentsInBlock(iter)) {
+			waitSet.insert(iter);
+			continue;
+		}
+		if (!AddToBlock(iter, nHeight, nBlockMaxSize, *pview))
+			continue;
+
+		// Children waiting for this one may be ready now
+		for (CTxMemPool::txiter child : mempool.GetMemPoolChildren(iter)) {
+			if (waitSet.count(child) && ParentsInBlock(child)) {
+				waitSet.erase(child);
+				clearedTxs.push_back(child);
+			}
+		}
+	}
+
+	// Then by fee rate including the in-mempool ancestors. An entry whose parents are not
+	// in the block yet brings them along, parents first, so that a child can pay for them.
+	typedef CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator ancestor_score_iter;
+	for (ancestor_score_iter ai = mempool.mapTx.get<ancestor_score>().begin(); ai != mempool.mapTx.get<ancestor_score>().end(); ++ai) {
+		CTxMemPool::txiter iter = mempool.mapTx.project<0>(ai);
+		const CTransaction& tx = iter->GetTx();
+		if (setInBlock.count(tx.GetHash()))
+			continue;
+
+		std::vector<CTxMemPool::txiter> vPackage;
+		CAmount nPackageFees;
+		uint64_t nPackageSize;
+		GetPackage(iter, vPackage, nPackageFees, nPackageSize);
+		if (nBlockSize + nPackageSize >= nBlockMaxSize)
+			continue;
+
+		// Skip free transactions if we're past the minimum block size. The index is ordered
+		// by this fee rate, so nothing after the first one pays more, unless part of the
+		// entry's ancestors are in the block already and no longer count.
+		if (!tx.IsZerocoinSpend() && nBlockSize + nPackageSize >= nBlockMinSize) {
+			double dPriorityDelta = 0;
+			CAmount nFeeDelta = 0;
+			mempool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nFeeDelta);
+			if (dPriorityDelta <= 0 && nFeeDelta <= 0 && CFeeRate(nPackageFees, nPackageSize) < ::minRelayTxFee) {
+				if (vPackage.size() == iter->GetCountWithAncestors())
+					break;
+				continue;
+			}
+		}
+
+		// The package goes in as a whole or not at all: its inputs are spent in a view of its own,
+		// flushed into the block's once every entry was added
+		CCoinsViewCache viewPackage(pview.get());
+		viewPackage.SetBestBlock(pview->GetBestBlock());
+		size_t nTx = vtx.size();
+		size_t nSerials = vBlockSerials.size();
+		bool fAdded = true;
+		for (CTxMemPool::txiter entry : vPackage) {
+			if (!AddToBlock(entry, nHeight, nBlockMaxSize, viewPackage)) {
+				fAdded = false;
+				break;
+			}
+		}
+		if (fAdded)
+			viewPackage.Flush();
+		else
+			Truncate(nTx, nSerials);
+	}
+}
+} // namespace
+
+static CBlockAssembly blockAssembly;
+static CCriticalSection cs_blockAssemblyStats;
+static CBlockAssemblyStats blockAssemblyStats;
+static int64_t nStakeFoundMicros = 0;
+
+CBlockAssemblyStats GetBlockAssemblyStats()
+{
+	LOCK(cs_blockAssemblyStats);
+	return blockAssemblyStats;
+}
+
+/** Bring the cached template up to date with the tip and the mempool */
+static void UpdateBlockAssembly(const CBlockIndex* pindexPrev)
+{
+	AssertLockHeld(cs_main);
+	AssertLockHeld(mempool.cs);
+
+	unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+	bool fMempoolChanged = nTransactionsUpdated != blockAssembly.nTransactionsUpdated;
+	bool fRebuild = blockAssembly.hashPrevBlock != pindexPrev->GetBlockHash() || blockAssembly.pcoinsBase != pcoinsTip ||
+					(fMempoolChanged && GetTime() - blockAssembly.nTimeRebuilt > BLOCK_ASSEMBLY_REBUILD_INTERVAL);
+	if (!fRebuild && !fMempoolChanged)
+		return;
+
+	int64_t nStart = GetTimeMicros();
+	if (fRebuild)
+		blockAssembly.Reset(pindexPrev, NULL);
+	blockAssembly.AddTransactions(pindexPrev->nHeight + 1);
+	blockAssembly.nTransactionsUpdated = nTransactionsUpdated;
+	int64_t nDuration = GetTimeMicros() - nStart;
+	LogPrint("miner", "%s : %s template, %u transactions, %u bytes in %.2fms\n", __func__, fRebuild ? "rebuilt" : "extended",
+		blockAssembly.vtx.size(), blockAssembly.nBlockSize, nDuration * 0.001);
+
+	LOCK(cs_blockAssemblyStats);
+	blockAssemblyStats.nTime = GetTime();
+	blockAssemblyStats.nUpdateMicros = nDuration;
+	blockAssemblyStats.fRebuilt = fRebuild;
+	blockAssemblyStats.nTx = blockAssembly.vtx.size();
+	blockAssemblyStats.nSize = blockAssembly.nBlockSize;
+	if (fRebuild)
+		blockAssemblyStats.nRebuilds++;
+	else
+		blockAssemblyStats.nUpdates++;
 }
 
 std::pair<int, std::pair<uint256, uint256> > pCheckpointCache;
@@ -138,6 +500,12 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
 	if (fProofOfStake) {
 		boost::this_thread::interruption_point();
+		// Have the transactions ready before the kernel search, a kernel found then
+		// only needs them spliced in behind the coinstake
+		{
+			LOCK2(cs_main, mempool.cs);
+			UpdateBlockAssembly(chainActive.Tip());
+		}
 		pblock->nTime = GetAdjustedTime();
 		CBlockIndex* pindexPrev = chainActive.Tip();
 		pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
@@ -151,6 +519,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 				pblock->vtx[0].vout[0].SetEmpty();
 				pblock->vtx.push_back(CTransaction(txCoinStake));
 				fStakeFound = true;
+				nStakeFoundMicros = GetTimeMicros();
 			}
 			nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
 			nLastCoinStakeSearchTime = nSearchTime;
@@ -160,22 +529,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 			return NULL;
 	}
 
-	// Largest block you're willing to create:
-	unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-	// Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-	unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
-	nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
-
-	// How much of the block should be dedicated to high-priority transactions,
-	// included regardless of the fees they pay
-	unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-	nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-	// Minimum block size you want to create; block will be filled with free transactions
-	// until there are no more or the block reaches this size:
-	unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-	nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
 	// Collect memory pool transactions into the block
 	CAmount nFees = 0;
 
@@ -185,248 +538,24 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
         txNew.vin[0].scriptSig = CScript() << nHeight << OP_0;
-        CCoinsViewCache view(pcoinsTip);
-
-		// Priority order to process transactions
-		list<COrphan> vOrphan; // list memory doesn't move
-		map<uint256, vector<COrphan*> > mapDependers;
-		bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-		// This vector will be sorted into a priority queue:
-		vector<TxPriority> vecPriority;
-		vecPriority.reserve(mempool.mapTx.size());
-		for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-			mi != mempool.mapTx.end(); ++mi) {
-			const CTransaction& tx = mi->second.GetTx();
-			if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) {
-				continue;
-			}
-			if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()) {
-				continue;
-			}
-
-			COrphan* porphan = NULL;
-			double dPriority = 0;
-			CAmount nTotalIn = 0;
-			bool fMissingInputs = false;
-			uint256 txid = tx.GetHash();
-			for (const CTxIn& txin : tx.vin) {
-				//zerocoinspend has special vin
-				if (tx.IsZerocoinSpend()) {
-					nTotalIn = tx.GetZerocoinSpent();
-
-					//Give a high priority to zerocoinspends to get into the next block
-					//Priority = (age^6+100000)*amount - gives higher priority to zsmncs that have been in mempool long
-					//and higher priority to zsmncs that are large in value
-					int64_t nTimeSeen = GetAdjustedTime();
-					double nConfs = 100000;
-
-					auto it = mapZerocoinspends.find(txid);
-					if (it != mapZerocoinspends.end()) {
-						nTimeSeen = it->second;
-					}
-					else {
-						//for some reason not in map, add it
-						mapZerocoinspends[txid] = nTimeSeen;
-					}
-
-					double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
-
-					// zsmnc spends can have very large priority, use non-overflowing safe functions
-					dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
-					dPriority = double_safe_multiplication(dPriority, nTotalIn);
-
-					continue;
-				}
-
-				// Read prev transaction
-				if (!view.HaveCoins(txin.prevout.hash)) {
-					// This should never happen; all transactions in the memory
-					// pool should connect to either transactions in the chain
-					// or other transactions in the memory pool.
-					if (!mempool.mapTx.count(txin.prevout.hash)) {
-						LogPrintf("ERROR: mempool transaction missing input\n");
-						if (fDebug) assert("mempool transaction missing input" == 0);
-						fMissingInputs = true;
-						if (porphan)
-							vOrphan.pop_back();
-						break;
-					}
-
-					// Has to wait for dependencies
-					if (!porphan) {
-						// Use list for automatic deletion
-						vOrphan.push_back(COrphan(&tx));
-						porphan = &vOrphan.back();
-					}
-					mapDependers[txin.prevout.hash].push_back(porphan);
-					porphan->setDependsOn.insert(txin.prevout.hash);
-					nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-					continue;
-				}
-
-				//Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-				if (invalid_out::ContainsOutPoint(txin.prevout)) {
-					LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-					fMissingInputs = true;
-					break;
-				}
-
-				const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-				assert(coins);
-
-				CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-				nTotalIn += nValueIn;
-
-				int nConf = nHeight - coins->nHeight;
-
-				// zsmnc spends can have very large priority, use non-overflowing safe functions
-				dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-
-			}
-			if (fMissingInputs) continue;
-
-			// Priority is sum(valuein * age) / modified_txsize
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-			dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-			uint256 hash = tx.GetHash();
-			mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-			CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-			if (porphan) {
-				porphan->dPriority = dPriority;
-				porphan->feeRate = feeRate;
-			}
-			else
-				vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-		}
 
 		// Collect transactions into block
-		uint64_t nBlockSize = 1000;
-		uint64_t nBlockTx = 0;
-		int nBlockSigOps = 100;
-		bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-		TxPriorityCompare comparer(fSortedByFee);
-		std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-		vector<CBigNum> vBlockSerials;
-		vector<CBigNum> vTxSerials;
-		while (!vecPriority.empty()) {
-			// Take highest priority transaction off the priority queue:
-			double dPriority = vecPriority.front().get<0>();
-			CFeeRate feeRate = vecPriority.front().get<1>();
-			const CTransaction& tx = *(vecPriority.front().get<2>());
-
-			std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-			vecPriority.pop_back();
-
-			// Size limits
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-			if (nBlockSize + nTxSize >= nBlockMaxSize)
-				continue;
-
-			// Legacy limits on sigOps:
-			unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-			unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-			if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-				continue;
-
-			// Skip free transactions if we're past the minimum block size:
-			const uint256& hash = tx.GetHash();
-			double dPriorityDelta = 0;
-			CAmount nFeeDelta = 0;
-			mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-			if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-				continue;
-
-			// Prioritise by fee once past the priority size or we run out of high-priority
-			// transactions:
-			if (!fSortedByFee &&
-				((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-				fSortedByFee = true;
-				comparer = TxPriorityCompare(fSortedByFee);
-				std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-			}
-
-			if (!view.HaveInputs(tx))
-				continue;
-
-			// double check that there are no double spent zsmnc spends in this block or tx
-			if (tx.IsZerocoinSpend()) {
-				int nHeightTx = 0;
-				if (IsTransactionInChain(tx.GetHash(), nHeightTx))
-					continue;
-
-				bool fDoubleSerial = false;
-				for (const CTxIn& txIn : tx.vin) {
-					if (txIn.scriptSig.IsZerocoinSpend()) {
-						libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-						bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend.getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
-						if (!spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
-							fDoubleSerial = true;
-						if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
-							fDoubleSerial = true;
-						if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber()))
-							fDoubleSerial = true;
-						if (fDoubleSerial)
-							break;
-						vTxSerials.emplace_back(spend.getCoinSerialNumber());
-					}
-				}
-				//This zsmnc serial has already been included in the block, do not add this tx.
-				if (fDoubleSerial)
-					continue;
-			}
-
-			CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-			nTxSigOps += GetP2SHSigOpCount(tx, view);
-			if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-				continue;
-
-			// Note that flags: we don't want to set mempool/IsStandard()
-			// policy here, but we still have to ensure that the block we
-			// create only contains transactions that are valid in new blocks.
-			CValidationState state;
-			if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-				continue;
-
-			CTxUndo txundo;
-			UpdateCoins(tx, state, view, txundo, nHeight);
-
-			// Added
-			pblock->vtx.push_back(tx);
-			pblocktemplate->vTxFees.push_back(nTxFees);
-			pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-			nBlockSize += nTxSize;
-			++nBlockTx;
-			nBlockSigOps += nTxSigOps;
-			nFees += nTxFees;
-
-			for (const CBigNum& bnSerial : vTxSerials)
-				vBlockSerials.emplace_back(bnSerial);
-
-			if (fPrintPriority) {
-				LogPrintf("priority %.1f fee %s txid %s\n",
-					dPriority, feeRate.ToString(), tx.GetHash().ToString());
-			}
-
-			// Add transactions that depend on this one to the priority queue
-			if (mapDependers.count(hash)) {
-				BOOST_FOREACH(COrphan* porphan, mapDependers[hash]) {
-					if (!porphan->setDependsOn.empty()) {
-						porphan->setDependsOn.erase(hash);
-						if (porphan->setDependsOn.empty()) {
-							vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-							std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-						}
-					}
-				}
-			}
+		UpdateBlockAssembly(pindexPrev);
+		if (fProofOfStake && blockAssembly.ConflictsWith(pblock->vtx[1])) {
+			// The template spends what we stake: one without those transactions, for this block only
+			LogPrint("miner", "CreateNewBlock() : coinstake conflicts with the template, rebuilding\n");
+			blockAssembly.Reset(pindexPrev, &pblock->vtx[1]);
+			blockAssembly.AddTransactions(nHeight);
+			pblock->vtx.insert(pblock->vtx.end(), blockAssembly.vtx.begin(), blockAssembly.vtx.end());
+			blockAssembly.Invalidate();
+		} else {
+			pblock->vtx.insert(pblock->vtx.end(), blockAssembly.vtx.begin(), blockAssembly.vtx.end());
 		}
+		pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), blockAssembly.vTxFees.begin(), blockAssembly.vTxFees.end());
+		pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), blockAssembly.vTxSigOps.begin(), blockAssembly.vTxSigOps.end());
+		uint64_t nBlockSize = blockAssembly.nBlockSize;
+		uint64_t nBlockTx = blockAssembly.vtx.size();
+		nFees = blockAssembly.nFees;
 
 		if (!fProofOfStake) {
 			//Masternode and general budget payments
@@ -473,6 +602,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 						// the block hash of the last block used in the accumulator checkpoint calc. This will handle reorg situations.
 						pCheckpointCache.second.first = hashBlockLastAccumulated;
 						pCheckpointCache.second.second = nCheckpoint;
+						// the checkpoint stays the same until the next multiple of 10
+						pCheckpointCache.first = nHeight + (10 - (nHeight % 10));
 					}
 				}
 			}
@@ -484,9 +615,15 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 		if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
 			LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
 			mempool.clear();
+			blockAssembly.Invalidate();
 			return NULL;
 		}
 
+		if (fProofOfStake) {
+			LOCK(cs_blockAssemblyStats);
+			blockAssemblyStats.nStakeSpliceMicros = GetTimeMicros() - nStakeFoundMicros;
+		}
+
 		//        if (pblock->IsZerocoinStake()) {
 		//            CWalletTx wtx(pwalletMain, pblock->vtx[1]);
 		//            pwalletMain->AddToWallet(wtx);
@@ -512,6 +649,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
 
 	pblock->vtx[0] = txCoinbase;
 	pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+	pblock->InvalidateHash();
 }
 
 #ifdef ENABLE_WALLET
@@ -667,8 +805,16 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
 			LogPrintf("CPUMiner : proof-of-stake block was signed %s \n", pblock->GetHash().ToString().c_str());
 			SetThreadPriority(THREAD_PRIORITY_NORMAL);
-			ProcessBlockFound(pblock, *pwallet, reservekey);
+			if (!ProcessBlockFound(pblock, *pwallet, reservekey)) {
+				// Start the next template from scratch
+				LOCK(cs_main);
+				blockAssembly.Invalidate();
+			}
 			SetThreadPriority(THREAD_PRIORITY_LOWEST);
+			{
+				LOCK(cs_blockAssemblyStats);
+				blockAssemblyStats.nStakeBroadcastMicros = GetTimeMicros() - nStakeFoundMicros;
+			}
 
 			continue;
 		}
@@ -703,6 +849,7 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 					break;
 				}
 				pblock->nNonce += 1;
+				pblock->InvalidateHash();
 				nHashesDone += 1;
 				if ((pblock->nNonce & 0xFF) == 0)
 					break;
@@ -30,6 +30,22 @@ void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
 
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
 
+/** The cached transactions for the next block and the last stake's timings, reported by getstakingstatus */
+struct CBlockAssemblyStats {
+    int64_t nTime;                 // time of the last template update
+    int64_t nUpdateMicros;         // duration of the last template update
+    bool fRebuilt;                 // whether that update started from an empty template
+    uint64_t nTx;                  // transactions in the template
+    uint64_t nSize;                // block size with them, without coinbase and coinstake
+    uint64_t nRebuilds;            // template rebuilds since startup
+    uint64_t nUpdates;             // incremental updates since startup
+    int64_t nStakeSpliceMicros;    // last kernel found to block ready for signing
+    int64_t nStakeBroadcastMicros; // last kernel found to block processed and announced
+
+    CBlockAssemblyStats() : nTime(0), nUpdateMicros(0), fRebuilt(false), nTx(0), nSize(0), nRebuilds(0), nUpdates(0), nStakeSpliceMicros(0), nStakeBroadcastMicros(0) {}
+};
+CBlockAssemblyStats GetBlockAssemblyStats();
+
 extern double dHashesPerSec;
 extern int64_t nHPSTimerStart;
 
@@ -0,0 +1,191 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/sha256.h"
+
+#include <stdexcept>
+#include <string.h>
+
+namespace
+{
+/** The prime 2^3072 - 1103717 and its Montgomery context, shared read-only by all instances. */
+class CMuHashModulus
+{
+public:
+    BIGNUM* bnModulus;
+    BIGNUM* bnOne;
+    BN_MONT_CTX* pmont;
+
+    CMuHashModulus()
+    {
+        BN_CTX* pctx = BN_CTX_new();
+        bnModulus = BN_new();
+        bnOne = BN_new();
+        pmont = BN_MONT_CTX_new();
+        if (!pctx || !bnModulus || !bnOne || !pmont ||
+            !BN_set_bit(bnModulus, 3072) || !BN_sub_word(bnModulus, 1103717) ||
+            !BN_MONT_CTX_set(pmont, bnModulus, pctx) ||
+            !BN_to_montgomery(bnOne, BN_value_one(), pmont, pctx))
+            throw std::runtime_error("CMuHashModulus : initialization failed");
+        BN_CTX_free(pctx);
+    }
+
+    ~CMuHashModulus()
+    {
+        BN_MONT_CTX_free(pmont);
+        BN_free(bnOne);
+        BN_free(bnModulus);
+    }
+};
+
+const CMuHashModulus& GetModulus()
+{
+    static const CMuHashModulus modulus;
+    return modulus;
+}
+
+void Check(int nResult)
+{
+    if (!nResult)
+        throw std::runtime_error("CMuHash3072 : bignum operation failed");
+}
+} // anonymous namespace
+
+CMuHash3072::CMuHash3072()
+{
+    const CMuHashModulus& modulus = GetModulus();
+    bnNumerator = BN_dup(modulus.bnOne);
+    bnDenominator = BN_dup(modulus.bnOne);
+    pctx = BN_CTX_new();
+    if (!bnNumerator || !bnDenominator || !pctx)
+        throw std::runtime_error("CMuHash3072 : allocation failed");
+}
+
+CMuHash3072::CMuHash3072(const CMuHash3072& other)
+{
+    bnNumerator = BN_dup(other.bnNumerator);
+    bnDenominator = BN_dup(other.bnDenominator);
+    pctx = BN_CTX_new();
+    if (!bnNumerator || !bnDenominator || !pctx)
+        throw std::runtime_error("CMuHash3072 : allocation failed");
+}
+
+CMuHash3072& CMuHash3072::operator=(const CMuHash3072& other)
+{
+    if (this != &other) {
+        Check(BN_copy(bnNumerator, other.bnNumerator) != NULL);
+        Check(BN_copy(bnDenominator, other.bnDenominator) != NULL);
+    }
+    return *this;
+}
+
+CMuHash3072::~CMuHash3072()
+{
+    BN_CTX_free(pctx);
+    BN_free(bnDenominator);
+    BN_free(bnNumerator);
+}
+
+void CMuHash3072::ToNum(const unsigned char* pbegin, size_t nLen, BIGNUM* bnOut)
+{
+    // Expand SHA256(data) to 3072 bits with ChaCha20. The result is taken
+    // as the Montgomery representation of the element, which saves a
+    // conversion per insert and is just as uniform.
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(pbegin, nLen).Finalize(key);
+    unsigned char vch[BYTE_SIZE];
+    CChaCha20(key, sizeof(key)).Output(vch, sizeof(vch));
+
+    const CMuHashModulus& modulus = GetModulus();
+    Check(BN_bin2bn(vch, sizeof(vch), bnOut) != NULL);
+    if (BN_cmp(bnOut, modulus.bnModulus) >= 0)
+        Check(BN_sub(bnOut, bnOut, modulus.bnModulus));
+}
+
+void CMuHash3072::GetBytes(const BIGNUM* bn, unsigned char* pout) const
+{
+    const CMuHashModulus& modulus = GetModulus();
+    BN_CTX_start(pctx);
+    BIGNUM* bnTmp = BN_CTX_get(pctx);
+    Check(bnTmp != NULL);
+    Check(BN_from_montgomery(bnTmp, bn, modulus.pmont, pctx));
+    int nBytes = BN_num_bytes(bnTmp);
+    memset(pout, 0, BYTE_SIZE - nBytes);
+    BN_bn2bin(bnTmp, pout + BYTE_SIZE - nBytes);
+    BN_CTX_end(pctx);
+}
+
+void CMuHash3072::SetBytes(const unsigned char* pin, BIGNUM* bn)
+{
+    const CMuHashModulus& modulus = GetModulus();
+    Check(BN_bin2bn(pin, BYTE_SIZE, bn) != NULL);
+    if (BN_cmp(bn, modulus.bnModulus) >= 0)
+        Check(BN_sub(bn, bn, modulus.bnModulus));
+    Check(BN_to_montgomery(bn, bn, modulus.pmont, pctx));
+}
+
+CMuHash3072& CMuHash3072::Insert(const unsigned char* pbegin, size_t nLen)
+{
+    BN_CTX_start(pctx);
+    BIGNUM* bnElement = BN_CTX_get(pctx);
+    Check(bnElement != NULL);
+    ToNum(pbegin, nLen, bnElement);
+    Check(BN_mod_mul_montgomery(bnNumerator, bnNumerator, bnElement, GetModulus().pmont, pctx));
+    BN_CTX_end(pctx);
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::Remove(const unsigned char* pbegin, size_t nLen)
+{
+    BN_CTX_start(pctx);
+    BIGNUM* bnElement = BN_CTX_get(pctx);
+    Check(bnElement != NULL);
+    ToNum(pbegin, nLen, bnElement);
+    Check(BN_mod_mul_montgomery(bnDenominator, bnDenominator, bnElement, GetModulus().pmont, pctx));
+    BN_CTX_end(pctx);
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& other)
+{
+    const CMuHashModulus& modulus = GetModulus();
+    Check(BN_mod_mul_montgomery(bnNumerator, bnNumerator, other.bnNumerator, modulus.pmont, pctx));
+    Check(BN_mod_mul_montgomery(bnDenominator, bnDenominator, other.bnDenominator, modulus.pmont, pctx));
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator/=(const CMuHash3072& other)
+{
+    const CMuHashModulus& modulus = GetModulus();
+    Check(BN_mod_mul_montgomery(bnNumerator, bnNumerator, other.bnDenominator, modulus.pmont, pctx));
+    Check(BN_mod_mul_montgomery(bnDenominator, bnDenominator, other.bnNumerator, modulus.pmont, pctx));
+    return *this;
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    const CMuHashModulus& modulus = GetModulus();
+    BN_CTX_start(pctx);
+    BIGNUM* bnNum = BN_CTX_get(pctx);
+    BIGNUM* bnDen = BN_CTX_get(pctx);
+    Check(bnDen != NULL);
+    Check(BN_from_montgomery(bnNum, bnNumerator, modulus.pmont, pctx));
+    Check(BN_from_montgomery(bnDen, bnDenominator, modulus.pmont, pctx));
+    Check(BN_mod_inverse(bnDen, bnDen, modulus.bnModulus, pctx) != NULL);
+    Check(BN_mod_mul(bnNum, bnNum, bnDen, modulus.bnModulus, pctx));
+
+    unsigned char vch[BYTE_SIZE];
+    int nBytes = BN_num_bytes(bnNum);
+    memset(vch, 0, BYTE_SIZE - nBytes);
+    BN_bn2bin(bnNum, vch + BYTE_SIZE - nBytes);
+    BN_CTX_end(pctx);
+
+    uint256 hash;
+    CSHA256().Write(vch, sizeof(vch)).Finalize(hash.begin());
+    return hash;
+}
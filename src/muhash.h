@@ -0,0 +1,91 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SupportMasterNodeCommunity_MUHASH_H
+#define SupportMasterNodeCommunity_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <openssl/bn.h>
+
+/**
+ * Order-independent hash of a multiset of byte strings (MuHash).
+ *
+ * Every element is expanded to a 3072-bit number and multiplied into a
+ * running product modulo the prime 2^3072 - 1103717. Removals multiply into
+ * a separate denominator, so a set can be built in any order, split across
+ * threads and merged with operator*=, or updated incrementally; equal sets
+ * always finalize to the same digest. The division only happens in
+ * Finalize().
+ *
+ * Products are kept in Montgomery form. Instances are not thread safe, but
+ * independent instances may be used concurrently.
+ */
+class CMuHash3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+private:
+    BIGNUM* bnNumerator;
+    BIGNUM* bnDenominator;
+    BN_CTX* pctx;
+
+    void ToNum(const unsigned char* pbegin, size_t nLen, BIGNUM* bnOut);
+    void GetBytes(const BIGNUM* bn, unsigned char* pout) const;
+    void SetBytes(const unsigned char* pin, BIGNUM* bn);
+
+public:
+    //! Initialize to the empty set
+    CMuHash3072();
+    CMuHash3072(const CMuHash3072& other);
+    CMuHash3072& operator=(const CMuHash3072& other);
+    ~CMuHash3072();
+
+    //! Add an element to the set
+    CMuHash3072& Insert(const unsigned char* pbegin, size_t nLen);
+    CMuHash3072& Insert(const std::vector<unsigned char>& vch) { return Insert(vch.empty() ? NULL : &vch[0], vch.size()); }
+
+    //! Remove an element from the set
+    CMuHash3072& Remove(const unsigned char* pbegin, size_t nLen);
+    CMuHash3072& Remove(const std::vector<unsigned char>& vch) { return Remove(vch.empty() ? NULL : &vch[0], vch.size()); }
+
+    //! Merge another set into this one
+    CMuHash3072& operator*=(const CMuHash3072& other);
+
+    //! Remove another set from this one
+    CMuHash3072& operator/=(const CMuHash3072& other);
+
+    //! SHA256 of the normalized 3072-bit value
+    uint256 Finalize() const;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 2 * BYTE_SIZE;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char vch[2 * BYTE_SIZE];
+        GetBytes(bnNumerator, vch);
+        GetBytes(bnDenominator, vch + BYTE_SIZE);
+        s.write((const char*)vch, sizeof(vch));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char vch[2 * BYTE_SIZE];
+        s.read((char*)vch, sizeof(vch));
+        SetBytes(vch, bnNumerator);
+        SetBytes(vch + BYTE_SIZE, bnDenominator);
+    }
+};
+
+#endif // SupportMasterNodeCommunity_MUHASH_H
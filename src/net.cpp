@@ -20,6 +20,7 @@
 #include "obfuscation.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "socketevents.h"
 #include "ui_interface.h"
 #include "wallet.h"
 
@@ -108,12 +109,55 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore* semOutbound = NULL;
-boost::condition_variable messageHandlerCondition;
+
+/** A message handler thread, and the peers pinned to it that have work waiting */
+struct CMessageHandlerShard {
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::set<NodeId> setReady;
+};
+static std::vector<std::unique_ptr<CMessageHandlerShard> > vMessageHandlerShards;
+
+static size_t GetMessageHandlerShard(const CNode* pnode)
+{
+    return (size_t)pnode->id % vMessageHandlerShards.size();
+}
 
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
 
+/** What the network thread waits on, see InitSocketEvents() */
+static std::unique_ptr<CSocketEvents> socketEvents;
+
+bool InitSocketEvents(const std::string& strMode)
+{
+    CSocketEvents* pevents = CSocketEvents::Create(strMode);
+    if (!pevents)
+        return false;
+    socketEvents.reset(pevents);
+    LogPrintf("Using %s to wait for network sockets\n", socketEvents->GetName());
+    return true;
+}
+
+/** Whether the network thread will be able to wait on hSocket */
+static bool IsWaitableSocket(SOCKET hSocket)
+{
+    return socketEvents ? socketEvents->IsWaitable(hSocket) : IsSelectableSocket(hSocket);
+}
+
+void WakeMessageHandler(CNode* pnode)
+{
+    if (vMessageHandlerShards.empty())
+        return;
+    CMessageHandlerShard& shard = *vMessageHandlerShards[GetMessageHandlerShard(pnode)];
+    {
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        shard.setReady.insert(pnode->id);
+    }
+    shard.cond.notify_one();
+}
+
 void AddOneShot(string strDest)
 {
     LOCK(cs_vOneShots);
@@ -415,7 +459,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsWaitableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -703,9 +747,42 @@ void CNode::copyStats(CNodeStats& stats)
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    {
+        LOCK(cs_mapProcessTime);
+        stats.mapProcessTime = mapProcessTime;
+    }
 }
 #undef X
 
+CProcessTimeHistogram::CProcessTimeHistogram() : nCount(0), nTotalMicros(0), nMaxMicros(0)
+{
+    std::fill(vBuckets, vBuckets + BUCKETS, 0);
+}
+
+void CProcessTimeHistogram::Add(int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < BUCKETS - 1 && (nMicros >> (nBucket + 1)) > 0)
+        nBucket++;
+    vBuckets[nBucket]++;
+    nCount++;
+    nTotalMicros += nMicros;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+}
+
+void CNode::RecordProcessTime(const std::string& strCommand, int64_t nMicros)
+{
+    LOCK(cs_mapProcessTime);
+    // commands are chosen by the peer, do not let it grow the map without bound
+    std::map<std::string, CProcessTimeHistogram>::iterator it = mapProcessTime.find(strCommand);
+    if (it == mapProcessTime.end() && mapProcessTime.size() >= MAX_PROCESS_TIME_COMMANDS)
+        it = mapProcessTime.insert(std::make_pair(std::string("other"), CProcessTimeHistogram())).first;
+    else if (it == mapProcessTime.end())
+        it = mapProcessTime.insert(std::make_pair(strCommand, CProcessTimeHistogram())).first;
+    it->second.Add(nMicros);
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 {
@@ -737,7 +814,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            WakeMessageHandler(this);
         }
     }
 
@@ -794,10 +871,12 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    // message processing pauses while the send buffer is full
+    bool fSendBufferFull = pnode->nSendSize >= SendBufferSize();
+    std::deque<CNetSerializeData>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        const CNetSerializeData& data = *it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -832,13 +911,79 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    if (fSendBufferFull && pnode->nSendSize < SendBufferSize())
+        WakeMessageHandler(pnode);
 }
 
 static list<CNode*> vNodesDisconnected;
 
+/** Drop the registration of pnode's socket, which may have been closed by another thread already */
+static void UnregisterNodeSocket(CNode* pnode)
+{
+    if (pnode->hSocketRegistered == INVALID_SOCKET)
+        return;
+    socketEvents->Remove(pnode->hSocketRegistered, pnode);
+    pnode->hSocketRegistered = INVALID_SOCKET;
+    pnode->nSocketEvents = 0;
+}
+
+static void AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+    } else if (!IsWaitableSocket(hSocket)) {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (CNode::IsBanned(addr) && !whitelisted) {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
+
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+        }
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
+    std::vector<CSocketEvents::Event> vEvents;
+
+    // Listening sockets stay registered for the lifetime of the thread
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+        if (!socketEvents->Set(hListenSocket.socket, SOCKET_EVENT_RECV, NULL))
+            LogPrintf("%s: cannot wait on listening socket, error %s\n", __func__, NetworkErrorString(WSAGetLastError()));
+
     while (true) {
         //
         // Disconnect nodes
@@ -857,6 +1002,7 @@ void ThreadSocketHandler()
                     pnode->grantOutbound.Release();
 
                     // close socket and cleanup
+                    UnregisterNodeSocket(pnode);
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -902,44 +1048,26 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Update what each socket is waited for. Registrations persist, so this
+        // only talks to the kernel for sockets whose state changed.
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
+                SOCKET hSocket = pnode->hSocket;
+                if (hSocket != pnode->hSocketRegistered)
+                    UnregisterNodeSocket(pnode);
+                if (hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
 
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -947,106 +1075,80 @@ void ThreadSocketHandler()
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                // Errors are always waited for.
+                int nEvents = 0;
+                bool fLocked = true;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (!lockSend)
+                        fLocked = false;
+                    else if (!pnode->vSendMsg.empty())
+                        nEvents = SOCKET_EVENT_SEND;
                 }
-                {
+                if (!nEvents) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    if (!lockRecv)
+                        fLocked = false;
+                    else if (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                             pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                        nEvents = SOCKET_EVENT_RECV;
+                }
+
+                if (pnode->hSocketRegistered == hSocket && (pnode->nSocketEvents == nEvents || (!nEvents && !fLocked)))
+                    continue; // unchanged, or busy in another thread: keep what is registered
+                if (socketEvents->Set(hSocket, nEvents, pnode)) {
+                    pnode->hSocketRegistered = hSocket;
+                    pnode->nSocketEvents = nEvents;
+                } else {
+                    LogPrintf("cannot wait on socket of peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+                    pnode->fDisconnect = true;
                 }
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+        // 50ms is the frequency to poll pnode->vSend
+        if (!socketEvents->Wait(50, vEvents)) {
+            LogPrintf("socket %s error %s\n", socketEvents->GetName(), NetworkErrorString(WSAGetLastError()));
+            MilliSleep(50);
         }
+        boost::this_thread::interruption_point();
 
         //
         // Accept new connections
         //
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t len = sizeof(sockaddr);
-                SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int nInbound = 0;
-
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        LogPrintf("Warning: Unknown socket family\n");
-
-                bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
-
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
-                    LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
-                    LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (CNode::IsBanned(addr) && !whitelisted) {
-                    LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else {
-                    CNode* pnode = new CNode(hSocket, addr, "", true);
-                    pnode->AddRef();
-                    pnode->fWhitelisted = whitelisted;
-
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
-            }
+        BOOST_FOREACH (const CSocketEvents::Event& event, vEvents) {
+            if (event.pcookie != NULL)
+                continue;
+            BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+                if (hListenSocket.socket != INVALID_SOCKET && hListenSocket.socket == event.hSocket)
+                    AcceptConnection(hListenSocket);
         }
 
         //
-        // Service each socket
+        // Service each ready socket
         //
-        vector<CNode*> vNodesCopy;
+        vector<pair<CNode*, int> > vNodesReady;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            // nodes are unregistered before they leave vNodes, so every cookie is still alive
+            BOOST_FOREACH (const CSocketEvents::Event& event, vEvents) {
+                if (event.pcookie == NULL)
+                    continue;
+                CNode* pnode = (CNode*)event.pcookie;
                 pnode->AddRef();
+                vNodesReady.push_back(make_pair(pnode, event.nEvents));
+            }
         }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+        BOOST_FOREACH (const PAIRTYPE(CNode*, int)& ready, vNodesReady) {
             boost::this_thread::interruption_point();
+            CNode* pnode = ready.first;
 
             //
             // Receive
             //
-            if (pnode->hSocket == INVALID_SOCKET)
+            if (pnode->hSocket == INVALID_SOCKET || pnode->hSocket != pnode->hSocketRegistered)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (ready.second & (SOCKET_EVENT_RECV | SOCKET_EVENT_ERROR)) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
@@ -1082,16 +1184,30 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (ready.second & SOCKET_EVENT_SEND) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     SocketSendData(pnode);
             }
+        }
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH (const PAIRTYPE(CNode*, int)& ready, vNodesReady)
+                ready.first->Release();
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
+        //
+        // Inactivity checking, for all nodes but at most once a second
+        //
+        int64_t nTime = GetTime();
+        if (nTime == nLastInactivityCheck)
+            continue;
+        nLastInactivityCheck = nTime;
+
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
             if (nTime - pnode->nTimeConnected > 60) {
                 if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
                     LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
@@ -1108,15 +1224,9 @@ void ThreadSocketHandler()
                 }
             }
         }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
-        }
     }
 }
 
-
 #ifdef USE_UPNP
 void ThreadMapPort()
 {
@@ -1493,67 +1603,73 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+void ThreadMessageHandler(size_t nShard)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    CMessageHandlerShard& shard = *vMessageHandlerShards[nShard];
+    int64_t nNextSend = 0;
 
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
+        // Sleep until a peer of this thread has work, or it is time to send
+        std::set<NodeId> setReady;
+        bool fSendAll;
+        {
+            boost::unique_lock<boost::mutex> lock(shard.mutex);
+            int64_t nNow = GetTimeMillis();
+            while (shard.setReady.empty() && nNow < nNextSend) {
+                shard.cond.timed_wait(lock, boost::posix_time::milliseconds(nNextSend - nNow));
+                nNow = GetTimeMillis();
+            }
+            setReady.swap(shard.setReady);
+            fSendAll = nNow >= nNextSend;
+            if (fSendAll)
+                nNextSend = nNow + MSGHANDLER_SEND_INTERVAL;
+        }
+
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+            BOOST_FOREACH (CNode* pnode, vNodes) {
+                if (GetMessageHandlerShard(pnode) != nShard || (!fSendAll && !setReady.count(pnode->id)))
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
-        // Poll the connected nodes for messages
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (fSendAll && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
-        bool fSleep = true;
-
         BOOST_FOREACH (CNode* pnode, vNodesCopy) {
             if (pnode->fDisconnect)
                 continue;
 
             // Receive messages
             {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    if (!g_signals.ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
+                LOCK(pnode->cs_vRecvMsg);
+                if (!g_signals.ProcessMessages(pnode))
+                    pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
-                        }
+                // one message at a time, come back for the next one
+                if (pnode->nSendSize < SendBufferSize()) {
+                    if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
+                        WakeMessageHandler(pnode);
                     }
                 }
             }
             boost::this_thread::interruption_point();
 
             // Send messages
-            {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
-            }
+            g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
             boost::this_thread::interruption_point();
         }
 
-
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
-
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
 
@@ -1594,7 +1710,7 @@ bool BindListenPort(const CService& addrBind, string& strError, bool fWhiteliste
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket)) {
+    if (!IsWaitableSocket(hListenSocket)) {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
         return false;
@@ -1758,6 +1874,8 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    if (!socketEvents)
+        InitSocketEvents(DEFAULT_SOCKETEVENTS);
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -1766,8 +1884,14 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Initiate outbound connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
-    // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    // Process messages, peers are spread over the threads by id
+    if (vMessageHandlerShards.empty()) {
+        int nThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+        for (int i = 0; i < nThreads; i++)
+            vMessageHandlerShards.emplace_back(new CMessageHandlerShard());
+    }
+    for (size_t i = 0; i < vMessageHandlerShards.size(); i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -1930,21 +2054,21 @@ void CNode::Fuzz(int nChance)
     case 0:
         // xor a random byte with a random value:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CNetDataStream::size_type pos = GetRand(ssSend.size());
             ssSend[pos] ^= (unsigned char)(GetRand(256));
         }
         break;
     case 1:
         // delete a random byte:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CNetDataStream::size_type pos = GetRand(ssSend.size());
             ssSend.erase(ssSend.begin() + pos);
         }
         break;
     case 2:
         // insert a random byte at a random position
         {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CNetDataStream::size_type pos = GetRand(ssSend.size());
             char ch = (char)GetRand(256);
             ssSend.insert(ssSend.begin() + pos, ch);
         }
@@ -2056,6 +2180,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 {
     nServices = 0;
     hSocket = hSocketIn;
+    hSocketRegistered = INVALID_SOCKET;
+    nSocketEvents = 0;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2181,28 +2307,57 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         return;
     }
 
+    CNetSerializeData vMessage;
+    ssSend.GetAndClear(vMessage);
+    QueueMessage(vMessage);
+
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+void CNode::PushRawMessage(const char* pszCommand, CNetSerializeData& vMessage)
+{
+    assert(vMessage.size() >= CMessageHeader::HEADER_SIZE);
+
+    BeginMessage(pszCommand);
+    assert(ssSend.size() == CMessageHeader::HEADER_SIZE);
+
+    // Let EndMessage() apply the -*messagestest options to a copy of the payload
+    if (mapArgs.count("-dropmessagestest") || mapArgs.count("-fuzzmessagestest")) {
+        ssSend.insert(ssSend.end(), vMessage.data() + CMessageHeader::HEADER_SIZE, vMessage.data() + vMessage.size());
+        vMessage.clear();
+        EndMessage();
+        return;
+    }
+
+    std::copy(ssSend.begin(), ssSend.end(), vMessage.begin());
+    ssSend.clear();
+    QueueMessage(vMessage);
+
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+void CNode::QueueMessage(CNetSerializeData& vMessage)
+{
     // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    unsigned int nSize = vMessage.size() - CMessageHeader::HEADER_SIZE;
+    memcpy(&vMessage[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
 
     // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
+    uint256 hash = Hash(vMessage.begin() + CMessageHeader::HEADER_SIZE, vMessage.end());
     unsigned int nChecksum = 0;
     memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    assert(vMessage.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy(&vMessage[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
+    std::deque<CNetSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CNetSerializeData());
+    it->swap(vMessage);
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
     if (it == vSendMsg.begin())
         SocketSendData(this);
-
-    LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
 //
@@ -63,6 +63,14 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** -msghandlerthreads default */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Upper limit for -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** How often the message handler threads run SendMessages() for every peer (in milliseconds) */
+static const int MSGHANDLER_SEND_INTERVAL = 100;
+/** Processing times are kept for this many distinct commands per peer, the rest is counted as "other" */
+static const size_t MAX_PROCESS_TIME_COMMANDS = 64;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -79,6 +87,10 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
+/** Choose how the network thread waits on sockets (-socketevents), false if strMode is not available */
+bool InitSocketEvents(const std::string& strMode);
+/** Tell the message handler thread of pnode that it has work to do */
+void WakeMessageHandler(CNode* pnode);
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
@@ -152,6 +164,22 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** How long the messages of one command took to process */
+class CProcessTimeHistogram
+{
+public:
+    /** Bucket i counts times in [2^i, 2^(i+1)) microseconds; the first also counts 0, the last anything longer */
+    static const int BUCKETS = 24;
+
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    uint64_t vBuckets[BUCKETS];
+
+    CProcessTimeHistogram();
+    void Add(int64_t nMicros);
+};
+
 class CNodeStats
 {
 public:
@@ -172,6 +200,7 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    std::map<std::string, CProcessTimeHistogram> mapProcessTime;
 };
 
 
@@ -285,11 +314,14 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
-    CDataStream ssSend;
+    // socket and SocketEvent bits registered with the network thread, only touched by that thread
+    SOCKET hSocketRegistered;
+    int nSocketEvents;
+    CNetDataStream ssSend;
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CNetSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -297,6 +329,9 @@ public:
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
+    // processing time per message command
+    std::map<std::string, CProcessTimeHistogram> mapProcessTime;
+    CCriticalSection cs_mapProcessTime;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -416,6 +451,8 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes);
 
+    void RecordProcessTime(const std::string& strCommand, int64_t nMicros);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -484,6 +521,18 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+private:
+    // requires LOCK(cs_vSend)
+    void QueueMessage(CNetSerializeData& vMessage);
+
+public:
+
+    /**
+     * Queue a message whose payload is serialized already, without copying it. vMessage holds
+     * CMessageHeader::HEADER_SIZE bytes of room for the header, then the payload; it is left empty.
+     */
+    void PushRawMessage(const char* pszCommand, CNetSerializeData& vMessage);
+
     void PushVersion();
 
 
@@ -15,12 +15,88 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <atomic>
+
+bool fBlockHashCache = false;
+
+static std::atomic<uint64_t> nBlockHashComputed(0);
+static std::atomic<uint64_t> nBlockHashSaved(0);
+
+/** Whether header has the fields its hash was memoized for */
+static bool HasCachedFields(const CBlockHeader& header)
+{
+    const CBlockHeader::CachedFields& fields = header.fieldsCached;
+    return fields.nNonce == header.nNonce && fields.nTime == header.nTime && fields.hashMerkleRoot == header.hashMerkleRoot &&
+           fields.nBits == header.nBits && fields.nVersion == header.nVersion && fields.hashPrevBlock == header.hashPrevBlock &&
+           fields.nAccumulatorCheckpoint == header.nAccumulatorCheckpoint;
+}
+
 uint256 CBlockHeader::GetHash() const
 {
+    // The fields are public and written all over; checking them makes a write without
+    // InvalidateHash() cost a recomputation instead of returning a stale hash.
+    if (nHashCacheState.load(std::memory_order_acquire) == HASH_CACHED && HasCachedFields(*this)) {
+        ++nBlockHashSaved;
+        return hashCached;
+    }
+
+    uint256 hash;
     if(nVersion < 4)
-        return HashQuark(BEGIN(nVersion), END(nNonce));
+        hash = HashQuark(BEGIN(nVersion), END(nNonce));
+    else
+        hash = Hash(BEGIN(nVersion), END(nAccumulatorCheckpoint));
+    ++nBlockHashComputed;
+
+    SetCachedHash(hash);
+    return hash;
+}
 
-    return Hash(BEGIN(nVersion), END(nAccumulatorCheckpoint));
+void CBlockHeader::SetCachedHash(const uint256& hash) const
+{
+    if (!fBlockHashCache)
+        return;
+
+    // A header shared between threads may be hashed by several of them at once; only the one that
+    // claims the slot writes the cache, and readers only look at it once HASH_CACHED is published.
+    // A published cache is never rewritten, so a stale one waits for InvalidateHash().
+    int nExpected = HASH_NONE;
+    if (nHashCacheState.compare_exchange_strong(nExpected, HASH_WRITING, std::memory_order_acquire)) {
+        fieldsCached.nVersion = nVersion;
+        fieldsCached.hashPrevBlock = hashPrevBlock;
+        fieldsCached.hashMerkleRoot = hashMerkleRoot;
+        fieldsCached.nTime = nTime;
+        fieldsCached.nBits = nBits;
+        fieldsCached.nNonce = nNonce;
+        fieldsCached.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+        hashCached = hash;
+        nHashCacheState.store(HASH_CACHED, std::memory_order_release);
+    }
+}
+
+void GetBlockHashCacheStats(uint64_t& nComputed, uint64_t& nSaved)
+{
+    nComputed = nBlockHashComputed;
+    nSaved = nBlockHashSaved;
+}
+
+bool GetSerializedBlockHeaderHash(const char* pch, size_t nSize, uint256& hash)
+{
+    // Serialized as BEGIN(nVersion) to END(nNonce), followed by nAccumulatorCheckpoint from version 4
+    const size_t nLegacySize = 80;
+    const size_t nFullSize = nLegacySize + sizeof(uint256);
+    if (nSize < nLegacySize)
+        return false;
+
+    int32_t nVersion;
+    memcpy(&nVersion, pch, sizeof(nVersion));
+    if (nVersion < 4) {
+        hash = HashQuark(pch, pch + nLegacySize);
+    } else {
+        if (nSize < nFullSize)
+            return false;
+        hash = Hash(pch, pch + nFullSize);
+    }
+    return true;
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -14,6 +14,11 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+
+/** Whether CBlockHeader::GetHash() memoizes its result (-blockhashcache) */
+extern bool fBlockHashCache;
+
 /** The maximum allowed size for a serialized block, in bytes (network rule) */
 static const unsigned int MAX_BLOCK_SIZE_CURRENT = 2000000;
 static const unsigned int MAX_BLOCK_SIZE_LEGACY = 1000000;
@@ -38,15 +43,57 @@ public:
     uint32_t nNonce;
     uint256 nAccumulatorCheckpoint;
 
+    // memory only; hashCached is the hash of the fields in fieldsCached, both published by a
+    // release-store of HASH_CACHED and only used while the header still has those fields, see GetHash()
+    enum { HASH_NONE, HASH_WRITING, HASH_CACHED };
+    struct CachedFields {
+        int32_t nVersion;
+        uint256 hashPrevBlock;
+        uint256 hashMerkleRoot;
+        uint32_t nTime;
+        uint32_t nBits;
+        uint32_t nNonce;
+        uint256 nAccumulatorCheckpoint;
+    };
+    mutable CachedFields fieldsCached;
+    mutable uint256 hashCached;
+    mutable std::atomic<int> nHashCacheState;
+
     CBlockHeader()
     {
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other)
+    {
+        *this = other;
+    }
+
+    CBlockHeader& operator=(const CBlockHeader& other)
+    {
+        nVersion = other.nVersion;
+        hashPrevBlock = other.hashPrevBlock;
+        hashMerkleRoot = other.hashMerkleRoot;
+        nTime = other.nTime;
+        nBits = other.nBits;
+        nNonce = other.nNonce;
+        nAccumulatorCheckpoint = other.nAccumulatorCheckpoint;
+        if (other.nHashCacheState.load(std::memory_order_acquire) == HASH_CACHED) {
+            fieldsCached = other.fieldsCached;
+            hashCached = other.hashCached;
+            nHashCacheState.store(HASH_CACHED, std::memory_order_release);
+        } else {
+            nHashCacheState.store(HASH_NONE, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        if (ser_action.ForRead())
+            InvalidateHash();
         READWRITE(this->nVersion);
         nVersion = this->nVersion;
         READWRITE(hashPrevBlock);
@@ -69,8 +116,19 @@ public:
         nBits = 0;
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
+        InvalidateHash();
+    }
+
+    /** Forget the memoized hash so the next GetHash() memoizes the current one. A hash memoized before
+     *  the fields changed is never returned either way, it is just not replaced until this is called. */
+    void InvalidateHash()
+    {
+        nHashCacheState.store(HASH_NONE, std::memory_order_relaxed);
     }
 
+    /** Memoize hash as the hash of the current fields. No-op without -blockhashcache. */
+    void SetCachedHash(const uint256& hash) const;
+
     bool IsNull() const
     {
         return (nBits == 0);
@@ -84,6 +142,12 @@ public:
     }
 };
 
+/** Number of header hashes computed, and number of recomputations saved by -blockhashcache. */
+void GetBlockHashCacheStats(uint64_t& nComputed, uint64_t& nSaved);
+
+/** Compute GetHash() of a header serialized at the start of the nSize bytes at pch, false if they are too short. */
+bool GetSerializedBlockHeaderHash(const char* pch, size_t nSize, uint256& hash);
+
 
 class CBlock : public CBlockHeader
 {
@@ -231,6 +231,64 @@ public:
     };
 };
 
+//a single mint output as recorded by the per-block pubcoin index
+class CPubcoinIndexEntry
+{
+public:
+    libzerocoin::CoinDenomination denomination;
+    CBigNum value;
+    bool fInvalidOutpoint; //dropped when the block is read with invalid outpoints filtered
+
+    CPubcoinIndexEntry()
+    {
+        denomination = libzerocoin::ZQ_ERROR;
+        fInvalidOutpoint = false;
+    }
+
+    CPubcoinIndexEntry(libzerocoin::CoinDenomination denom, const CBigNum& bnValue, bool fInvalid)
+    {
+        denomination = denom;
+        value = bnValue;
+        fInvalidOutpoint = fInvalid;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(denomination);
+        READWRITE(value);
+        READWRITE(fInvalidOutpoint);
+    };
+};
+
+//all zerocoin mints of one block, keyed by height in the zerocoinDB so that accumulator code does not need the full block
+class CBlockPubcoins
+{
+public:
+    uint256 hashBlock;
+    std::vector<CPubcoinIndexEntry> vPubcoins;
+
+    CBlockPubcoins()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        vPubcoins.clear();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(vPubcoins);
+    };
+};
+
 class CZerocoinSpendReceipt
 {
 private:
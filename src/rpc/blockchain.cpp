@@ -8,6 +8,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "main.h"
@@ -18,6 +19,7 @@
 #include "utilmoneystr.h"
 #include "accumulatormap.h"
 #include "accumulators.h"
+#include "zkpcache.h"
 
 #include <stdint.h>
 #include <univalue.h>
@@ -181,9 +183,8 @@ UniValue mempoolToJSON(bool fVerbose = false)
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+        BOOST_FOREACH (const CTxMemPoolEntry& e, mempool.mapTx) {
+            const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -191,6 +192,12 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
             info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             const CTransaction& tx = e.GetTx();
             set<string> setDepends;
             BOOST_FOREACH (const CTxIn& txin, tx.vin) {
@@ -244,6 +251,12 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -288,6 +301,64 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockfilters(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilters startheight ( count )\n"
+            "\nReturns the BIP158 basic filters of blocks of the best chain, with their BIP157 filter headers.\n"
+            "Requires -blockfilterindex.\n"
+
+            "\nArguments:\n"
+            "1. startheight   (numeric, required) The height of the first block\n"
+            "2. count         (numeric, optional, default=1) The number of blocks, at most " + std::to_string(MAX_BLOCKFILTERS_RESULTS) + "\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": n,       (numeric) The block height\n"
+            "    \"hash\": \"hash\",    (string) The block hash\n"
+            "    \"filter\": \"hex\",   (string) The serialized filter\n"
+            "    \"header\": \"hash\"   (string) The filter header\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilters", "1000 100") + HelpExampleRpc("getblockfilters", "1000, 100"));
+
+    if (!pblockfilterdb)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter index not enabled, start with -blockfilterindex");
+
+    int nHeight = params[0].get_int();
+    int nCount = params.size() > 1 ? params[1].get_int() : 1;
+    if (nCount < 1 || nCount > MAX_BLOCKFILTERS_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %d", MAX_BLOCKFILTERS_RESULTS));
+
+    std::vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        for (int i = nHeight; i < nHeight + nCount && i <= chainActive.Height(); i++)
+            vBlocks.push_back(chainActive[i]);
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (CBlockIndex* pindex : vBlocks) {
+        CBlockFilterEntry entry;
+        if (!pblockfilterdb->ReadFilter(pindex->GetBlockHash(), entry))
+            throw JSONRPCError(RPC_MISC_ERROR, strprintf("No filter for block %d yet, the index is still being built", pindex->nHeight));
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("height", pindex->nHeight));
+        obj.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+        obj.push_back(Pair("filter", HexStr(entry.vFilter)));
+        obj.push_back(Pair("header", entry.hashHeader.GetHex()));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -414,7 +485,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
         throw runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless the node runs with -coinstatsindex.\n"
 
             "\nResult:\n"
             "{\n"
@@ -423,26 +494,34 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (not returned with -coinstatsindex)\n"
+            "  \"muhash\": \"hash\",   (string) Order-independent MuHash3072 commitment to the set\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
+    // Only the flush needs cs_main, the scan reads a database snapshot
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    bool fIndexed;
+    {
+        LOCK(cs_main);
+        fIndexed = GetCoinStatsIndex(stats);
+        if (!fIndexed)
+            FlushStateToDisk();
+    }
+    if (fIndexed || pcoinsTip->GetStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (!fIndexed)
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
@@ -575,6 +654,16 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"blockhashcache\": {       (object) block header hash memoization (-blockhashcache)\n"
+            "    \"enabled\": true|false,  (boolean) if header hashes are memoized\n"
+            "    \"computed\": xxxxx,      (numeric) header hashes computed since startup\n"
+            "    \"saved\": xxxxx          (numeric) recomputations answered from the cache since startup\n"
+            "  },\n"
+            "  \"zkpcache\": {             (object) verified zerocoin spend cache (-zkpcachesize)\n"
+            "    \"entries\": xxxxx,        (numeric) spends currently remembered as verified\n"
+            "    \"hits\": xxxxx,           (numeric) spend proofs skipped since startup\n"
+            "    \"misses\": xxxxx          (numeric) spend proofs run since startup\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -590,6 +679,22 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+
+    uint64_t nHashComputed, nHashSaved;
+    GetBlockHashCacheStats(nHashComputed, nHashSaved);
+    UniValue hashcache(UniValue::VOBJ);
+    hashcache.push_back(Pair("enabled", fBlockHashCache));
+    hashcache.push_back(Pair("computed", nHashComputed));
+    hashcache.push_back(Pair("saved", nHashSaved));
+    obj.push_back(Pair("blockhashcache", hashcache));
+
+    uint64_t nZkpEntries, nZkpHits, nZkpMisses;
+    GetZerocoinSpendCacheStats(nZkpEntries, nZkpHits, nZkpMisses);
+    UniValue zkpcache(UniValue::VOBJ);
+    zkpcache.push_back(Pair("entries", nZkpEntries));
+    zkpcache.push_back(Pair("hits", nZkpHits));
+    zkpcache.push_back(Pair("misses", nZkpMisses));
+    obj.push_back(Pair("zkpcache", zkpcache));
     return obj;
 }
 
@@ -786,6 +891,9 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     //ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
     return ret;
 }
@@ -801,6 +909,8 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum size of the mempool's transactions in bytes\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in smnc/kB for a transaction to be accepted\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -949,4 +1059,126 @@ UniValue getaccumulatorvalues(const UniValue& params, bool fHelp)
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+UniValue getwitnesscacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getwitnesscacheinfo\n"
+            "\nReturns statistics of the zerocoin accumulator witness cache.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"mints\": n,          (numeric) number of mints with a cached witness\n"
+            "  \"spent\": n,          (numeric) mints among them whose spend is not final yet\n"
+            "  \"hits\": n,           (numeric) witnesses generated from a cached witness\n"
+            "  \"misses\": n,         (numeric) witnesses generated by walking the chain from the mint\n"
+            "  \"hitrate\": x.xxx,    (numeric) hits / (hits + misses)\n"
+            "  \"last_ms\": x.xxx,    (numeric) time taken by the last witness generation, in milliseconds\n"
+            "  \"average_ms\": x.xxx  (numeric) average witness generation time, in milliseconds\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getwitnesscacheinfo", "") + HelpExampleRpc("getwitnesscacheinfo", ""));
+
+    return witnessCache.GetStats();
+}
+
+UniValue dbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "dbstats ( \"name\" )\n"
+            "\nReturns the tuning and internal statistics of the open LevelDB databases.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"    (string, optional) Only this database: chainstate, index, zerocoin, sporks or filter\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",          (string) database directory name\n"
+            "    \"profile\": \"xxxx\",       (string) -dbprofile the database was opened with\n"
+            "    \"block_cache\": n,        (numeric) table block cache size in bytes\n"
+            "    \"write_buffer\": n,       (numeric) write buffer size in bytes\n"
+            "    \"approximate_size\": n,   (numeric) approximate size of the tables on disk in bytes\n"
+            "    \"memory_usage\": n,       (numeric) approximate memory used by LevelDB in bytes\n"
+            "    \"files_per_level\": [n,...], (array) number of table files at each level\n"
+            "    \"stats\": \"xxxx\"          (string) LevelDB's compaction statistics\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dbstats", "") + HelpExampleCli("dbstats", "\"chainstate\"") + HelpExampleRpc("dbstats", "\"chainstate\""));
+
+    std::string strName = params.size() > 0 ? params[0].get_str() : "";
+    UniValue ret(UniValue::VARR);
+    int nFound = ForEachLevelDB(strName, [&ret](CLevelDBWrapper& db) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", db.GetName()));
+        obj.push_back(Pair("profile", GetDBProfileName(db.GetProfile())));
+        obj.push_back(Pair("block_cache", (uint64_t)db.GetBlockCacheSize()));
+        obj.push_back(Pair("write_buffer", (uint64_t)db.GetWriteBufferSize()));
+        obj.push_back(Pair("approximate_size", db.GetApproximateSize()));
+        std::string strValue;
+        if (db.GetProperty("leveldb.approximate-memory-usage", strValue))
+            obj.push_back(Pair("memory_usage", atoi64(strValue)));
+        UniValue levels(UniValue::VARR);
+        for (int nLevel = 0; db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue); nLevel++)
+            levels.push_back(atoi64(strValue));
+        obj.push_back(Pair("files_per_level", levels));
+        if (db.GetProperty("leveldb.stats", strValue))
+            obj.push_back(Pair("stats", strValue));
+        ret.push_back(obj);
+    });
+    if (!strName.empty() && nFound == 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Database not found");
+
+    return ret;
+}
+
+UniValue compactdb(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "compactdb ( \"name\" )\n"
+            "\nMerges all tables of a LevelDB database, or of every open database, into their final levels.\n"
+            "Reclaims the space of overwritten and erased entries, most useful after an initial sync with\n"
+            "-dbprofile=bulk. Blocks until done and may take several minutes on the chainstate.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"    (string, optional) Only this database: chainstate, index, zerocoin, sporks or filter\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",      (string) database directory name\n"
+            "    \"size_before\": n,    (numeric) approximate size on disk before, in bytes\n"
+            "    \"size_after\": n,     (numeric) approximate size on disk after, in bytes\n"
+            "    \"time_ms\": n         (numeric) time taken in milliseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("compactdb", "\"chainstate\"") + HelpExampleRpc("compactdb", "\"chainstate\""));
+
+    std::string strName = params.size() > 0 ? params[0].get_str() : "";
+    UniValue ret(UniValue::VARR);
+    int nFound = ForEachLevelDB(strName, [&ret](CLevelDBWrapper& db) {
+        UniValue obj(UniValue::VOBJ);
+        int64_t nStart = GetTimeMillis();
+        obj.push_back(Pair("name", db.GetName()));
+        obj.push_back(Pair("size_before", db.GetApproximateSize()));
+        db.CompactFull();
+        obj.push_back(Pair("size_after", db.GetApproximateSize()));
+        obj.push_back(Pair("time_ms", GetTimeMillis() - nStart));
+        ret.push_back(obj);
+    });
+    if (!strName.empty() && nFound == 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Database not found");
+
+    return ret;
+}
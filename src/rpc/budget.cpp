@@ -332,7 +332,10 @@ UniValue submitbudget(const UniValue& params, bool fHelp)
     //     return "Proposal is not valid - " + budgetProposalBroadcast.GetHash().ToString() + " - " + strError;
     // }
 
-    budget.mapSeenMasternodeBudgetProposals.insert(make_pair(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast));
+    {
+        LOCK(budget.cs_mapSeen);
+        budget.mapSeenMasternodeBudgetProposals.insert(make_pair(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast));
+    }
     budgetProposalBroadcast.Relay();
     if(budget.AddProposal(budgetProposalBroadcast)) {
         return budgetProposalBroadcast.GetHash().ToString();
@@ -434,7 +437,10 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
             std::string strError = "";
             if (budget.UpdateProposal(vote, NULL, strError)) {
                 success++;
-                budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                {
+                    LOCK(budget.cs_mapSeen);
+                    budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                }
                 vote.Relay();
                 statusObj.push_back(Pair("node", "local"));
                 statusObj.push_back(Pair("result", "success"));
@@ -500,7 +506,10 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
 
             std::string strError = "";
             if (budget.UpdateProposal(vote, NULL, strError)) {
-                budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                {
+                    LOCK(budget.cs_mapSeen);
+                    budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                }
                 vote.Relay();
                 success++;
                 statusObj.push_back(Pair("node", mne.getAlias()));
@@ -575,7 +584,10 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
 
             std::string strError = "";
             if(budget.UpdateProposal(vote, NULL, strError)) {
-                budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                {
+                    LOCK(budget.cs_mapSeen);
+                    budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                }
                 vote.Relay();
                 success++;
                 statusObj.push_back(Pair("node", mne.getAlias()));
@@ -853,7 +865,10 @@ UniValue mnbudgetrawvote(const UniValue& params, bool fHelp)
 
     std::string strError = "";
     if (budget.UpdateProposal(vote, NULL, strError)) {
-        budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        {
+            LOCK(budget.cs_mapSeen);
+            budget.mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        }
         vote.Relay();
         return "Voted successfully";
     } else {
@@ -932,7 +947,10 @@ UniValue mnfinalbudget(const UniValue& params, bool fHelp)
 
             std::string strError = "";
             if (budget.UpdateFinalizedBudget(vote, NULL, strError)) {
-                budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                {
+                    LOCK(budget.cs_mapSeen);
+                    budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+                }
                 vote.Relay();
                 success++;
                 statusObj.push_back(Pair("result", "success"));
@@ -977,7 +995,10 @@ UniValue mnfinalbudget(const UniValue& params, bool fHelp)
 
         std::string strError = "";
         if (budget.UpdateFinalizedBudget(vote, NULL, strError)) {
-            budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+            {
+                LOCK(budget.cs_mapSeen);
+                budget.mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+            }
             vote.Relay();
             return "success";
         } else {
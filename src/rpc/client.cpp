@@ -51,6 +51,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getbalance", 1},
         {"getbalance", 2},
         {"getblockhash", 0},
+        {"getblockfilters", 0},
+        {"getblockfilters", 1},
         {"move", 2},
         {"move", 3},
         {"sendfrom", 2},
@@ -87,6 +89,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"sendrawtransaction", 2},
         {"gettxout", 1},
         {"gettxout", 2},
+        {"checkwalletbalances", 0},
         {"lockunspent", 0},
         {"lockunspent", 1},
         {"importprivkey", 2},
@@ -184,6 +184,7 @@ UniValue setgenerate(const UniValue& params, bool fHelp)
                 // Yes, there is a chance every nonce could fail to satisfy the -regtest
                 // target -- 1 in 2^(2^32). That ain't gonna happen.
                 ++pblock->nNonce;
+                pblock->InvalidateHash();
             }
             CValidationState state;
             if (!ProcessNewBlock(state, NULL, pblock))
@@ -516,6 +517,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     // Update nTime
     UpdateTime(pblock, pindexPrev);
     pblock->nNonce = 0;
+    pblock->InvalidateHash();
 
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
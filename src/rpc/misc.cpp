@@ -10,8 +10,11 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
+#include "kernel.h"
+#include "logging.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "miner.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
@@ -545,6 +548,60 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue getlogbuffer(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlogbuffer ( \"category\" )\n"
+            "\nReturns the most recent debug log lines kept in memory for each category (see -logbufferlines),\n"
+            "and statistics of the background log writer.\n"
+
+            "\nArguments:\n"
+            "1. \"category\"    (string, optional) Only return the lines of this category, \"default\" for uncategorized output\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"async\": true|false,    (boolean) Whether debug.log is written by the background thread\n"
+            "  \"queuecapacity\": n,     (numeric) Lines the queue holds\n"
+            "  \"queued\": n,            (numeric) Lines waiting to be written\n"
+            "  \"written\": n,           (numeric) Lines written by the background thread\n"
+            "  \"dropped\": n,           (numeric) Lines lost because the queue was full\n"
+            "  \"flushes\": n,           (numeric) Batches written\n"
+            "  \"categories\": {\n"
+            "    \"category\": [         (array of string) Recent lines, oldest first\n"
+            "      \"line\", ...\n"
+            "    ], ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getlogbuffer", "") + HelpExampleCli("getlogbuffer", "\"net\"") + HelpExampleRpc("getlogbuffer", "\"net\""));
+
+    std::string strCategory;
+    if (params.size() > 0)
+        strCategory = params[0].get_str();
+
+    CLogStats stats = GetLogStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("async", stats.fAsync));
+    ret.push_back(Pair("queuecapacity", (uint64_t)stats.nQueueCapacity));
+    ret.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    ret.push_back(Pair("written", stats.nWritten));
+    ret.push_back(Pair("dropped", stats.nDropped));
+    ret.push_back(Pair("flushes", stats.nFlushes));
+
+    UniValue categories(UniValue::VOBJ);
+    std::map<std::string, std::vector<std::string> > mapBuffers = GetLogBuffers(strCategory);
+    for (const std::pair<const std::string, std::vector<std::string> >& buffer : mapBuffers) {
+        UniValue lines(UniValue::VARR);
+        for (const std::string& strLine : buffer.second)
+            lines.push_back(strLine);
+        categories.push_back(Pair(buffer.first, lines));
+    }
+    ret.push_back(Pair("categories", categories));
+    return ret;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
@@ -562,6 +619,25 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"lastsearch\": {                   (object) the last stake kernel search pass\n"
+            "    \"time\": ttt,                    (numeric) the time the pass started\n"
+            "    \"duration_ms\": xxx,             (numeric) the time spent hashing, in milliseconds\n"
+            "    \"inputs\": xxx,                  (numeric) the number of stake inputs searched\n"
+            "    \"hashes\": xxx,                  (numeric) the number of kernel hashes computed\n"
+            "    \"hashespersec\": xxx,            (numeric) the kernel hash rate of the pass\n"
+            "    \"threads\": xxx                  (numeric) the number of threads used\n"
+            "  },\n"
+            "  \"template\": {                     (object) the transactions kept ready for the next block\n"
+            "    \"time\": ttt,                    (numeric) the time of the last update\n"
+            "    \"update_ms\": xxx,               (numeric) the duration of the last update, in milliseconds\n"
+            "    \"rebuilt\": true|false,          (boolean) if the last update started from an empty template\n"
+            "    \"transactions\": xxx,            (numeric) the number of transactions in the template\n"
+            "    \"size\": xxx,                    (numeric) the block size with them, in bytes\n"
+            "    \"rebuilds\": xxx,                (numeric) the number of rebuilds since startup\n"
+            "    \"updates\": xxx,                 (numeric) the number of incremental updates since startup\n"
+            "    \"stakesplice_ms\": xxx,          (numeric) last kernel found to block ready for signing, in milliseconds\n"
+            "    \"stakebroadcast_ms\": xxx        (numeric) last kernel found to block processed and announced, in milliseconds\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -590,6 +666,29 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    CStakeSearchStats stats = GetStakeSearchStats();
+    UniValue search(UniValue::VOBJ);
+    search.push_back(Pair("time", stats.nTime));
+    search.push_back(Pair("duration_ms", stats.nDurationMicros / 1000.0));
+    search.push_back(Pair("inputs", stats.nKernels));
+    search.push_back(Pair("hashes", stats.nHashes));
+    search.push_back(Pair("hashespersec", stats.nDurationMicros > 0 ? (double)stats.nHashes * 1000000 / stats.nDurationMicros : 0.0));
+    search.push_back(Pair("threads", stats.nThreads));
+    obj.push_back(Pair("lastsearch", search));
+
+    CBlockAssemblyStats assembly = GetBlockAssemblyStats();
+    UniValue blocktemplate(UniValue::VOBJ);
+    blocktemplate.push_back(Pair("time", assembly.nTime));
+    blocktemplate.push_back(Pair("update_ms", assembly.nUpdateMicros / 1000.0));
+    blocktemplate.push_back(Pair("rebuilt", assembly.fRebuilt));
+    blocktemplate.push_back(Pair("transactions", assembly.nTx));
+    blocktemplate.push_back(Pair("size", assembly.nSize));
+    blocktemplate.push_back(Pair("rebuilds", assembly.nRebuilds));
+    blocktemplate.push_back(Pair("updates", assembly.nUpdates));
+    blocktemplate.push_back(Pair("stakesplice_ms", assembly.nStakeSpliceMicros / 1000.0));
+    blocktemplate.push_back(Pair("stakebroadcast_ms", assembly.nStakeBroadcastMicros / 1000.0));
+    obj.push_back(Pair("template", blocktemplate));
+
     return obj;
 }
 #endif // ENABLE_WALLET
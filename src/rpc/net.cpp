@@ -110,7 +110,17 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"processtime\": {          (json object) Time spent processing the messages of this peer, by command\n"
+            "      \"command\": {\n"
+            "        \"count\": n,            (numeric) Messages processed\n"
+            "        \"total_us\": n,         (numeric) Total processing time in microseconds\n"
+            "        \"max_us\": n,           (numeric) Longest processing time in microseconds\n"
+            "        \"histogram\": [ n, ... ] (array) Message counts by processing time: element i counts times\n"
+            "                                   from 2^i up to 2^(i+1) microseconds; trailing zeros are left out\n"
+            "      }, ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -162,6 +172,24 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
+        UniValue processTime(UniValue::VOBJ);
+        for (const std::pair<const std::string, CProcessTimeHistogram>& command : stats.mapProcessTime) {
+            const CProcessTimeHistogram& histogram = command.second;
+            UniValue commandObj(UniValue::VOBJ);
+            commandObj.push_back(Pair("count", histogram.nCount));
+            commandObj.push_back(Pair("total_us", histogram.nTotalMicros));
+            commandObj.push_back(Pair("max_us", histogram.nMaxMicros));
+            int nBuckets = CProcessTimeHistogram::BUCKETS;
+            while (nBuckets > 0 && histogram.vBuckets[nBuckets - 1] == 0)
+                nBuckets--;
+            UniValue buckets(UniValue::VARR);
+            for (int i = 0; i < nBuckets; i++)
+                buckets.push_back(histogram.vBuckets[i]);
+            commandObj.push_back(Pair("histogram", buckets));
+            processTime.push_back(Pair(command.first, commandObj));
+        }
+        obj.push_back(Pair("processtime", processTime));
+
         ret.push_back(obj);
     }
 
@@ -2139,6 +2139,111 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getrescaninfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "Returns the progress of the running or last wallet rescan.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"scanning\": true|false,   (boolean) whether a rescan is running\n"
+            "  \"startheight\": n,         (numeric) the block the rescan started at\n"
+            "  \"height\": n,              (numeric) the last block scanned\n"
+            "  \"stopheight\": n,          (numeric) the chain tip the rescan is heading for\n"
+            "  \"progress\": x.xxx,        (numeric) fraction of the blocks scanned\n"
+            "  \"blocks\": n,              (numeric) the number of blocks scanned\n"
+            "  \"filterskipped\": n,       (numeric) of those, the blocks not read because their filter did not match (-blockfilterindex)\n"
+            "  \"duration\": n,            (numeric) milliseconds since the rescan started\n"
+            "  \"blockspersecond\": x.xx,  (numeric) blocks scanned per second\n"
+            "  \"found\": n                (numeric) wallet transactions added or updated\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getrescaninfo", "") + HelpExampleRpc("getrescaninfo", ""));
+
+    // Does not take cs_main or cs_wallet, which the rescan holds while it adds transactions
+    CRescanProgress progress = pwalletMain->GetRescanProgress();
+    int64_t nDuration = progress.nStartTime ? GetTimeMillis() - progress.nStartTime : 0;
+    int nBlocksTotal = progress.nStopHeight - progress.nStartHeight + 1;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("scanning", progress.fScanning));
+    obj.push_back(Pair("startheight", progress.nStartHeight));
+    obj.push_back(Pair("height", progress.nHeight));
+    obj.push_back(Pair("stopheight", progress.nStopHeight));
+    obj.push_back(Pair("progress", nBlocksTotal > 0 ? std::min(1.0, (double)progress.nBlocks / nBlocksTotal) : 1.0));
+    obj.push_back(Pair("blocks", progress.nBlocks));
+    obj.push_back(Pair("filterskipped", progress.nSkipped));
+    obj.push_back(Pair("duration", nDuration));
+    obj.push_back(Pair("blockspersecond", nDuration > 0 ? progress.nBlocks * 1000.0 / nDuration : 0.0));
+    obj.push_back(Pair("found", progress.nFound));
+    return obj;
+}
+
+UniValue checkwalletbalances(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "checkwalletbalances ( repair )\n"
+            "Compares the wallet's index of unspent transactions and the balances computed from it\n"
+            "with a scan of all wallet transactions. The scan takes long on large wallets.\n"
+
+            "\nArguments:\n"
+            "1. repair     (boolean, optional, default=false) Rebuild the index if it differs\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"consistent\": true|false,  (boolean) whether index and scan agree\n"
+            "  \"txcount\": n,              (numeric) the number of wallet transactions\n"
+            "  \"unspenttxcount\": n,       (numeric) the number of indexed transactions with unspent outputs\n"
+            "  \"missing\": [\"txid\",...],  (array) transactions with unspent outputs that are not indexed\n"
+            "  \"extra\": [\"txid\",...],    (array) indexed transactions without unspent outputs\n"
+            "  \"balances\": {             (object) per balance\n"
+            "    \"name\": {\n"
+            "      \"indexed\": x.xxx,      (numeric) as returned by the balance calls\n"
+            "      \"scanned\": x.xxx       (numeric) from the scan of all wallet transactions\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("checkwalletbalances", "") + HelpExampleCli("checkwalletbalances", "true") + HelpExampleRpc("checkwalletbalances", "true"));
+
+    bool fRepair = params.size() > 0 && params[0].get_bool();
+
+    std::vector<uint256> vMissing;
+    std::vector<uint256> vExtra;
+    std::vector<CBalanceCheck> vBalances;
+    bool fConsistent = pwalletMain->CheckUnspentIndex(vMissing, vExtra, vBalances, fRepair);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("consistent", fConsistent));
+    {
+        LOCK(pwalletMain->cs_wallet);
+        obj.push_back(Pair("txcount", (int)pwalletMain->mapWallet.size()));
+    }
+    obj.push_back(Pair("unspenttxcount", (int)pwalletMain->GetUnspentTxCount()));
+    UniValue missing(UniValue::VARR);
+    BOOST_FOREACH (const uint256& hash, vMissing)
+        missing.push_back(hash.GetHex());
+    obj.push_back(Pair("missing", missing));
+    UniValue extra(UniValue::VARR);
+    BOOST_FOREACH (const uint256& hash, vExtra)
+        extra.push_back(hash.GetHex());
+    obj.push_back(Pair("extra", extra));
+    UniValue balances(UniValue::VOBJ);
+    BOOST_FOREACH (const CBalanceCheck& check, vBalances) {
+        UniValue balance(UniValue::VOBJ);
+        balance.push_back(Pair("indexed", ValueFromAmount(check.nIndexed)));
+        balance.push_back(Pair("scanned", ValueFromAmount(check.nScanned)));
+        balances.push_back(Pair(check.strName, balance));
+    }
+    obj.push_back(Pair("balances", balances));
+    return obj;
+}
+
 // ppcoin: reserve balance from being staked for network protection
 UniValue reservebalance(const UniValue& params, bool fHelp)
 {
@@ -0,0 +1,233 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/smnc.config.h"
+#endif
+
+#include "socketevents.h"
+
+#include "netbase.h"
+
+#include <algorithm>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+bool CSocketEvents::Set(SOCKET hSocket, int nEvents, void* pcookie)
+{
+    if (hSocket == INVALID_SOCKET || !IsWaitable(hSocket))
+        return false;
+
+    LOCK(cs);
+    std::map<SOCKET, CRegistration>::iterator it = mapRegistrations.find(hSocket);
+    bool fNew = it == mapRegistrations.end();
+    if (!fNew && it->second.nEvents == nEvents && it->second.pcookie == pcookie)
+        return true;
+    if (!Register(hSocket, nEvents, fNew))
+        return false;
+
+    CRegistration& reg = mapRegistrations[hSocket];
+    reg.nEvents = nEvents;
+    reg.pcookie = pcookie;
+    return true;
+}
+
+void CSocketEvents::Remove(SOCKET hSocket, void* pcookie)
+{
+    LOCK(cs);
+    std::map<SOCKET, CRegistration>::iterator it = mapRegistrations.find(hSocket);
+    if (it == mapRegistrations.end() || it->second.pcookie != pcookie)
+        return;
+    Unregister(hSocket);
+    mapRegistrations.erase(it);
+}
+
+size_t CSocketEvents::Size() const
+{
+    LOCK(cs);
+    return mapRegistrations.size();
+}
+
+namespace
+{
+/** Portable fallback: rebuilds the fd_sets from all registrations on every wait */
+class CSocketEventsSelect : public CSocketEvents
+{
+public:
+    bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) override
+    {
+        vEvents.clear();
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        std::vector<Event> vWaiting;
+        {
+            LOCK(cs);
+            vWaiting.reserve(mapRegistrations.size());
+            for (const std::pair<const SOCKET, CRegistration>& reg : mapRegistrations) {
+                if (reg.second.nEvents & SOCKET_EVENT_RECV)
+                    FD_SET(reg.first, &fdsetRecv);
+                if (reg.second.nEvents & SOCKET_EVENT_SEND)
+                    FD_SET(reg.first, &fdsetSend);
+                FD_SET(reg.first, &fdsetError);
+                hSocketMax = std::max(hSocketMax, reg.first);
+                vWaiting.push_back(Event{reg.first, reg.second.pcookie, 0});
+            }
+        }
+
+        struct timeval timeout = MillisToTimeval(nTimeoutMs);
+        int nSelect = select(vWaiting.empty() ? 0 : hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR)
+            return WSAGetLastError() == WSAEINTR;
+
+        for (Event& event : vWaiting) {
+            if (FD_ISSET(event.hSocket, &fdsetRecv))
+                event.nEvents |= SOCKET_EVENT_RECV;
+            if (FD_ISSET(event.hSocket, &fdsetSend))
+                event.nEvents |= SOCKET_EVENT_SEND;
+            if (FD_ISSET(event.hSocket, &fdsetError))
+                event.nEvents |= SOCKET_EVENT_ERROR;
+            if (event.nEvents)
+                vEvents.push_back(event);
+        }
+        return true;
+    }
+
+    bool IsWaitable(SOCKET hSocket) const override
+    {
+#ifdef WIN32
+        return true;
+#else
+        return hSocket < FD_SETSIZE;
+#endif
+    }
+
+    std::string GetName() const override { return "select"; }
+
+protected:
+    bool Register(SOCKET hSocket, int nEvents, bool fNew) override { return true; }
+    void Unregister(SOCKET hSocket) override {}
+};
+
+#ifdef USE_EPOLL
+/** Linux: the kernel keeps the registrations and only returns ready sockets */
+class CSocketEventsEpoll : public CSocketEvents
+{
+private:
+    int hEpoll;
+    std::vector<struct epoll_event> vReady;
+
+    static uint32_t ToEpoll(int nEvents)
+    {
+        uint32_t nEpoll = 0;
+        if (nEvents & SOCKET_EVENT_RECV)
+            nEpoll |= EPOLLIN;
+        if (nEvents & SOCKET_EVENT_SEND)
+            nEpoll |= EPOLLOUT;
+        return nEpoll;
+    }
+
+public:
+    CSocketEventsEpoll()
+    {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    ~CSocketEventsEpoll()
+    {
+        if (hEpoll != -1)
+            close(hEpoll);
+    }
+
+    bool IsValid() const { return hEpoll != -1; }
+
+    bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) override
+    {
+        vEvents.clear();
+
+        // size the buffer to the registrations, a full buffer just leaves the rest for the next wait
+        vReady.resize(std::max((size_t)64, std::min(Size(), (size_t)4096)));
+        int nReady = epoll_wait(hEpoll, vReady.data(), vReady.size(), nTimeoutMs);
+        if (nReady < 0)
+            return errno == EINTR;
+
+        LOCK(cs);
+        for (int i = 0; i < nReady; i++) {
+            // closed sockets drop out of the epoll set by themselves; skip ones we no longer know
+            std::map<SOCKET, CRegistration>::const_iterator it = mapRegistrations.find(vReady[i].data.fd);
+            if (it == mapRegistrations.end())
+                continue;
+
+            Event event{it->first, it->second.pcookie, 0};
+            if (vReady[i].events & EPOLLIN)
+                event.nEvents |= SOCKET_EVENT_RECV;
+            if (vReady[i].events & EPOLLOUT)
+                event.nEvents |= SOCKET_EVENT_SEND;
+            if (vReady[i].events & (EPOLLERR | EPOLLHUP))
+                event.nEvents |= SOCKET_EVENT_ERROR;
+            vEvents.push_back(event);
+        }
+        return true;
+    }
+
+    bool IsWaitable(SOCKET hSocket) const override { return true; }
+
+    std::string GetName() const override { return "epoll"; }
+
+protected:
+    bool Register(SOCKET hSocket, int nEvents, bool fNew) override
+    {
+        struct epoll_event ev = {};
+        ev.events = ToEpoll(nEvents);
+        ev.data.fd = hSocket;
+        if (epoll_ctl(hEpoll, fNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &ev) == 0)
+            return true;
+
+        // A socket closed while registered leaves the epoll set but not mapRegistrations,
+        // and its descriptor may be reused by a new socket. Retry the other way round.
+        if ((fNew && errno == EEXIST) || (!fNew && errno == ENOENT))
+            return epoll_ctl(hEpoll, fNew ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, hSocket, &ev) == 0;
+        return false;
+    }
+
+    void Unregister(SOCKET hSocket) override
+    {
+        // fails harmlessly when the socket was closed already
+        epoll_ctl(hEpoll, EPOLL_CTL_DEL, hSocket, NULL);
+    }
+};
+#endif // USE_EPOLL
+} // namespace
+
+CSocketEvents* CSocketEvents::Create(const std::string& strMode)
+{
+    if (strMode == "select")
+        return new CSocketEventsSelect();
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        CSocketEventsEpoll* pevents = new CSocketEventsEpoll();
+        if (pevents->IsValid())
+            return pevents;
+        delete pevents;
+    }
+#endif
+    return NULL;
+}
+
+std::vector<std::string> CSocketEvents::GetModes()
+{
+    std::vector<std::string> vModes;
+#ifdef USE_EPOLL
+    vModes.push_back("epoll");
+#endif
+    vModes.push_back("select");
+    return vModes;
+}
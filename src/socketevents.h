@@ -0,0 +1,80 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+#include "sync.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** What a socket is waited for, or found ready for. Bits may be combined. */
+enum SocketEvent {
+    SOCKET_EVENT_RECV = (1U << 0),
+    SOCKET_EVENT_SEND = (1U << 1),
+    SOCKET_EVENT_ERROR = (1U << 2),
+};
+
+/** Default for -socketevents */
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/**
+ * Set of sockets a thread waits on. Registrations are kept between waits, so
+ * callers only report changes. Errors are reported for every registered
+ * socket, whatever it is waited for.
+ *
+ * Set() and Remove() may be called from any thread, Wait() from one thread at a time.
+ */
+class CSocketEvents
+{
+public:
+    struct Event {
+        SOCKET hSocket;
+        void* pcookie; // as passed to Set()
+        int nEvents;   // SocketEvent bits
+    };
+
+    virtual ~CSocketEvents() {}
+
+    /** Register hSocket, or change what it is waited for. False if the socket cannot be waited on. */
+    bool Set(SOCKET hSocket, int nEvents, void* pcookie);
+    /** Unregister hSocket, unless it has been registered again under another cookie */
+    void Remove(SOCKET hSocket, void* pcookie);
+    /** Number of registered sockets */
+    size_t Size() const;
+
+    /** Wait up to nTimeoutMs for registered sockets to become ready. False on error, see WSAGetLastError(). */
+    virtual bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) = 0;
+    /** Whether this backend can wait on hSocket at all */
+    virtual bool IsWaitable(SOCKET hSocket) const = 0;
+    virtual std::string GetName() const = 0;
+
+    /** Backend for a -socketevents mode, NULL if the mode is unknown or unavailable here */
+    static CSocketEvents* Create(const std::string& strMode);
+    /** The -socketevents modes available on this platform */
+    static std::vector<std::string> GetModes();
+
+protected:
+    struct CRegistration {
+        int nEvents;
+        void* pcookie;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<SOCKET, CRegistration> mapRegistrations;
+
+    /** Register or update hSocket with the backend, cs is held. fNew is a hint only. */
+    virtual bool Register(SOCKET hSocket, int nEvents, bool fNew) = 0;
+    /** Unregister hSocket from the backend, cs is held. The socket may be closed already. */
+    virtual void Unregister(SOCKET hSocket) = 0;
+};
+
+#endif // BITCOIN_SOCKETEVENTS_H
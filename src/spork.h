@@ -59,6 +59,8 @@ using namespace boost;
 class CSporkMessage;
 class CSporkManager;
 
+/** Protects mapSporks and mapSporksActive; only the peer send locks are taken while holding it */
+extern CCriticalSection cs_mapSporks;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
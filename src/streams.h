@@ -27,11 +27,14 @@
  *
  * >> and << read and write unformatted data using the above serialization templates.
  * Fills with data in linear time; some stringstream implementations take N^2 time.
+ * SerializeType is the byte vector it keeps its data in, which decides how the memory
+ * is allocated and whether it is cleared when freed.
  */
-class CDataStream
+template <typename SerializeType>
+class CBaseDataStream
 {
 protected:
-    typedef CSerializeData vector_type;
+    typedef SerializeType vector_type;
     vector_type vch;
     unsigned int nReadPos;
 
@@ -39,44 +42,44 @@ public:
     int nType;
     int nVersion;
 
-    typedef vector_type::allocator_type allocator_type;
-    typedef vector_type::size_type size_type;
-    typedef vector_type::difference_type difference_type;
-    typedef vector_type::reference reference;
-    typedef vector_type::const_reference const_reference;
-    typedef vector_type::value_type value_type;
-    typedef vector_type::iterator iterator;
-    typedef vector_type::const_iterator const_iterator;
-    typedef vector_type::reverse_iterator reverse_iterator;
+    typedef typename vector_type::allocator_type allocator_type;
+    typedef typename vector_type::size_type size_type;
+    typedef typename vector_type::difference_type difference_type;
+    typedef typename vector_type::reference reference;
+    typedef typename vector_type::const_reference const_reference;
+    typedef typename vector_type::value_type value_type;
+    typedef typename vector_type::iterator iterator;
+    typedef typename vector_type::const_iterator const_iterator;
+    typedef typename vector_type::reverse_iterator reverse_iterator;
 
-    explicit CDataStream(int nTypeIn, int nVersionIn)
+    explicit CBaseDataStream(int nTypeIn, int nVersionIn)
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
+    CBaseDataStream(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 
 #if !defined(_MSC_VER) || _MSC_VER >= 1300
-    CDataStream(const char* pbegin, const char* pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
+    CBaseDataStream(const char* pbegin, const char* pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 #endif
 
-    CDataStream(const vector_type& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    CBaseDataStream(const vector_type& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    CBaseDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    CBaseDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
@@ -88,15 +91,15 @@ public:
         nVersion = nVersionIn;
     }
 
-    CDataStream& operator+=(const CDataStream& b)
+    CBaseDataStream& operator+=(const CBaseDataStream& b)
     {
         vch.insert(vch.end(), b.begin(), b.end());
         return *this;
     }
 
-    friend CDataStream operator+(const CDataStream& a, const CDataStream& b)
+    friend CBaseDataStream operator+(const CBaseDataStream& a, const CBaseDataStream& b)
     {
-        CDataStream ret = a;
+        CBaseDataStream ret = a;
         ret += b;
         return (ret);
     }
@@ -201,7 +204,7 @@ public:
     // Stream subset
     //
     bool eof() const { return size() == 0; }
-    CDataStream* rdbuf() { return this; }
+    CBaseDataStream* rdbuf() { return this; }
     int in_avail() { return size(); }
 
     void SetType(int n) { nType = n; }
@@ -211,7 +214,7 @@ public:
     void ReadVersion() { *this >> nVersion; }
     void WriteVersion() { *this << nVersion; }
 
-    CDataStream& read(char* pch, size_t nSize)
+    CBaseDataStream& read(char* pch, size_t nSize)
     {
         // Read from the beginning of the buffer
         unsigned int nReadPosNext = nReadPos + nSize;
@@ -229,7 +232,7 @@ public:
         return (*this);
     }
 
-    CDataStream& ignore(int nSize)
+    CBaseDataStream& ignore(int nSize)
     {
         // Ignore from the beginning of the buffer
         assert(nSize >= 0);
@@ -245,7 +248,7 @@ public:
         return (*this);
     }
 
-    CDataStream& write(const char* pch, size_t nSize)
+    CBaseDataStream& write(const char* pch, size_t nSize)
     {
         // Write to the end of the buffer
         vch.insert(vch.end(), pch, pch + nSize);
@@ -268,7 +271,7 @@ public:
     }
 
     template <typename T>
-    CDataStream& operator<<(const T& obj)
+    CBaseDataStream& operator<<(const T& obj)
     {
         // Serialize to this stream
         ::Serialize(*this, obj, nType, nVersion);
@@ -276,21 +279,29 @@ public:
     }
 
     template <typename T>
-    CDataStream& operator>>(T& obj)
+    CBaseDataStream& operator>>(T& obj)
     {
         // Unserialize from this stream
         ::Unserialize(*this, obj, nType, nVersion);
         return (*this);
     }
 
-    void GetAndClear(CSerializeData& data)
+    void GetAndClear(vector_type& data)
     {
-        data.insert(data.end(), begin(), end());
+        if (data.empty() && nReadPos == 0)
+            data.swap(vch);
+        else
+            data.insert(data.end(), begin(), end());
         clear();
     }
 };
 
 
+/** Stream for anything that may hold secrets, like wallet records: cleared when freed */
+typedef CBaseDataStream<CSerializeData> CDataStream;
+/** Stream for network messages, using recycled buffers that are not cleared */
+typedef CBaseDataStream<CNetSerializeData> CNetDataStream;
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -407,6 +418,67 @@ public:
     }
 };
 
+/** Deserialize from memory owned elsewhere, such as a mapped file, without copying it
+ *
+ * Only reads. The memory must outlive the reader.
+ */
+class CMemoryReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+
+    int nType;
+    int nVersion;
+
+public:
+    CMemoryReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) : pbegin(pbeginIn), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    //
+    // Stream subset
+    //
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+
+    const char* data() const { return pbegin; }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read : end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore : end of data");
+        pbegin += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    unsigned int GetSerializeSize(const T& obj)
+    {
+        // Tells the size of the object if serialized to this stream
+        return ::GetSerializeSize(obj, nType, nVersion);
+    }
+
+    template <typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind a given number of bytes.
  *
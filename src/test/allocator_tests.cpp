@@ -5,8 +5,15 @@
 #include "util.h"
 
 #include "allocators.h"
+#include "random.h"
+#include "streams.h"
+#include "uint256.h"
+#include "version.h"
+
+#include <deque>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_AUTO_TEST_SUITE(allocator_tests)
 
@@ -116,4 +123,94 @@ BOOST_AUTO_TEST_CASE(test_LockedPageManagerBase)
     BOOST_CHECK((last_unlock_len & (test_page_size-1)) == 0); // always unlock entire pages
 }
 
+BOOST_AUTO_TEST_CASE(pooled_allocator_recycles)
+{
+    const char* pchFirst;
+    {
+        CNetSerializeData v(1000);
+        pchFirst = &v[0];
+    }
+    BufferPoolStats before = GetBufferPoolStats();
+    {
+        // same size class, so the same buffer comes back
+        CNetSerializeData v(700);
+        BOOST_CHECK(&v[0] == pchFirst);
+    }
+    BufferPoolStats after = GetBufferPoolStats();
+    BOOST_CHECK_EQUAL(after.nAllocations - before.nAllocations, 1U);
+    BOOST_CHECK_EQUAL(after.nHeapAllocations, before.nHeapAllocations);
+    BOOST_CHECK_EQUAL(after.nReleases - before.nReleases, 1U);
+    BOOST_CHECK_EQUAL(after.nCachedBytes, before.nCachedBytes);
+
+    // too large to be pooled
+    {
+        CNetSerializeData v(8 << 20);
+    }
+    BufferPoolStats large = GetBufferPoolStats();
+    BOOST_CHECK_EQUAL(large.nHeapAllocations - after.nHeapAllocations, 1U);
+    BOOST_CHECK_EQUAL(large.nHeapReleases - after.nHeapReleases, 1U);
+    BOOST_CHECK_EQUAL(large.nCachedBytes, after.nCachedBytes);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_allocator_cross_thread)
+{
+    // Messages are serialized on one thread and released on another once sent,
+    // as between CNode::PushMessage() and SocketSendData()
+    const int nMessages = 10000;
+    const size_t nMaxQueued = 8;
+    std::vector<uint256> vHashes(35);
+    for (uint256& hash : vHashes)
+        hash = GetRandHash();
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<CNetSerializeData> vQueue;
+    bool fDone = false;
+
+    BufferPoolStats before = GetBufferPoolStats();
+    boost::thread sender([&]() {
+        while (true) {
+            CNetSerializeData vMessage;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (vQueue.empty() && !fDone)
+                    cond.wait(lock);
+                if (vQueue.empty())
+                    return;
+                vMessage.swap(vQueue.front());
+                vQueue.pop_front();
+            }
+            cond.notify_all();
+        }
+    });
+
+    CNetDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    for (int i = 0; i < nMessages; i++) {
+        ss << i << vHashes;
+        CNetSerializeData vMessage;
+        ss.GetAndClear(vMessage);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (vQueue.size() >= nMaxQueued)
+            cond.wait(lock);
+        vQueue.push_back(CNetSerializeData());
+        vQueue.back().swap(vMessage);
+        cond.notify_all();
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fDone = true;
+    }
+    cond.notify_all();
+    sender.join();
+    BufferPoolStats after = GetBufferPoolStats();
+
+    // the buffers the sender releases are handed out to the serializing thread again
+    uint64_t nAllocations = after.nAllocations - before.nAllocations;
+    uint64_t nHeapAllocations = after.nHeapAllocations - before.nHeapAllocations;
+    BOOST_CHECK(nAllocations >= (uint64_t)nMessages);
+    BOOST_CHECK(after.nReleases - before.nReleases >= (uint64_t)nMessages);
+    BOOST_CHECK(nHeapAllocations < nAllocations / 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
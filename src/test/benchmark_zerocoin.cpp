@@ -35,6 +35,7 @@ using namespace libzerocoin;
 #define COLOR_STR_RED     "\033[31m"
 
 #define TESTS_COINS_TO_ACCUMULATE   50
+#define TESTS_FIXED_BASE_ROUNDS     5
 
 // Global test counters
 uint32_t    ggNumTests        = 0;
@@ -370,6 +371,132 @@ Testb_MintAndSpend()
 	return false;
 }
 
+void
+gLogTableTiming(string proofName, int nPlain, int nTables)
+{
+	cout << "\t" << proofName << " ELAPSED TIME (" << TESTS_FIXED_BASE_ROUNDS << " rounds):\n\t\tpow_mod: " << nPlain << " ms\tfixed-base tables: " << nTables << " ms" << endl;
+}
+
+bool
+Testb_FixedBaseTables()
+{
+	// This test assumes a list of coins were generated in Testb_MintCoin()
+	if (ggCoins[0] == NULL) {
+		return false;
+	}
+
+	bool fResult = true;
+	try {
+		const PrivateCoin& coin = *(ggCoins[0]);
+		const IntegerGroupParams* serialGroup = &gg_Params->serialNumberSoKCommitmentGroup;
+		const IntegerGroupParams* accGroup = &gg_Params->accumulatorParams.accumulatorPoKCommitmentGroup;
+
+		Accumulator acc(&gg_Params->accumulatorParams, CoinDenomination::ZQ_ONE);
+		AccumulatorWitness wAcc(gg_Params, acc, coin.getPublicCoin());
+		for (uint32_t i = 0; i < TESTS_COINS_TO_ACCUMULATE; i++) {
+			acc += ggCoins[i]->getPublicCoin();
+			wAcc += ggCoins[i]->getPublicCoin();
+		}
+
+		CBigNum bnRandomness = CBigNum::randBignum(serialGroup->groupOrder);
+		Commitment fullCommitment(serialGroup, coin.getPublicCoin().getValue());
+		Commitment accCommitment(accGroup, coin.getPublicCoin().getValue());
+		uint256 msghash = CBigNum::randBignum(CBigNum(~uint256(0))).getuint256();
+
+		// Pass 0 runs on plain pow_mod, pass 1 on the fixed-base tables. The
+		// proofs of pass 0 are verified again in pass 1 so both paths must agree.
+		int nCommit[2], nCommitProve[2], nCommitVerify[2], nAccProve[2], nAccVerify[2];
+		int nSoKProve[2], nSoKVerify[2], nSpendVerify[2];
+		CBigNum bnCommitment[2];
+		CommitmentProofOfKnowledge commitProof(serialGroup, accGroup, fullCommitment, accCommitment);
+		AccumulatorProofOfKnowledge accProof(&gg_Params->accumulatorParams, accCommitment, wAcc, acc);
+		SerialNumberSignatureOfKnowledge sokProof(gg_Params, coin, fullCommitment, msghash);
+		CoinSpend spend(gg_Params, gg_Params, coin, acc, 0, wAcc, 0, SpendType::SPEND);
+
+		for (int nPass = 0; nPass < 2; nPass++) {
+			IntegerGroupParams::fUseFixedBaseTables = (nPass == 1);
+
+			// Untimed round: builds the tables and checks the other pass' proofs
+			fResult &= commitProof.Verify(fullCommitment.getCommitmentValue(), accCommitment.getCommitmentValue());
+			fResult &= accProof.Verify(acc, accCommitment.getCommitmentValue());
+			fResult &= sokProof.Verify(coin.getSerialNumber(), fullCommitment.getCommitmentValue(), msghash);
+			fResult &= spend.Verify(acc);
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				bnCommitment[nPass] = Commitment(serialGroup, coin.getSerialNumber(), bnRandomness).getCommitmentValue();
+			timer.stop();
+			nCommit[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				commitProof = CommitmentProofOfKnowledge(serialGroup, accGroup, fullCommitment, accCommitment);
+			timer.stop();
+			nCommitProve[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				fResult &= commitProof.Verify(fullCommitment.getCommitmentValue(), accCommitment.getCommitmentValue());
+			timer.stop();
+			nCommitVerify[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				accProof = AccumulatorProofOfKnowledge(&gg_Params->accumulatorParams, accCommitment, wAcc, acc);
+			timer.stop();
+			nAccProve[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				fResult &= accProof.Verify(acc, accCommitment.getCommitmentValue());
+			timer.stop();
+			nAccVerify[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				sokProof = SerialNumberSignatureOfKnowledge(gg_Params, coin, fullCommitment, msghash);
+			timer.stop();
+			nSoKProve[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				fResult &= sokProof.Verify(coin.getSerialNumber(), fullCommitment.getCommitmentValue(), msghash);
+			timer.stop();
+			nSoKVerify[nPass] = timer.duration();
+
+			timer.start();
+			for (uint32_t i = 0; i < TESTS_FIXED_BASE_ROUNDS; i++)
+				fResult &= spend.Verify(acc);
+			timer.stop();
+			nSpendVerify[nPass] = timer.duration();
+
+			// Leave a fresh spend for the other pass to verify
+			spend = CoinSpend(gg_Params, gg_Params, coin, acc, 0, wAcc, 0, SpendType::SPEND);
+		}
+		IntegerGroupParams::fUseFixedBaseTables = true;
+
+		if (bnCommitment[0] != bnCommitment[1]) {
+			cout << "Commitments differ between pow_mod and fixed-base tables" << endl;
+			fResult = false;
+		}
+
+		gLogTableTiming("COMMITMENT", nCommit[0], nCommit[1]);
+		gLogTableTiming("COMMITMENT POK PROVE", nCommitProve[0], nCommitProve[1]);
+		gLogTableTiming("COMMITMENT POK VERIFY", nCommitVerify[0], nCommitVerify[1]);
+		gLogTableTiming("ACCUMULATOR POK PROVE", nAccProve[0], nAccProve[1]);
+		gLogTableTiming("ACCUMULATOR POK VERIFY", nAccVerify[0], nAccVerify[1]);
+		gLogTableTiming("SERIAL NUMBER SOK PROVE", nSoKProve[0], nSoKProve[1]);
+		gLogTableTiming("SERIAL NUMBER SOK VERIFY", nSoKVerify[0], nSoKVerify[1]);
+		gLogTableTiming("SPEND VERIFY", nSpendVerify[0], nSpendVerify[1]);
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		IntegerGroupParams::fUseFixedBaseTables = true;
+		return false;
+	}
+
+	return fResult;
+}
+
 void
 Testb_RunAllTests()
 {
@@ -389,6 +516,7 @@ Testb_RunAllTests()
 	gLogTestResult("coins can be minted", Testb_MintCoin);
 	gLogTestResult("the accumulator works", Testb_Accumulator);
 	gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
+	gLogTestResult("fixed-base tables match pow_mod", Testb_FixedBaseTables);
 
 	// Summarize test results
 	if (ggSuccessfulTests < ggNumTests) {
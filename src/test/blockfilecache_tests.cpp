@@ -0,0 +1,204 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilecache.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "undo.h"
+#include "test/test_smnc.h"
+
+#include <ctime>
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** A block of nTx transactions with random inputs, about 250 bytes each */
+CBlock MakeBlock(int nTx)
+{
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        std::vector<unsigned char> vchSig(140);
+        GetRandBytes(vchSig.data(), vchSig.size());
+        tx.vin[0].scriptSig << vchSig;
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = GetRand(100 * COIN);
+            out.scriptPubKey << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+CBlockUndo MakeUndo(int nTx)
+{
+    CBlockUndo undo;
+    undo.vtxundo.resize(nTx);
+    for (CTxUndo& txundo : undo.vtxundo) {
+        CTxOut out(GetRand(100 * COIN), CScript() << ToByteVector(GetRandHash()) << OP_CHECKSIG);
+        txundo.vprevout.push_back(CTxInUndo(out, false, false, 1 + GetRand(1000), 1));
+    }
+    return undo;
+}
+
+/** Undo data position after the record at pos, see CBlockUndo::WriteToDisk() */
+CDiskBlockPos NextUndoPos(const CDiskBlockPos& pos, const CBlockUndo& undo)
+{
+    return CDiskBlockPos(pos.nFile, pos.nPos + ::GetSerializeSize(undo, SER_DISK, CLIENT_VERSION) + sizeof(uint256));
+}
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(blockfilecache_tests)
+
+BOOST_AUTO_TEST_CASE(mapped_reads_match_stdio)
+{
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+
+    CBlock block = MakeBlock(50);
+    CDiskBlockPos pos(1100, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+    // file 1100 is still being written
+    uint64_t nMaps = blockFileCache.GetMaps();
+    CBlock blockRead;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockRead, pos));
+    BOOST_CHECK_EQUAL(blockFileCache.GetMaps(), nMaps);
+    CNetSerializeData vStdio;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vStdio, pos));
+
+    blockFileCache.SetFinishedFiles(1200);
+    BOOST_REQUIRE(ReadBlockFromDisk(blockRead, pos));
+    BOOST_CHECK_EQUAL(blockFileCache.GetMaps(), nMaps + 1);
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRead.vtx == block.vtx);
+    CNetSerializeData vMapped;
+    uint64_t nHits = blockFileCache.GetHits();
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vMapped, pos));
+    BOOST_CHECK_EQUAL(blockFileCache.GetHits(), nHits + 1);
+    BOOST_CHECK(vMapped == vStdio);
+
+    // a position that is not the start of a block
+    CNetSerializeData vBad;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vBad, CDiskBlockPos(pos.nFile, pos.nPos + 1)));
+
+    // undo data, with a second record appended after the file was mapped
+    uint256 hashBlock = GetRandHash();
+    CBlockUndo undo1 = MakeUndo(20), undo2 = MakeUndo(30), undoRead;
+    CDiskBlockPos posUndo1(1100, 0);
+    BOOST_REQUIRE(undo1.WriteToDisk(posUndo1, hashBlock));
+    BOOST_REQUIRE(undoRead.ReadFromDisk(posUndo1, hashBlock));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), undo1.vtxundo.size());
+    BOOST_CHECK(!undoRead.ReadFromDisk(posUndo1, GetRandHash()));
+
+    CDiskBlockPos posUndo2 = NextUndoPos(posUndo1, undo1);
+    BOOST_REQUIRE(undo2.WriteToDisk(posUndo2, hashBlock));
+    nMaps = blockFileCache.GetMaps();
+    BOOST_REQUIRE(undoRead.ReadFromDisk(posUndo2, hashBlock));
+    BOOST_CHECK_EQUAL(blockFileCache.GetMaps(), nMaps + 1);
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), undo2.vtxundo.size());
+    BOOST_CHECK(undoRead.vtxundo[29].vprevout[0].txout == undo2.vtxundo[29].vprevout[0].txout);
+
+    blockFileCache.SetFinishedFiles(0);
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+BOOST_AUTO_TEST_CASE(least_recently_used_files_unmapped)
+{
+    std::vector<CDiskBlockPos> vPos;
+    for (int i = 0; i < 3; i++) {
+        CBlock block = MakeBlock(5);
+        CDiskBlockPos pos(1110 + i, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        vPos.push_back(pos);
+    }
+    blockFileCache.SetFinishedFiles(1200);
+    blockFileCache.SetMaxFiles(2);
+
+    CBlockFileCache::MappedFilePtr pfile = blockFileCache.Get(vPos[0].nFile, "blk", vPos[0].nPos);
+    BOOST_REQUIRE(pfile);
+    BOOST_CHECK(blockFileCache.Get(vPos[1].nFile, "blk", vPos[1].nPos));
+    BOOST_CHECK(blockFileCache.Get(vPos[0].nFile, "blk", vPos[0].nPos) == pfile);
+    // evicts file 1111, the least recently used
+    BOOST_CHECK(blockFileCache.Get(vPos[2].nFile, "blk", vPos[2].nPos));
+    uint64_t nMaps = blockFileCache.GetMaps();
+    BOOST_CHECK(blockFileCache.Get(vPos[0].nFile, "blk", vPos[0].nPos) == pfile);
+    BOOST_CHECK_EQUAL(blockFileCache.GetMaps(), nMaps);
+    BOOST_CHECK(blockFileCache.Get(vPos[1].nFile, "blk", vPos[1].nPos));
+    BOOST_CHECK_EQUAL(blockFileCache.GetMaps(), nMaps + 1);
+
+    // unmapped files stay readable where still referenced
+    blockFileCache.Clear();
+    const char* pbegin;
+    const char* pend;
+    BOOST_CHECK(pfile->GetRecord(vPos[0].nPos, 0, pbegin, pend));
+    BOOST_CHECK(!blockFileCache.Get(vPos[0].nFile, "blk", vPos[0].nPos));
+
+    blockFileCache.SetMaxFiles(DEFAULT_MMAP_BLOCK_FILES);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(random_block_reads)
+{
+    const int nFiles = fRunBenchmarks ? 4 : 2;
+    const int nBlocksPerFile = fRunBenchmarks ? 16 : 4;
+    const int nTx = fRunBenchmarks ? 500 : 20;
+    const int nReads = fRunBenchmarks ? 2000 : 50;
+
+    // the synthetic blocks are not mined
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+
+    std::vector<CDiskBlockPos> vPos;
+    for (int nFile = 0; nFile < nFiles; nFile++) {
+        CDiskBlockPos pos(1120 + nFile, 0);
+        for (int i = 0; i < nBlocksPerFile; i++) {
+            CBlock block = MakeBlock(nTx);
+            BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+            vPos.push_back(pos);
+            pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        }
+    }
+
+    std::vector<int> vOrder;
+    for (int i = 0; i < nReads; i++)
+        vOrder.push_back(GetRand(vPos.size()));
+
+    std::vector<uint256> vHashes;
+    for (int fMapped = 0; fMapped < 2; fMapped++) {
+        blockFileCache.SetFinishedFiles(fMapped ? 1200 : 0);
+        uint256 hashAll;
+        std::clock_t nStart = std::clock();
+        for (int i : vOrder) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, vPos[i]));
+            uint256 hashTx = block.vtx.back().GetHash();
+            hashAll = Hash(hashAll.begin(), hashAll.end(), hashTx.begin(), hashTx.end());
+        }
+        double dSeconds = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+        vHashes.push_back(hashAll);
+
+        if (fRunBenchmarks)
+            std::cout << "Random block reads " << (fMapped ? "mmap" : "stdio") << ": " << nReads << " blocks of " << nTx << " transactions in "
+                      << dSeconds << " s CPU, " << (dSeconds > 0 ? nReads / dSeconds : 0) << " blocks/s" << std::endl;
+    }
+
+    // both ways read the same blocks
+    BOOST_CHECK(vHashes[0] == vHashes[1]);
+
+    blockFileCache.SetFinishedFiles(0);
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,260 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "test/test_smnc.h"
+
+#include <ctime>
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+CBlockFilter::Element RandomElement()
+{
+    uint256 hash = GetRandHash();
+    return CBlockFilter::Element(hash.begin(), hash.begin() + 1 + GetRand(32));
+}
+
+CScript RandomScript()
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+/** A block of nTx transactions paying to random scripts, and to vScripts in the first ones */
+CBlock MakeBlock(int nTx, const std::vector<CScript>& vScripts)
+{
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        std::vector<unsigned char> vchSig(72);
+        GetRandBytes(vchSig.data(), vchSig.size());
+        tx.vin[0].scriptSig << vchSig;
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = GetRand(100 * COIN);
+            out.scriptPubKey = (size_t)i < vScripts.size() ? vScripts[i] : RandomScript();
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** What a wallet does with a block it has read: look for outputs to its keys */
+int CountMine(const CBlock& block, const CKeyStore& keystore)
+{
+    int nMine = 0;
+    for (const CTransaction& tx : block.vtx) {
+        for (const CTxOut& txout : tx.vout) {
+            CTxDestination dest;
+            if (ExtractDestination(txout.scriptPubKey, dest) && boost::get<CKeyID>(&dest) && keystore.HaveKey(boost::get<CKeyID>(dest))) {
+                nMine++;
+                break;
+            }
+        }
+    }
+    return nMine;
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(gcs_filter_match)
+{
+    uint256 hashBlock = GetRandHash();
+    CBlockFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    CBlockFilter filter(hashBlock, included);
+    BOOST_CHECK_EQUAL(filter.GetElementCount(), included.size());
+    for (const CBlockFilter::Element& element : included)
+        BOOST_CHECK(filter.Match(element));
+    BOOST_CHECK(filter.MatchAny(included));
+    // false positives have a probability of 1/M each
+    int nFalsePositives = 0;
+    for (const CBlockFilter::Element& element : excluded)
+        nFalsePositives += filter.Match(element);
+    BOOST_CHECK(nFalsePositives <= 1);
+
+    // a stored filter matches the same
+    CBlockFilter decoded;
+    BOOST_REQUIRE(decoded.Decode(hashBlock, filter.GetEncoded()));
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetElementCount(), included.size());
+    for (const CBlockFilter::Element& element : included)
+        BOOST_CHECK(decoded.Match(element));
+    BOOST_CHECK(!decoded.Decode(hashBlock, std::vector<unsigned char>()));
+
+    // the same elements for another block hash to other values
+    CBlockFilter other(GetRandHash(), included);
+    BOOST_CHECK(other.GetEncoded() != filter.GetEncoded());
+
+    // empty filters are a single 0 and match nothing
+    CBlockFilter empty(hashBlock, CBlockFilter::ElementSet());
+    BOOST_CHECK(empty.GetEncoded() == std::vector<unsigned char>(1, 0));
+    BOOST_CHECK(!empty.MatchAny(included));
+    BOOST_CHECK(!filter.MatchAny(CBlockFilter::ElementSet()));
+}
+
+BOOST_AUTO_TEST_CASE(block_filter_elements)
+{
+    CBlock block = MakeBlock(3, std::vector<CScript>());
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(3);
+    coinbase.vout[0].scriptPubKey = RandomScript();
+    coinbase.vout[1].scriptPubKey = CScript() << OP_RETURN << ToByteVector(GetRandHash());
+    block.vtx.insert(block.vtx.begin(), coinbase);
+
+    CBlockFilter::ElementSet elements = CBlockFilter::GetBlockElements(block);
+    // 6 + 1 output scripts, 3 spent outpoints; OP_RETURN, the empty script and the coinbase input are left out
+    BOOST_CHECK_EQUAL(elements.size(), 10U);
+
+    CBlockFilter filter(block);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK(filter.Match(CBlockFilter::Element(coinbase.vout[0].scriptPubKey.begin(), coinbase.vout[0].scriptPubKey.end())));
+    BOOST_CHECK(filter.Match(CBlockFilter::OutPointElement(block.vtx[2].vin[0].prevout)));
+    CBlockFilter::ElementSet spentOutpoints;
+    spentOutpoints.insert(CBlockFilter::OutPointElement(COutPoint(GetRandHash(), 0)));
+    spentOutpoints.insert(CBlockFilter::OutPointElement(block.vtx[3].vin[0].prevout));
+    BOOST_CHECK(filter.MatchAny(spentOutpoints));
+
+    // headers commit to the whole chain of filters
+    uint256 hashHeader = filter.ComputeHeader(0);
+    BOOST_CHECK(hashHeader != filter.ComputeHeader(GetRandHash()));
+    uint256 hashFilter = filter.GetHash();
+    BOOST_CHECK(hashHeader == Hash(hashFilter.begin(), hashFilter.end(), uint256(0).begin(), uint256(0).end()));
+}
+
+BOOST_AUTO_TEST_CASE(block_filter_db)
+{
+    CBlockFilterDB db(1 << 20, true);
+
+    std::vector<CBlock> vBlocks;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 3; i++) {
+        vBlocks.push_back(MakeBlock(5, std::vector<CScript>()));
+        vHashes.push_back(vBlocks.back().GetHash());
+    }
+    std::vector<CBlockIndex> vIndex(3);
+    for (int i = 0; i < 3; i++) {
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+    }
+
+    // not before the parent has one
+    BOOST_CHECK(!db.WriteFilter(vBlocks[1], &vIndex[1]));
+    BOOST_CHECK(!db.HaveFilter(vHashes[1]));
+
+    uint256 hashHeader = 0;
+    for (int i = 0; i < 3; i++) {
+        BOOST_REQUIRE(db.WriteFilter(vBlocks[i], &vIndex[i]));
+        CBlockFilterEntry entry;
+        BOOST_REQUIRE(db.ReadFilter(vHashes[i], entry));
+        CBlockFilter filter(vBlocks[i]);
+        BOOST_CHECK(entry.vFilter == filter.GetEncoded());
+        hashHeader = filter.ComputeHeader(hashHeader);
+        BOOST_CHECK(entry.hashHeader == hashHeader);
+
+        CBlockFilter stored;
+        BOOST_REQUIRE(db.ReadFilter(vHashes[i], stored));
+        BOOST_CHECK(stored.MatchAny(CBlockFilter::GetBlockElements(vBlocks[i])));
+    }
+    uint256 hashBest;
+    BOOST_REQUIRE(db.ReadBestBlock(hashBest));
+    BOOST_CHECK(hashBest == vHashes[2]);
+}
+
+BOOST_AUTO_TEST_CASE(rescan_with_filters)
+{
+    const int nBlocks = fRunBenchmarks ? 100 : 10;
+    const int nTx = fRunBenchmarks ? 1000 : 20;
+    const int nWalletBlocks = 2; // blocks paying to the wallet
+
+    // the synthetic blocks are not mined
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+
+    CBasicKeyStore keystore;
+    std::vector<CScript> vScripts;
+    CBlockFilter::ElementSet elements;
+    for (int i = 0; i < 20; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        vScripts.push_back(GetScriptForDestination(key.GetPubKey().GetID()));
+        elements.insert(CBlockFilter::Element(vScripts.back().begin(), vScripts.back().end()));
+    }
+
+    CBlockFilterDB db(1 << 22, true);
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    std::vector<CDiskBlockPos> vPos;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block = MakeBlock(nTx, i % (nBlocks / nWalletBlocks) == 0 ? std::vector<CScript>(1, vScripts[i % vScripts.size()]) : std::vector<CScript>());
+        CDiskBlockPos pos(2000 + i, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        vPos.push_back(pos);
+        vHashes[i] = block.GetHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+        BOOST_REQUIRE(db.WriteFilter(block, &vIndex[i]));
+    }
+
+    // read every block
+    std::clock_t nStart = std::clock();
+    int nFoundFull = 0;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, vPos[i]));
+        nFoundFull += CountMine(block, keystore);
+    }
+    double dFull = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+
+    // read the blocks whose filter matches
+    nStart = std::clock();
+    int nFoundFiltered = 0;
+    int nRead = 0;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockFilter filter;
+        BOOST_REQUIRE(db.ReadFilter(vHashes[i], filter));
+        if (!filter.MatchAny(elements))
+            continue;
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, vPos[i]));
+        nFoundFiltered += CountMine(block, keystore);
+        nRead++;
+    }
+    double dFiltered = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+
+    if (fRunBenchmarks)
+        std::cout << "Rescan of " << nBlocks << " blocks of " << nTx << " transactions: all blocks " << dFull << " s CPU, "
+                  << "with filters " << dFiltered << " s CPU, " << nRead << " blocks read" << std::endl;
+
+    BOOST_CHECK_EQUAL(nFoundFull, nWalletBlocks);
+    BOOST_CHECK_EQUAL(nFoundFiltered, nFoundFull);
+    BOOST_CHECK(nRead >= nWalletBlocks && nRead <= nWalletBlocks + 1);
+
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
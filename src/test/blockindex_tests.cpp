@@ -0,0 +1,348 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+#include "test/test_smnc.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** A chain of nBlocks block index entries past the proof of work blocks, every other one staked */
+struct CTestChain
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+
+    explicit CTestChain(int nBlocks) : vIndex(nBlocks), vHashes(nBlocks)
+    {
+        for (int i = 0; i < nBlocks; i++) {
+            CBlockIndex& index = vIndex[i];
+            index.pprev = i > 0 ? &vIndex[i - 1] : NULL;
+            index.nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+            index.nVersion = 3 + i % 2;
+            index.hashMerkleRoot = GetRandHash();
+            index.nTime = GetTime() + i;
+            index.nBits = 0x1e0ffff0;
+            index.nNonce = insecure_rand();
+            index.nStatus = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA;
+            index.nTx = 1 + i % 7;
+            index.nFile = 0;
+            index.nDataPos = 80 * i;
+            index.nMint = GetRand(1000 * COIN);
+            index.nMoneySupply = GetRand(1000000 * COIN);
+            if (i % 2) {
+                index.SetProofOfStake();
+                index.prevoutStake = COutPoint(GetRandHash(), i);
+                index.nStakeTime = index.nTime;
+            }
+            vHashes[i] = index.GetBlockHeader().GetHash();
+            index.phashBlock = &vHashes[i];
+        }
+    }
+
+    void Write(CBlockTreeDB& db) const
+    {
+        for (const CBlockIndex& index : vIndex)
+            BOOST_REQUIRE(db.WriteBlockIndex(CDiskBlockIndex(const_cast<CBlockIndex*>(&index))));
+    }
+
+    void Erase(CBlockTreeDB& db) const
+    {
+        for (const uint256& hash : vHashes)
+            BOOST_REQUIRE(db.Erase(std::make_pair('b', hash)));
+    }
+
+    /** Compare what was loaded into mapBlockIndex and take it out again */
+    void CheckLoaded() const
+    {
+        for (unsigned int i = 0; i < vIndex.size(); i++) {
+            BlockMap::iterator mi = mapBlockIndex.find(vHashes[i]);
+            BOOST_REQUIRE(mi != mapBlockIndex.end());
+            const CBlockIndex* pindex = mi->second;
+            BOOST_CHECK(pindex->pprev == (i > 0 ? mapBlockIndex[vHashes[i - 1]] : NULL));
+            BOOST_CHECK_EQUAL(pindex->nHeight, vIndex[i].nHeight);
+            BOOST_CHECK_EQUAL(pindex->nStatus, vIndex[i].nStatus);
+            BOOST_CHECK_EQUAL(pindex->nTx, vIndex[i].nTx);
+            BOOST_CHECK_EQUAL(pindex->nDataPos, vIndex[i].nDataPos);
+            BOOST_CHECK_EQUAL(pindex->nMint, vIndex[i].nMint);
+            BOOST_CHECK_EQUAL(pindex->nMoneySupply, vIndex[i].nMoneySupply);
+            BOOST_CHECK_EQUAL(pindex->IsProofOfStake(), vIndex[i].IsProofOfStake());
+            BOOST_CHECK(pindex->prevoutStake == vIndex[i].prevoutStake);
+            BOOST_CHECK(pindex->GetBlockHeader().GetHash() == vHashes[i]);
+        }
+        for (unsigned int i = 0; i < vIndex.size(); i++) {
+            BlockMap::iterator mi = mapBlockIndex.find(vHashes[i]);
+            setStakeSeen.erase(std::make_pair(mi->second->prevoutStake, mi->second->nStakeTime));
+            blockIndexArena.Destroy(mi->second);
+            mapBlockIndex.erase(mi);
+        }
+    }
+};
+
+/** Block index entry as it was before the arena, with its zerocoin fields on the heap */
+struct CHeapBlockIndex : public CBlockIndex {
+    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+
+    CHeapBlockIndex()
+    {
+        for (auto& denom : libzerocoin::zerocoinDenomList)
+            mapZerocoinSupply.insert(std::make_pair(denom, 0));
+    }
+};
+
+/** Resident set size in kB, 0 where /proc is not available */
+size_t GetResidentKB()
+{
+#ifndef WIN32
+    std::ifstream statm("/proc/self/statm");
+    size_t nPages = 0, nResident = 0;
+    if (statm >> nPages >> nResident)
+        return nResident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+    return 0;
+}
+
+/** Link vIndex into a chain and walk it the way GetAncestor does, returns the CPU seconds taken */
+double LinkAndWalk(const std::vector<CBlockIndex*>& vIndex, const std::vector<uint256>& vHashes)
+{
+    std::clock_t nStart = std::clock();
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i]->phashBlock = &vHashes[i];
+        vIndex[i]->nHeight = i;
+        vIndex[i]->pprev = i > 0 ? vIndex[i - 1] : NULL;
+        vIndex[i]->BuildSkip();
+    }
+    int64_t nSum = 0;
+    for (int i = 0; i < 100000; i++) {
+        CBlockIndex* pindex = vIndex[insecure_rand() % vIndex.size()];
+        nSum += pindex->GetAncestor(insecure_rand() % (pindex->nHeight + 1))->nHeight;
+    }
+    BOOST_CHECK(nSum >= 0);
+    return (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+}
+
+bool HaveBlocks(const CTestChain& chain)
+{
+    for (const uint256& hash : chain.vHashes) {
+        if (!mapBlockIndex.count(hash))
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(blockindex_tests)
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot)
+{
+    const boost::filesystem::path pathSnapshot = GetDataDir() / "blocks" / "index.snapshot";
+    CBlockTreeDB db(1 << 20, true, true);
+    CTestChain chain(5000);
+    const uint256 hashBest = chain.vHashes.back();
+
+    // decoded on several threads from the database
+    chain.Write(db);
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(hashBest));
+    chain.CheckLoaded();
+
+    // a snapshot of a clean shutdown is used even without the database records
+    BOOST_REQUIRE(db.WriteFlag("shutdown", true));
+    BOOST_REQUIRE(db.WriteBlockIndexSnapshot(hashBest));
+    BOOST_CHECK(boost::filesystem::exists(pathSnapshot));
+    chain.Erase(db);
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(hashBest));
+    BOOST_CHECK(!boost::filesystem::exists(pathSnapshot));
+    chain.CheckLoaded();
+
+    // but only once, and only for the coins tip it was written against
+    chain.Write(db);
+    BOOST_REQUIRE(db.WriteBlockIndexSnapshot(hashBest));
+    chain.Erase(db);
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(chain.vHashes.front()));
+    BOOST_CHECK(!boost::filesystem::exists(pathSnapshot));
+    BOOST_CHECK(!HaveBlocks(chain));
+
+    // and after a clean shutdown only
+    chain.Write(db);
+    BOOST_REQUIRE(db.WriteBlockIndexSnapshot(hashBest));
+    chain.Erase(db);
+    BOOST_REQUIRE(db.WriteFlag("shutdown", false));
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(hashBest));
+    BOOST_CHECK(!HaveBlocks(chain));
+
+    // a damaged snapshot falls back to the database
+    chain.Write(db);
+    BOOST_REQUIRE(db.WriteFlag("shutdown", true));
+    BOOST_REQUIRE(db.WriteBlockIndexSnapshot(hashBest));
+    {
+        FILE* file = fopen(pathSnapshot.string().c_str(), "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, 100, SEEK_SET);
+        int ch = fgetc(file);
+        fseek(file, 100, SEEK_SET);
+        fputc(~ch, file);
+        fclose(file);
+    }
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(hashBest));
+    chain.CheckLoaded();
+}
+
+BOOST_AUTO_TEST_CASE(zerocoin_fields)
+{
+    // serialized as the std::map and std::vector they replaced, the vector sorted
+    CZerocoinSupply supply;
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+    CMintDenominations mints;
+    std::vector<libzerocoin::CoinDenomination> vMints;
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        supply.at(denom) = GetRand(1000);
+        mapSupply[denom] = supply.at(denom);
+        for (int i = GetRand(3); i > 0; i--)
+            vMints.push_back(denom);
+    }
+    mints.assign(vMints);
+    CDataStream ss(SER_DISK, CLIENT_VERSION), ssLegacy(SER_DISK, CLIENT_VERSION);
+    ss << supply << mints;
+    ssLegacy << mapSupply << vMints;
+    BOOST_CHECK(ss.str() == ssLegacy.str());
+    BOOST_CHECK_EQUAL(ss.size(), supply.GetSerializeSize(SER_DISK, CLIENT_VERSION) + mints.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    CZerocoinSupply supply2;
+    CMintDenominations mints2;
+    ss >> supply2 >> mints2;
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        BOOST_CHECK_EQUAL(supply2.at(denom), mapSupply[denom]);
+        BOOST_CHECK_EQUAL(mints2.count(denom), (unsigned int)std::count(vMints.begin(), vMints.end(), denom));
+    }
+    BOOST_CHECK_EQUAL(mints2.size(), vMints.size());
+    BOOST_CHECK_THROW(supply2.at(libzerocoin::ZQ_ERROR), std::out_of_range);
+    BOOST_CHECK_EQUAL(mints2.count(libzerocoin::ZQ_ERROR), 0U);
+
+    // a vector in mint order, as earlier versions wrote it, keeps its counts and is written back unchanged
+    std::vector<libzerocoin::CoinDenomination> vMintOrder = {libzerocoin::ZQ_FIVE_THOUSAND, libzerocoin::ZQ_ONE,
+        libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_ONE, libzerocoin::ZQ_TEN, libzerocoin::ZQ_FIVE_THOUSAND};
+    CDataStream ssMintOrder(SER_DISK, CLIENT_VERSION);
+    ssMintOrder << vMintOrder;
+    CMintDenominations mints3;
+    ssMintOrder >> mints3;
+    BOOST_CHECK_EQUAL(mints3.size(), vMintOrder.size());
+    BOOST_CHECK_EQUAL(mints3.count(libzerocoin::ZQ_ONE), 2U);
+    BOOST_CHECK_EQUAL(mints3.count(libzerocoin::ZQ_TEN), 1U);
+    BOOST_CHECK_EQUAL(mints3.count(libzerocoin::ZQ_FIFTY), 1U);
+    BOOST_CHECK_EQUAL(mints3.count(libzerocoin::ZQ_FIVE_THOUSAND), 2U);
+    BOOST_CHECK_EQUAL(mints3.count(libzerocoin::ZQ_FIVE), 0U);
+
+    CDataStream ssWritten(SER_DISK, CLIENT_VERSION);
+    ssWritten << mints3;
+    BOOST_CHECK(ssWritten.str() == ssMintOrder.str());
+    BOOST_CHECK_EQUAL(ssWritten.size(), mints3.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // copies share the order, and so does an equal order read again
+    CMintDenominations mints4 = mints3, mints5;
+    CDataStream ssCopy(SER_DISK, CLIENT_VERSION), ssAgain(SER_DISK, CLIENT_VERSION);
+    ssCopy << mints4;
+    BOOST_CHECK(ssCopy.str() == ssMintOrder.str());
+    mints5.assign(vMintOrder);
+    ssAgain << mints5;
+    BOOST_CHECK(ssAgain.str() == ssMintOrder.str());
+    BOOST_CHECK(InternMintOrder(vMintOrder) == InternMintOrder(std::vector<libzerocoin::CoinDenomination>(vMintOrder)));
+
+    // ZQ_ERROR is not counted but still written back where it was
+    std::vector<libzerocoin::CoinDenomination> vWithError = {libzerocoin::ZQ_ONE, libzerocoin::ZQ_ERROR, libzerocoin::ZQ_TEN};
+    CMintDenominations mints6;
+    mints6.assign(vWithError);
+    BOOST_CHECK_EQUAL(mints6.size(), 3U);
+    BOOST_CHECK_EQUAL(mints6.count(libzerocoin::ZQ_ERROR), 0U);
+    CDataStream ssError(SER_DISK, CLIENT_VERSION), ssErrorLegacy(SER_DISK, CLIENT_VERSION);
+    ssError << mints6;
+    ssErrorLegacy << vWithError;
+    BOOST_CHECK(ssError.str() == ssErrorLegacy.str());
+}
+
+BOOST_AUTO_TEST_CASE(block_index_arena)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 20000; i++)
+        vIndex.push_back(arena.Create());
+    BOOST_CHECK_EQUAL(arena.size(), vIndex.size());
+    BOOST_CHECK(vIndex[1] == vIndex[0] + 1);
+
+    // freed entries are handed out again, the others stay where they are
+    CBlockIndex* pindexFreed = vIndex[123];
+    arena.Destroy(pindexFreed);
+    CBlockIndex block;
+    block.nHeight = 42;
+    CBlockIndex* pindex = arena.Create(block);
+    BOOST_CHECK(pindex == pindexFreed);
+    BOOST_CHECK_EQUAL(pindex->nHeight, 42);
+    BOOST_CHECK_EQUAL(arena.size(), vIndex.size());
+    BOOST_CHECK(arena.DynamicMemoryUsage() >= vIndex.size() * sizeof(CBlockIndex));
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_arena_benchmark)
+{
+    // timing only, block_index_arena checks the arena
+    if (!fRunBenchmarks)
+        return;
+
+    const int nEntries = 500000;
+    std::vector<uint256> vHashes(nEntries);
+    for (uint256& hash : vHashes)
+        hash = GetRandHash();
+
+    // arena entries with the zerocoin fields inline
+    size_t nResidentStart = GetResidentKB();
+    std::clock_t nStart = std::clock();
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vArenaIndex;
+    for (int i = 0; i < nEntries; i++)
+        vArenaIndex.push_back(arena.Create());
+    double dArenaCreate = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+    size_t nArenaKB = GetResidentKB() - nResidentStart;
+    double dArenaWalk = LinkAndWalk(vArenaIndex, vHashes);
+    BOOST_CHECK_EQUAL(arena.size(), (size_t)nEntries);
+    vArenaIndex.clear();
+    arena.Clear();
+
+    // one allocation per entry and eight more for its zerocoin supply, as before
+    nResidentStart = GetResidentKB();
+    nStart = std::clock();
+    std::vector<std::unique_ptr<CHeapBlockIndex> > vHeap;
+    std::vector<CBlockIndex*> vHeapIndex;
+    for (int i = 0; i < nEntries; i++) {
+        vHeap.emplace_back(new CHeapBlockIndex());
+        vHeapIndex.push_back(vHeap.back().get());
+    }
+    double dHeapCreate = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+    size_t nHeapKB = GetResidentKB() - nResidentStart;
+    double dHeapWalk = LinkAndWalk(vHeapIndex, vHashes);
+
+    std::cout << nEntries << " block index entries: heap " << dHeapCreate << " s to create, " << dHeapWalk << " s to link and walk, "
+              << nHeapKB << " kB resident; arena " << dArenaCreate << " s to create, " << dArenaWalk << " s to link and walk, "
+              << nArenaKB << " kB resident" << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
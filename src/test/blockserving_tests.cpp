@@ -0,0 +1,236 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "net.h"
+#include "random.h"
+#include "util.h"
+#include "test/test_smnc.h"
+
+#include <ctime>
+#include <iostream>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** A block of nTx transactions with random inputs, about 250 bytes each */
+CBlock MakeBlock(int nTx)
+{
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        std::vector<unsigned char> vchSig(140);
+        GetRandBytes(vchSig.data(), vchSig.size());
+        tx.vin[0].scriptSig << vchSig;
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = GetRand(100 * COIN);
+            out.scriptPubKey << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Points -datadir at a fresh directory while in scope, so the test block files stay out of the shared one */
+struct CTempDataDir
+{
+    std::string strDataDirPrev;
+    boost::filesystem::path path;
+
+    CTempDataDir()
+    {
+        strDataDirPrev = mapArgs["-datadir"];
+        path = GetTempPath() / strprintf("test_smnc_blockserving_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+        boost::filesystem::create_directories(path);
+        mapArgs["-datadir"] = path.string();
+        ClearDatadirCache();
+    }
+
+    ~CTempDataDir()
+    {
+        mapArgs["-datadir"] = strDataDirPrev;
+        ClearDatadirCache();
+        boost::filesystem::remove_all(path);
+    }
+};
+
+/** Skips the proof of work check while in scope, the synthetic blocks are not mined */
+struct CSkipProofOfWorkCheck
+{
+    CSkipProofOfWorkCheck() { ModifiableParams()->setSkipProofOfWorkCheck(true); }
+    ~CSkipProofOfWorkCheck() { ModifiableParams()->setSkipProofOfWorkCheck(false); }
+};
+
+#ifndef WIN32
+/** Nodes on one end of local socket pairs, the receiving peers on the other */
+struct CLocalPeers
+{
+    std::vector<std::unique_ptr<CNode> > vNodes;
+    std::vector<SOCKET> vPeer;
+
+    bool Open(int nPeers)
+    {
+        for (int i = 0; i < nPeers; i++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+                return false;
+            SOCKET hLocal = fds[0], hPeer = fds[1];
+            SetSocketNonBlocking(hLocal, true);
+            SetSocketNonBlocking(hPeer, true);
+            vNodes.emplace_back(new CNode(hLocal, CAddress(), "", true));
+            vPeer.push_back(hPeer);
+        }
+        return true;
+    }
+
+    /** Send whatever is queued and read it on the other end, until all send queues are empty */
+    size_t Drain()
+    {
+        size_t nReceived = 0;
+        char pchBuf[0x10000];
+        bool fPending = true;
+        while (fPending) {
+            fPending = false;
+            for (size_t i = 0; i < vNodes.size(); i++) {
+                {
+                    LOCK(vNodes[i]->cs_vSend);
+                    SocketSendData(vNodes[i].get());
+                    fPending |= !vNodes[i]->vSendMsg.empty();
+                }
+                int nBytes;
+                while ((nBytes = recv(vPeer[i], pchBuf, sizeof(pchBuf), MSG_DONTWAIT)) > 0)
+                    nReceived += nBytes;
+            }
+        }
+        return nReceived;
+    }
+
+    ~CLocalPeers()
+    {
+        for (SOCKET& hSocket : vPeer)
+            CloseSocket(hSocket);
+    }
+};
+#endif
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(blockserving_tests)
+
+BOOST_AUTO_TEST_CASE(raw_block_matches_network_serialization)
+{
+    // the genesis block written by InitBlockIndex()
+    CBlock genesis;
+    BOOST_REQUIRE(ReadBlockFromDisk(genesis, chainActive.Genesis()));
+    CNetSerializeData vGenesis;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vGenesis, chainActive.Genesis()->GetBlockPos()));
+    CDataStream ssGenesis(SER_NETWORK, PROTOCOL_VERSION);
+    ssGenesis << genesis;
+    BOOST_CHECK(CNetSerializeData(ssGenesis.begin(), ssGenesis.end()) == vGenesis);
+
+    CTempDataDir datadir;
+    CBlock block = MakeBlock(50);
+    CDiskBlockPos pos(1000, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    CNetSerializeData vData(CMessageHeader::HEADER_SIZE, 'x');
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vData, pos));
+    BOOST_CHECK_EQUAL(vData.size(), CMessageHeader::HEADER_SIZE + ss.size());
+    BOOST_CHECK(std::equal(ss.begin(), ss.end(), vData.begin() + CMessageHeader::HEADER_SIZE));
+    BOOST_CHECK(std::all_of(vData.begin(), vData.begin() + CMessageHeader::HEADER_SIZE, [](char c) { return c == 'x'; }));
+
+    // through the index, the stored header has to hash to the indexed block
+    CBlockIndex index(block);
+    uint256 hashBlock = block.GetHash();
+    index.phashBlock = &hashBlock;
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus |= BLOCK_HAVE_DATA;
+    CNetSerializeData vIndexed;
+    BOOST_CHECK(ReadRawBlockFromDisk(vIndexed, &index));
+    BOOST_CHECK(CNetSerializeData(ss.begin(), ss.end()) == vIndexed);
+    CBlock blockOther = MakeBlock(1);
+    CDiskBlockPos posOther(1001, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(blockOther, posOther));
+    CNetSerializeData vMisplaced;
+    index.nFile = posOther.nFile;
+    index.nDataPos = posOther.nPos;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vMisplaced, &index));
+
+    // a position that is not the start of a block
+    CNetSerializeData vBad;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vBad, CDiskBlockPos(pos.nFile, pos.nPos + 1)));
+    BOOST_CHECK(!ReadRawBlockFromDisk(vBad, CDiskBlockPos(pos.nFile, 0)));
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(raw_and_deserialized_serving_match)
+{
+    const int nPeers = fRunBenchmarks ? 8 : 2;
+    const int nBlocks = fRunBenchmarks ? 8 : 2;
+    const int nRounds = fRunBenchmarks ? 4 : 1;
+    const int nTx = fRunBenchmarks ? 2000 : 50;
+
+    CTempDataDir datadir;
+    CSkipProofOfWorkCheck skipPoW;
+
+    std::vector<CDiskBlockPos> vPos;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block = MakeBlock(nTx);
+        CDiskBlockPos pos(1001 + i, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        vPos.push_back(pos);
+    }
+
+    std::vector<size_t> vReceived;
+    for (int fRaw = 0; fRaw < 2; fRaw++) {
+        CLocalPeers peers;
+        BOOST_REQUIRE(peers.Open(nPeers));
+
+        size_t nReceived = 0;
+        std::clock_t nStart = std::clock();
+        for (int nRound = 0; nRound < nRounds; nRound++) {
+            // every peer asks for every block, as during initial sync
+            for (const CDiskBlockPos& pos : vPos) {
+                for (std::unique_ptr<CNode>& pnode : peers.vNodes) {
+                    if (fRaw) {
+                        CNetSerializeData vMessage(CMessageHeader::HEADER_SIZE);
+                        BOOST_REQUIRE(ReadRawBlockFromDisk(vMessage, pos));
+                        pnode->PushRawMessage("block", vMessage);
+                    } else {
+                        CBlock block;
+                        BOOST_REQUIRE(ReadBlockFromDisk(block, pos));
+                        pnode->PushMessage("block", block);
+                    }
+                }
+                nReceived += peers.Drain();
+            }
+        }
+        double dSeconds = (double)(std::clock() - nStart) / CLOCKS_PER_SEC;
+        vReceived.push_back(nReceived);
+
+        if (fRunBenchmarks)
+            std::cout << "Block serving " << (fRaw ? "raw" : "deserialize/serialize") << ": " << nPeers << " peers, "
+                      << nReceived / 1000000 << " MB in " << dSeconds << " s CPU, "
+                      << (dSeconds > 0 ? nReceived / dSeconds / 1000000 : 0) << " MB/s" << std::endl;
+    }
+
+    // both ways put the same bytes on the wire
+    BOOST_CHECK_EQUAL(vReceived[0], vReceived[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,15 +8,21 @@
 
 
 
+#include "chainparams.h"
 #include "clientversion.h"
+#include "coins.h"
 #include "main.h"
+#include "random.h"
+#include "timedata.h"
 #include "utiltime.h"
 
+#include <atomic>
 #include <cstdio>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 
 BOOST_AUTO_TEST_SUITE(CheckBlock_tests)
@@ -66,4 +72,87 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+namespace
+{
+/** A block on the tip with a coinbase and, if fZerocoinSpend, a transaction that claims to be a zerocoin spend */
+CBlock MakeBlock(bool fZerocoinSpend)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = fZerocoinSpend ? GetRandHash() : chainActive.Tip()->GetBlockHash();
+    block.nTime = GetAdjustedTime();
+    block.nBits = chainActive.Tip()->nBits;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << (chainActive.Height() + 1) << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+    if (fZerocoinSpend) {
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(uint256(0), 0);
+        std::vector<unsigned char> vchSpend(200);
+        GetRandBytes(vchSpend.data(), vchSpend.size());
+        spend.vin[0].scriptSig = CScript() << OP_ZEROCOINSPEND << vchSpend;
+        spend.vout.resize(1);
+        spend.vout[0].nValue = COIN;
+        spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(spend);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+} // namespace
+
+// A block with a zerocoin spend checked outside of cs_main, as ProcessNewBlock() does, while
+// another thread connects a block: ConnectBlock() holds cs_main and waits for the script check
+// queue, so CheckBlock() must not wait for cs_main once it has claimed the queue.
+BOOST_AUTO_TEST_CASE(zerocoin_spend_checked_while_connecting)
+{
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    CBlock blockSpend = MakeBlock(true);
+    CBlock blockConnect = MakeBlock(false);
+    BOOST_REQUIRE(blockSpend.vtx[1].IsZerocoinSpend());
+
+    std::atomic<bool> fLocked(false);
+    boost::thread threadConnect([&blockConnect, &fLocked]() {
+        LOCK(cs_main);
+        fLocked = true;
+        // give the other thread time to get into CheckBlock() and wait for cs_main
+        MilliSleep(500);
+        uint256 hashBlock = blockConnect.GetHash();
+        CBlockIndex index(blockConnect);
+        index.phashBlock = &hashBlock;
+        index.pprev = chainActive.Tip();
+        index.nHeight = chainActive.Height() + 1;
+        CCoinsViewCache view(pcoinsTip);
+        CValidationState state;
+        ConnectBlock(blockConnect, state, &index, view, true, true);
+    });
+    boost::thread threadProcess([&blockSpend, &fLocked]() {
+        while (!fLocked)
+            MilliSleep(1);
+        CValidationState state;
+        try {
+            ProcessNewBlock(state, NULL, &blockSpend);
+        } catch (const std::exception&) {
+            // the spend is random bytes, only the locking is of interest here
+        }
+    });
+
+    bool fConnected = threadConnect.try_join_for(boost::chrono::seconds(60));
+    bool fProcessed = threadProcess.try_join_for(boost::chrono::seconds(60));
+    BOOST_CHECK(fConnected);
+    BOOST_CHECK(fProcessed);
+    if (!fConnected || !fProcessed) {
+        // deadlocked, the threads can't be stopped
+        threadConnect.detach();
+        threadProcess.detach();
+    }
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "hash.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
@@ -175,4 +177,136 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+static CCoins RandomCoins()
+{
+    CCoins coins;
+    coins.nVersion = 1 + insecure_rand() % 2;
+    coins.nHeight = insecure_rand() % 100000;
+    coins.fCoinBase = insecure_rand() % 2;
+    coins.vout.resize(1 + insecure_rand() % 4);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = insecure_rand() % 100000000;
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return coins;
+}
+
+static void CheckStatsEqual(const CTxOutSetStats& a, const CTxOutSetStats& b)
+{
+    BOOST_CHECK_EQUAL(a.nTransactions, b.nTransactions);
+    BOOST_CHECK_EQUAL(a.nTransactionOutputs, b.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(a.nSerializedSize, b.nSerializedSize);
+    BOOST_CHECK_EQUAL(a.nTotalAmount, b.nTotalAmount);
+    BOOST_CHECK(a.muhash.Finalize() == b.muhash.Finalize());
+}
+
+// Statistics moved across the changes of a cache layer match a full recount
+BOOST_AUTO_TEST_CASE(coins_stats_update)
+{
+    CCoinsViewTest base;
+    std::map<uint256, CCoins> result;
+    std::vector<uint256> txids;
+    {
+        CCoinsViewCache cache(&base);
+        for (int i = 0; i < 200; i++) {
+            txids.push_back(GetRandHash());
+            *cache.ModifyCoins(txids.back()) = result[txids.back()] = RandomCoins();
+        }
+        cache.SetBestBlock(GetRandHash());
+        cache.Flush();
+    }
+
+    CTxOutSetStats stats;
+    for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++)
+        stats.Add(it->first, it->second);
+
+    for (int nBlock = 0; nBlock < 10; nBlock++) {
+        CCoinsViewCache cache(&base);
+        for (int i = 0; i < 50; i++) {
+            uint256 txid = insecure_rand() % 4 ? txids[insecure_rand() % txids.size()] : GetRandHash();
+            CCoins& coins = result[txid];
+            CCoinsModifier entry = cache.ModifyCoins(txid);
+            switch (insecure_rand() % 3) {
+            case 0:
+                coins = RandomCoins();
+                break;
+            case 1:
+                if (!coins.vout.empty())
+                    coins.vout[insecure_rand() % coins.vout.size()].SetNull();
+                coins.Cleanup();
+                break;
+            case 2:
+                coins.Clear();
+                break;
+            }
+            *entry = coins;
+        }
+        // Read-only accesses must not count
+        cache.AccessCoins(txids[insecure_rand() % txids.size()]);
+        uint256 hashBlock = GetRandHash();
+        cache.SetBestBlock(hashBlock);
+        cache.UpdateStats(stats);
+        BOOST_CHECK(stats.hashBlock == hashBlock);
+        cache.Flush();
+
+        CTxOutSetStats full;
+        for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++)
+            full.Add(it->first, it->second);
+        CheckStatsEqual(stats, full);
+    }
+}
+
+// The parallel chainstate scan matches the statistics accumulated one txid at a time
+BOOST_AUTO_TEST_CASE(coins_stats_parallel_scan)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CTxOutSetStats expected;
+    std::map<std::vector<unsigned char>, std::pair<uint256, CCoins> > mapOrdered; // in database key order
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 2000; i++) {
+            uint256 txid = GetRandHash();
+            CCoins coins = RandomCoins();
+            expected.Add(txid, coins);
+            *cache.ModifyCoins(txid) = coins;
+            if (!coins.IsPruned())
+                mapOrdered[std::vector<unsigned char>(txid.begin(), txid.end())] = std::make_pair(txid, coins);
+        }
+        expected.hashBlock = GetRandHash();
+        cache.SetBestBlock(expected.hashBlock);
+        cache.Flush();
+    }
+
+    CTxOutSetStats stats;
+    uint256 hashSerialized;
+    BOOST_CHECK(db.GetTxOutSetStats(stats, &hashSerialized));
+    BOOST_CHECK(stats.hashBlock == expected.hashBlock);
+    CheckStatsEqual(stats, expected);
+
+    // hash_serialized as the serial walk of gettxoutsetinfo computed it
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << expected.hashBlock;
+    for (const auto& entry : mapOrdered) {
+        const CCoins& coins = entry.second.second;
+        ss << entry.second.first;
+        ss << VARINT(coins.nVersion);
+        ss << (coins.fCoinBase ? 'c' : 'n');
+        ss << VARINT(coins.nHeight);
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull()) {
+                ss << VARINT(i + 1);
+                ss << coins.vout[i];
+            }
+        }
+        ss << VARINT(0);
+    }
+    BOOST_CHECK(hashSerialized == ss.GetHash());
+
+    BOOST_CHECK(db.WriteTxOutSetStats(stats));
+    CTxOutSetStats read;
+    BOOST_CHECK(db.ReadTxOutSetStats(read));
+    BOOST_CHECK(read.hashBlock == expected.hashBlock);
+    CheckStatsEqual(read, expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
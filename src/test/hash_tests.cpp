@@ -3,11 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "muhash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -46,4 +51,160 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Vectors of the SipHash-2-4 reference implementation: key 00..0f, message 00..(n-1)
+    CSipHasher hasher(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), 0x726fdb47dd0e0e31ull);
+    static const unsigned char t0[1] = {0};
+    hasher.Write(t0, 1);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), 0x74f839c593dc67fdull);
+    static const unsigned char t1[7] = {1, 2, 3, 4, 5, 6, 7};
+    hasher.Write(t1, 7);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), 0x93f5f5799a932462ull);
+    static const unsigned char t2[8] = {8, 9, 10, 11, 12, 13, 14, 15};
+    hasher.Write(t2, 8);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), 0x3f2acc7f57c29bdbull);
+    static const unsigned char t3[2] = {16, 17};
+    hasher.Write(t3, 2);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), 0x4bc1b3f0968dd39cull);
+}
+
+BOOST_AUTO_TEST_CASE(muhash)
+{
+    std::vector<std::vector<unsigned char> > vElements;
+    for (int i = 0; i < 16; i++)
+        vElements.push_back(std::vector<unsigned char>(1 + i, (unsigned char)i));
+
+    // Insertion order and grouping do not matter
+    CMuHash3072 forward, backward, left, right;
+    for (unsigned int i = 0; i < vElements.size(); i++) {
+        forward.Insert(vElements[i]);
+        backward.Insert(vElements[vElements.size() - 1 - i]);
+        (i % 2 ? left : right).Insert(vElements[i]);
+    }
+    left *= right;
+    BOOST_CHECK(forward.Finalize() == backward.Finalize());
+    BOOST_CHECK(forward.Finalize() == left.Finalize());
+
+    // Removing what was inserted gets back to the same set, in any order
+    CMuHash3072 empty;
+    CMuHash3072 partial = forward;
+    partial.Remove(vElements[3]);
+    BOOST_CHECK(partial.Finalize() != forward.Finalize());
+    partial.Insert(vElements[3]);
+    BOOST_CHECK(partial.Finalize() == forward.Finalize());
+    CMuHash3072 removed;
+    removed.Remove(vElements[0]);
+    removed.Insert(vElements[0]);
+    BOOST_CHECK(removed.Finalize() == empty.Finalize());
+    partial /= backward;
+    BOOST_CHECK(partial.Finalize() == empty.Finalize());
+
+    // Multiset, not set
+    CMuHash3072 twice = empty;
+    twice.Insert(vElements[0]).Insert(vElements[0]);
+    CMuHash3072 once;
+    once.Insert(vElements[0]);
+    BOOST_CHECK(twice.Finalize() != once.Finalize());
+
+    // Serialization keeps numerator and denominator apart
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << partial << forward;
+    BOOST_CHECK_EQUAL(ss.size(), 4 * CMuHash3072::BYTE_SIZE);
+    CMuHash3072 read1, read2;
+    ss >> read1 >> read2;
+    BOOST_CHECK(read1.Finalize() == empty.Finalize());
+    BOOST_CHECK(read2.Finalize() == forward.Finalize());
+    read2.Remove(vElements[5]).Insert(vElements[5]);
+    BOOST_CHECK(read2.Finalize() == forward.Finalize());
+}
+
+static CBlockHeader RandomHeader(int32_t nVersion)
+{
+    CBlockHeader header;
+    header.nVersion = nVersion;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = insecure_rand();
+    header.nBits = insecure_rand();
+    header.nNonce = insecure_rand();
+    header.nAccumulatorCheckpoint = GetRandHash();
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(quark_genesis)
+{
+    // Mainnet genesis header
+    CBlockHeader genesis;
+    genesis.nVersion = 1;
+    genesis.hashPrevBlock.SetNull();
+    genesis.hashMerkleRoot = uint256("0xd03805b519b0b22277a4e1a3aa49b81f80b72ffd6abc96cae041a6c80dfaf89b");
+    genesis.nTime = 1620555589;
+    genesis.nBits = 0x1e0ffff0;
+    genesis.nNonce = 13315739;
+    BOOST_CHECK(genesis.GetHash() == uint256("0x00000886870b1ea12f26f3ced5f59d8d94c71958be350cacfa1467038a1d1aa6"));
+}
+
+BOOST_AUTO_TEST_CASE(blockhash_cache)
+{
+    fBlockHashCache = true;
+    CBlockHeader header = RandomHeader(3);
+    const uint256 hash = header.GetHash();
+    BOOST_CHECK(header.nHashCacheState == CBlockHeader::HASH_CACHED);
+
+    uint64_t nComputed, nSaved, nSavedBefore;
+    GetBlockHashCacheStats(nComputed, nSavedBefore);
+    BOOST_CHECK(header.GetHash() == hash);
+    GetBlockHashCacheStats(nComputed, nSaved);
+    BOOST_CHECK_EQUAL(nSaved, nSavedBefore + 1);
+
+    // Copies carry the memoized hash, mutations must invalidate it
+    CBlock block(header);
+    BOOST_CHECK(block.nHashCacheState == CBlockHeader::HASH_CACHED);
+    block.nNonce++;
+    block.InvalidateHash();
+    BOOST_CHECK(block.GetHash() != hash);
+    block.nNonce--;
+    block.InvalidateHash();
+    BOOST_CHECK(block.GetHash() == hash);
+
+    // A field written without InvalidateHash() never gets the old hash back
+    CBlockHeader mutated = header;
+    mutated.nTime++;
+    CBlockHeader fresh = mutated;
+    fresh.InvalidateHash();
+    const uint256 hashMutated = fresh.GetHash();
+    BOOST_CHECK(hashMutated != hash);
+    BOOST_CHECK(mutated.GetHash() == hashMutated);
+    mutated.nTime--;
+    BOOST_CHECK(mutated.GetHash() == hash);
+    mutated.nAccumulatorCheckpoint = GetRandHash();
+    mutated.nVersion = 4;
+    fresh = mutated;
+    fresh.InvalidateHash();
+    BOOST_CHECK(mutated.GetHash() == fresh.GetHash());
+
+    // Deserialization always starts from a fresh hash
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << RandomHeader(4);
+    CBlockHeader header2 = header;
+    ss >> header2;
+    BOOST_CHECK(header2.nHashCacheState == CBlockHeader::HASH_NONE);
+
+    // A header shared between threads gives every one of them the same hash
+    CBlockHeader shared = RandomHeader(4);
+    const uint256 hashShared = CBlockHeader(shared).GetHash();
+    shared.InvalidateHash();
+    std::vector<uint256> vThreadHashes(4);
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < vThreadHashes.size(); i++)
+        threads.create_thread([&shared, &vThreadHashes, i]() { vThreadHashes[i] = shared.GetHash(); });
+    threads.join_all();
+    for (const uint256& hashThread : vThreadHashes)
+        BOOST_CHECK(hashThread == hashShared);
+    BOOST_CHECK(shared.GetHash() == hashShared);
+    fBlockHashCache = false;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
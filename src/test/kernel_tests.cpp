@@ -0,0 +1,120 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "main.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Stake input with a fixed modifier and uniqueness stream */
+class CTestStakeInput : public CStakeInput
+{
+public:
+    uint64_t nModifier;
+    uint256 hashUnique;
+    CAmount nValue;
+
+    CBlockIndex* GetIndexFrom() override { return NULL; }
+    bool CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut = 0) override { return false; }
+    bool GetTxFrom(CTransaction& tx) override { return false; }
+    CAmount GetValue() override { return nValue; }
+    bool CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, CAmount nTotal) override { return false; }
+    bool GetModifier(uint64_t& nStakeModifier) override
+    {
+        nStakeModifier = nModifier;
+        return true;
+    }
+    bool IsZSMNC() override { return false; }
+    CDataStream GetUniqueness() override
+    {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << hashUnique << (unsigned int)7;
+        return ss;
+    }
+};
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_prefix)
+{
+    // The prefix-hashed kernel must produce the same proof hashes as CheckStake()
+    for (int i = 0; i < 20; i++) {
+        CTestStakeInput input;
+        input.nModifier = ((uint64_t)insecure_rand() << 32) | insecure_rand();
+        input.hashUnique = GetRandHash();
+        input.nValue = (insecure_rand() % 100000) * COIN;
+        unsigned int nTimeBlockFrom = 1600000000 + insecure_rand() % 1000000;
+
+        CStakeKernel kernel;
+        BOOST_CHECK(kernel.Init(&input, nTimeBlockFrom));
+        BOOST_CHECK_EQUAL(kernel.nValueIn, input.nValue);
+
+        for (int j = 0; j < STAKE_HASH_DRIFT; j++) {
+            unsigned int nTryTime = nTimeBlockFrom + 3600 + j;
+            uint256 bnTarget;
+            bnTarget.SetCompact(0x1e0ffff0);
+            uint256 hashExpected;
+            bool fHit = CheckStake(input.GetUniqueness(), input.nValue, input.nModifier, bnTarget, nTimeBlockFrom, nTryTime, hashExpected);
+            uint256 hash = kernel.GetHashProofOfStake(nTryTime);
+            BOOST_CHECK(hash == hashExpected);
+            BOOST_CHECK_EQUAL(stakeTargetHit(hash, kernel.nValueIn, bnTarget), fHit);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search)
+{
+    // Enough inputs to be spread over the workers, an easy target so that several of them hit
+    std::vector<CTestStakeInput> vInputs(1000);
+    std::vector<CStakeKernel> vKernels(vInputs.size());
+    const unsigned int nTimeBlockFrom = 1600000000;
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        vInputs[i].nModifier = i;
+        vInputs[i].hashUnique = GetRandHash();
+        vInputs[i].nValue = COIN;
+        BOOST_REQUIRE(vKernels[i].Init(&vInputs[i], nTimeBlockFrom));
+    }
+    const unsigned int nBits = 0x1d00b505; // about one input in a hundred hits
+    const unsigned int nTimeTx = nTimeBlockFrom + 3600;
+    uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+
+    // the first hit of the serial search, from nStart
+    size_t nStart = 100;
+    size_t nExpected = vKernels.size();
+    unsigned int nTimeExpected = 0;
+    for (size_t i = nStart; i < vKernels.size() && nExpected == vKernels.size(); i++) {
+        for (int j = 0; j < STAKE_HASH_DRIFT; j++) {
+            unsigned int nTryTime = nTimeTx + STAKE_HASH_DRIFT - j;
+            if (stakeTargetHit(vKernels[i].GetHashProofOfStake(nTryTime), vKernels[i].nValueIn, bnTarget)) {
+                nExpected = i;
+                nTimeExpected = nTryTime;
+                break;
+            }
+        }
+    }
+    BOOST_REQUIRE(nExpected < vKernels.size());
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+    size_t nFound = 0;
+    unsigned int nTimeFound = 0;
+    uint256 hashProofOfStake;
+    BOOST_CHECK(SearchStakeKernels(vKernels, nStart, nBits, nTimeTx, nHeight, nFound, nTimeFound, hashProofOfStake));
+    BOOST_CHECK_EQUAL(nFound, nExpected);
+    BOOST_CHECK_EQUAL(nTimeFound, nTimeExpected);
+    BOOST_CHECK(hashProofOfStake == vKernels[nExpected].GetHashProofOfStake(nTimeExpected));
+
+    // a search for a height the chain is no longer at gives up
+    BOOST_CHECK(!SearchStakeKernels(vKernels, nStart, nBits, nTimeTx, nHeight + 1, nFound, nTimeFound, hashProofOfStake));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
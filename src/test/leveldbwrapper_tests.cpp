@@ -0,0 +1,64 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "leveldbwrapper.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(leveldbwrapper_tests)
+
+BOOST_AUTO_TEST_CASE(dbprofile_args)
+{
+    DBProfile profile;
+    BOOST_CHECK(ParseDBProfile("bulk", profile) && profile == DB_PROFILE_BULK);
+    BOOST_CHECK(ParseDBProfile("read", profile) && profile == DB_PROFILE_READ);
+    BOOST_CHECK(!ParseDBProfile("fast", profile));
+    BOOST_CHECK_EQUAL(GetDBProfileName(DB_PROFILE_WRITE), "write");
+
+    BOOST_CHECK(CheckDBProfileArg("balanced"));
+    BOOST_CHECK(CheckDBProfileArg("chainstate:bulk"));
+    BOOST_CHECK(!CheckDBProfileArg(":bulk"));
+    BOOST_CHECK(!CheckDBProfileArg("chainstate:"));
+    BOOST_CHECK(!CheckDBProfileArg("chainstate"));
+}
+
+BOOST_AUTO_TEST_CASE(dbprofile_select_and_compact)
+{
+    mapMultiArgs["-dbprofile"].clear();
+    mapMultiArgs["-dbprofile"].push_back("read");
+    mapMultiArgs["-dbprofile"].push_back("dbtest_bulk:bulk");
+    {
+        CLevelDBWrapper dbBulk(GetDataDir() / "dbtest_bulk", 1 << 20, true);
+        CLevelDBWrapper dbOther(GetDataDir() / "dbtest_other", 1 << 20, true);
+        BOOST_CHECK_EQUAL(dbBulk.GetName(), "dbtest_bulk");
+        BOOST_CHECK(dbBulk.GetProfile() == DB_PROFILE_BULK);
+        BOOST_CHECK(dbOther.GetProfile() == DB_PROFILE_READ);
+        BOOST_CHECK(dbOther.GetBlockCacheSize() > dbBulk.GetBlockCacheSize());
+
+        for (int i = 0; i < 1000; i++)
+            BOOST_CHECK(dbBulk.Write(std::make_pair('k', i), uint256((uint64_t)i)));
+
+        int nBulk = 0;
+        ForEachLevelDB("", [&nBulk](CLevelDBWrapper& db) {
+            if (db.GetProfile() == DB_PROFILE_BULK) {
+                db.CompactFull();
+                nBulk++;
+            }
+        });
+        BOOST_CHECK_EQUAL(nBulk, 1);
+        BOOST_CHECK_EQUAL(ForEachLevelDB("dbtest_other", [](CLevelDBWrapper& db) {}), 1);
+
+        uint256 value;
+        BOOST_CHECK(dbBulk.Read(std::make_pair('k', 999), value) && value == uint256((uint64_t)999));
+        std::string strStats;
+        BOOST_CHECK(dbBulk.GetProperty("leveldb.stats", strStats) && !strStats.empty());
+    }
+    // Closed databases leave the registry
+    BOOST_CHECK_EQUAL(ForEachLevelDB("dbtest_bulk", [](CLevelDBWrapper& db) {}), 0);
+    mapMultiArgs["-dbprofile"].clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
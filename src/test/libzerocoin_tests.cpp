@@ -431,6 +431,14 @@ Test_MintAndSpend()
 
 		// See if we can verify the deserialized proof (return our result)
 		bool ret =  newSpend.Verify(acc);
+
+		// Evaluating the serial number proof rounds in another order must not change the result
+		ret = ret && newSpend.Verify(acc, [](uint32_t n, const std::function<bool(uint32_t)>& fn) {
+			for (uint32_t i = n; i > 0; i--)
+				if (!fn(i - 1))
+					return false;
+			return true;
+		});
 		
 		// Extract the serial number
 		CBigNum serialNumber = newSpend.getCoinSerialNumber();
@@ -445,6 +453,32 @@ Test_MintAndSpend()
 	return false;
 }
 
+bool
+Test_FixedBaseTable()
+{
+	// The tables have to agree with pow_mod for every base, negative ones
+	// and ones at or above the modulus included
+	const CBigNum& modulus = g_Params->serialNumberSoKCommitmentGroup.modulus;
+	const unsigned int nBits = 64;
+	try {
+		for (uint32_t i = 0; i < 10; i++) {
+			CBigNum base = CBigNum::randBignum(modulus);
+			CBigNum vBases[] = {base, -base, base + modulus, -(base + modulus)};
+			CBigNum e = CBigNum::randBignum(CBigNum(2).pow(nBits));
+			for (const CBigNum& b : vBases) {
+				FixedBaseTable table(b, modulus, nBits);
+				if (table.pow_mod(e) != b.pow_mod(e, modulus)) {
+					return false;
+				}
+			}
+		}
+	} catch (runtime_error &e) {
+		return false;
+	}
+
+	return true;
+}
+
 void
 Test_RunAllTests()
 {
@@ -465,6 +499,7 @@ Test_RunAllTests()
 	LogTestResult("invalid coins will be rejected", Test_InvalidCoin);
 	LogTestResult("the accumulator works", Test_Accumulator);
 	LogTestResult("the commitment equality PoK works", Test_EqualityPoK);
+	LogTestResult("fixed-base tables match pow_mod", Test_FixedBaseTable);
 	LogTestResult("a minted coin can be spent", Test_MintAndSpend);
 
 	cout << endl << "Average coin size is " << gCoinSize << " bytes." << endl;
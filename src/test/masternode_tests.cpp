@@ -0,0 +1,128 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+#include "random.h"
+#include "utiltime.h"
+#include "test/test_smnc.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+
+extern std::map<int64_t, uint256> mapCacheBlockHashes;
+
+namespace
+{
+CMasternode MakeMasternode(int64_t nNow)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(GetRandHash(), 0);
+    mn.protocolVersion = PROTOCOL_VERSION;
+    mn.activeState = CMasternode::MASTERNODE_ENABLED;
+    mn.unitTest = true;
+    mn.sigTime = nNow - 3 * 60 * 60;
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.sigTime = nNow;
+    return mn;
+}
+
+/** Rank every masternode against hashBlock the way the list used to: hash all, then sort */
+std::vector<CTxIn> RankByRescan(const std::vector<CMasternode>& vMasternodes, const uint256& hashBlock)
+{
+    std::vector<std::pair<uint256, CTxIn> > vScores;
+    for (const CMasternode& mn : vMasternodes)
+        vScores.push_back(std::make_pair(mn.CalculateScore(hashBlock), mn.vin));
+    std::sort(vScores.begin(), vScores.end(), [](const std::pair<uint256, CTxIn>& a, const std::pair<uint256, CTxIn>& b) {
+        if (a.first != b.first)
+            return a.first > b.first;
+        return a.second.prevout < b.second.prevout;
+    });
+
+    std::vector<CTxIn> vRanked;
+    for (const std::pair<uint256, CTxIn>& s : vScores)
+        vRanked.push_back(s.second);
+    return vRanked;
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+BOOST_AUTO_TEST_CASE(masternode_score_table)
+{
+    const int64_t nHeight = 1000000;
+    const int nMasternodes = fRunBenchmarks ? 5000 : 200;
+    const int nLookups = 50;
+
+    uint256 hashBlock = GetRandHash();
+    mapCacheBlockHashes[nHeight] = hashBlock;
+
+    int64_t nNow = GetAdjustedTime();
+    CMasternodeMan mnodes;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn = MakeMasternode(nNow);
+        BOOST_CHECK(mnodes.Add(mn));
+        vMasternodes.push_back(mn);
+    }
+
+    std::vector<CTxIn> vRanked = RankByRescan(vMasternodes, hashBlock);
+    BOOST_CHECK_EQUAL(vRanked.size(), (size_t)nMasternodes);
+
+    // full rescan per lookup, as every rank query used to do
+    int64_t nRescanTime = 0;
+    if (fRunBenchmarks) {
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nLookups; i++) {
+            std::vector<CTxIn> vRescan = RankByRescan(vMasternodes, hashBlock);
+            BOOST_CHECK(vRescan[i] == vRanked[i]);
+        }
+        nRescanTime = GetTimeMicros() - nStart;
+    }
+
+    // first lookup scores the list, the rest reuse the table
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nLookups; i++) {
+        int nIndex = i * (nMasternodes / nLookups);
+        BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vRanked[nIndex], nHeight, 0, false), nIndex + 1);
+    }
+    int64_t nCachedTime = GetTimeMicros() - nStart;
+
+    if (fRunBenchmarks)
+        std::cout << "Masternode rank of " << nMasternodes << " nodes: rescan " << nRescanTime / nLookups
+                  << " us/lookup, score table " << nCachedTime / nLookups << " us/lookup" << std::endl;
+
+    for (int nRank = 1; nRank <= 10; nRank++) {
+        CMasternode* pmn = mnodes.GetMasternodeByRank(nRank, nHeight, 0, false);
+        BOOST_CHECK(pmn && pmn->vin == vRanked[nRank - 1]);
+    }
+
+    // ranked by compact score, so only the order of the compact scores is fixed
+    std::vector<pair<int, CMasternode> > vecRanks = mnodes.GetMasternodeRanks(nHeight);
+    BOOST_CHECK_EQUAL(vecRanks.size(), (size_t)nMasternodes);
+    for (size_t i = 1; i < vecRanks.size(); i++) {
+        BOOST_CHECK_EQUAL(vecRanks[i].first, (int)i + 1);
+        BOOST_CHECK(vecRanks[i - 1].second.CalculateScore(hashBlock).GetCompact(false) >= vecRanks[i].second.CalculateScore(hashBlock).GetCompact(false));
+    }
+
+    // removing the best masternode moves everybody else up by one
+    mnodes.Remove(vRanked[0]);
+    BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vRanked[0], nHeight, 0, false), -1);
+    BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vRanked[1], nHeight, 0, false), 1);
+    BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vRanked[nMasternodes - 1], nHeight, 0, false), nMasternodes - 1);
+
+    // a different block reorders the list
+    uint256 hashOther = GetRandHash();
+    mapCacheBlockHashes[nHeight + 1] = hashOther;
+    vMasternodes.erase(std::remove_if(vMasternodes.begin(), vMasternodes.end(), [&](const CMasternode& mn) { return mn.vin == vRanked[0]; }), vMasternodes.end());
+    std::vector<CTxIn> vOther = RankByRescan(vMasternodes, hashOther);
+    BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vOther[0], nHeight + 1, 0, false), 1);
+    BOOST_CHECK_EQUAL(mnodes.GetMasternodeRank(vOther[100], nHeight + 1, 0, false), 101);
+
+    mapCacheBlockHashes.erase(nHeight);
+    mapCacheBlockHashes.erase(nHeight + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
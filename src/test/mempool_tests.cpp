@@ -7,7 +7,9 @@
 #include "util.h"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(mempool_tests)
 
@@ -99,4 +101,181 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction ChildTx(const uint256& hashPrev, int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    tx.vout.resize(nOutputs);
+    for (int i = 0; i < nOutputs; i++) {
+        tx.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[i].nValue = 10000LL;
+    }
+    return tx;
+}
+
+template <typename name>
+static void CheckSort(CTxMemPool& pool, const std::vector<uint256>& sortedOrder)
+{
+    BOOST_REQUIRE_EQUAL(pool.size(), sortedOrder.size());
+    typename CTxMemPool::indexed_transaction_set::index<name>::type::iterator it = pool.mapTx.get<name>().begin();
+    for (unsigned int i = 0; it != pool.mapTx.get<name>().end(); ++it, ++i)
+        BOOST_CHECK_EQUAL(it->GetTx().GetHash().ToString(), sortedOrder[i].ToString());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPackageStateTest)
+{
+    // A chain parent -> child -> grandchild
+    CMutableTransaction txParent = ChildTx(GetRandHash(), 1);
+    CMutableTransaction txChild = ChildTx(txParent.GetHash(), 1);
+    CMutableTransaction txGrandChild = ChildTx(txChild.GetHash(), 1);
+
+    CTxMemPool pool(CFeeRate(0));
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 2000, 0, 0.0, 1));
+    pool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 3000, 0, 0.0, 1));
+
+    CTxMemPool::txiter it = pool.mapTx.find(txParent.GetHash());
+    uint64_t nTxSize = it->GetTxSize();
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), 3 * nTxSize);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1U);
+    it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 6000);
+
+    // Prioritising the child shows in the packages on both sides of it
+    pool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 0, 500);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 6500);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetModFeesWithAncestors(), 6500);
+
+    // Limits count the new transaction itself
+    std::string errString;
+    CTxMemPool::setEntries setAncestors;
+    CMutableTransaction txGreat = ChildTx(txGrandChild.GetHash(), 1);
+    CTxMemPoolEntry entry(txGreat, 0, 0, 0.0, 1);
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry, setAncestors, 4, 1000000, 4, 1000000, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3U);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 3, 1000000, 4, 1000000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 4, 1000000, 3, 1000000, errString));
+
+    // Mining the parent leaves the others, without it in their ancestor state
+    std::vector<CTransaction> vtx(1, txParent);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 2, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 5500);
+
+    // A reorg brings the parent back after its children, it becomes their ancestor again
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 6500);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(it).size(), 1U);
+    it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), 3 * nTxSize);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // Same sizes, so the fee decides
+    CMutableTransaction tx1 = ChildTx(GetRandHash(), 2);
+    CMutableTransaction tx2 = ChildTx(GetRandHash(), 2);
+    CMutableTransaction tx3 = ChildTx(GetRandHash(), 2);
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000, 0, 10.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 20000, 2, 9.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 0, 1, 100.0, 1));
+
+    std::vector<uint256> sortedOrder;
+    sortedOrder.push_back(tx3.GetHash());
+    sortedOrder.push_back(tx1.GetHash());
+    sortedOrder.push_back(tx2.GetHash());
+    CheckSort<descendant_score>(pool, sortedOrder);
+
+    // A high fee child lifts its parent's descendant score, and its own ancestor score
+    // stays below the parent's
+    CMutableTransaction tx4 = ChildTx(tx3.GetHash(), 2);
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 50000, 3, 0.0, 1));
+    sortedOrder.clear();
+    sortedOrder.push_back(tx1.GetHash());
+    sortedOrder.push_back(tx2.GetHash());
+    sortedOrder.push_back(tx3.GetHash());
+    sortedOrder.push_back(tx4.GetHash());
+    CheckSort<descendant_score>(pool, sortedOrder);
+
+    sortedOrder.clear();
+    sortedOrder.push_back(tx4.GetHash()); // (0 + 50000) / 2 sizes
+    sortedOrder.push_back(tx2.GetHash());
+    sortedOrder.push_back(tx1.GetHash());
+    sortedOrder.push_back(tx3.GetHash());
+    CheckSort<ancestor_score>(pool, sortedOrder);
+
+    sortedOrder.clear();
+    sortedOrder.push_back(tx1.GetHash());
+    sortedOrder.push_back(tx3.GetHash());
+    sortedOrder.push_back(tx2.GetHash());
+    sortedOrder.push_back(tx4.GetHash());
+    CheckSort<entry_time>(pool, sortedOrder);
+
+    sortedOrder.clear();
+    sortedOrder.push_back(tx3.GetHash());
+    sortedOrder.push_back(tx1.GetHash());
+    sortedOrder.push_back(tx2.GetHash());
+    sortedOrder.push_back(tx4.GetHash());
+    CheckSort<priority>(pool, sortedOrder);
+
+    // Block assembly order
+    std::vector<uint256> vtxid;
+    pool.queryHashes(vtxid);
+    BOOST_CHECK(vtxid[0] == tx4.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction tx1 = ChildTx(GetRandHash(), 2);
+    CMutableTransaction tx2 = ChildTx(GetRandHash(), 2);
+    CMutableTransaction tx3 = ChildTx(tx2.GetHash(), 2);
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 30000, 0, 0.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000, 0, 0.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 20000, 0, 0.0, 1));
+    uint64_t nTxSize = pool.mapTx.find(tx1.GetHash())->GetTxSize();
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 3 * nTxSize);
+
+    // Nothing to do while within the limit
+    pool.TrimToSize(pool.GetTotalTxSize());
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK(pool.GetMinFee(1) == CFeeRate(0));
+
+    // tx3 pays for its parent, but the package tx2 + tx3 pays less per byte than tx1
+    // and goes as a whole
+    std::vector<uint256> vNoSpendsRemaining;
+    pool.TrimToSize(2 * nTxSize, &vNoSpendsRemaining);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK_EQUAL(vNoSpendsRemaining.size(), 2U);
+    BOOST_CHECK(std::count(vNoSpendsRemaining.begin(), vNoSpendsRemaining.end(), tx2.vin[0].prevout.hash));
+
+    // The evicted package's fee rate plus the relay fee is the minimum now
+    CFeeRate minFee = pool.GetMinFee(2 * nTxSize);
+    BOOST_CHECK(minFee == CFeeRate(CFeeRate(25000, 2 * nTxSize).GetFeePerK() + 1000));
+
+    // Expiry goes by entry time
+    CMutableTransaction tx4 = ChildTx(GetRandHash(), 2);
+    pool.addUnchecked(tx4.GetHash(), CTxMemPoolEntry(tx4, 10000, 100, 0.0, 1));
+    BOOST_CHECK_EQUAL(pool.Expire(50), 1);
+    BOOST_CHECK(pool.exists(tx4.GetHash()));
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
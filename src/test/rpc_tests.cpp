@@ -8,6 +8,7 @@
 #include "rpc/client.h"
 
 #include "base58.h"
+#include "logging.h"
 #include "netbase.h"
 #include "util.h"
 
@@ -265,4 +266,25 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_getlogbuffer)
+{
+    StartAsyncLogger(0, DEFAULT_LOG_QUEUE_SIZE, 2);
+    WriteDebugLog("first\n", "rpctest");
+    WriteDebugLog("second\n", "rpctest");
+    WriteDebugLog("third\n", "rpctest");
+
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallRPC("getlogbuffer rpctest"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "async").get_bool(), false);
+    UniValue categories = find_value(r.get_obj(), "categories");
+    BOOST_CHECK_EQUAL(categories.size(), 1U);
+    UniValue lines = find_value(categories.get_obj(), "rpctest");
+    BOOST_REQUIRE_EQUAL(lines.size(), 2U);
+    BOOST_CHECK(boost::algorithm::ends_with(lines[0].get_str(), " second"));
+    BOOST_CHECK(boost::algorithm::ends_with(lines[1].get_str(), " third"));
+    BOOST_CHECK_THROW(CallRPC("getlogbuffer rpctest extra"), runtime_error);
+
+    StartAsyncLogger(0, DEFAULT_LOG_QUEUE_SIZE, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
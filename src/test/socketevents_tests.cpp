@@ -0,0 +1,190 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "netbase.h"
+#include "random.h"
+#include "util.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Connected loopback TCP sockets: a synthetic peer on one end, the node's side on the other */
+struct CLoopbackPeers
+{
+    std::vector<SOCKET> vPeer;
+    std::vector<SOCKET> vLocal;
+
+    bool Open(int nPeers)
+    {
+        SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (hListen == INVALID_SOCKET)
+            return false;
+
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bool fOk = ::bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) != SOCKET_ERROR &&
+                   listen(hListen, SOMAXCONN) != SOCKET_ERROR &&
+                   getsockname(hListen, (struct sockaddr*)&addr, &len) != SOCKET_ERROR;
+
+        for (int i = 0; fOk && i < nPeers; i++) {
+            SOCKET hPeer = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (hPeer == INVALID_SOCKET || connect(hPeer, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+                if (hPeer != INVALID_SOCKET)
+                    CloseSocket(hPeer);
+                fOk = false;
+                break;
+            }
+            SOCKET hLocal = accept(hListen, NULL, NULL);
+            if (hLocal == INVALID_SOCKET || !SetSocketNonBlocking(hLocal, true)) {
+                if (hLocal != INVALID_SOCKET)
+                    CloseSocket(hLocal);
+                CloseSocket(hPeer);
+                fOk = false;
+                break;
+            }
+            vPeer.push_back(hPeer);
+            vLocal.push_back(hLocal);
+        }
+        CloseSocket(hListen);
+        return fOk;
+    }
+
+    ~CLoopbackPeers()
+    {
+        for (SOCKET& hSocket : vPeer)
+            CloseSocket(hSocket);
+        for (SOCKET& hSocket : vLocal)
+            CloseSocket(hSocket);
+    }
+};
+
+const char MESSAGE[24] = "synthetic message head";
+
+/**
+ * Each round a few random peers send one message and the node side waits until it
+ * has received all of them, like a busy node where most peers are idle at any time.
+ * Returns the number of messages received, or -1 on an unexpected event.
+ */
+int DriveMessages(CSocketEvents& events, CLoopbackPeers& peers, int nRounds, int nSendersPerRound)
+{
+    int nReceived = 0;
+    std::vector<CSocketEvents::Event> vEvents;
+    for (int nRound = 0; nRound < nRounds; nRound++) {
+        std::set<size_t> setSenders;
+        while ((int)setSenders.size() < nSendersPerRound)
+            setSenders.insert(GetRand(peers.vPeer.size()));
+        for (size_t nPeer : setSenders)
+            if (send(peers.vPeer[nPeer], MESSAGE, sizeof(MESSAGE), MSG_NOSIGNAL) != sizeof(MESSAGE))
+                return -1;
+
+        while (!setSenders.empty()) {
+            if (!events.Wait(1000, vEvents) || vEvents.empty())
+                return -1;
+            for (const CSocketEvents::Event& event : vEvents) {
+                size_t nPeer = (size_t)event.pcookie;
+                if (event.nEvents != SOCKET_EVENT_RECV || peers.vLocal[nPeer] != event.hSocket || !setSenders.count(nPeer))
+                    return -1;
+                char pchBuf[sizeof(MESSAGE)];
+                if (recv(event.hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT) != sizeof(MESSAGE))
+                    return -1;
+                setSenders.erase(nPeer);
+                nReceived++;
+            }
+        }
+    }
+    return nReceived;
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(socketevents_tests)
+
+BOOST_AUTO_TEST_CASE(socketevents_modes)
+{
+    BOOST_CHECK(CSocketEvents::Create("poll") == NULL);
+    BOOST_CHECK(CSocketEvents::Create("") == NULL);
+
+    std::vector<std::string> vModes = CSocketEvents::GetModes();
+    BOOST_CHECK(std::find(vModes.begin(), vModes.end(), DEFAULT_SOCKETEVENTS) != vModes.end());
+    for (const std::string& strMode : vModes) {
+        std::unique_ptr<CSocketEvents> events(CSocketEvents::Create(strMode));
+        BOOST_REQUIRE(events);
+        BOOST_CHECK_EQUAL(events->GetName(), strMode);
+
+        CLoopbackPeers peers;
+        BOOST_REQUIRE(peers.Open(2));
+        SOCKET hSocket = peers.vLocal[0];
+        int nCookie = 0, nOtherCookie = 0;
+        std::vector<CSocketEvents::Event> vEvents;
+
+        // idle sockets are not reported, writable ones are when asked
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_RECV, &nCookie));
+        BOOST_CHECK(events->Wait(0, vEvents));
+        BOOST_CHECK(vEvents.empty());
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_SEND, &nCookie));
+        BOOST_CHECK(events->Wait(0, vEvents));
+        BOOST_REQUIRE_EQUAL(vEvents.size(), 1U);
+        BOOST_CHECK(vEvents[0].hSocket == hSocket && vEvents[0].pcookie == &nCookie && vEvents[0].nEvents == SOCKET_EVENT_SEND);
+
+        // a registration under another cookie survives removal under the old one
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_SEND, &nOtherCookie));
+        events->Remove(hSocket, &nCookie);
+        BOOST_CHECK_EQUAL(events->Size(), 1U);
+        events->Remove(hSocket, &nOtherCookie);
+        BOOST_CHECK_EQUAL(events->Size(), 0U);
+        BOOST_CHECK(events->Wait(0, vEvents));
+        BOOST_CHECK(vEvents.empty());
+
+        // a peer closing the connection makes its socket readable
+        BOOST_CHECK(events->Set(peers.vLocal[1], SOCKET_EVENT_RECV, &nCookie));
+        CloseSocket(peers.vPeer[1]);
+        BOOST_CHECK(events->Wait(1000, vEvents));
+        BOOST_REQUIRE_EQUAL(vEvents.size(), 1U);
+        BOOST_CHECK(vEvents[0].hSocket == peers.vLocal[1] && (vEvents[0].nEvents & SOCKET_EVENT_RECV));
+        events->Remove(peers.vLocal[1], &nCookie);
+
+        BOOST_CHECK(!events->Set(INVALID_SOCKET, SOCKET_EVENT_RECV, &nCookie));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_loopback_benchmark)
+{
+    // stay below FD_SETSIZE, so that select can take part
+    const int nPeers = 400;
+    const int nRounds = 200;
+    const int nSendersPerRound = 8;
+    if (RaiseFileDescriptorLimit(2 * nPeers + 64) < 2 * nPeers + 64) {
+        BOOST_TEST_MESSAGE("socketevents_loopback_benchmark skipped: not enough file descriptors");
+        return;
+    }
+
+    for (const std::string& strMode : CSocketEvents::GetModes()) {
+        CLoopbackPeers peers;
+        BOOST_REQUIRE(peers.Open(nPeers));
+        std::unique_ptr<CSocketEvents> events(CSocketEvents::Create(strMode));
+        BOOST_REQUIRE(events);
+        for (size_t i = 0; i < peers.vLocal.size(); i++)
+            BOOST_REQUIRE(events->Set(peers.vLocal[i], SOCKET_EVENT_RECV, (void*)i));
+
+        std::clock_t nStart = std::clock();
+        int nReceived = DriveMessages(*events, peers, nRounds, nSendersPerRound);
+        std::clock_t nCpu = std::clock() - nStart;
+        BOOST_CHECK_EQUAL(nReceived, nRounds * nSendersPerRound);
+
+        std::cout << "socketevents " << strMode << ": " << nPeers << " peers, " << nReceived << " messages, "
+                  << (nReceived > 0 ? 1000000.0 * nCpu / CLOCKS_PER_SEC / nReceived : 0) << " us CPU/message" << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
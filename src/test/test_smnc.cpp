@@ -6,6 +6,8 @@
 
 #define BOOST_TEST_MODULE SupportMasterNodeCommunity Test Suite
 
+#include "test/test_smnc.h"
+
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
@@ -22,6 +24,7 @@
 
 CClientUIInterface uiInterface;
 CWallet* pwalletMain;
+bool fRunBenchmarks = false;
 
 extern bool fPrintToConsole;
 extern void noui_connect();
@@ -37,6 +40,7 @@ struct TestingSetup {
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
+        fRunBenchmarks = getenv("SMNC_BENCH") != NULL;
         SelectParams(CBaseChainParams::UNITTEST);
         noui_connect();
 #ifdef ENABLE_WALLET
@@ -58,6 +62,9 @@ struct TestingSetup {
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        nParallelThreads = 3;
+        for (int i=0; i < nParallelThreads-1; i++)
+            threadGroup.create_thread(&ThreadParallelWork);
         RegisterNodeSignals(GetNodeSignals());
     }
     ~TestingSetup()
@@ -0,0 +1,11 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SupportMasterNodeCommunity_TEST_TEST_SMNC_H
+#define SupportMasterNodeCommunity_TEST_TEST_SMNC_H
+
+/** Run the timing loops of the benchmark test cases at full size, set SMNC_BENCH in the environment */
+extern bool fRunBenchmarks;
+
+#endif // SupportMasterNodeCommunity_TEST_TEST_SMNC_H
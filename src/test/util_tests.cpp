@@ -7,6 +7,7 @@
 #include "util.h"
 
 #include "clientversion.h"
+#include "logging.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "sync.h"
@@ -16,7 +17,9 @@
 #include <stdint.h>
 #include <vector>
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -426,4 +429,91 @@ BOOST_AUTO_TEST_CASE(test_FormatSubVersion)
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments),std::string("/Test:0.9.99(comment1)/"));
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments2),std::string("/Test:0.9.99(comment1; comment2)/"));
 }
+
+BOOST_AUTO_TEST_CASE(test_BoundedMPSCQueue)
+{
+    CBoundedMPSCQueue<int> queue(3);
+    BOOST_CHECK_EQUAL(queue.Capacity(), 4U);
+    int n = 0;
+    for (int i = 0; i < 4; i++) {
+        n = i;
+        BOOST_CHECK(queue.Push(n));
+    }
+    n = 4;
+    BOOST_CHECK(!queue.Push(n)); // full
+    BOOST_CHECK_EQUAL(n, 4);
+    BOOST_CHECK_EQUAL(queue.Size(), 4U);
+    for (int i = 0; i < 4; i++) {
+        BOOST_CHECK(queue.Pop(n));
+        BOOST_CHECK_EQUAL(n, i);
+    }
+    BOOST_CHECK(!queue.Pop(n));
+
+    // several producers: every value arrives once, in order per producer
+    const int nProducers = 4;
+    const int nValues = 20000;
+    CBoundedMPSCQueue<int> shared(64);
+    boost::thread_group producers;
+    for (int p = 0; p < nProducers; p++) {
+        producers.create_thread([&shared, p]() {
+            for (int i = 0; i < nValues; i++) {
+                int nValue = p * nValues + i;
+                while (!shared.Push(nValue))
+                    boost::this_thread::yield();
+            }
+        });
+    }
+    std::vector<int> vNext(nProducers, 0);
+    for (int nReceived = 0; nReceived < nProducers * nValues;) {
+        if (!shared.Pop(n)) {
+            boost::this_thread::yield();
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(n % nValues, vNext[n / nValues]);
+        vNext[n / nValues]++;
+        nReceived++;
+    }
+    producers.join_all();
+    BOOST_CHECK(!shared.Pop(n));
+}
+
+BOOST_AUTO_TEST_CASE(test_LogBuffers)
+{
+    // written by the calling thread, the last 3 lines of each category kept
+    StartAsyncLogger(0, DEFAULT_LOG_QUEUE_SIZE, 3);
+    for (int i = 0; i < 5; i++)
+        WriteDebugLog(strprintf("net line %d\n", i), "net");
+    WriteDebugLog("no category\n", NULL);
+
+    std::map<std::string, std::vector<std::string> > mapNet = GetLogBuffers("net");
+    BOOST_CHECK_EQUAL(mapNet.size(), 1U);
+    const std::vector<std::string>& vNet = mapNet["net"];
+    BOOST_REQUIRE_EQUAL(vNet.size(), 3U);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(boost::algorithm::ends_with(vNet[i], strprintf(" net line %d", i + 2)));
+    std::map<std::string, std::vector<std::string> > mapAll = GetLogBuffers("");
+    BOOST_REQUIRE(mapAll.count("default"));
+    BOOST_CHECK(boost::algorithm::ends_with(mapAll["default"].back(), " no category"));
+    BOOST_CHECK(GetLogBuffers("none").empty());
+
+    // a full queue drops lines, the writer says how many
+    StartAsyncLogger(60000, 2, 10000);
+    uint64_t nDroppedBefore = GetLogStats().nDropped;
+    for (int i = 0; i < 1000; i++)
+        WriteDebugLog(strprintf("bench line %d\n", i), "bench");
+    StopAsyncLogger();
+    uint64_t nDropped = GetLogStats().nDropped - nDroppedBefore;
+    BOOST_CHECK(nDropped > 0);
+    uint64_t nReported = 0;
+    for (const std::string& strLine : GetLogBuffers("default")["default"]) {
+        if (boost::algorithm::ends_with(strLine, " log lines dropped"))
+            nReported += atoi64(strLine.substr(strLine.find(' ', strLine.find(' ') + 1) + 1));
+    }
+    BOOST_CHECK_EQUAL(nReported, nDropped);
+    BOOST_CHECK_EQUAL(GetLogBuffers("bench")["bench"].size() + nDropped, 1000U);
+
+    StartAsyncLogger(0, DEFAULT_LOG_QUEUE_SIZE, 0);
+    BOOST_CHECK(GetLogBuffers("").empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include "wallet.h"
 
+#include "random.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -21,6 +23,8 @@
 
 using namespace std;
 
+extern CWallet* pwalletMain;
+
 typedef set<pair<const CWalletTx*,unsigned int> > CoinSet;
 
 BOOST_AUTO_TEST_SUITE(wallet_tests)
@@ -305,4 +309,96 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(unspent_index_tests)
+{
+    // a wallet of its own, so the shared one stays as the other tests expect it
+    CWallet walletIndex("unspent_index_tests.dat");
+    bool fFirstRun;
+    BOOST_REQUIRE(walletIndex.LoadWallet(fFirstRun) == DB_LOAD_OK);
+    LOCK2(cs_main, walletIndex.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_REQUIRE(walletIndex.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // a payment to us
+    CMutableTransaction txReceive;
+    txReceive.vin.resize(1);
+    txReceive.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txReceive.vout.resize(1);
+    txReceive.vout[0].nValue = 10 * COIN;
+    txReceive.vout[0].scriptPubKey = scriptMine;
+    BOOST_CHECK(walletIndex.AddToWallet(CWalletTx(&walletIndex, txReceive)));
+    BOOST_CHECK_EQUAL(walletIndex.GetUnspentTxCount(), (size_t)1);
+
+    // an unconfirmed transaction that pays nothing to us does not take it out of the index
+    CMutableTransaction txSpendUnconfirmed;
+    txSpendUnconfirmed.vin.resize(1);
+    txSpendUnconfirmed.vin[0].prevout = COutPoint(txReceive.GetHash(), 0);
+    txSpendUnconfirmed.vout.resize(1);
+    txSpendUnconfirmed.vout[0].nValue = 9 * COIN;
+    txSpendUnconfirmed.vout[0].scriptPubKey = scriptOther;
+    BOOST_CHECK(walletIndex.AddToWallet(CWalletTx(&walletIndex, txSpendUnconfirmed)));
+    BOOST_CHECK_EQUAL(walletIndex.GetUnspentTxCount(), (size_t)1);
+
+    // a spend in the chain does, its change is indexed and counted
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txReceive.GetHash(), 0);
+    txSpend.vout.resize(2);
+    txSpend.vout[0].nValue = 4 * COIN;
+    txSpend.vout[0].scriptPubKey = scriptOther;
+    txSpend.vout[1].nValue = 5 * COIN;
+    txSpend.vout[1].scriptPubKey = scriptMine;
+    CWalletTx wtxSpend(&walletIndex, txSpend);
+    wtxSpend.hashBlock = chainActive.Tip()->GetBlockHash();
+    wtxSpend.nIndex = 0;
+    wtxSpend.fMerkleVerified = true;
+    BOOST_CHECK(walletIndex.AddToWallet(wtxSpend));
+    BOOST_CHECK_EQUAL(walletIndex.GetUnspentTxCount(), (size_t)1);
+    BOOST_CHECK_EQUAL(walletIndex.GetBalance(), 5 * COIN);
+
+    std::vector<uint256> vMissing;
+    std::vector<uint256> vExtra;
+    std::vector<CBalanceCheck> vBalances;
+    BOOST_CHECK(walletIndex.CheckUnspentIndex(vMissing, vExtra, vBalances, false));
+    BOOST_CHECK(vMissing.empty());
+    BOOST_CHECK(vExtra.empty());
+    BOOST_CHECK_EQUAL(vBalances.size(), (size_t)BALANCE_COUNT);
+
+    // locking the change changes the cached balances
+    COutPoint outpoint(txSpend.GetHash(), 1);
+    walletIndex.LockCoin(outpoint);
+    BOOST_CHECK_EQUAL(walletIndex.GetLockedCoins(), (fLiteMode ? 0 : 5 * COIN));
+    walletIndex.UnlockCoin(outpoint);
+    BOOST_CHECK_EQUAL(walletIndex.GetLockedCoins(), 0);
+
+    // a key added afterwards makes the unconfirmed transaction ours, MarkDirty() picks it up
+    BOOST_REQUIRE(walletIndex.AddKeyPubKey(keyOther, keyOther.GetPubKey()));
+    walletIndex.MarkDirty();
+    BOOST_CHECK_EQUAL(walletIndex.GetUnspentTxCount(), (size_t)2);
+    BOOST_CHECK(walletIndex.CheckUnspentIndex(vMissing, vExtra, vBalances, false));
+    BOOST_CHECK(vMissing.empty());
+    BOOST_CHECK(vExtra.empty());
+}
+
+BOOST_AUTO_TEST_CASE(rescan_progress_tests)
+{
+    // scan from the genesis block, as after importing a key
+    int64_t nTimeFirstKey = pwalletMain->nTimeFirstKey;
+    pwalletMain->nTimeFirstKey = 1;
+    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+    pwalletMain->nTimeFirstKey = nTimeFirstKey;
+
+    CRescanProgress progress = pwalletMain->GetRescanProgress();
+    BOOST_CHECK(!progress.fScanning);
+    BOOST_CHECK_EQUAL(progress.nStartHeight, 0);
+    BOOST_CHECK_EQUAL(progress.nHeight, chainActive.Height());
+    BOOST_CHECK_EQUAL(progress.nBlocks, chainActive.Height() + 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
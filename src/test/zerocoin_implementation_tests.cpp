@@ -18,6 +18,8 @@
 #include "wallet.h"
 #include "zsmncwallet.h"
 #include "zsmncchain.h"
+#include "invalid.h"
+#include "zkpcache.h"
 
 using namespace libzerocoin;
 
@@ -364,6 +366,27 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
     BOOST_CHECK_MESSAGE(coinSpend_v2.HasValidSignature(), "coinspend_v2 does not have valid signature");
     BOOST_CHECK_MESSAGE(coinSpend_v2.getVersion() == 2, "coinspend_v2 version is wrong");
     BOOST_CHECK_MESSAGE(coinSpend_v2.getPubKey() == privateCoin_v2.getPubKey(), "pub keys do not match");
+
+    // the same proof checks as queued by CheckBlock, against the right and a wrong accumulator value
+    CZerocoinSpendCheck checkValid(coinSpend_v2, false, accumulator_v2.getValue(), false);
+    CZerocoinSpendCheck checkQueued;
+    checkValid.swap(checkQueued);
+    BOOST_CHECK_MESSAGE(checkQueued(), "zerocoin spend check failed to verify");
+    CZerocoinSpendCheck checkWrongAccumulator(coinSpend_v2, false, accumulator.getValue(), false);
+    BOOST_CHECK_MESSAGE(!checkWrongAccumulator(), "zerocoin spend check verified against the wrong accumulator");
+
+    // a verified spend is only served from the zkp cache when it was stored, and only for the same params version
+    uint256 hashSpend = SerializeHash(coinSpend_v2);
+    BOOST_CHECK(!IsZerocoinSpendVerified(hashSpend, nChecksum_v2, false));
+    CZerocoinSpendCheck checkStore(coinSpend_v2, false, accumulator_v2.getValue(), true);
+    BOOST_CHECK(checkStore());
+    BOOST_CHECK(IsZerocoinSpendVerified(hashSpend, nChecksum_v2, false));
+    BOOST_CHECK(!IsZerocoinSpendVerified(hashSpend, nChecksum_v2, true));
+    BOOST_CHECK(!IsZerocoinSpendVerified(hashSpend, nChecksum_v2 + 1, false));
+
+    uint64_t nEntries, nHits, nMisses;
+    GetZerocoinSpendCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK(nEntries >= 1 && nHits >= 1 && nMisses >= 3);
 }
 
 BOOST_AUTO_TEST_CASE(setup_exceptions_test)
@@ -517,4 +540,170 @@ BOOST_AUTO_TEST_CASE(deterministic_tests)
 }
 
 
+BOOST_AUTO_TEST_CASE(pubcoin_index_test)
+{
+    cout << "Running pubcoin_index_test...\n";
+
+    // a block with a few mints among ordinary pay-to-pubkey-hash transactions
+    CBlock block;
+    const std::vector<unsigned char> vchSig(72, 1), vchPubKey(33, 2), vchKeyId(20, 3);
+    for (int i = 0; i < 250; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vin[0].scriptSig = CScript() << vchSig << vchPubKey;
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = 1 * COIN;
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyId << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        if (i % 25 == 0) {
+            CoinDenomination denom = zerocoinDenomList[(i / 25) % zerocoinDenomList.size()];
+            CBigNum bnValue = CBigNum::randBignum(Params().Zerocoin_Params(false)->coinCommitmentGroup.modulus);
+            tx.vout[0].nValue = ZerocoinDenominationToAmount(denom);
+            tx.vout[0].scriptPubKey = CScript() << OP_ZEROCOINMINT << bnValue.getvch().size() << bnValue.getvch();
+        }
+        block.vtx.push_back(CTransaction(tx));
+    }
+
+    // the first mint spends an invalid outpoint and has to be dropped when filtering
+    invalid_out::setInvalidOutPoints.insert(block.vtx[0].vin[0].prevout);
+
+    std::list<PublicCoin> listBlock, listBlockAll;
+    BOOST_CHECK(BlockToPubcoinList(block, listBlock, true));
+    BOOST_CHECK(BlockToPubcoinList(block, listBlockAll, false));
+    BOOST_CHECK_EQUAL(listBlockAll.size(), 10U);
+    BOOST_CHECK_EQUAL(listBlock.size(), 9U);
+
+    CBlockPubcoins pubcoins;
+    BOOST_CHECK(BlockToBlockPubcoins(block, pubcoins));
+    BOOST_CHECK(pubcoins.hashBlock == block.GetHash());
+    BOOST_CHECK_EQUAL(pubcoins.vPubcoins.size(), listBlockAll.size());
+
+    CZerocoinDB* zerocoinDBPrev = zerocoinDB;
+    zerocoinDB = new CZerocoinDB(1 << 20, true);
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+    index.nHeight = 1000;
+    BOOST_CHECK(zerocoinDB->WriteBlockPubcoins(index.nHeight, pubcoins));
+
+    std::list<PublicCoin> listIndex, listIndexAll;
+    BOOST_CHECK(GetBlockPubcoinList(&index, listIndex, true));
+    BOOST_CHECK(GetBlockPubcoinList(&index, listIndexAll, false));
+    BOOST_CHECK(listIndex == listBlock);
+    BOOST_CHECK(listIndexAll == listBlockAll);
+    for (auto it = listIndex.begin(), itBlock = listBlock.begin(); it != listIndex.end() && itBlock != listBlock.end(); ++it, ++itBlock)
+        BOOST_CHECK(it->getDenomination() == itBlock->getDenomination());
+
+    // compare reading the whole block against reading its index entry
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    const int nRuns = 100;
+    int64_t nTimeStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++) {
+        CDataStream ss(ssBlock);
+        CBlock blockRead;
+        ss >> blockRead;
+        std::list<PublicCoin> listPubcoins;
+        BlockToPubcoinList(blockRead, listPubcoins, true);
+    }
+    int64_t nTimeBlock = GetTimeMicros() - nTimeStart;
+
+    nTimeStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++) {
+        std::list<PublicCoin> listPubcoins;
+        GetBlockPubcoinList(&index, listPubcoins, true);
+    }
+    int64_t nTimeIndex = GetTimeMicros() - nTimeStart;
+
+    unsigned int nIndexSize = ::GetSerializeSize(pubcoins, SER_DISK, CLIENT_VERSION);
+    cout << "Block: " << ssBlock.size() << " bytes, " << nTimeBlock / nRuns << "us per read. "
+         << "Pubcoin index: " << nIndexSize << " bytes, " << nTimeIndex / nRuns << "us per read" << endl;
+    BOOST_CHECK(nIndexSize < ssBlock.size());
+
+    delete zerocoinDB;
+    zerocoinDB = zerocoinDBPrev;
+    invalid_out::setInvalidOutPoints.erase(block.vtx[0].vin[0].prevout);
+}
+
+BOOST_AUTO_TEST_CASE(witness_cache_test)
+{
+    CZerocoinDB* zerocoinDBPrev = zerocoinDB;
+    zerocoinDB = new CZerocoinDB(1 << 20, true);
+    CAccumulatorWitnessCache cache;
+
+    CAccumulatorWitnessState state;
+    state.bnPubcoin = CBigNum(12345);
+    state.nDenomination = CoinDenomination::ZQ_ONE;
+    state.nHeight = 100;
+    state.hashBlockPrev = GetRandHash();
+    state.bnWitness = CBigNum(678);
+    state.hashSerial = GetRandHash();
+    uint256 hashPubcoin = GetPubCoinHash(state.bnPubcoin);
+
+    // put and get, also after loading from the database
+    CAccumulatorWitnessState stateRead;
+    BOOST_CHECK(!cache.Get(hashPubcoin, stateRead));
+    cache.Put(hashPubcoin, state);
+    BOOST_CHECK(cache.Get(hashPubcoin, stateRead));
+    BOOST_CHECK(stateRead.bnWitness == state.bnWitness);
+    BOOST_CHECK_EQUAL(stateRead.nHeight, state.nHeight);
+    CAccumulatorWitnessCache cacheLoaded;
+    BOOST_CHECK(cacheLoaded.Load());
+    BOOST_CHECK(cacheLoaded.Get(hashPubcoin, stateRead));
+    BOOST_CHECK(stateRead.hashBlockPrev == state.hashBlockPrev);
+    BOOST_CHECK(stateRead.hashSerial == state.hashSerial);
+
+    // a connected spend sets the witness aside, disconnecting the spend brings it back
+    cache.MarkSpent(state.hashSerial, 200);
+    BOOST_CHECK(!cache.Get(hashPubcoin, stateRead));
+    cache.UnmarkSpent(state.hashSerial);
+    BOOST_CHECK(cache.Get(hashPubcoin, stateRead));
+
+    // until the spend is final
+    cache.MarkSpent(state.hashSerial, 200);
+    cache.PruneSpent(199);
+    cache.UnmarkSpent(state.hashSerial);
+    BOOST_CHECK(cache.Get(hashPubcoin, stateRead));
+    cache.MarkSpent(state.hashSerial, 200);
+    cache.PruneSpent(200);
+    cache.UnmarkSpent(state.hashSerial);
+    BOOST_CHECK(!cache.Get(hashPubcoin, stateRead));
+    CAccumulatorWitnessCache cachePruned;
+    BOOST_CHECK(cachePruned.Load());
+    BOOST_CHECK(!cachePruned.Get(hashPubcoin, stateRead));
+
+    // once full, only the mints cached already are updated
+    for (unsigned int i = 1; i <= MAX_CACHED_WITNESSES; i++)
+        cache.Put(uint256(i), state);
+    CAccumulatorWitnessState stateNext = state;
+    stateNext.nHeight = 110;
+    cache.Put(hashPubcoin, stateNext);
+    BOOST_CHECK(!cache.Get(hashPubcoin, stateRead));
+    cache.Put(uint256(1), stateNext);
+    BOOST_CHECK(cache.Get(uint256(1), stateRead));
+    BOOST_CHECK_EQUAL(stateRead.nHeight, 110);
+    cache.Erase(uint256(2));
+    cache.Put(hashPubcoin, stateNext);
+    BOOST_CHECK(cache.Get(hashPubcoin, stateRead));
+
+    // the counters behind getwitnesscacheinfo, every entry was put with the same serial hash
+    cache.MarkSpent(state.hashSerial, 300);
+    cache.RecordGeneration(true, 1000);
+    cache.RecordGeneration(false, 3000);
+    cache.RecordGeneration(true, 2000);
+    UniValue stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(find_value(stats, "mints").get_int(), (int)MAX_CACHED_WITNESSES);
+    BOOST_CHECK_EQUAL(find_value(stats, "spent").get_int(), (int)MAX_CACHED_WITNESSES);
+    BOOST_CHECK_EQUAL(find_value(stats, "hits").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(stats, "misses").get_int(), 1);
+    BOOST_CHECK_CLOSE(find_value(stats, "hitrate").get_real(), 2.0 / 3, 0.001);
+    BOOST_CHECK_CLOSE(find_value(stats, "last_ms").get_real(), 2.0, 0.001);
+    BOOST_CHECK_CLOSE(find_value(stats, "average_ms").get_real(), 2.0, 0.001);
+
+    delete zerocoinDB;
+    zerocoinDB = zerocoinDBPrev;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
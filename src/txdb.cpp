@@ -10,9 +10,21 @@
 #include "pow.h"
 #include "uint256.h"
 #include "accumulators.h"
+#include "crypto/common.h"
+#include "hash.h"
 
+#include <atomic>
+#include <memory>
 #include <stdint.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -117,57 +129,173 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+bool CCoinsViewDB::WriteTxOutSetStats(const CTxOutSetStats& stats)
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    return db.Write('S', stats);
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
+bool CCoinsViewDB::ReadTxOutSetStats(CTxOutSetStats& stats) const
+{
+    return db.Read('S', stats);
+}
+
+namespace
+{
+//! coins are keyed by 'c' and the txid, the first txid byte picks the partition
+const int COINS_STATS_PARTITIONS = 256;
+
+/**
+ * Scans the chainstate as of one snapshot. Threads pull partitions of the
+ * key space from a shared counter and fold them into their own statistics,
+ * which are merged at the end. For the ordered hash every partition is also
+ * serialized, and hashed as soon as the partitions before it are.
+ */
+class CCoinsStatsScanner
+{
+private:
+    const CLevelDBWrapper& db;
+    const leveldb::Snapshot* snapshot;
+    std::atomic<int> nNextPartition;
+    boost::mutex csError;
+    std::string strError;
+
+    CHashWriter* pssOrdered;
+    boost::mutex csOrdered;
+    std::vector<std::unique_ptr<CDataStream> > vPartitions;
+    int nNextHashed;
+
+    //! Hand over a scanned partition, hash it and any that were waiting for it
+    void FinishPartition(int nPartition, std::unique_ptr<CDataStream>& pss);
+
+public:
+    CCoinsStatsScanner(const CLevelDBWrapper& dbIn, const leveldb::Snapshot* snapshotIn, CHashWriter* pssOrderedIn)
+        : db(dbIn), snapshot(snapshotIn), nNextPartition(0), pssOrdered(pssOrderedIn), vPartitions(COINS_STATS_PARTITIONS), nNextHashed(0) {}
+
+    void Scan(CTxOutSetStats& stats);
+
+    bool Failed()
+    {
+        boost::lock_guard<boost::mutex> lock(csError);
+        return !strError.empty();
+    }
+
+    std::string GetError()
+    {
+        boost::lock_guard<boost::mutex> lock(csError);
+        return strError;
+    }
+
+    //! Make the remaining threads stop at their next partition
+    void Stop()
+    {
+        nNextPartition = COINS_STATS_PARTITIONS;
+    }
+};
+
+void CCoinsStatsScanner::FinishPartition(int nPartition, std::unique_ptr<CDataStream>& pss)
+{
+    boost::lock_guard<boost::mutex> lock(csOrdered);
+    vPartitions[nPartition].swap(pss);
+    while (nNextHashed < COINS_STATS_PARTITIONS && vPartitions[nNextHashed]) {
+        CDataStream& ss = *vPartitions[nNextHashed];
+        if (!ss.empty())
+            pssOrdered->write(&ss[0], ss.size());
+        vPartitions[nNextHashed++].reset();
+    }
+}
+
+void CCoinsStatsScanner::Scan(CTxOutSetStats& stats)
+{
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(snapshot));
+        int nPartition;
+        while ((nPartition = nNextPartition++) < COINS_STATS_PARTITIONS) {
+            std::unique_ptr<CDataStream> pss;
+            if (pssOrdered)
+                pss.reset(new CDataStream(SER_GETHASH, PROTOCOL_VERSION));
+            const char prefix[2] = {'c', (char)nPartition};
+            for (pcursor->Seek(leveldb::Slice(prefix, sizeof(prefix))); pcursor->Valid(); pcursor->Next()) {
+                boost::this_thread::interruption_point();
+                leveldb::Slice slKey = pcursor->key();
+                if (slKey.size() != 1 + sizeof(uint256) || slKey[0] != 'c' || (unsigned char)slKey[1] != nPartition)
+                    break;
+                uint256 txhash;
+                memcpy(txhash.begin(), slKey.data() + 1, sizeof(uint256));
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CCoins coins;
                 ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+                stats.Add(txhash, coins, pss.get());
             }
-            pcursor->Next();
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            if (!pcursor->status().ok())
+                throw std::runtime_error(pcursor->status().ToString());
+            if (pss)
+                FinishPartition(nPartition, pss);
         }
+    } catch (const boost::thread_interrupted&) {
+        Stop();
+        throw;
+    } catch (const std::exception& e) {
+        Stop();
+        boost::lock_guard<boost::mutex> lock(csError);
+        if (strError.empty())
+            strError = e.what();
+    }
+}
+} // anonymous namespace
+
+bool CCoinsViewDB::GetTxOutSetStats(CTxOutSetStats& stats, uint256* phashSerialized) const
+{
+    const leveldb::Snapshot* snapshot = db.GetSnapshot();
+    stats.SetNull();
+    if (!db.Read('B', stats.hashBlock, snapshot))
+        stats.hashBlock = uint256(0);
+
+    // the best block, then every txid's element in key order, as hash_serialized always was
+    CHashWriter ssOrdered(SER_GETHASH, PROTOCOL_VERSION);
+    ssOrdered << stats.hashBlock;
+
+    unsigned int nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    std::vector<CTxOutSetStats> vPartial(nThreads - 1);
+    CCoinsStatsScanner scanner(db, snapshot, phashSerialized ? &ssOrdered : NULL);
+    boost::thread_group threadGroup;
+    for (unsigned int i = 0; i < vPartial.size(); i++) {
+        CTxOutSetStats* pstats = &vPartial[i];
+        threadGroup.create_thread([&scanner, pstats]() { scanner.Scan(*pstats); });
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    try {
+        scanner.Scan(stats);
+    } catch (const boost::thread_interrupted&) {
+        threadGroup.join_all();
+        db.ReleaseSnapshot(snapshot);
+        throw;
+    }
+    threadGroup.join_all();
+    db.ReleaseSnapshot(snapshot);
+
+    if (scanner.Failed())
+        return error("%s : Deserialize or I/O error - %s", __func__, scanner.GetError());
+    for (unsigned int i = 0; i < vPartial.size(); i++)
+        stats += vPartial[i];
+    if (phashSerialized)
+        *phashSerialized = ssOrdered.GetHash();
+    return true;
+}
+
+bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+{
+    int64_t nStart = GetTimeMillis();
+    CTxOutSetStats txOutSetStats;
+    if (!GetTxOutSetStats(txOutSetStats, &stats.hashSerialized))
+        return false;
+    txOutSetStats.GetStats(stats);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+        if (mi != mapBlockIndex.end())
+            stats.nHeight = mi->second->nHeight;
+    }
+    LogPrint("coindb", "%s : %u transactions in %dms\n", __func__, stats.nTransactions, GetTimeMillis() - nStart);
     return true;
 }
 
@@ -208,85 +336,442 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+namespace
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+const unsigned char BLOCK_INDEX_SNAPSHOT_MAGIC[8] = {'s', 'm', 'n', 'c', 'b', 'i', 'd', 'x'};
+//! magic, version and header size ahead of the header
+const size_t BLOCK_INDEX_SNAPSHOT_PREFIX = 16;
+//! record count and checksum after the records
+const size_t BLOCK_INDEX_SNAPSHOT_TRAILER = 40;
+//! hash and value size ahead of each record value
+const size_t BLOCK_INDEX_SNAPSHOT_RECORD = 36;
+//! records decoded per round, bounds what a LevelDB walk holds in memory
+const size_t BLOCK_INDEX_LOAD_BATCH = 65536;
+//! smaller rounds are decoded on the loading thread
+const size_t BLOCK_INDEX_PARALLEL_MIN = 4096;
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair('b', uint256(0));
-    pcursor->Seek(ssKeySet.str());
+boost::filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
 
-    // Load mapBlockIndex
+/** What a snapshot must have been written against to be used */
+CDataStream GetBlockIndexSnapshotHeader(CBlockTreeDB& db, const uint256& hashBestChain)
+{
+    int nLastBlockFile = 0;
+    CBlockFileInfo info;
+    db.ReadLastBlockFile(nLastBlockFile);
+    db.ReadBlockFileInfo(nLastBlockFile, info);
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << hashBestChain << nLastBlockFile << info;
+    return ssHeader;
+}
+
+/**
+ * blocks/index.snapshot: the 'b' records of the block tree as they are in
+ * LevelDB, each after its block hash, so loading them neither walks the
+ * database nor hashes the headers. Mapped read-only where possible.
+ */
+class CBlockIndexSnapshot
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+#ifdef WIN32
+    std::vector<unsigned char> vData;
+#endif
+
+    bool Parse();
+
+public:
+    const unsigned char* pheader;
+    size_t nHeaderSize;
+    const unsigned char* pbegin; //! first record
+    const unsigned char* pend;   //! past the last record
+    uint64_t nRecords;
+
+    CBlockIndexSnapshot() : pdata(NULL), nSize(0), pheader(NULL), nHeaderSize(0), pbegin(NULL), pend(NULL), nRecords(0) {}
+    ~CBlockIndexSnapshot();
+
+    bool Open(const boost::filesystem::path& path);
+    bool Matches(const CDataStream& ssHeader) const
+    {
+        return ssHeader.size() == nHeaderSize && memcmp(&ssHeader[0], pheader, nHeaderSize) == 0;
+    }
+};
+
+CBlockIndexSnapshot::~CBlockIndexSnapshot()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+bool CBlockIndexSnapshot::Open(const boost::filesystem::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    void* pmap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pmap == MAP_FAILED)
+        return false;
+    madvise(pmap, st.st_size, MADV_SEQUENTIAL);
+    pdata = (const unsigned char*)pmap;
+    nSize = st.st_size;
+#else
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    vData.resize(boost::filesystem::file_size(path));
+    size_t nRead = vData.empty() ? 0 : fread(&vData[0], 1, vData.size(), file);
+    fclose(file);
+    if (vData.empty() || nRead != vData.size())
+        return false;
+    pdata = &vData[0];
+    nSize = vData.size();
+#endif
+    return Parse();
+}
+
+bool CBlockIndexSnapshot::Parse()
+{
+    if (nSize < BLOCK_INDEX_SNAPSHOT_PREFIX + BLOCK_INDEX_SNAPSHOT_TRAILER ||
+        memcmp(pdata, BLOCK_INDEX_SNAPSHOT_MAGIC, sizeof(BLOCK_INDEX_SNAPSHOT_MAGIC)) != 0 ||
+        ReadLE32(pdata + 8) != BLOCK_INDEX_SNAPSHOT_VERSION)
+        return false;
+    nHeaderSize = ReadLE32(pdata + 12);
+    if (nSize - BLOCK_INDEX_SNAPSHOT_PREFIX - BLOCK_INDEX_SNAPSHOT_TRAILER < nHeaderSize)
+        return false;
+
+    uint256 hashCheck;
+    CHash256().Write(pdata, nSize - 32).Finalize(hashCheck.begin());
+    if (memcmp(hashCheck.begin(), pdata + nSize - 32, 32) != 0)
+        return false;
+
+    pheader = pdata + BLOCK_INDEX_SNAPSHOT_PREFIX;
+    pbegin = pheader + nHeaderSize;
+    pend = pdata + nSize - BLOCK_INDEX_SNAPSHOT_TRAILER;
+    nRecords = ReadLE64(pend);
+
+    // Check the framing once, so loading cannot stop half way through
+    uint64_t nCount = 0;
+    for (const unsigned char* p = pbegin; p < pend; nCount++) {
+        if ((size_t)(pend - p) < BLOCK_INDEX_SNAPSHOT_RECORD || (size_t)(pend - p) - BLOCK_INDEX_SNAPSHOT_RECORD < ReadLE32(p + 32))
+            return false;
+        p += BLOCK_INDEX_SNAPSHOT_RECORD + ReadLE32(p + 32);
+    }
+    return nCount == nRecords;
+}
+
+/** A serialized CDiskBlockIndex, with its block hash when that is already known */
+struct CBlockIndexRecord {
+    uint256 hash;
+    const char* pbegin;
+    size_t nSize;
+};
+
+/**
+ * Decodes rounds of block index records over several threads, then links
+ * them into mapBlockIndex on the calling thread.
+ */
+class CBlockIndexLoader
+{
+private:
+    int nThreads;
+    std::vector<CDiskBlockIndex> vIndex;
+    std::vector<uint256> vHash;
+    boost::mutex csError;
+    std::string strError;
     uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+
+    void DecodeRange(size_t nBegin, size_t nEnd);
+
+public:
+    std::vector<CBlockIndexRecord> vRecords;
+    //! accumulator checkpoints to load once the index is in
+    std::vector<uint256> vCheckpoints;
+    uint64_t nLoaded;
+    int64_t nDecodeMillis;
+    int64_t nLinkMillis;
+
+    explicit CBlockIndexLoader(int nThreadsIn) : nThreads(nThreadsIn), nLoaded(0), nDecodeMillis(0), nLinkMillis(0) {}
+
+    bool Flush();
+};
+
+void CBlockIndexLoader::DecodeRange(size_t nBegin, size_t nEnd)
+{
+    try {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const CBlockIndexRecord& record = vRecords[i];
+            CDataStream ssValue(record.pbegin, record.pbegin + record.nSize, SER_DISK, CLIENT_VERSION);
+            ssValue >> vIndex[i];
+            vHash[i] = record.hash;
+            if (record.hash != 0)
+                continue;
+
+            const CDiskBlockIndex& diskindex = vIndex[i];
+            CBlockHeader header;
+            header.nVersion = diskindex.nVersion;
+            header.hashPrevBlock = diskindex.hashPrev;
+            header.hashMerkleRoot = diskindex.hashMerkleRoot;
+            header.nTime = diskindex.nTime;
+            header.nBits = diskindex.nBits;
+            header.nNonce = diskindex.nNonce;
+            header.nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            vHash[i] = header.GetHash();
+        }
+
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (vIndex[i].nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(vHash[i], vIndex[i].nBits))
+                throw std::runtime_error(strprintf("CheckProofOfWork failed: %s", vIndex[i].ToString()));
+        }
+    } catch (const std::exception& e) {
+        boost::lock_guard<boost::mutex> lock(csError);
+        if (strError.empty())
+            strError = e.what();
+    }
+}
+
+bool CBlockIndexLoader::Flush()
+{
+    int64_t nStart = GetTimeMillis();
+    size_t nRecords = vRecords.size();
+    vIndex.clear();
+    vIndex.resize(nRecords);
+    vHash.assign(nRecords, uint256());
+
+    if (nRecords < BLOCK_INDEX_PARALLEL_MIN || nThreads <= 1) {
+        DecodeRange(0, nRecords);
+    } else {
+        size_t nChunk = (nRecords + nThreads - 1) / nThreads;
+        boost::thread_group threadGroup;
+        for (size_t nBegin = nChunk; nBegin < nRecords; nBegin += nChunk) {
+            size_t nEnd = std::min(nBegin + nChunk, nRecords);
+            threadGroup.create_thread([this, nBegin, nEnd]() { DecodeRange(nBegin, nEnd); });
+        }
+        DecodeRange(0, std::min(nChunk, nRecords));
+        threadGroup.join_all();
+    }
+    if (!strError.empty())
+        return error("LoadBlockIndex() : %s", strError);
+
+    int64_t nDecoded = GetTimeMillis();
+    nDecodeMillis += nDecoded - nStart;
+
+    for (size_t i = 0; i < nRecords; i++) {
+        const CDiskBlockIndex& diskindex = vIndex[i];
+
+        // Construct block index object
+        CBlockIndex* pindexNew = InsertBlockIndex(vHash[i]);
+        pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+        pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nFile = diskindex.nFile;
+        pindexNew->nDataPos = diskindex.nDataPos;
+        pindexNew->nUndoPos = diskindex.nUndoPos;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = diskindex.nStatus;
+        pindexNew->nTx = diskindex.nTx;
+
+        //zerocoin
+        pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+        pindexNew->zerocoinSupply = diskindex.zerocoinSupply;
+        pindexNew->mintDenominations = diskindex.mintDenominations;
+
+        //Proof Of Stake
+        pindexNew->nMint = diskindex.nMint;
+        pindexNew->nMoneySupply = diskindex.nMoneySupply;
+        pindexNew->nFlags = diskindex.nFlags;
+        pindexNew->nStakeModifier = diskindex.nStakeModifier;
+        pindexNew->prevoutStake = diskindex.prevoutStake;
+        pindexNew->nStakeTime = diskindex.nStakeTime;
+        pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+        // ppcoin: build setStakeSeen
+        if (pindexNew->IsProofOfStake())
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+        //accumulator checksums are read in one go once every record is in
+        if (pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+            //Don't load any checkpoints that exist before v2 zsmnc. The accumulator is invalid for v1 and not used.
+            if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
+                vCheckpoints.push_back(pindexNew->nAccumulatorCheckpoint);
+
+            nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+        }
+    }
+
+    nLinkMillis += GetTimeMillis() - nDecoded;
+    nLoaded += nRecords;
+    vRecords.clear();
+    return true;
+}
+} // namespace
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const uint256& hashBestChain)
+{
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    boost::filesystem::path pathTmp = GetDataDir() / "blocks" / "index.snapshot.new";
+    TryCreateDirectory(path.parent_path());
+
+    CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open %s", __func__, pathTmp.string());
+
+    // Everything but the checksum goes through the hasher as well
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    auto write = [&fileout, &hasher](const void* pch, size_t nSize) {
+        fileout.write((const char*)pch, nSize);
+        hasher.write((const char*)pch, nSize);
+    };
+
+    uint64_t nRecords = 0;
+    try {
+        CDataStream ssHeader = GetBlockIndexSnapshotHeader(*this, hashBestChain);
+        unsigned char prefix[BLOCK_INDEX_SNAPSHOT_PREFIX];
+        memcpy(prefix, BLOCK_INDEX_SNAPSHOT_MAGIC, sizeof(BLOCK_INDEX_SNAPSHOT_MAGIC));
+        WriteLE32(prefix + 8, BLOCK_INDEX_SNAPSHOT_VERSION);
+        WriteLE32(prefix + 12, ssHeader.size());
+        write(prefix, sizeof(prefix));
+        write(&ssHeader[0], ssHeader.size());
+
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << make_pair('b', uint256(0));
+        pcursor->Seek(ssKeySet.str());
+
+        // The key is 'b' and the block hash
+        for (; pcursor->Valid(); pcursor->Next()) {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+            if (slKey.size() != 33 || slKey[0] != 'b')
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            unsigned char size[4];
+            WriteLE32(size, slValue.size());
+            write(slKey.data() + 1, 32);
+            write(size, sizeof(size));
+            write(slValue.data(), slValue.size());
+            nRecords++;
+        }
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zsmnc. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+        unsigned char count[8];
+        WriteLE64(count, nRecords);
+        write(count, sizeof(count));
+        uint256 hashCheck = hasher.GetHash();
+        fileout.write((const char*)hashCheck.begin(), 32);
+        FileCommit(fileout.Get());
+        fileout.fclose();
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathTmp, ec);
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
 
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+    if (!RenameOver(pathTmp, path))
+        return error("%s : Rename-into-place failed", __func__);
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+    LogPrintf("%s : wrote %u block index records in %dms\n", __func__, nRecords, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const uint256& hashBestChain)
+{
+    int64_t nStart = GetTimeMillis();
+    CBlockIndexLoader loader(std::max(1u, boost::thread::hardware_concurrency()));
+
+    // A snapshot is good for the first start after the clean shutdown that
+    // wrote it, with the coins and block files it was written against
+    boost::filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    CBlockIndexSnapshot snapshot;
+    bool fSnapshot = false;
+    if (boost::filesystem::exists(pathSnapshot)) {
+        bool fShutdown = false;
+        fSnapshot = ReadFlag("shutdown", fShutdown) && fShutdown && snapshot.Open(pathSnapshot) &&
+                    snapshot.Matches(GetBlockIndexSnapshotHeader(*this, hashBestChain));
+        if (!fSnapshot)
+            LogPrintf("%s : ignoring stale block index snapshot\n", __func__);
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathSnapshot, ec);
+    }
+
+    try {
+        if (fSnapshot) {
+            for (const unsigned char* p = snapshot.pbegin; p < snapshot.pend;) {
+                CBlockIndexRecord record;
+                memcpy(record.hash.begin(), p, 32);
+                record.nSize = ReadLE32(p + 32);
+                record.pbegin = (const char*)p + BLOCK_INDEX_SNAPSHOT_RECORD;
+                p += BLOCK_INDEX_SNAPSHOT_RECORD + record.nSize;
+
+                loader.vRecords.push_back(record);
+                if (loader.vRecords.size() == BLOCK_INDEX_LOAD_BATCH) {
+                    boost::this_thread::interruption_point();
+                    if (!loader.Flush())
+                        return false;
+                }
+            }
+            if (!loader.Flush())
+                return false;
+        } else {
+            boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+            CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+            ssKeySet << make_pair('b', uint256(0));
+            pcursor->Seek(ssKeySet.str());
+
+            // Load mapBlockIndex, copying out a round of values at a time
+            std::vector<std::string> vValues;
+            vValues.reserve(BLOCK_INDEX_LOAD_BATCH);
+            while (true) {
+                bool fEnd = !pcursor->Valid() || pcursor->key().empty() || pcursor->key()[0] != 'b';
+                if (!fEnd) {
+                    leveldb::Slice slValue = pcursor->value();
+                    vValues.push_back(std::string(slValue.data(), slValue.size()));
+                    pcursor->Next();
+                }
+                if (vValues.size() == BLOCK_INDEX_LOAD_BATCH || (fEnd && !vValues.empty())) {
+                    boost::this_thread::interruption_point();
+                    for (const std::string& strValue : vValues) {
+                        CBlockIndexRecord record;
+                        record.pbegin = strValue.data();
+                        record.nSize = strValue.size();
+                        loader.vRecords.push_back(record);
+                    }
+                    if (!loader.Flush())
+                        return false;
+                    vValues.clear();
+                }
+                if (fEnd)
+                    break; // if shutdown requested or finished loading block index
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
+    int64_t nLoaded = GetTimeMillis();
 
+    //populate accumulator checksum map in memory
+    LoadAccumulatorValuesFromDB(loader.vCheckpoints);
+
+    LogPrintf("%s : %u block index records from the %s in %dms (decode %dms, link %dms), %u accumulator checkpoints in %dms\n", __func__,
+        loader.nLoaded, fSnapshot ? "snapshot" : "database", nLoaded - nStart, loader.nDecodeMillis, loader.nLinkMillis,
+        loader.vCheckpoints.size(), GetTimeMillis() - nLoaded);
     return true;
 }
 
@@ -424,3 +909,69 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('2', nChecksum));
 }
+
+bool CZerocoinDB::WriteWitnessState(const uint256& hashPubcoin, const CAccumulatorWitnessState& state)
+{
+    return Write(make_pair('w', hashPubcoin), state);
+}
+
+bool CZerocoinDB::ReadWitnessStates(std::map<uint256, CAccumulatorWitnessState>& mapStates)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('w', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'w')
+                break;
+
+            uint256 hashPubcoin;
+            ssKey >> hashPubcoin;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> mapStates[hashPubcoin];
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CZerocoinDB::EraseWitnessState(const uint256& hashPubcoin)
+{
+    return Erase(make_pair('w', hashPubcoin));
+}
+
+bool CZerocoinDB::WriteBlockPubcoins(const int& nHeight, const CBlockPubcoins& pubcoins)
+{
+    return Write(make_pair('p', nHeight), pubcoins);
+}
+
+bool CZerocoinDB::WriteBlockPubcoinsBatch(const std::vector<std::pair<int, CBlockPubcoins> >& vPubcoins)
+{
+    CLevelDBBatch batch;
+    for (const std::pair<int, CBlockPubcoins>& entry : vPubcoins)
+        batch.Write(make_pair('p', entry.first), entry.second);
+
+    LogPrint("zero", "Writing pubcoin lists of %u blocks to db.\n", (unsigned int)vPubcoins.size());
+    return WriteBatch(batch, true);
+}
+
+bool CZerocoinDB::ReadBlockPubcoins(const int& nHeight, CBlockPubcoins& pubcoins)
+{
+    return Read(make_pair('p', nHeight), pubcoins);
+}
+
+bool CZerocoinDB::EraseBlockPubcoins(const int& nHeight)
+{
+    return Erase(make_pair('p', nHeight));
+}
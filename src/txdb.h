@@ -16,6 +16,7 @@
 #include <utility>
 #include <vector>
 
+class CAccumulatorWitnessState;
 class CCoins;
 class uint256;
 
@@ -25,6 +26,10 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -blockindexsnapshot default
+static const bool DEFAULT_BLOCKINDEXSNAPSHOT = true;
+//! version of the blocks/index.snapshot file format
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -40,6 +45,13 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Scan the whole set as of one snapshot, in parallel, and the ordered hash of the set if phashSerialized is given
+    bool GetTxOutSetStats(CTxOutSetStats& stats, uint256* phashSerialized = NULL) const;
+
+    //! Statistics kept up to date block by block (-coinstatsindex)
+    bool WriteTxOutSetStats(const CTxOutSetStats& stats);
+    bool ReadTxOutSetStats(CTxOutSetStats& stats) const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -66,7 +78,13 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
-    bool LoadBlockIndexGuts();
+    /**
+     * Copy the block index records to a flat file next to the database, so the
+     * next start can read them without walking LevelDB. Only valid for a clean
+     * shutdown with hashBestChain as the coins tip.
+     */
+    bool WriteBlockIndexSnapshot(const uint256& hashBestChain);
+    bool LoadBlockIndexGuts(const uint256& hashBestChain);
 };
 
 /** Zerocoin database (zerocoin/) */
@@ -94,6 +112,14 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    bool WriteWitnessState(const uint256& hashPubcoin, const CAccumulatorWitnessState& state);
+    bool ReadWitnessStates(std::map<uint256, CAccumulatorWitnessState>& mapStates);
+    bool EraseWitnessState(const uint256& hashPubcoin);
+    bool WriteBlockPubcoins(const int& nHeight, const CBlockPubcoins& pubcoins);
+    /** Write per-block pubcoin lists to the zerocoinDB in a batch */
+    bool WriteBlockPubcoinsBatch(const std::vector<std::pair<int, CBlockPubcoins> >& vPubcoins);
+    bool ReadBlockPubcoins(const int& nHeight, CBlockPubcoins& pubcoins);
+    bool EraseBlockPubcoins(const int& nHeight);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -13,20 +13,30 @@
 #include "utilmoneystr.h"
 #include "version.h"
 
+#include <cmath>
+#include <limits>
+
 #include <boost/circular_buffer.hpp>
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0), dPriorityDelta(0.0)
 {
     nHeight = MEMPOOL_HEIGHT;
+    nCountWithDescendants = nCountWithAncestors = 1;
+    nSizeWithDescendants = nSizeWithAncestors = 0;
+    nModFeesWithDescendants = nModFeesWithAncestors = 0;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0), dPriorityDelta(0.0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nCountWithDescendants = nCountWithAncestors = 1;
+    nSizeWithDescendants = nSizeWithAncestors = nTxSize;
+    nModFeesWithDescendants = nModFeesWithAncestors = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -43,6 +53,32 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    nModFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithAncestors += modifySize;
+    assert(int64_t(nSizeWithAncestors) > 0);
+    nModFeesWithAncestors += modifyFee;
+    nCountWithAncestors += modifyCount;
+    assert(int64_t(nCountWithAncestors) > 0);
+}
+
+void CTxMemPoolEntry::UpdateDeltas(double dNewPriorityDelta, CAmount nNewFeeDelta)
+{
+    nModFeesWithDescendants += nNewFeeDelta - nFeeDelta;
+    nModFeesWithAncestors += nNewFeeDelta - nFeeDelta;
+    nFeeDelta = nNewFeeDelta;
+    dPriorityDelta = dNewPriorityDelta;
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -356,7 +392,11 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       totalTxSize(0),
+                                                       lastRollingFeeUpdate(GetTime()),
+                                                       blockSinceLastRollingFeeBump(false),
+                                                       rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -402,34 +442,314 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
+{
+    setEntries& parents = mapLinks[entry].parents;
+    if (add)
+        parents.insert(parent);
+    else
+        parents.erase(parent);
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    setEntries& children = mapLinks[entry].children;
+    if (add)
+        children.insert(child);
+    else
+        children.erase(child);
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.parents;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolChildren(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.children;
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+    uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents) const
+{
+    setEntries parentHashes;
+    const CTransaction& tx = entry.GetTx();
+
+    if (fSearchForParents) {
+        // Get parents of this transaction that are in the mempool
+        if (!tx.IsZerocoinSpend()) {
+            for (const CTxIn& txin : tx.vin) {
+                txiter piter = mapTx.find(txin.prevout.hash);
+                if (piter != mapTx.end()) {
+                    parentHashes.insert(piter);
+                    if (parentHashes.size() + 1 > limitAncestorCount) {
+                        errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
+                        return false;
+                    }
+                }
+            }
+        }
+    } else {
+        // If we're not searching for parents, we require this to be an entry in the mempool already
+        txiter it = mapTx.find(tx.GetHash());
+        parentHashes = GetMemPoolParents(it);
+    }
+
+    size_t totalSizeWithAncestors = entry.GetTxSize();
+
+    while (!parentHashes.empty()) {
+        txiter stageit = *parentHashes.begin();
+
+        setAncestors.insert(stageit);
+        parentHashes.erase(stageit);
+        totalSizeWithAncestors += stageit->GetTxSize();
+
+        if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantSize);
+            return false;
+        } else if (stageit->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantCount);
+            return false;
+        } else if (totalSizeWithAncestors > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+
+        for (txiter phash : GetMemPoolParents(stageit)) {
+            // If this is a new ancestor, add it.
+            if (setAncestors.count(phash) == 0)
+                parentHashes.insert(phash);
+            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+                errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
+{
+    setEntries stage;
+    if (setDescendants.count(entryit) == 0)
+        stage.insert(entryit);
+    // Traverse down the children of entry, only adding children that are not
+    // accounted for in setDescendants already (because those children have either
+    // already been walked, or will be walked in this iteration).
+    while (!stage.empty()) {
+        txiter it = *stage.begin();
+        setDescendants.insert(it);
+        stage.erase(it);
+
+        for (txiter childiter : GetMemPoolChildren(it)) {
+            if (!setDescendants.count(childiter))
+                stage.insert(childiter);
+        }
+    }
+}
+
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries& setAncestors)
+{
+    // add or remove this tx as a child of each parent
+    for (txiter piter : GetMemPoolParents(it))
+        UpdateChild(piter, it, add);
+
+    const int64_t updateCount = (add ? 1 : -1);
+    const int64_t updateSize = updateCount * it->GetTxSize();
+    const CAmount updateFee = updateCount * it->GetModifiedFee();
+    for (txiter ancestorIt : setAncestors)
+        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+}
+
+void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries& setAncestors)
+{
+    int64_t updateCount = setAncestors.size();
+    int64_t updateSize = 0;
+    CAmount updateFee = 0;
+    for (txiter ancestorIt : setAncestors) {
+        updateSize += ancestorIt->GetTxSize();
+        updateFee += ancestorIt->GetModifiedFee();
+    }
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount));
+}
+
+void CTxMemPool::UpdateChildrenForRemoval(txiter it)
+{
+    for (txiter updateIt : GetMemPoolChildren(it))
+        UpdateParent(updateIt, it, false);
+}
+
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries& entriesToRemove, bool updateDescendants)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    if (updateDescendants) {
+        // Descendants stay when a transaction is mined rather than removed with them:
+        // take it out of their ancestor state. The links are needed to walk the
+        // mempool until all entries are gone, they are cut below.
+        for (txiter removeIt : entriesToRemove) {
+            setEntries setDescendants;
+            CalculateDescendants(removeIt, setDescendants);
+            setDescendants.erase(removeIt);
+            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+            CAmount modifyFee = -removeIt->GetModifiedFee();
+            for (txiter dit : setDescendants)
+                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1));
+        }
+    }
+    for (txiter removeIt : entriesToRemove) {
+        setEntries setAncestors;
+        std::string dummy;
+        // the entry is in the pool, so its parents are in mapLinks already
+        CalculateMemPoolAncestors(*removeIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        // This also cuts the links from the parents to removeIt, which is fine as
+        // only the parent links are needed to walk up to the ancestors.
+        UpdateAncestorsOf(false, removeIt, setAncestors);
+    }
+    for (txiter removeIt : entriesToRemove)
+        UpdateChildrenForRemoval(removeIt);
+}
+
+void CTxMemPool::UpdateForOrphanedChildren(txiter it)
+{
+    const uint256& hash = it->GetTx().GetHash();
+    setEntries setChildren;
+    for (std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0)); itNext != mapNextTx.end() && itNext->first.hash == hash; ++itNext) {
+        txiter childIt = mapTx.find(itNext->second.ptx->GetHash());
+        assert(childIt != mapTx.end());
+        setChildren.insert(childIt);
+    }
+    if (setChildren.empty())
+        return;
+
+    setEntries setDescendants;
+    for (txiter childIt : setChildren) {
+        UpdateChild(it, childIt, true);
+        UpdateParent(childIt, it, true);
+        CalculateDescendants(childIt, setDescendants);
+    }
+
+    // The ancestors of it and its new descendants may share entries already,
+    // so recount the state of both sides from the links
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (txiter dit : setDescendants) {
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(*dit, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        int64_t nSize = dit->GetTxSize();
+        CAmount nFees = dit->GetModifiedFee();
+        for (txiter ancestorIt : setAncestors) {
+            nSize += ancestorIt->GetTxSize();
+            nFees += ancestorIt->GetModifiedFee();
+        }
+        mapTx.modify(dit, update_ancestor_state(nSize - (int64_t)dit->GetSizeWithAncestors(), nFees - dit->GetModFeesWithAncestors(),
+                              (int64_t)setAncestors.size() + 1 - (int64_t)dit->GetCountWithAncestors()));
+    }
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+    setAncestors.insert(it);
+    for (txiter ancestorIt : setAncestors) {
+        setEntries setAncestorDescendants;
+        CalculateDescendants(ancestorIt, setAncestorDescendants);
+        int64_t nSize = 0;
+        CAmount nFees = 0;
+        for (txiter dit : setAncestorDescendants) {
+            nSize += dit->GetTxSize();
+            nFees += dit->GetModifiedFee();
+        }
+        mapTx.modify(ancestorIt, update_descendant_state(nSize - (int64_t)ancestorIt->GetSizeWithDescendants(), nFees - ancestorIt->GetModFeesWithDescendants(),
+                                     (int64_t)setAncestorDescendants.size() - (int64_t)ancestorIt->GetCountWithDescendants()));
+    }
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
+{
+    LOCK(cs);
+    setEntries setAncestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+    return addUnchecked(hash, entry, setAncestors);
+}
+
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry, setEntries& setAncestors)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
-    {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        if(!tx.IsZerocoinSpend()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
-                mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+    txiter newit = mapTx.insert(entry).first;
+    mapLinks.insert(std::make_pair(newit, TxLinks()));
+
+    // Apply earlier PrioritiseTransaction() calls
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    if (pos != mapDeltas.end())
+        mapTx.modify(newit, update_deltas(pos->second.first, pos->second.second));
+
+    const CTransaction& tx = newit->GetTx();
+    if (!tx.IsZerocoinSpend()) {
+        std::set<uint256> setParentTransactions;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            setParentTransactions.insert(tx.vin[i].prevout.hash);
+        }
+        for (const uint256& phash : setParentTransactions) {
+            txiter pit = mapTx.find(phash);
+            if (pit != mapTx.end())
+                UpdateParent(newit, pit, true);
         }
-        nTransactionsUpdated++;
-        totalTxSize += entry.GetTxSize();
     }
+    UpdateAncestorsOf(true, newit, setAncestors);
+    UpdateEntryForAncestors(newit, setAncestors);
+    // Transactions of a disconnected block come back after those spending them
+    UpdateForOrphanedChildren(newit);
+
+    nTransactionsUpdated++;
+    totalTxSize += entry.GetTxSize();
     return true;
 }
 
+void CTxMemPool::removeUnchecked(txiter it)
+{
+    const CTransaction& tx = it->GetTx();
+    for (const CTxIn& txin : tx.vin) {
+        std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.find(txin.prevout);
+        // zerocoin spends are not in mapNextTx
+        if (itNext != mapNextTx.end() && itNext->second.ptx == &tx)
+            mapNextTx.erase(itNext);
+    }
+
+    totalTxSize -= it->GetTxSize();
+    mapLinks.erase(it);
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+}
+
+void CTxMemPool::RemoveStaged(setEntries& stage, bool updateDescendants)
+{
+    AssertLockHeld(cs);
+    UpdateForRemoveFromMempool(stage, updateDescendants);
+    for (txiter it : stage)
+        removeUnchecked(it);
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
+        setEntries txToRemove;
+        txiter origit = mapTx.find(origTx.GetHash());
+        if (origit != mapTx.end()) {
+            txToRemove.insert(origit);
+        } else if (fRecursive) {
             // If recursively removing but origTx isn't in the mempool
             // be sure to remove any children that are in the pool. This can
             // happen during chain re-orgs if origTx isn't re-accepted into
@@ -438,31 +758,21 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
+                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                assert(nextit != mapTx.end());
+                txToRemove.insert(nextit);
             }
         }
-        while (!txToRemove.empty()) {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
-                continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
-            }
-            BOOST_FOREACH (const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
-
-            removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+        setEntries setAllRemoves;
+        if (fRecursive) {
+            for (txiter it : txToRemove)
+                CalculateDescendants(it, setAllRemoves);
+        } else {
+            setAllRemoves.swap(txToRemove);
         }
+        for (txiter it : setAllRemoves)
+            removed.push_back(it->GetTx());
+        RemoveStaged(setAllRemoves, !fRecursive);
     }
 }
 
@@ -471,10 +781,10 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
     // Remove transactions spending a coinbase which are now immature
     LOCK(cs);
     list<CTransaction> transactionsToRemove;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->second.GetTx();
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        const CTransaction& tx = it->GetTx();
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
             const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
@@ -515,9 +825,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
     BOOST_FOREACH (const CTransaction& tx, vtx) {
-        uint256 hash = tx.GetHash();
-        if (mapTx.count(hash))
-            entries.push_back(mapTx[hash]);
+        indexed_transaction_set::const_iterator it = mapTx.find(tx.GetHash());
+        if (it != mapTx.end())
+            entries.push_back(*it);
     }
     minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
     BOOST_FOREACH (const CTransaction& tx, vtx) {
@@ -526,12 +836,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -551,18 +864,23 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
 
     LOCK(cs);
     list<const CTxMemPoolEntry*> waitingOnDependants;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
-        checkTotal += it->second.GetTxSize();
-        const CTransaction& tx = it->second.GetTx();
+        checkTotal += it->GetTxSize();
+        const CTransaction& tx = it->GetTx();
+        txlinksMap::const_iterator linksiter = mapLinks.find(it);
+        assert(linksiter != mapLinks.end());
+        const TxLinks& links = linksiter->second;
         bool fDependsWait = false;
+        setEntries setParentCheck;
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
-                const CTransaction& tx2 = it2->second.GetTx();
+                const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
+                setParentCheck.insert(it2);
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 assert(coins && coins->IsAvailable(txin.prevout.n));
@@ -574,8 +892,40 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        assert(setParentCheck == links.parents);
+
+        // Verify the ancestor state against a walk of the parents
+        setEntries setAncestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+        uint64_t nCountCheck = setAncestors.size() + 1;
+        uint64_t nSizeCheck = it->GetTxSize();
+        CAmount nFeesCheck = it->GetModifiedFee();
+        for (txiter ancestorIt : setAncestors) {
+            nSizeCheck += ancestorIt->GetTxSize();
+            nFeesCheck += ancestorIt->GetModifiedFee();
+        }
+        assert(it->GetCountWithAncestors() == nCountCheck);
+        assert(it->GetSizeWithAncestors() == nSizeCheck);
+        assert(it->GetModFeesWithAncestors() == nFeesCheck);
+
+        // Check children against mapNextTx, and the descendant state against the children
+        setEntries setChildrenCheck;
+        uint64_t nChildSizes = 0;
+        std::map<COutPoint, CInPoint>::const_iterator iter = mapNextTx.lower_bound(COutPoint(tx.GetHash(), 0));
+        for (; iter != mapNextTx.end() && iter->first.hash == tx.GetHash(); ++iter) {
+            txiter childit = mapTx.find(iter->second.ptx->GetHash());
+            assert(childit != mapTx.end());
+            if (setChildrenCheck.insert(childit).second)
+                nChildSizes += childit->GetTxSize();
+        }
+        assert(setChildrenCheck == links.children);
+        // Shared descendants can be counted several times, so only a lower bound
+        assert(it->GetSizeWithDescendants() >= nChildSizes + it->GetTxSize());
+
         if (fDependsWait)
-            waitingOnDependants.push_back(&it->second);
+            waitingOnDependants.push_back(&(*it));
         else {
             CValidationState state;
             CTxUndo undo;
@@ -601,9 +951,9 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
     for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
-        map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(hash);
-        const CTransaction& tx = it2->second.GetTx();
+        indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         assert(it2 != mapTx.end());
+        const CTransaction& tx = it2->GetTx();
         assert(&tx == it->second.ptx);
         assert(tx.vin.size() > it->second.n);
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
@@ -618,8 +968,9 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    typedef indexed_transaction_set::index<ancestor_score>::type::const_iterator ancestor_score_iter;
+    for (ancestor_score_iter mi = mapTx.get<ancestor_score>().begin(); mi != mapTx.get<ancestor_score>().end(); ++mi)
+        vtxid.push_back(mi->GetTx().GetHash());
 }
 
 void CTxMemPool::getTransactions(std::set<uint256>& setTxid)
@@ -627,16 +978,25 @@ void CTxMemPool::getTransactions(std::set<uint256>& setTxid)
     setTxid.clear();
 
     LOCK(cs);
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        setTxid.insert((*mi).first);
+    for (indexed_transaction_set::const_iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        setTxid.insert(mi->GetTx().GetHash());
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    map<uint256, CTxMemPoolEntry>::const_iterator i = mapTx.find(hash);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end()) return false;
+    result = i->GetTx();
+    return true;
+}
+
+bool CTxMemPool::lookupEntry(const uint256& hash, CTxMemPoolEntry& result) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second.GetTx();
+    result = *i;
     return true;
 }
 
@@ -689,6 +1049,23 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end()) {
+            mapTx.modify(it, update_deltas(deltas.first, deltas.second));
+            // Now update all ancestors' modified fees with descendants
+            setEntries setAncestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            for (txiter ancestorIt : setAncestors)
+                mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
+            // and the descendants' modified fees with ancestors
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            setDescendants.erase(it);
+            for (txiter descendantIt : setDescendants)
+                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0));
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -710,6 +1087,100 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
     mapDeltas.erase(hash);
 }
 
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(llround(rollingMinimumFeeRate));
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (totalTxSize < sizelimit / 4)
+            halflife /= 4;
+        else if (totalTxSize < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < minRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), minRelayFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining)
+{
+    LOCK(cs);
+
+    unsigned nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && totalTxSize > sizelimit) {
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+        // The next transaction must pay more than the package just evicted, plus
+        // what relaying it costs, so that the pool cannot be churned for free
+        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed += minRelayFee;
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        setEntries stage;
+        CalculateDescendants(mapTx.project<0>(it), stage);
+        nTxnRemoved += stage.size();
+
+        std::vector<CTransaction> txn;
+        if (pvNoSpendsRemaining) {
+            txn.reserve(stage.size());
+            for (txiter setIter : stage)
+                txn.push_back(setIter->GetTx());
+        }
+        RemoveStaged(stage, false);
+        if (pvNoSpendsRemaining) {
+            for (const CTransaction& tx : txn) {
+                for (const CTxIn& txin : tx.vin) {
+                    if (txin.prevout.IsNull() || exists(txin.prevout.hash))
+                        continue;
+                    std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(txin.prevout.hash, 0));
+                    if (iter == mapNextTx.end() || iter->first.hash != txin.prevout.hash)
+                        pvNoSpendsRemaining->push_back(txin.prevout.hash);
+                }
+            }
+        }
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
+    setEntries toremove;
+    while (it != mapTx.get<entry_time>().end() && it->GetTime() < time) {
+        toremove.insert(mapTx.project<0>(it));
+        it++;
+    }
+    setEntries stage;
+    for (txiter removeit : toremove)
+        CalculateDescendants(removeit, stage);
+    RemoveStaged(stage, false);
+    return stage.size();
+}
+
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
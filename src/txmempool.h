@@ -8,12 +8,20 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <map>
+#include <set>
+#include <string>
 
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -32,8 +40,26 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Default for -maxmempool, maximum megabytes of transactions in the mempool */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, hours after which transactions are dropped from the mempool */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+/** Default for -limitdescendantcount, max number of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+
 /**
  * CTxMemPool stores these:
+ *
+ * Besides the transaction itself, an entry caches the count, size and fees of its
+ * in-mempool descendants and ancestors, each including the entry itself. These are kept
+ * up to date by CTxMemPool as transactions come and go, and are what the mempool's
+ * indices sort by.
  */
 class CTxMemPoolEntry
 {
@@ -45,6 +71,15 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee adjustment by PrioritiseTransaction()
+    double dPriorityDelta; //! Priority adjustment by PrioritiseTransaction()
+
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants; //! Including fee deltas
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -57,8 +92,163 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+    /** Priority when entering the mempool, with the PrioritiseTransaction() adjustment */
+    double GetModifiedStartingPriority() const { return dPriority + dPriorityDelta; }
+
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    void UpdateDeltas(double dNewPriorityDelta, CAmount nNewFeeDelta);
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+};
+
+// Helpers for modifying CTxMemPool::mapTx, which only allows its entries to be changed through modify()
+struct update_descendant_state {
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct update_ancestor_state {
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateAncestorState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct update_deltas {
+    update_deltas(double _dPriorityDelta, CAmount _nFeeDelta) : dPriorityDelta(_dPriorityDelta), nFeeDelta(_nFeeDelta) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDeltas(dPriorityDelta, nFeeDelta); }
+
+private:
+    double dPriorityDelta;
+    CAmount nFeeDelta;
+};
+
+/** Extracts the txid of an entry, the key of mapTx's primary index */
+struct mempoolentry_txid {
+    typedef uint256 result_type;
+    result_type operator()(const CTxMemPoolEntry& entry) const { return entry.GetTx().GetHash(); }
+};
+
+/**
+ * Sort an entry by max(fee rate of the entry, fee rate of the entry with its descendants),
+ * lowest first. The front of this index is what to evict when the mempool is full:
+ * neither the entry nor any package it heads would be mined soon.
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        bool fUseADescendants = UseDescendantScore(a);
+        bool fUseBDescendants = UseDescendantScore(b);
+
+        double aModFee = fUseADescendants ? a.GetModFeesWithDescendants() : a.GetModifiedFee();
+        double aSize = fUseADescendants ? a.GetSizeWithDescendants() : a.GetTxSize();
+        double bModFee = fUseBDescendants ? b.GetModFeesWithDescendants() : b.GetModifiedFee();
+        double bSize = fUseBDescendants ? b.GetSizeWithDescendants() : b.GetTxSize();
+
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b)
+        double f1 = aModFee * bSize;
+        double f2 = aSize * bModFee;
+        if (f1 == f2)
+            return a.GetTime() > b.GetTime();
+        return f1 < f2;
+    }
+
+    /** Whether the descendant fee rate is higher than the entry's own */
+    static bool UseDescendantScore(const CTxMemPoolEntry& a)
+    {
+        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
+        double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
+        return f2 > f1;
+    }
+};
+
+/**
+ * Sort an entry by min(fee rate of the entry, fee rate of the entry with its ancestors),
+ * highest first: the order in which to try transactions for a block. Including an entry
+ * means including its ancestors, so a high fee rate is only worth as much as the package.
+ */
+class CompareTxMemPoolEntryByAncestorScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double aFees, aSize, bFees, bSize;
+        GetScore(a, aFees, aSize);
+        GetScore(b, bFees, bSize);
+
+        double f1 = aFees * bSize;
+        double f2 = aSize * bFees;
+        if (f1 == f2)
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        return f1 > f2;
+    }
+
+    static void GetScore(const CTxMemPoolEntry& a, double& dFees, double& dSize)
+    {
+        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithAncestors();
+        double f2 = (double)a.GetModFeesWithAncestors() * a.GetTxSize();
+        if (f1 > f2) {
+            dFees = a.GetModFeesWithAncestors();
+            dSize = a.GetSizeWithAncestors();
+        } else {
+            dFees = a.GetModifiedFee();
+            dSize = a.GetTxSize();
+        }
+    }
+};
+
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
+/**
+ * Zerocoin spends first, oldest first, then by modified starting priority, highest first.
+ * Priority grows with the chain height at a rate that differs per transaction, so no
+ * index can hold the current order; the starting priority is what it is sorted by.
+ */
+class CompareTxMemPoolEntryByPriority
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        bool fSpendA = a.GetTx().IsZerocoinSpend();
+        bool fSpendB = b.GetTx().IsZerocoinSpend();
+        if (fSpendA != fSpendB)
+            return fSpendA;
+        if (fSpendA)
+            return a.GetTime() < b.GetTime();
+        return a.GetModifiedStartingPriority() > b.GetModifiedStartingPriority();
+    }
 };
 
+// Tags of mapTx's secondary indices
+struct descendant_score {};
+struct entry_time {};
+struct ancestor_score {};
+struct priority {};
+
 class CMinerPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -91,6 +281,16 @@ public:
  * are added to the pool: if a new transaction double-spends
  * an input of a transaction in the pool, it is dropped,
  * as are non-standard transactions.
+ *
+ * mapTx is a boost::multi_index container. Its primary index is by txid; the others
+ * order the entries by
+ * - descendant_score: package fee rate of the entry and its descendants, for eviction
+ * - entry_time: for expiry
+ * - ancestor_score: package fee rate of the entry and its ancestors, for block assembly
+ * - priority: starting priority, for the free part of a block
+ *
+ * mapLinks keeps the in-mempool parents and children of each entry, from which the
+ * ancestor and descendant state of the entries is maintained.
  */
 class CTxMemPool
 {
@@ -102,9 +302,78 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee rate to get into the pool, decreases exponentially
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<mempoolentry_txid, CCoinsKeyHasher>,
+            // sorted by fee rate with descendants, lowest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore>,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime>,
+            // sorted by fee rate with ancestors, highest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<ancestor_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorScore>,
+            // sorted by starting priority, highest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<priority>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByPriority> > >
+        indexed_transaction_set;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTxMemPoolEntry> mapTx;
+    indexed_transaction_set mapTx;
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+
+    struct CompareIteratorByHash {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
+    const setEntries& GetMemPoolParents(txiter entry) const;
+    const setEntries& GetMemPoolChildren(txiter entry) const;
+
+private:
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    txlinksMap mapLinks;
+
+    void UpdateParent(txiter entry, txiter parent, bool add);
+    void UpdateChild(txiter entry, txiter child, bool add);
+    /** Link entry to transactions already in the pool that spend its outputs, after a reorg */
+    void UpdateForOrphanedChildren(txiter entry);
+    /** Set ancestor state and links of a new entry, and add it to the descendant state of setAncestors */
+    void UpdateAncestorsOf(bool add, txiter hash, setEntries& setAncestors);
+    void UpdateEntryForAncestors(txiter it, const setEntries& setAncestors);
+    /** Before removing entries: update the state of their ancestors and, if updateDescendants, remaining descendants */
+    void UpdateForRemoveFromMempool(const setEntries& entriesToRemove, bool updateDescendants);
+    void UpdateChildrenForRemoval(txiter entry);
+    void removeUnchecked(txiter entry);
+    /** Raise the rolling minimum fee to the fee rate of an evicted package */
+    void trackPackageRemoved(const CFeeRate& rate);
+
+public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
@@ -120,12 +389,16 @@ public:
     void check(const CCoinsViewCache* pcoins) const;
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
+    /** Add entry, whose in-mempool ancestors are setAncestors, as computed by CalculateMemPoolAncestors() */
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry, setEntries& setAncestors);
+    /** Add entry without limits on its ancestors */
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
     void clear();
+    /** The txids of the pool, in the order block assembly tries them */
     void queryHashes(std::vector<uint256>& vtxid);
     void getTransactions(std::set<uint256>& setTxid);
     void pruneSpent(const uint256& hash, CCoins& coins);
@@ -137,6 +410,26 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /**
+     * Find the in-mempool ancestors of entry, and check them against the limits. False with
+     * errString set if the entry would have more than limitAncestorCount ancestors or ancestor
+     * bytes including itself, or make any of its ancestors exceed the descendant limits.
+     * fSearchForParents looks up the parents by the entry's inputs, for entries not yet in mapTx.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+        uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const;
+    /** Add entryit and all its in-mempool descendants to setDescendants */
+    void CalculateDescendants(txiter entryit, setEntries& setDescendants) const;
+    /** Remove a set of entries, which must include the descendants of each of them */
+    void RemoveStaged(setEntries& stage, bool updateDescendants);
+
+    /** Evict the transactions with the lowest descendant fee rate until the pool's transactions take at most sizelimit bytes */
+    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining = NULL);
+    /** Remove transactions that entered before time, with their descendants. Returns the number removed. */
+    int Expire(int64_t time);
+    /** The fee rate a transaction needs to get into the pool, raised by evictions and decaying afterwards */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
     unsigned long size()
     {
         LOCK(cs);
@@ -155,6 +448,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** The entry of hash, false if it is not in the pool */
+    bool lookupEntry(const uint256& hash, CTxMemPoolEntry& result) const;
 
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
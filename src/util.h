@@ -65,8 +65,8 @@ bool SetupNetworking();
 
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
-/** Send a string to the log output */
-int LogPrintStr(const std::string& str);
+/** Send a string to the log output, category is NULL for unconditional output */
+int LogPrintStr(const std::string& str, const char* category = NULL);
 
 #define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
 
@@ -80,7 +80,7 @@ int LogPrintStr(const std::string& str);
     static inline int LogPrint(const char* category, const char* format, TINYFORMAT_VARARGS(n)) \
     {                                                                                           \
         if (!LogAcceptCategory(category)) return 0;                                             \
-        return LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));                        \
+        return LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)), category);              \
     }                                                                                           \
     /**   Log error and return false */                                                         \
     template <TINYFORMAT_ARGTYPES(n)>                                                           \
@@ -99,7 +99,7 @@ TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_AND_LOG_FUNC)
 static inline int LogPrint(const char* category, const char* format)
 {
     if (!LogAcceptCategory(category)) return 0;
-    return LogPrintStr(format);
+    return LogPrintStr(format, category);
 }
 static inline bool error(const char* format)
 {
@@ -119,6 +119,7 @@ bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 bool TryCreateDirectory(const boost::filesystem::path& p);
 boost::filesystem::path GetDefaultDataDir();
 const boost::filesystem::path& GetDataDir(bool fNetSpecific = true);
+void ClearDatadirCache();
 boost::filesystem::path GetConfigFile();
 boost::filesystem::path GetMasternodeConfigFile();
 #ifndef WIN32
@@ -467,6 +467,70 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+/**
+ * Whether hash has an output of ours that is not spent in the main chain. Only spends in the
+ * main chain count: those go away with a disconnected block, whose transactions are passed to
+ * SyncTransaction(), while unconfirmed ones can drop out of the mempool without the wallet hearing about it.
+ */
+bool CWallet::IsUnspentTx(const uint256& hash) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+    if (it == mapWallet.end())
+        return false;
+
+    const CWalletTx& wtx = it->second;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) == ISMINE_NO)
+            continue;
+        bool fSpent = false;
+        pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator itSpend = range.first; itSpend != range.second && !fSpent; ++itSpend) {
+            map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(itSpend->second);
+            fSpent = mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0;
+        }
+        if (!fSpent)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::UpdateUnspent(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet); // setUnspentTxs
+    if (IsUnspentTx(hash))
+        setUnspentTxs.insert(hash);
+    else
+        setUnspentTxs.erase(hash);
+    InvalidateBalanceCache();
+}
+
+void CWallet::UpdateUnspentSpentBy(const CTransaction& tx)
+{
+    // Zerocoin spends have no real prevouts
+    if (tx.IsCoinBase() || tx.IsZerocoinSpend())
+        return;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+        if (mapWallet.count(txin.prevout.hash))
+            UpdateUnspent(txin.prevout.hash);
+}
+
+void CWallet::RebuildUnspent()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    setUnspentTxs.clear();
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateUnspent(it->first);
+}
+
+size_t CWallet::GetUnspentTxCount() const
+{
+    LOCK(cs_wallet);
+    return setUnspentTxs.size();
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -635,9 +699,14 @@ int64_t CWallet::IncOrderPosNext(CWalletDB* pwalletdb)
 void CWallet::MarkDirty()
 {
     {
-        LOCK(cs_wallet);
-        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
+        LOCK2(cs_main, cs_wallet);
+        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet) {
             item.second.MarkDirty();
+            // Called after keys or scripts were added, which may have made more outputs ours. Nothing
+            // stops being ours, so only the transactions that are not indexed yet need a look.
+            if (!setUnspentTxs.count(item.first))
+                UpdateUnspent(item.first);
+        }
     }
 }
 
@@ -695,6 +764,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        UpdateUnspent(hash);
+        UpdateUnspentSpentBy(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -753,8 +824,11 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            setUnspentTxs.erase(hash);
+            InvalidateBalanceCache();
+        }
     }
     return;
 }
@@ -1430,10 +1504,128 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+namespace
+{
+/**
+ * Reads the blocks of a rescan on several threads, ahead of the one that adds their
+ * transactions to the wallet, and marks the transactions that pay to the wallet.
+ * Matching outputs only needs the keystore, which has its own lock, so it is done here
+ * without cs_wallet. Inputs depend on transactions found earlier in the same scan and
+ * are checked when the block is taken out with Pop().
+ *
+ * With a filter index, blocks whose filter matches none of the wallet's elements are not
+ * read; Pop() hands out their filter instead so it can be checked against the outpoints
+ * of transactions found later.
+ */
+class CRescanPipeline
+{
+private:
+    struct CSlot {
+        CBlock block;
+        std::vector<bool> vfMine;
+        CBlockFilter filter;
+        bool fSkipped;
+        bool fReady;
+
+        CSlot() : fSkipped(false), fReady(false) {}
+    };
+
+    const CWallet& wallet;
+    const std::vector<std::pair<CBlockIndex*, CDiskBlockPos> >& vBlocks;
+    const CBlockFilter::ElementSet* pelements; // NULL to read every block
+    std::vector<CSlot> vSlots;
+    size_t nNext;   // next block for a reader thread
+    size_t nPopped; // blocks taken out by Pop()
+    bool fStop;
+    boost::mutex mutex;
+    boost::condition_variable condReady;
+    boost::condition_variable condSpace;
+    boost::thread_group threads;
+
+    void ThreadRead()
+    {
+        RenameThread("smnc-rescan");
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNext < vBlocks.size() && nNext >= nPopped + vSlots.size())
+                    condSpace.wait(lock);
+                if (fStop || nNext >= vBlocks.size())
+                    return;
+                i = nNext++;
+            }
+
+            CBlockFilter filter;
+            bool fSkipped = pelements && pblockfilterdb && pblockfilterdb->ReadFilter(vBlocks[i].first->GetBlockHash(), filter) &&
+                            !filter.MatchAny(*pelements);
+
+            CBlock block;
+            if (!fSkipped && (!ReadBlockFromDisk(block, vBlocks[i].second) || block.GetHash() != vBlocks[i].first->GetBlockHash())) {
+                LogPrintf("ScanForWalletTransactions() : cannot read block %s\n", vBlocks[i].first->GetBlockHash().ToString());
+                block.SetNull();
+            }
+            std::vector<bool> vfMine(block.vtx.size());
+            for (size_t j = 0; j < block.vtx.size(); j++)
+                vfMine[j] = wallet.IsMine(block.vtx[j]);
+
+            boost::lock_guard<boost::mutex> lock(mutex);
+            // nobody else touches the slot until it is ready, Pop() has taken out the block it held before
+            CSlot& slot = vSlots[i % vSlots.size()];
+            std::swap(slot.block, block);
+            std::swap(slot.vfMine, vfMine);
+            std::swap(slot.filter, filter);
+            slot.fSkipped = fSkipped;
+            slot.fReady = true;
+            condReady.notify_all();
+        }
+    }
+
+public:
+    CRescanPipeline(const CWallet& walletIn, const std::vector<std::pair<CBlockIndex*, CDiskBlockPos> >& vBlocksIn, const CBlockFilter::ElementSet* pelementsIn, int nThreads)
+        : wallet(walletIn), vBlocks(vBlocksIn), pelements(pelementsIn), vSlots(RESCAN_READ_AHEAD), nNext(0), nPopped(0), fStop(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CRescanPipeline::ThreadRead, this));
+    }
+
+    ~CRescanPipeline()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condSpace.notify_all();
+        threads.join_all();
+    }
+
+    /** Take out the next block in chain order, waiting for it to be read. False if it was skipped, filter is set then. */
+    bool Pop(CBlock& block, std::vector<bool>& vfMine, CBlockFilter& filter)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CSlot& slot = vSlots[nPopped % vSlots.size()];
+        while (!slot.fReady)
+            condReady.wait(lock);
+        std::swap(block, slot.block);
+        std::swap(vfMine, slot.vfMine);
+        std::swap(filter, slot.filter);
+        bool fRead = !slot.fSkipped;
+        slot.fReady = false;
+        nPopped++;
+        condSpace.notify_all();
+        return fRead;
+    }
+};
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against our keys by CRescanPipeline. cs_main and cs_wallet
+ * are only taken to add the transactions of one block at a time, so the node keeps working.
+ * With -blockfilterindex only the blocks whose filter matches the wallet are read.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1443,7 +1635,19 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     if (fCheckZSMNC)
         zsmncTracker->Init();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+    // zerocoin mints are recognized by their value, not by anything in the filter
+    bool fUseFilters = pblockfilterdb && !fCheckZSMNC;
+    CBlockFilter::ElementSet elements;
+    CBlockFilter::ElementSet elementsFound; // outpoints of transactions added by this scan
+
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1452,20 +1656,81 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)) && pindex->nHeight <= Params().Zerocoin_StartHeight())
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        set<uint256> setAddedToWallet;
-        while (pindex) {
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+
+        LOCK(cs_rescan);
+        rescanProgress = CRescanProgress();
+        rescanProgress.fScanning = true;
+        rescanProgress.nStartHeight = pindex ? pindex->nHeight : chainActive.Height();
+        rescanProgress.nStopHeight = chainActive.Height();
+        rescanProgress.nHeight = rescanProgress.nStartHeight;
+        rescanProgress.nStartTime = GetTimeMillis();
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    set<uint256> setAddedToWallet;
+    while (pindex) {
+        // The blocks up to the current tip, ones connected meanwhile are picked up by the next round
+        std::vector<std::pair<CBlockIndex*, CDiskBlockPos> > vBlocks;
+        {
+            LOCK(cs_main);
+            for (CBlockIndex* pindexBlock = pindex; pindexBlock; pindexBlock = chainActive.Next(pindexBlock))
+                vBlocks.push_back(std::make_pair(pindexBlock, pindexBlock->GetBlockPos()));
+        }
+
+        if (fUseFilters) {
+            elements.clear();
+            GetFilterElements(elements);
+        }
+
+        CRescanPipeline pipeline(*this, vBlocks, fUseFilters ? &elements : NULL, nThreads);
+        CBlockIndex* pindexNext = NULL;
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            CBlock block;
+            std::vector<bool> vfMine;
+            CBlockFilter filter;
+            bool fRead = pipeline.Pop(block, vfMine, filter);
+            pindex = vBlocks[i].first;
+
+            // A skipped block may still spend outputs of transactions found after the filter was checked
+            if (!fRead && filter.MatchAny(elementsFound)) {
+                if (!ReadBlockFromDisk(block, vBlocks[i].second) || block.GetHash() != pindex->GetBlockHash()) {
+                    LogPrintf("ScanForWalletTransactions() : cannot read block %s\n", pindex->GetBlockHash().ToString());
+                    block.SetNull();
+                }
+                vfMine.resize(block.vtx.size());
+                for (size_t j = 0; j < block.vtx.size(); j++)
+                    vfMine[j] = IsMine(block.vtx[j]);
+                fRead = true;
+            }
+
+            LOCK2(cs_main, cs_wallet);
+            if (!chainActive.Contains(pindex)) {
+                // reorganized away while reading, continue at the fork
+                pindexNext = chainActive.Next(chainActive.FindFork(pindex));
+                break;
+            }
+            pindexNext = chainActive.Next(pindex);
+
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+            int nFound = 0;
+            for (size_t j = 0; j < block.vtx.size(); j++) {
+                const CTransaction& tx = block.vtx[j];
+                bool fRelevant = vfMine[j] || mapWallet.count(tx.GetHash());
+                if (!tx.IsCoinBase())
+                    for (size_t k = 0; k < tx.vin.size() && !fRelevant; k++)
+                        fRelevant = mapWallet.count(tx.vin[k].prevout.hash) > 0;
+                if (fRelevant && AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
+                    nFound++;
+                    if (fUseFilters)
+                        for (unsigned int n = 0; n < tx.vout.size(); n++)
+                            elementsFound.insert(CBlockFilter::OutPointElement(COutPoint(tx.GetHash(), n)));
+                }
             }
+            ret += nFound;
 
             //If this is a zapwallettx, need to readd zsmnc
             if (fCheckZSMNC && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
@@ -1513,17 +1778,72 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
                 }
             }
 
-            pindex = chainActive.Next(pindex);
+            {
+                LOCK(cs_rescan);
+                rescanProgress.nHeight = pindex->nHeight;
+                rescanProgress.nStopHeight = std::max(rescanProgress.nStopHeight, chainActive.Height());
+                rescanProgress.nBlocks++;
+                if (!fRead)
+                    rescanProgress.nSkipped++;
+                rescanProgress.nFound += nFound;
+            }
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        pindex = pindexNext;
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+    LOCK(cs_rescan);
+    rescanProgress.fScanning = false;
+    LogPrintf("ScanForWalletTransactions() : scanned %d blocks (%d skipped by their filter) in %dms with %d threads, found %d transactions\n",
+        rescanProgress.nBlocks, rescanProgress.nSkipped, GetTimeMillis() - rescanProgress.nStartTime, nThreads, rescanProgress.nFound);
     return ret;
 }
 
+CRescanProgress CWallet::GetRescanProgress() const
+{
+    LOCK(cs_rescan);
+    return rescanProgress;
+}
+
+void CWallet::GetFilterElements(CBlockFilter::ElementSet& elements) const
+{
+    std::set<CKeyID> setKeyIds;
+    GetKeys(setKeyIds);
+    for (const CKeyID& keyid : setKeyIds) {
+        CScript script = GetScriptForDestination(keyid);
+        elements.insert(CBlockFilter::Element(script.begin(), script.end()));
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey)) {
+            script = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+            elements.insert(CBlockFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    {
+        LOCK(cs_KeyStore);
+        for (const std::pair<const CScriptID, CScript>& item : mapScripts) {
+            CScript script = GetScriptForDestination(item.first);
+            elements.insert(CBlockFilter::Element(script.begin(), script.end()));
+        }
+        for (const CScript& script : setWatchOnly)
+            elements.insert(CBlockFilter::Element(script.begin(), script.end()));
+        for (const CScript& script : setMultiSig)
+            elements.insert(CBlockFilter::Element(script.begin(), script.end()));
+    }
+
+    LOCK(cs_wallet);
+    for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+        const CWalletTx& wtx = item.second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++)
+            if (IsMine(wtx.vout[i]) != ISMINE_NO)
+                elements.insert(CBlockFilter::OutPointElement(COutPoint(wtx.GetHash(), i)));
+    }
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     LOCK2(cs_main, cs_wallet);
@@ -1625,22 +1945,164 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+void CWallet::InvalidateBalanceCache() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+    std::fill(fCachedBalance, fCachedBalance + BALANCE_COUNT, false);
+}
 
+CAmount CWallet::GetCachedBalance(WalletBalance balance) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Unconfirmed transactions count differently once they leave the mempool
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256(0);
+    unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (hashTip != hashCachedBalanceTip || nMempoolUpdated != nCachedBalanceMempool) {
+        InvalidateBalanceCache();
+        hashCachedBalanceTip = hashTip;
+        nCachedBalanceMempool = nMempoolUpdated;
+    }
+
+    if (!fCachedBalance[balance]) {
+        nCachedBalance[balance] = ComputeBalance(balance, false);
+        fCachedBalance[balance] = true;
+    }
+    return nCachedBalance[balance];
+}
+
+/** Sum of one balance over setUnspentTxs, or over all of mapWallet if fFullScan */
+CAmount CWallet::ComputeBalance(WalletBalance balance, bool fFullScan) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::vector<const CWalletTx*> vCoins;
+    if (fFullScan) {
+        vCoins.reserve(mapWallet.size());
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            vCoins.push_back(&it->second);
+    } else {
+        vCoins.reserve(setUnspentTxs.size());
+        for (const uint256& hash : setUnspentTxs)
+            vCoins.push_back(&mapWallet.at(hash));
+    }
+
+    CAmount nTotal = 0;
+    for (const CWalletTx* pcoin : vCoins) {
+        switch (balance) {
+        case BALANCE_TRUSTED:
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
+            break;
+        case BALANCE_UNCONFIRMED:
+            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
+                nTotal += pcoin->GetAvailableCredit();
+            break;
+        case BALANCE_IMMATURE:
+            nTotal += pcoin->GetImmatureCredit();
+            break;
+        case BALANCE_WATCH_ONLY:
+            if (pcoin->IsTrusted())
+                nTotal += pcoin->GetAvailableWatchOnlyCredit();
+            break;
+        case BALANCE_UNCONFIRMED_WATCH_ONLY:
+            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
+                nTotal += pcoin->GetAvailableWatchOnlyCredit();
+            break;
+        case BALANCE_IMMATURE_WATCH_ONLY:
+            nTotal += pcoin->GetImmatureWatchOnlyCredit();
+            break;
+        case BALANCE_LOCKED_WATCH_ONLY:
+            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
+                nTotal += pcoin->GetLockedWatchOnlyCredit();
+            break;
+        case BALANCE_LOCKED:
+            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
+                nTotal += pcoin->GetLockedCredit();
+            break;
+        case BALANCE_UNLOCKED:
+            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
+                nTotal += pcoin->GetUnlockedCredit();
+            break;
+        case BALANCE_ANONYMIZABLE:
+            if (pcoin->IsTrusted())
+                nTotal += pcoin->GetAnonymizableCredit();
+            break;
+        case BALANCE_ANONYMIZED:
+            if (pcoin->IsTrusted())
+                nTotal += pcoin->GetAnonymizedCredit();
+            break;
+        case BALANCE_DENOMINATED:
+            nTotal += pcoin->GetDenominatedCredit(false);
+            break;
+        case BALANCE_DENOMINATED_UNCONFIRMED:
+            nTotal += pcoin->GetDenominatedCredit(true);
+            break;
+        case BALANCE_COUNT:
+            break;
         }
     }
-
     return nTotal;
 }
 
+static const char* const pszBalanceNames[BALANCE_COUNT] = {
+    "trusted",
+    "unconfirmed",
+    "immature",
+    "watchonly",
+    "unconfirmed_watchonly",
+    "immature_watchonly",
+    "locked_watchonly",
+    "locked",
+    "unlocked",
+    "anonymizable",
+    "anonymized",
+    "denominated",
+    "denominated_unconfirmed",
+};
+
+bool CWallet::CheckUnspentIndex(std::vector<uint256>& vMissing, std::vector<uint256>& vExtra, std::vector<CBalanceCheck>& vBalances, bool fRepair)
+{
+    LOCK2(cs_main, cs_wallet);
+    vMissing.clear();
+    vExtra.clear();
+    vBalances.clear();
+
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        bool fIndexed = setUnspentTxs.count(it->first) > 0;
+        if (IsUnspentTx(it->first) != fIndexed)
+            (fIndexed ? vExtra : vMissing).push_back(it->first);
+    }
+    for (const uint256& hash : setUnspentTxs)
+        if (!mapWallet.count(hash))
+            vExtra.push_back(hash);
+
+    bool fConsistent = vMissing.empty() && vExtra.empty();
+    for (int i = 0; i < BALANCE_COUNT; i++) {
+        CBalanceCheck check;
+        check.strName = pszBalanceNames[i];
+        check.nIndexed = GetCachedBalance((WalletBalance)i);
+        check.nScanned = ComputeBalance((WalletBalance)i, true);
+        fConsistent &= check.nIndexed == check.nScanned;
+        vBalances.push_back(check);
+    }
+
+    if (!fConsistent) {
+        LogPrintf("CheckUnspentIndex() : index differs from wallet scan, %u missing, %u extra transactions%s\n",
+            vMissing.size(), vExtra.size(), fRepair ? ", rebuilding" : "");
+        if (fRepair)
+            RebuildUnspent();
+    }
+    return fConsistent;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_TRUSTED);
+}
+
 std::map<libzerocoin::CoinDenomination, int> mapMintMaturity;
 int nLastMaturityCheck = 0;
 CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const
@@ -1677,36 +2139,16 @@ CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_UNLOCKED);
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_LOCKED);
 }
 
 // Get a Map pairing the Denominations with the amount of Zerocoin for each Denomination
@@ -1729,36 +2171,16 @@ CAmount CWallet::GetAnonymizableBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizableCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_ANONYMIZABLE);
 }
 
 CAmount CWallet::GetAnonymizedBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_ANONYMIZED);
 }
 
 // Note: calculated including unconfirmed,
@@ -1772,10 +2194,10 @@ double CWallet::GetAverageAnonymizedRounds() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (std::set<uint256>::const_iterator it = setUnspentTxs.begin(); it != setUnspentTxs.end(); ++it) {
+            const CWalletTx* pcoin = &mapWallet.at(*it);
 
-            uint256 hash = (*it).first;
+            uint256 hash = *it;
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1804,10 +2226,10 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (std::set<uint256>::const_iterator it = setUnspentTxs.begin(); it != setUnspentTxs.end(); ++it) {
+            const CWalletTx* pcoin = &mapWallet.at(*it);
 
-            uint256 hash = (*it).first;
+            uint256 hash = *it;
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1828,100 +2250,44 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            nTotal += pcoin->GetDenominatedCredit(unconfirmed);
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(unconfirmed ? BALANCE_DENOMINATED_UNCONFIRMED : BALANCE_DENOMINATED);
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_UNCONFIRMED);
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_IMMATURE);
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_WATCH_ONLY);
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_UNCONFIRMED_WATCH_ONLY);
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_IMMATURE_WATCH_ONLY);
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalance(BALANCE_LOCKED_WATCH_ONLY);
 }
 
 /**
@@ -1933,9 +2299,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        for (std::set<uint256>::const_iterator it = setUnspentTxs.begin(); it != setUnspentTxs.end(); ++it) {
+            const uint256& wtxid = *it;
+            const CWalletTx* pcoin = &mapWallet.at(wtxid);
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1991,11 +2357,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_MASTERNODE_COLLATERAL)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_MASTERNODE_COLLATERAL)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -2947,14 +3313,18 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() - chainActive.Tip()->GetBlockTime() < 60)
         MilliSleep(10000);
 
-    CAmount nCredit = 0;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested())
-            return false;
+    // The kernel search gives up once the tip moves on from here
+    int nHeightSearch;
+    {
+        LOCK(cs_main);
+        nHeightSearch = chainActive.Height();
+    }
 
+    // Serialize and hash the constant part of every input's kernel once
+    unsigned int nTimeSearch = GetAdjustedTime();
+    std::vector<CStakeKernel> vKernels;
+    vKernels.reserve(listInputs.size());
+    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
         //make sure that enough time has elapsed between
         CBlockIndex* pindex = stakeInput->GetIndexFrom();
         if (!pindex || pindex->nHeight < 1) {
@@ -2962,13 +3332,33 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             continue;
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+        unsigned int nTimeBlockFrom = pindex->GetBlockTime();
+        if (nTimeBlockFrom + nStakeMinAge > nTimeSearch)
+            continue;
+
+        CStakeKernel kernel;
+        if (kernel.Init(stakeInput.get(), nTimeBlockFrom))
+            vKernels.push_back(kernel);
+    }
+
+    CAmount nCredit = 0;
+    CScript scriptPubKeyKernel;
+    bool fKernelFound = false;
+    size_t nNext = 0;
+    while (nNext < vKernels.size()) {
+        // Make sure the wallet is unlocked and shutdown hasn't been requested
+        if (IsLocked() || ShutdownRequested())
+            return false;
+
+        //hashes all remaining inputs, resuming after an input that could not be used
+        size_t nFound = 0;
         uint256 hashProofOfStake = 0;
-        nTxNewTime = GetAdjustedTime();
+        if (!SearchStakeKernels(vKernels, nNext, nBits, nTimeSearch, nHeightSearch, nFound, nTxNewTime, hashProofOfStake))
+            break;
+        nNext = nFound + 1;
+        CStakeInput* stakeInput = vKernels[nFound].stakeInput;
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
+        {
             LOCK(cs_main);
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
@@ -3024,7 +3414,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
             //Mark mints as spent
             if (stakeInput->IsZSMNC()) {
-                CZSMNCStake* z = (CZSMNCStake*)stakeInput.get();
+                CZSMNCStake* z = (CZSMNCStake*)stakeInput;
                 if (!z->MarkSpent(this, txNew.GetHash()))
                     return error("%s: failed to mark mint as used\n", __func__);
             }
@@ -3032,8 +3422,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             fKernelFound = true;
             break;
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
     }
     if (!fKernelFound)
         return false;
@@ -3329,6 +3717,12 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    {
+        // Transactions are read before the watch-only scripts, index them once everything is loaded
+        LOCK2(cs_main, cs_wallet);
+        RebuildUnspent();
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -3748,18 +4142,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    InvalidateBalanceCache();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    InvalidateBalanceCache();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    InvalidateBalanceCache();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4575,7 +4972,8 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
     libzerocoin::AccumulatorWitness witness(paramsAccumulator, accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, pindexCheckpoint)) {
+    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, pindexCheckpoint,
+                                    GetSerialHash(zerocoinSelected.GetSerialNumber()))) {
         receipt.SetStatus(_("Try to spend with a higher security level to include more coins"), ZSMNC_FAILED_ACCUMULATOR_INITIALIZATION);
         return error("%s : %s", __func__, receipt.GetStatusMessage());
     }
@@ -12,6 +12,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "blockfilter.h"
 #include "crypter.h"
 #include "kernel.h"
 #include "key.h"
@@ -60,6 +61,12 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -rescanthreads default, 0 = one per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of block reading threads during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks a rescan reads ahead of the one it adds transactions from
+static const int RESCAN_READ_AHEAD = 64;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -91,6 +98,45 @@ enum AvailableCoinsType {
     STAKABLE_COINS = 6                          // UTXO's that are valid for staking
 };
 
+//! Balances kept by CWallet::GetCachedBalance()
+enum WalletBalance {
+    BALANCE_TRUSTED,
+    BALANCE_UNCONFIRMED,
+    BALANCE_IMMATURE,
+    BALANCE_WATCH_ONLY,
+    BALANCE_UNCONFIRMED_WATCH_ONLY,
+    BALANCE_IMMATURE_WATCH_ONLY,
+    BALANCE_LOCKED_WATCH_ONLY,
+    BALANCE_LOCKED,
+    BALANCE_UNLOCKED,
+    BALANCE_ANONYMIZABLE,
+    BALANCE_ANONYMIZED,
+    BALANCE_DENOMINATED,
+    BALANCE_DENOMINATED_UNCONFIRMED,
+    BALANCE_COUNT
+};
+
+//! Progress of CWallet::ScanForWalletTransactions()
+struct CRescanProgress {
+    bool fScanning;
+    int nStartHeight;
+    int nStopHeight;   // tip when the scan started, it continues with blocks connected meanwhile
+    int nHeight;       // last block whose transactions were added
+    int64_t nStartTime; // milliseconds
+    int64_t nBlocks;   // blocks scanned
+    int64_t nSkipped;  // of those, not read because their filter did not match
+    int nFound;        // transactions added or updated
+
+    CRescanProgress() : fScanning(false), nStartHeight(0), nStopHeight(0), nHeight(0), nStartTime(0), nBlocks(0), nSkipped(0), nFound(0) {}
+};
+
+//! Result of CWallet::CheckUnspentIndex() for one balance
+struct CBalanceCheck {
+    std::string strName;
+    CAmount nIndexed;
+    CAmount nScanned;
+};
+
 // Possible states for zsmnc send
 enum ZerocoinSpendStatus {
     ZSMNC_SPEND_OKAY = 0,                            // No error
@@ -193,6 +239,28 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Wallet transactions with an output of ours that no transaction in the main chain spends.
+     * Balances and AvailableCoins() only look at these instead of all of mapWallet.
+     */
+    std::set<uint256> setUnspentTxs;
+    bool IsUnspentTx(const uint256& hash) const;
+    void UpdateUnspent(const uint256& hash);
+    void UpdateUnspentSpentBy(const CTransaction& tx);
+    void RebuildUnspent();
+
+    /**
+     * Balances computed from setUnspentTxs. Depth and maturity change with every block,
+     * so they are kept until the chain tip or the mempool moves, or a wallet transaction or locked coin changes.
+     */
+    mutable CAmount nCachedBalance[BALANCE_COUNT];
+    mutable bool fCachedBalance[BALANCE_COUNT];
+    mutable uint256 hashCachedBalanceTip;
+    mutable unsigned int nCachedBalanceMempool;
+    void InvalidateBalanceCache() const;
+    CAmount GetCachedBalance(WalletBalance balance) const;
+    CAmount ComputeBalance(WalletBalance balance, bool fFullScan) const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount);
@@ -239,6 +307,10 @@ public:
      */
     mutable CCriticalSection cs_wallet;
 
+    //! Protects rescanProgress only, so it can be read while a rescan holds cs_main and cs_wallet
+    mutable CCriticalSection cs_rescan;
+    CRescanProgress rescanProgress;
+
     CzsmncWallet* zwalletMain;
 
     bool fFileBacked;
@@ -302,6 +374,9 @@ public:
         nNextResend = 0;
         nLastResend = 0;
         nTimeFirstKey = 0;
+        hashCachedBalanceTip = 0;
+        nCachedBalanceMempool = 0;
+        InvalidateBalanceCache();
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
 
@@ -455,12 +530,16 @@ public:
      */
     int64_t IncOrderPosNext(CWalletDB* pwalletdb = NULL);
 
+    //! Takes cs_main then cs_wallet; callers that hold cs_wallet must hold cs_main first
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    CRescanProgress GetRescanProgress() const;
+    //! Add what block filters of transactions paying to or spending from us contain: our scripts and the outpoints of our outputs
+    void GetFilterElements(CBlockFilter::ElementSet& elements) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
@@ -481,6 +560,9 @@ public:
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
     CAmount GetLockedWatchOnlyBalance() const;
+    //! Compare setUnspentTxs and the cached balances with a scan of all of mapWallet, rebuild them if fRepair
+    bool CheckUnspentIndex(std::vector<uint256>& vMissing, std::vector<uint256>& vExtra, std::vector<CBalanceCheck>& vBalances, bool fRepair);
+    size_t GetUnspentTxCount() const;
     bool CreateTransaction(CScript scriptPubKey, int64_t nValue, CWalletTx& wtxNew, CReserveKey& reservekey, int64_t& nFeeRet, std::string& strFailReason, const CCoinControl* coinControl);
     bool CreateTransaction(const std::vector<std::pair<CScript, CAmount> >& vecSend,
         CWalletTx& wtxNew,
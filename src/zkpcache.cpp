@@ -0,0 +1,110 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zkpcache.h"
+
+#include "crypto/sha256.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <atomic>
+#include <set>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Valid zerocoin spend cache, to avoid running the accumulator, serial number and
+ * commitment proofs twice for every spend (once when accepted into memory pool,
+ * and again when accepted into the block chain)
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! salted so that the eviction order can not be predicted by peers relaying spends
+    unsigned char salt[32];
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_zkpcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    uint256 GetKey(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params) const
+    {
+        unsigned char nParamsVersion = fV1Params ? 1 : 2;
+        uint256 key;
+        CSHA256().Write(salt, sizeof(salt)).Write(hashSpend.begin(), 32).Write((const unsigned char*)&nChecksum, sizeof(nChecksum)).Write(&nParamsVersion, 1).Finalize(key.begin());
+        return key;
+    }
+
+public:
+    CZerocoinSpendCache() : nHits(0), nMisses(0)
+    {
+        GetRandBytes(salt, sizeof(salt));
+    }
+
+    bool Get(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params)
+    {
+        uint256 key = GetKey(hashSpend, nChecksum, fV1Params);
+        boost::shared_lock<boost::shared_mutex> lock(cs_zkpcache);
+
+        if (setValid.count(key)) {
+            ++nHits;
+            return true;
+        }
+        ++nMisses;
+        return false;
+    }
+
+    void Set(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params)
+    {
+        int64_t nMaxCacheSize = GetArg("-zkpcachesize", DEFAULT_ZKP_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        uint256 key = GetKey(hashSpend, nChecksum, fV1Params);
+        boost::unique_lock<boost::shared_mutex> lock(cs_zkpcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize) {
+            // Evict a random entry, same reasoning as the signature cache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(key);
+    }
+
+    void GetStats(uint64_t& nEntriesOut, uint64_t& nHitsOut, uint64_t& nMissesOut)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_zkpcache);
+        nEntriesOut = setValid.size();
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+CZerocoinSpendCache& GetZerocoinSpendCache()
+{
+    static CZerocoinSpendCache zkpCache;
+    return zkpCache;
+}
+
+}
+
+bool IsZerocoinSpendVerified(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params)
+{
+    return GetZerocoinSpendCache().Get(hashSpend, nChecksum, fV1Params);
+}
+
+void SetZerocoinSpendVerified(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params)
+{
+    GetZerocoinSpendCache().Set(hashSpend, nChecksum, fV1Params);
+}
+
+void GetZerocoinSpendCacheStats(uint64_t& nEntries, uint64_t& nHits, uint64_t& nMisses)
+{
+    GetZerocoinSpendCache().GetStats(nEntries, nHits, nMisses);
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2020-2021 The SupportMasterNodeCommunity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SupportMasterNodeCommunity_ZKPCACHE_H
+#define SupportMasterNodeCommunity_ZKPCACHE_H
+
+#include <stdint.h>
+
+class uint256;
+
+//! Default for -zkpcachesize, the number of verified zerocoin spends remembered
+static const int64_t DEFAULT_ZKP_CACHE_SIZE = 10000;
+
+/**
+ * Cache of zerocoin spends whose proofs verified, so that a spend accepted to the
+ * memory pool is not proven a second time when the block containing it connects.
+ * Entries are keyed on (spend hash, accumulator checksum, zerocoin params version).
+ */
+bool IsZerocoinSpendVerified(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params);
+void SetZerocoinSpendVerified(const uint256& hashSpend, uint32_t nChecksum, bool fV1Params);
+void GetZerocoinSpendCacheStats(uint64_t& nEntries, uint64_t& nHits, uint64_t& nMisses);
+
+#endif //SupportMasterNodeCommunity_ZKPCACHE_H
@@ -81,6 +81,72 @@ bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>&
     return true;
 }
 
+//record every mint of a block for the pubcoin index, flagging the ones BlockToPubcoinList would filter as invalid
+bool BlockToBlockPubcoins(const CBlock& block, CBlockPubcoins& pubcoins)
+{
+    pubcoins.hashBlock = block.GetHash();
+    for (const CTransaction& tx : block.vtx) {
+        if(!tx.IsZerocoinMint())
+            continue;
+
+        bool fInvalidTx = false;
+        for (const CTxIn& in : tx.vin) {
+            if (!ValidOutPoint(in.prevout, INT_MAX)) {
+                fInvalidTx = true;
+                break;
+            }
+        }
+
+        uint256 txHash = tx.GetHash();
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            //edge case: invalid spend with minted change, this output and all the following ones are filtered
+            if (!fInvalidTx && !ValidOutPoint(COutPoint(txHash, i), INT_MAX))
+                fInvalidTx = true;
+
+            const CTxOut txOut = tx.vout[i];
+            if(!txOut.scriptPubKey.IsZerocoinMint())
+                continue;
+
+            CValidationState state;
+            libzerocoin::PublicCoin pubCoin(Params().Zerocoin_Params(false));
+            if(!TxOutToPublicCoin(txOut, pubCoin, state))
+                return false;
+
+            pubcoins.vPubcoins.emplace_back(pubCoin.getDenomination(), pubCoin.getValue(), fInvalidTx);
+        }
+    }
+
+    return true;
+}
+
+//same result as BlockToPubcoinList, read from the pubcoin index when it holds this block
+bool GetBlockPubcoinList(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid)
+{
+    CBlockPubcoins pubcoins;
+    if (!zerocoinDB->ReadBlockPubcoins(pindex->nHeight, pubcoins) || pubcoins.hashBlock != pindex->GetBlockHash()) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return error("%s: failed to read block from disk", __func__);
+
+        pubcoins.SetNull();
+        if (!BlockToBlockPubcoins(block, pubcoins))
+            return BlockToPubcoinList(block, listPubcoins, fFilterInvalid);
+
+        // fill in the index as we go, only for the active chain since entries are keyed by height
+        if (chainActive.Contains(pindex) && !zerocoinDB->WriteBlockPubcoins(pindex->nHeight, pubcoins))
+            LogPrintf("%s : failed to index pubcoins of block %d\n", __func__, pindex->nHeight);
+    }
+
+    for (const CPubcoinIndexEntry& entry : pubcoins.vPubcoins) {
+        if (fFilterInvalid && entry.fInvalidOutpoint)
+            continue;
+
+        listPubcoins.emplace_back(libzerocoin::PublicCoin(Params().Zerocoin_Params(false), entry.value, entry.denomination));
+    }
+
+    return true;
+}
+
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid)
 {
@@ -332,6 +398,50 @@ std::string ReindexZerocoinDB()
     return "";
 }
 
+std::string BackfillPubcoinIndex()
+{
+    uiInterface.ShowProgress(_("Indexing zerocoin pubcoins..."), 0);
+
+    int nStart = Params().Zerocoin_StartHeight();
+    int nIndexed = 0;
+    CBlockIndex* pindex = chainActive[nStart];
+    std::vector<std::pair<int, CBlockPubcoins> > vPubcoins;
+    while (pindex) {
+        uiInterface.ShowProgress(_("Indexing zerocoin pubcoins..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - nStart) / (double)(chainActive.Height() - nStart) * 100))));
+
+        CBlockPubcoins pubcoins;
+        if (!zerocoinDB->ReadBlockPubcoins(pindex->nHeight, pubcoins) || pubcoins.hashBlock != pindex->GetBlockHash()) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex))
+                return _("Indexing zerocoin pubcoins failed");
+
+            pubcoins.SetNull();
+            if (!BlockToBlockPubcoins(block, pubcoins))
+                return _("Indexing zerocoin pubcoins failed");
+
+            vPubcoins.emplace_back(pindex->nHeight, pubcoins);
+            ++nIndexed;
+        }
+
+        // Flush the index to disk every 1000 blocks
+        if (vPubcoins.size() >= 1000) {
+            if (!zerocoinDB->WriteBlockPubcoinsBatch(vPubcoins))
+                return _("Error writing zerocoinDB to disk");
+            vPubcoins.clear();
+        }
+
+        pindex = chainActive.Next(pindex);
+    }
+
+    if (!vPubcoins.empty() && !zerocoinDB->WriteBlockPubcoinsBatch(vPubcoins))
+        return _("Error writing zerocoinDB to disk");
+
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("%s : indexed pubcoins of %d blocks\n", __func__, nIndexed);
+
+    return "";
+}
+
 bool RemoveSerialFromDB(const CBigNum& bnSerial)
 {
     return zerocoinDB->EraseCoinSpend(bnSerial);
@@ -14,6 +14,8 @@
 #include <string>
 
 class CBlock;
+class CBlockIndex;
+class CBlockPubcoins;
 class CBigNum;
 struct CMintMeta;
 class CTransaction;
@@ -25,6 +27,9 @@ class uint256;
 
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
 bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
+bool BlockToBlockPubcoins(const CBlock& block, CBlockPubcoins& pubcoins);
+bool GetBlockPubcoinList(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
+std::string BackfillPubcoinIndex();
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid);
 void FindMints(std::vector<CMintMeta> vMintsToFind, std::vector<CMintMeta>& vMintsToUpdate, std::vector<CMintMeta>& vMissingMints);
 int GetZerocoinStartHeight();